@@ -0,0 +1,47 @@
+/// @file drvAsynVISABackend.h I/O backends of drvAsynVISAPort, which do the session operations for a resource
+
+#ifndef DRVASYNVISABACKEND_H
+#define DRVASYNVISABACKEND_H
+
+#include <visa.h>
+
+/// the VISA session operations drvAsynVISAPort uses for I/O. Each takes the arguments and returns the status
+/// codes of the VISA function of the same name, so the driver is the same whichever backend a port uses.
+/// GPIB bus operations are only available with the VISA library itself.
+typedef struct visaBackend {
+    const char *name;                                            ///< shown by asynReport
+    bool     (*match)(const char *resourceName);                 ///< should this backend handle the resource
+    ViStatus (*open)(ViSession rm, char *resourceName, ViSession *vi);
+    ViStatus (*close)(ViSession vi);
+    ViStatus (*read)(ViSession vi, ViBuf buf, ViUInt32 count, ViUInt32 *retCount);
+    ViStatus (*write)(ViSession vi, ViBuf buf, ViUInt32 count, ViUInt32 *retCount);
+    ViStatus (*setAttribute)(ViSession vi, ViAttr attr, ViAttrState value);
+    ViStatus (*getAttribute)(ViSession vi, ViAttr attr, void *value);
+    ViStatus (*clear)(ViSession vi);
+    ViStatus (*flush)(ViSession vi, ViUInt16 mask);
+    ViStatus (*setBuf)(ViSession vi, ViUInt16 mask, ViUInt32 size);
+    ViStatus (*readSTB)(ViSession vi, ViUInt16 *stb);
+    ViStatus (*statusDesc)(ViSession vi, ViStatus status, ViChar *desc); ///< desc is at least 256 characters
+    // the rest are NULL in a backend without events or asynchronous I/O, so no read ahead, service requests,
+    // overlapped I/O or watchdog abort. An event context is read with getAttribute and released with close.
+    ViStatus (*enableEvent)(ViSession vi, ViEventType eventType, ViUInt16 mechanism);
+    ViStatus (*disableEvent)(ViSession vi, ViEventType eventType, ViUInt16 mechanism);
+    ViStatus (*discardEvents)(ViSession vi, ViEventType eventType, ViUInt16 mechanism);
+    ViStatus (*waitOnEvent)(ViSession vi, ViEventType eventType, ViUInt32 timeout, ViEventType *outEventType, ViEvent *outContext);
+    ViStatus (*readAsync)(ViSession vi, ViBuf buf, ViUInt32 count, ViJobId *jobId);
+    ViStatus (*writeAsync)(ViSession vi, ViBuf buf, ViUInt32 count, ViJobId *jobId);
+    ViStatus (*terminate)(ViSession vi, ViUInt16 degree, ViJobId jobId);
+} visaBackend_t;
+
+/// native serial port backend for resource names that are a tty device path e.g. /dev/ttyUSB0,
+/// NULL where termios is not available
+extern const visaBackend_t *visaTermiosBackend;
+
+/// simulated instruments defined with drvAsynVISAMockInstrument(), for resource names MOCK::name or the name of a defined instrument
+extern const visaBackend_t *visaMockBackend;
+
+/// list the simulated instruments whose names match a VISA resource expression, for viFindRsrc() of the mock VISA library
+extern ViStatus visaMockFindRsrc(const char *expr, ViFindList *findList, ViUInt32 *retCount, ViChar *desc);
+extern ViStatus visaMockFindNext(ViFindList findList, ViChar *desc);
+
+#endif /* DRVASYNVISABACKEND_H */
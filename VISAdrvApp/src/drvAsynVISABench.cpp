@@ -0,0 +1,868 @@
+/// @file drvAsynVISABench.cpp iocsh command to measure transaction rate and latency through an asyn octet port
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errlog.h>
+#include <iocsh.h>
+#include <epicsStdio.h>
+#include <epicsString.h>
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <envDefs.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "asynDriver.h"
+#include "asynOctetSyncIO.h"
+#include "asynOptionSyncIO.h"
+#include "asynInt8ArraySyncIO.h"
+
+#include <epicsExport.h>
+
+#include "drvAsynVISAPort.h"
+
+/// return the p-th percentile (0 <= p <= 1) of an already sorted list of values
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.size() == 0)
+    {
+        return 0.0;
+    }
+    size_t i = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+/// Run repeated transactions on an asyn port and print rate and latency statistics.
+/// Everything goes through asynOctetSyncIO so the full asynOctet stack (EOS interpose layer,
+/// port locking, driver read settings) is included in the measurement.
+/// @param[in] portName @copydoc drvAsynVISABenchmarkArg0
+/// @param[in] command @copydoc drvAsynVISABenchmarkArg1
+/// @param[in] count @copydoc drvAsynVISABenchmarkArg2
+/// @param[in] timeout @copydoc drvAsynVISABenchmarkArg3
+/// @param[in] maxchars @copydoc drvAsynVISABenchmarkArg4
+/// @param[in] flushRead @copydoc drvAsynVISABenchmarkArg5
+static void drvAsynVISABenchmark(const char *portName, const char *command, int count,
+                                 double timeout, int maxchars, int flushRead)
+{
+    asynUser *pasynUser = NULL;
+    asynStatus status;
+    if (portName == NULL || *portName == '\0')
+    {
+        printf("drvAsynVISABenchmark: port name missing\n");
+        return;
+    }
+    if (count <= 0)
+    {
+        count = 100;
+    }
+    if (timeout <= 0.0)
+    {
+        timeout = 1.0;
+    }
+    if (maxchars <= 0)
+    {
+        maxchars = 256;
+    }
+    std::vector<char> cmd;
+    size_t cmdLen = 0;
+    if (command != NULL && *command != '\0')
+    {
+        cmd.resize(strlen(command) + 1);
+        cmdLen = epicsStrnRawFromEscaped(&(cmd[0]), cmd.size(), command, strlen(command));
+    }
+    std::vector<char> buffer(maxchars + 1);
+    std::vector<double> latency;
+    latency.reserve(count);
+    status = pasynOctetSyncIO->connect(portName, 0, &pasynUser, NULL);
+    if (status != asynSuccess)
+    {
+        printf("drvAsynVISABenchmark: unable to connect to port \"%s\"\n", portName);
+        return;
+    }
+    unsigned long nTimeouts = 0, nErrors = 0, nFlushed = 0;
+    double nBytesWritten = 0.0, nBytesRead = 0.0;
+    size_t nOut, nIn;
+    int eomReason;
+    epicsTimeStamp start, end, tStart, tEnd;
+    epicsTimeGetCurrent(&start);
+    for(int i = 0; i < count; ++i)
+    {
+        if (flushRead)
+        {
+            // what stream device does before each write to discard unread input
+            while (pasynOctetSyncIO->read(pasynUser, &(buffer[0]), maxchars, 0.0, &nIn, &eomReason) == asynSuccess && nIn > 0)
+            {
+                nFlushed += nIn;
+            }
+        }
+        nOut = nIn = 0;
+        epicsTimeGetCurrent(&tStart);
+        if (cmdLen > 0)
+        {
+            status = pasynOctetSyncIO->writeRead(pasynUser, &(cmd[0]), cmdLen, &(buffer[0]), maxchars,
+                                                 timeout, &nOut, &nIn, &eomReason);
+        }
+        else
+        {
+            status = pasynOctetSyncIO->read(pasynUser, &(buffer[0]), maxchars, timeout, &nIn, &eomReason);
+        }
+        epicsTimeGetCurrent(&tEnd);
+        nBytesWritten += nOut;
+        nBytesRead += nIn;
+        if (status == asynTimeout)
+        {
+            ++nTimeouts;
+        }
+        else if (status != asynSuccess)
+        {
+            ++nErrors;
+            printf("drvAsynVISABenchmark: %s\n", pasynUser->errorMessage);
+        }
+        else
+        {
+            latency.push_back(epicsTimeDiffInSeconds(&tEnd, &tStart));
+        }
+    }
+    epicsTimeGetCurrent(&end);
+    pasynOctetSyncIO->disconnect(pasynUser);
+    double elapsed = epicsTimeDiffInSeconds(&end, &start);
+    if (elapsed <= 0.0)
+    {
+        elapsed = 1e-9;
+    }
+    std::sort(latency.begin(), latency.end());
+    printf("Port %s: %d transactions in %f s (%lu timeouts, %lu errors)\n", portName, count, elapsed, nTimeouts, nErrors);
+    printf("           calls/s: %.1f\n", count / elapsed);
+    printf("   bytes written/s: %.1f\n", nBytesWritten / elapsed);
+    printf("      bytes read/s: %.1f\n", nBytesRead / elapsed);
+    if (flushRead)
+    {
+        printf("     bytes flushed: %lu\n", nFlushed);
+    }
+    if (latency.size() > 0)
+    {
+        printf("   latency min (ms): %.3f\n", 1000.0 * latency.front());
+        printf("   latency p50 (ms): %.3f\n", 1000.0 * percentile(latency, 0.50));
+        printf("   latency p99 (ms): %.3f\n", 1000.0 * percentile(latency, 0.99));
+        printf("   latency max (ms): %.3f\n", 1000.0 * latency.back());
+    }
+}
+
+/// Compare reading an instrument trace as text through asynOctet (and converting it to numbers, as
+/// stream device would) with reading it as an IEEE 488.2 binary block through the driver array interface.
+/// @param[in] portName @copydoc drvAsynVISABlockBenchmarkArg0
+/// @param[in] textQuery @copydoc drvAsynVISABlockBenchmarkArg1
+/// @param[in] blockQuery @copydoc drvAsynVISABlockBenchmarkArg2
+/// @param[in] count @copydoc drvAsynVISABlockBenchmarkArg3
+/// @param[in] timeout @copydoc drvAsynVISABlockBenchmarkArg4
+/// @param[in] maxbytes @copydoc drvAsynVISABlockBenchmarkArg5
+static void drvAsynVISABlockBenchmark(const char *portName, const char *textQuery, const char *blockQuery,
+                                      int count, double timeout, int maxbytes)
+{
+    asynUser *pasynUser = NULL;
+    asynStatus status;
+    if (portName == NULL || *portName == '\0')
+    {
+        printf("drvAsynVISABlockBenchmark: port name missing\n");
+        return;
+    }
+    if (count <= 0)
+    {
+        count = 10;
+    }
+    if (timeout <= 0.0)
+    {
+        timeout = 5.0;
+    }
+    if (maxbytes <= 0)
+    {
+        maxbytes = 1000000;
+    }
+    std::vector<char> buffer(maxbytes + 1);
+    epicsTimeStamp start, end;
+    if (textQuery != NULL && *textQuery != '\0')
+    {
+        if (pasynOctetSyncIO->connect(portName, 0, &pasynUser, NULL) != asynSuccess)
+        {
+            printf("drvAsynVISABlockBenchmark: unable to connect to port \"%s\"\n", portName);
+            return;
+        }
+        double nBytes = 0.0, nPoints = 0.0;
+        unsigned long nErrors = 0;
+        epicsTimeGetCurrent(&start);
+        for(int i = 0; i < count; ++i)
+        {
+            size_t nOut = 0, nIn = 0, total = 0;
+            int eomReason = 0;
+            status = pasynOctetSyncIO->writeRead(pasynUser, textQuery, strlen(textQuery), &(buffer[0]), maxbytes,
+                                                 timeout, &nOut, &nIn, &eomReason);
+            // a long reply may be returned in several parts
+            for(total = nIn; status == asynSuccess && total < (size_t)maxbytes && !(eomReason & (ASYN_EOM_EOS | ASYN_EOM_END)); total += nIn)
+            {
+                status = pasynOctetSyncIO->read(pasynUser, &(buffer[total]), maxbytes - total, timeout, &nIn, &eomReason);
+            }
+            if (status != asynSuccess && total == 0)
+            {
+                ++nErrors;
+                continue;
+            }
+            buffer[total] = '\0';
+            nBytes += total;
+            for(char *p = &(buffer[0]), *q; *p != '\0'; p = (*q == '\0' ? q : q + 1))
+            {
+                strtod(p, &q);
+                if (q == p)
+                {
+                    break;
+                }
+                ++nPoints;
+            }
+        }
+        epicsTimeGetCurrent(&end);
+        pasynOctetSyncIO->disconnect(pasynUser);
+        double elapsed = epicsTimeDiffInSeconds(&end, &start);
+        printf("Port %s text \"%s\": %d reads in %f s (%lu errors), %.3f MB/s, %.0f points/s\n", portName, textQuery,
+               count, elapsed, nErrors, (elapsed > 0.0 ? nBytes / elapsed / 1.0e6 : 0.0), (elapsed > 0.0 ? nPoints / elapsed : 0.0));
+    }
+    if (blockQuery != NULL && *blockQuery != '\0')
+    {
+        std::string drvInfo = std::string("BLOCK ") + blockQuery;
+        if (pasynInt8ArraySyncIO->connect(portName, 0, &pasynUser, drvInfo.c_str()) != asynSuccess)
+        {
+            printf("drvAsynVISABlockBenchmark: unable to connect to port \"%s\"\n", portName);
+            return;
+        }
+        double nBytes = 0.0;
+        unsigned long nErrors = 0;
+        epicsTimeGetCurrent(&start);
+        for(int i = 0; i < count; ++i)
+        {
+            size_t nIn = 0;
+            status = pasynInt8ArraySyncIO->read(pasynUser, reinterpret_cast<epicsInt8*>(&(buffer[0])), maxbytes, &nIn, timeout);
+            if (status != asynSuccess)
+            {
+                ++nErrors;
+                printf("drvAsynVISABlockBenchmark: %s\n", pasynUser->errorMessage);
+                continue;
+            }
+            nBytes += nIn;
+        }
+        epicsTimeGetCurrent(&end);
+        pasynInt8ArraySyncIO->disconnect(pasynUser);
+        double elapsed = epicsTimeDiffInSeconds(&end, &start);
+        printf("Port %s block \"%s\": %d reads in %f s (%lu errors), %.3f MB/s\n", portName, blockQuery,
+               count, elapsed, nErrors, (elapsed > 0.0 ? nBytes / elapsed / 1.0e6 : 0.0));
+    }
+}
+
+/// print latency statistics of a set of transactions, returns the median
+static double printLatency(const char *name, std::vector<double>& latency, unsigned long nErrors)
+{
+    std::sort(latency.begin(), latency.end());
+    if (latency.size() == 0)
+    {
+        printf("%14s: no successful transactions (%lu errors)\n", name, nErrors);
+        return 0.0;
+    }
+    double p50 = percentile(latency, 0.50);
+    printf("%14s: latency (ms) min %.3f p50 %.3f p99 %.3f max %.3f (%lu errors)\n", name,
+           1000.0 * latency.front(), 1000.0 * p50, 1000.0 * percentile(latency, 0.99),
+           1000.0 * latency.back(), nErrors);
+    return p50;
+}
+
+/// Compare the round trip time of a query made with separate asynOctet write and read calls
+/// (asynOctetSyncIO writeRead) with the driver's combined query path (drvAsynVISAQuery()).
+/// The two are interleaved so drift in the instrument affects both equally.
+/// @param[in] portName @copydoc drvAsynVISAQueryBenchmarkArg0
+/// @param[in] query @copydoc drvAsynVISAQueryBenchmarkArg1
+/// @param[in] count @copydoc drvAsynVISAQueryBenchmarkArg2
+/// @param[in] timeout @copydoc drvAsynVISAQueryBenchmarkArg3
+/// @param[in] maxchars @copydoc drvAsynVISAQueryBenchmarkArg4
+static void drvAsynVISAQueryBenchmark(const char *portName, const char *query, int count,
+                                      double timeout, int maxchars)
+{
+    asynUser *pasynUser = NULL;
+    if (portName == NULL || *portName == '\0' || query == NULL || *query == '\0')
+    {
+        printf("drvAsynVISAQueryBenchmark: port name or query missing\n");
+        return;
+    }
+    if (count <= 0)
+    {
+        count = 100;
+    }
+    if (timeout <= 0.0)
+    {
+        timeout = 1.0;
+    }
+    if (maxchars <= 0)
+    {
+        maxchars = 256;
+    }
+    std::vector<char> cmd(strlen(query) + 1);
+    size_t cmdLen = epicsStrnRawFromEscaped(&(cmd[0]), cmd.size(), query, strlen(query));
+    std::vector<char> buffer(maxchars + 1);
+    std::vector<double> twoCall, combined;
+    twoCall.reserve(count);
+    combined.reserve(count);
+    if (pasynOctetSyncIO->connect(portName, 0, &pasynUser, NULL) != asynSuccess)
+    {
+        printf("drvAsynVISAQueryBenchmark: unable to connect to port \"%s\"\n", portName);
+        return;
+    }
+    unsigned long nTwoCallErrors = 0, nCombinedErrors = 0;
+    epicsTimeStamp tStart, tEnd;
+    for(int i = 0; i < count; ++i)
+    {
+        size_t nOut = 0, nIn = 0;
+        int eomReason = 0;
+        epicsTimeGetCurrent(&tStart);
+        asynStatus status = pasynOctetSyncIO->writeRead(pasynUser, &(cmd[0]), cmdLen, &(buffer[0]), maxchars,
+                                                        timeout, &nOut, &nIn, &eomReason);
+        epicsTimeGetCurrent(&tEnd);
+        if (status == asynSuccess)
+        {
+            twoCall.push_back(epicsTimeDiffInSeconds(&tEnd, &tStart));
+        }
+        else
+        {
+            ++nTwoCallErrors;
+        }
+        epicsTimeGetCurrent(&tStart);
+        status = drvAsynVISAQuery(pasynUser, &(cmd[0]), cmdLen, &(buffer[0]), maxchars, timeout, &nIn, &eomReason);
+        epicsTimeGetCurrent(&tEnd);
+        if (status == asynSuccess)
+        {
+            combined.push_back(epicsTimeDiffInSeconds(&tEnd, &tStart));
+        }
+        else
+        {
+            ++nCombinedErrors;
+            if (nCombinedErrors == 1)
+            {
+                printf("drvAsynVISAQueryBenchmark: %s\n", pasynUser->errorMessage);
+            }
+        }
+    }
+    pasynOctetSyncIO->disconnect(pasynUser);
+    printf("Port %s: %d queries of each kind\n", portName, count);
+    double p50TwoCall = printLatency("write + read", twoCall, nTwoCallErrors);
+    double p50Combined = printLatency("combined query", combined, nCombinedErrors);
+    if (twoCall.size() > 0 && combined.size() > 0)
+    {
+        printf("%14s: %.3f ms per query (p50)\n", "saved", 1000.0 * (p50TwoCall - p50Combined));
+    }
+}
+
+/// Compare small message round trips with an asynOption set to each of two values, e.g. "tcpnodelay" Y and N on a
+/// TCPIP SOCKET port, or the transfer rate of large replies with e.g. "usbend" on a USB port. The values alternate
+/// every 10 transactions so drift in the device or network affects both equally, and the option is put back as
+/// it was at the end.
+/// @param[in] portName @copydoc drvAsynVISAOptionBenchmarkArg0
+/// @param[in] command @copydoc drvAsynVISAOptionBenchmarkArg1
+/// @param[in] count @copydoc drvAsynVISAOptionBenchmarkArg2
+/// @param[in] timeout @copydoc drvAsynVISAOptionBenchmarkArg3
+/// @param[in] key @copydoc drvAsynVISAOptionBenchmarkArg4
+/// @param[in] valueA @copydoc drvAsynVISAOptionBenchmarkArg5
+/// @param[in] valueB @copydoc drvAsynVISAOptionBenchmarkArg6
+/// @param[in] maxchars @copydoc drvAsynVISAOptionBenchmarkArg7
+static void drvAsynVISAOptionBenchmark(const char *portName, const char *command, int count, double timeout,
+                                       const char *key, const char *valueA, const char *valueB, int maxchars)
+{
+    asynUser *pasynUser = NULL, *pasynUserOption = NULL;
+    if (portName == NULL || *portName == '\0' || command == NULL || *command == '\0' ||
+        key == NULL || *key == '\0' || valueA == NULL || valueB == NULL)
+    {
+        printf("drvAsynVISAOptionBenchmark: port name, command, option or values missing\n");
+        return;
+    }
+    if (count <= 0)
+    {
+        count = 100;
+    }
+    if (timeout <= 0.0)
+    {
+        timeout = 1.0;
+    }
+    if (maxchars <= 0)
+    {
+        maxchars = 256;
+    }
+    std::vector<char> cmd(strlen(command) + 1);
+    size_t cmdLen = epicsStrnRawFromEscaped(&(cmd[0]), cmd.size(), command, strlen(command));
+    std::vector<char> buffer(maxchars + 1);
+    char original[64];
+    std::vector<double> latency[2];
+    unsigned long nErrors[2] = { 0, 0 };
+    double nBytesRead[2] = { 0.0, 0.0 }, busy[2] = { 0.0, 0.0 };
+    const char *values[2] = { valueA, valueB };
+    if (pasynOctetSyncIO->connect(portName, 0, &pasynUser, NULL) != asynSuccess ||
+        pasynOptionSyncIO->connect(portName, 0, &pasynUserOption, NULL) != asynSuccess)
+    {
+        printf("drvAsynVISAOptionBenchmark: unable to connect to port \"%s\"\n", portName);
+        if (pasynUser != NULL)
+        {
+            pasynOctetSyncIO->disconnect(pasynUser);
+        }
+        return;
+    }
+    if (pasynOptionSyncIO->getOption(pasynUserOption, key, original, sizeof(original), timeout) != asynSuccess)
+    {
+        printf("drvAsynVISAOptionBenchmark: cannot get option \"%s\": %s\n", key, pasynUserOption->errorMessage);
+        pasynOctetSyncIO->disconnect(pasynUser);
+        pasynOptionSyncIO->disconnect(pasynUserOption);
+        return;
+    }
+    epicsTimeStamp tStart, tEnd;
+    for(int i = 0; i < 2 * count; ++i)
+    {
+        int which = (i / 10) % 2;
+        if (i % 10 == 0 &&
+            pasynOptionSyncIO->setOption(pasynUserOption, key, values[which], timeout) != asynSuccess)
+        {
+            printf("drvAsynVISAOptionBenchmark: cannot set %s=%s: %s\n", key, values[which], pasynUserOption->errorMessage);
+            break;
+        }
+        size_t nOut = 0, nIn = 0;
+        int eomReason = 0;
+        epicsTimeGetCurrent(&tStart);
+        asynStatus status = pasynOctetSyncIO->writeRead(pasynUser, &(cmd[0]), cmdLen, &(buffer[0]), maxchars,
+                                                        timeout, &nOut, &nIn, &eomReason);
+        epicsTimeGetCurrent(&tEnd);
+        double t = epicsTimeDiffInSeconds(&tEnd, &tStart);
+        busy[which] += t;
+        nBytesRead[which] += nIn;
+        if (status == asynSuccess)
+        {
+            latency[which].push_back(t);
+        }
+        else
+        {
+            ++nErrors[which];
+        }
+    }
+    pasynOptionSyncIO->setOption(pasynUserOption, key, original, timeout);
+    pasynOctetSyncIO->disconnect(pasynUser);
+    pasynOptionSyncIO->disconnect(pasynUserOption);
+    printf("Port %s: %d transactions with each value of %s (was %s)\n", portName, count, key, original);
+    for(int which = 0; which < 2; ++which)
+    {
+        std::string name = std::string(key) + "=" + values[which];
+        printLatency(name.c_str(), latency[which], nErrors[which]);
+        printf("%14s  bytes read/s %.1f\n", "", (busy[which] > 0.0 ? nBytesRead[which] / busy[which] : 0.0));
+    }
+}
+
+/// Compare ways of discarding stale input before a command: the zero timeout reads stream device makes with
+/// "readinttmo" >= 0 (a real VISA read), the same with "readinttmo" -1 (the driver's discard) and an asynOctet
+/// flush. With a command, each flush follows the command with only one byte of its reply read, and is checked
+/// by sending the command again and comparing the reply with the first one. The methods alternate every 10
+/// flushes and "readinttmo" is put back as it was at the end.
+/// @param[in] portName @copydoc drvAsynVISAFlushBenchmarkArg0
+/// @param[in] command @copydoc drvAsynVISAFlushBenchmarkArg1
+/// @param[in] count @copydoc drvAsynVISAFlushBenchmarkArg2
+/// @param[in] timeout @copydoc drvAsynVISAFlushBenchmarkArg3
+/// @param[in] readIntTmoMs @copydoc drvAsynVISAFlushBenchmarkArg4
+/// @param[in] maxchars @copydoc drvAsynVISAFlushBenchmarkArg5
+static void drvAsynVISAFlushBenchmark(const char *portName, const char *command, int count, double timeout,
+                                      int readIntTmoMs, int maxchars)
+{
+    asynUser *pasynUser = NULL, *pasynUserOption = NULL;
+    if (portName == NULL || *portName == '\0')
+    {
+        printf("drvAsynVISAFlushBenchmark: port name missing\n");
+        return;
+    }
+    if (command == NULL)
+    {
+        command = "";
+    }
+    if (count <= 0)
+    {
+        count = 100;
+    }
+    if (timeout <= 0.0)
+    {
+        timeout = 1.0;
+    }
+    if (readIntTmoMs < 0)
+    {
+        readIntTmoMs = 0;
+    }
+    if (maxchars <= 0)
+    {
+        maxchars = 256;
+    }
+    std::vector<char> cmd(strlen(command) + 1);
+    size_t cmdLen = epicsStrnRawFromEscaped(&(cmd[0]), cmd.size(), command, strlen(command));
+    std::vector<char> buffer(maxchars + 1);
+    std::string reference;
+    char original[64], readIntTmo[16];
+    epicsSnprintf(readIntTmo, sizeof(readIntTmo), "%d", readIntTmoMs);
+    const char *names[3] = { "zero tmo read", "discard", "flush" };
+    const char *values[3] = { readIntTmo, "-1", "-1" };
+    std::vector<double> latency[3];
+    unsigned long nErrors[3] = { 0, 0, 0 }, nStale[3] = { 0, 0, 0 };
+    size_t nOut = 0, nIn = 0;
+    int eomReason = 0;
+    if (pasynOctetSyncIO->connect(portName, 0, &pasynUser, NULL) != asynSuccess ||
+        pasynOptionSyncIO->connect(portName, 0, &pasynUserOption, NULL) != asynSuccess)
+    {
+        printf("drvAsynVISAFlushBenchmark: unable to connect to port \"%s\"\n", portName);
+        if (pasynUser != NULL)
+        {
+            pasynOctetSyncIO->disconnect(pasynUser);
+        }
+        return;
+    }
+    if (pasynOptionSyncIO->getOption(pasynUserOption, "readinttmo", original, sizeof(original), timeout) != asynSuccess)
+    {
+        printf("drvAsynVISAFlushBenchmark: \"%s\" is not a VISA port\n", portName);
+        pasynOctetSyncIO->disconnect(pasynUser);
+        pasynOptionSyncIO->disconnect(pasynUserOption);
+        return;
+    }
+    if (cmdLen > 0)
+    {
+        if (pasynOctetSyncIO->writeRead(pasynUser, &(cmd[0]), cmdLen, &(buffer[0]), maxchars, timeout,
+                                        &nOut, &nIn, &eomReason) != asynSuccess || nIn < 2)
+        {
+            printf("drvAsynVISAFlushBenchmark: command needs a reply of at least 2 bytes: %s\n", pasynUser->errorMessage);
+            pasynOctetSyncIO->disconnect(pasynUser);
+            pasynOptionSyncIO->disconnect(pasynUserOption);
+            return;
+        }
+        reference.assign(&(buffer[0]), nIn);
+    }
+    epicsTimeStamp tStart, tEnd;
+    for(int i = 0; i < 3 * count; ++i)
+    {
+        int which = (i / 10) % 3;
+        if (i % 10 == 0 &&
+            pasynOptionSyncIO->setOption(pasynUserOption, "readinttmo", values[which], timeout) != asynSuccess)
+        {
+            printf("drvAsynVISAFlushBenchmark: cannot set readinttmo=%s: %s\n", values[which], pasynUserOption->errorMessage);
+            break;
+        }
+        if (cmdLen > 0)
+        {
+            // leave all but the first byte of the reply to be flushed
+            pasynOctetSyncIO->writeRead(pasynUser, &(cmd[0]), cmdLen, &(buffer[0]), 1, timeout, &nOut, &nIn, &eomReason);
+        }
+        asynStatus status = asynSuccess;
+        epicsTimeGetCurrent(&tStart);
+        if (which == 2)
+        {
+            status = pasynOctetSyncIO->flush(pasynUser);
+        }
+        else
+        {
+            // as stream device does, read until nothing more arrives
+            for(int j = 0; j < 1000; ++j)
+            {
+                if (pasynOctetSyncIO->read(pasynUser, &(buffer[0]), maxchars, 0.0, &nIn, &eomReason) != asynSuccess || nIn == 0)
+                {
+                    break;
+                }
+            }
+        }
+        epicsTimeGetCurrent(&tEnd);
+        if (status == asynSuccess)
+        {
+            latency[which].push_back(epicsTimeDiffInSeconds(&tEnd, &tStart));
+        }
+        else
+        {
+            ++nErrors[which];
+        }
+        if (cmdLen > 0 &&
+            (pasynOctetSyncIO->writeRead(pasynUser, &(cmd[0]), cmdLen, &(buffer[0]), maxchars, timeout,
+                                         &nOut, &nIn, &eomReason) != asynSuccess ||
+             reference.compare(0, std::string::npos, &(buffer[0]), nIn) != 0))
+        {
+            ++nStale[which];
+        }
+    }
+    pasynOptionSyncIO->setOption(pasynUserOption, "readinttmo", original, timeout);
+    pasynOctetSyncIO->disconnect(pasynUser);
+    pasynOptionSyncIO->disconnect(pasynUserOption);
+    printf("Port %s: %d flushes with each method%s\n", portName, count, (cmdLen > 0 ? " after a partly read reply" : ""));
+    for(int which = 0; which < 3; ++which)
+    {
+        printLatency(names[which], latency[which], nErrors[which]);
+        if (cmdLen > 0)
+        {
+            printf("%14s  wrong replies after flush %lu\n", "", nStale[which]);
+        }
+    }
+}
+
+#ifndef _WIN32
+
+/// master side of a pseudo terminal made by drvAsynVISAPtyEcho()
+static void ptyEchoThread(void *arg)
+{
+    int fd = static_cast<int>(reinterpret_cast<size_t>(arg));
+    char buffer[4096];
+    while(true)
+    {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n > 0)
+        {
+            for(ssize_t done = 0, w; done < n; done += (w > 0 ? w : 0))
+            {
+                if ( (w = write(fd, buffer + done, n - done)) < 0 && errno != EINTR && errno != EAGAIN )
+                {
+                    break;
+                }
+            }
+        }
+        else if (n < 0 && errno != EINTR)
+        {
+            epicsThreadSleep(0.01); // EIO while no port has the slave open
+        }
+    }
+}
+
+/// Create a pseudo terminal that echoes back everything written to it, as a stand in serial device for
+/// comparing the native termios backend with VISA ASRL e.g.
+///     drvAsynVISAPtyEcho("PTY")
+///     drvAsynVISAPortConfigure("N0", "$(PTY)", 0, 0, 0, 0, "\n")
+///     drvAsynVISAPortConfigure("V0", "ASRL$(PTY)::INSTR", 0, 0, 0, 0, "\n")
+/// then drvAsynVISABenchmark each port with a command ending in \n. The slave side is kept open so the
+/// terminal survives ports connecting and disconnecting.
+/// @param[in] envName @copydoc drvAsynVISAPtyEchoArg0
+static void drvAsynVISAPtyEcho(const char *envName)
+{
+    if (envName == NULL || *envName == '\0')
+    {
+        printf("drvAsynVISAPtyEcho: environment variable name missing\n");
+        return;
+    }
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0 || ptsname(master) == NULL)
+    {
+        printf("drvAsynVISAPtyEcho: cannot create pseudo terminal: %s\n", strerror(errno));
+        if (master >= 0)
+        {
+            close(master);
+        }
+        return;
+    }
+    std::string slaveName = ptsname(master);
+    int slave = open(slaveName.c_str(), O_RDWR | O_NOCTTY);
+    struct termios tio;
+    if (slave >= 0 && tcgetattr(slave, &tio) == 0)
+    {
+        cfmakeraw(&tio); // no echo or line editing by the terminal itself before a port configures it
+        tcsetattr(slave, TCSANOW, &tio);
+    }
+    std::string threadName = std::string("ptyEcho") + envName;
+    if (epicsThreadCreate(threadName.c_str(), epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackSmall),
+                          ptyEchoThread, reinterpret_cast<void*>(static_cast<size_t>(master))) == NULL)
+    {
+        printf("drvAsynVISAPtyEcho: cannot create echo thread\n");
+        close(master);
+        if (slave >= 0)
+        {
+            close(slave);
+        }
+        return;
+    }
+    epicsEnvSet(envName, slaveName.c_str());
+    printf("drvAsynVISAPtyEcho: %s=%s\n", envName, slaveName.c_str());
+}
+
+#endif /* _WIN32 */
+
+/*
+ * IOC shell command registration
+ */
+
+/// asyn port name to benchmark e.g. "L0"
+static const iocshArg drvAsynVISABenchmarkArg0 = { "portName", iocshArgString };
+/// command to send each transaction, escape sequences allowed e.g. "*IDN?". If empty only a read is done.
+static const iocshArg drvAsynVISABenchmarkArg1 = { "command", iocshArgString };
+/// number of transactions to perform (default 100)
+static const iocshArg drvAsynVISABenchmarkArg2 = { "count", iocshArgInt };
+/// timeout (seconds) for each transaction (default 1.0)
+static const iocshArg drvAsynVISABenchmarkArg3 = { "timeout", iocshArgDouble };
+/// size of read buffer (default 256)
+static const iocshArg drvAsynVISABenchmarkArg4 = { "maxchars", iocshArgInt };
+/// if non-zero, do zero timeout reads before each transaction in the same way stream device does.
+/// This is what exercises the readIntTmoMs setting of drvAsynVISAPortConfigure()
+static const iocshArg drvAsynVISABenchmarkArg5 = { "flushRead", iocshArgInt };
+
+static const iocshArg *drvAsynVISABenchmarkArgs[] = {
+    &drvAsynVISABenchmarkArg0, &drvAsynVISABenchmarkArg1, &drvAsynVISABenchmarkArg2,
+    &drvAsynVISABenchmarkArg3, &drvAsynVISABenchmarkArg4, &drvAsynVISABenchmarkArg5
+};
+
+static const iocshFuncDef drvAsynVISABenchmarkFuncDef =
+                      {"drvAsynVISABenchmark", sizeof(drvAsynVISABenchmarkArgs)/sizeof(iocshArg*), drvAsynVISABenchmarkArgs};
+
+static void drvAsynVISABenchmarkCallFunc(const iocshArgBuf *args)
+{
+    drvAsynVISABenchmark(args[0].sval, args[1].sval, args[2].ival, args[3].dval, args[4].ival, args[5].ival);
+}
+
+/// asyn port name to benchmark e.g. "L0"
+static const iocshArg drvAsynVISABlockBenchmarkArg0 = { "portName", iocshArgString };
+/// query returning the trace as text e.g. "CURVE?" after setting ASCII encoding, sent with the port output EOS. Empty to skip.
+static const iocshArg drvAsynVISABlockBenchmarkArg1 = { "textQuery", iocshArgString };
+/// query returning the trace as a definite length binary block, sent with the "blockeos" option. Empty to skip.
+static const iocshArg drvAsynVISABlockBenchmarkArg2 = { "blockQuery", iocshArgString };
+/// number of reads of each kind (default 10)
+static const iocshArg drvAsynVISABlockBenchmarkArg3 = { "count", iocshArgInt };
+/// timeout (seconds) for each read (default 5.0)
+static const iocshArg drvAsynVISABlockBenchmarkArg4 = { "timeout", iocshArgDouble };
+/// size of read buffer (default 1000000)
+static const iocshArg drvAsynVISABlockBenchmarkArg5 = { "maxbytes", iocshArgInt };
+
+static const iocshArg *drvAsynVISABlockBenchmarkArgs[] = {
+    &drvAsynVISABlockBenchmarkArg0, &drvAsynVISABlockBenchmarkArg1, &drvAsynVISABlockBenchmarkArg2,
+    &drvAsynVISABlockBenchmarkArg3, &drvAsynVISABlockBenchmarkArg4, &drvAsynVISABlockBenchmarkArg5
+};
+
+static const iocshFuncDef drvAsynVISABlockBenchmarkFuncDef =
+                      {"drvAsynVISABlockBenchmark", sizeof(drvAsynVISABlockBenchmarkArgs)/sizeof(iocshArg*), drvAsynVISABlockBenchmarkArgs};
+
+static void drvAsynVISABlockBenchmarkCallFunc(const iocshArgBuf *args)
+{
+    drvAsynVISABlockBenchmark(args[0].sval, args[1].sval, args[2].sval, args[3].ival, args[4].dval, args[5].ival);
+}
+
+/// asyn port name to benchmark e.g. "L0"
+static const iocshArg drvAsynVISAQueryBenchmarkArg0 = { "portName", iocshArgString };
+/// query to send, escape sequences allowed e.g. "*IDN?"
+static const iocshArg drvAsynVISAQueryBenchmarkArg1 = { "query", iocshArgString };
+/// number of queries of each kind (default 100)
+static const iocshArg drvAsynVISAQueryBenchmarkArg2 = { "count", iocshArgInt };
+/// timeout (seconds) for each query (default 1.0)
+static const iocshArg drvAsynVISAQueryBenchmarkArg3 = { "timeout", iocshArgDouble };
+/// size of read buffer (default 256)
+static const iocshArg drvAsynVISAQueryBenchmarkArg4 = { "maxchars", iocshArgInt };
+
+static const iocshArg *drvAsynVISAQueryBenchmarkArgs[] = {
+    &drvAsynVISAQueryBenchmarkArg0, &drvAsynVISAQueryBenchmarkArg1, &drvAsynVISAQueryBenchmarkArg2,
+    &drvAsynVISAQueryBenchmarkArg3, &drvAsynVISAQueryBenchmarkArg4
+};
+
+static const iocshFuncDef drvAsynVISAQueryBenchmarkFuncDef =
+                      {"drvAsynVISAQueryBenchmark", sizeof(drvAsynVISAQueryBenchmarkArgs)/sizeof(iocshArg*), drvAsynVISAQueryBenchmarkArgs};
+
+static void drvAsynVISAQueryBenchmarkCallFunc(const iocshArgBuf *args)
+{
+    drvAsynVISAQueryBenchmark(args[0].sval, args[1].sval, args[2].ival, args[3].dval, args[4].ival);
+}
+
+/// asyn port name to benchmark e.g. "L0"
+static const iocshArg drvAsynVISAOptionBenchmarkArg0 = { "portName", iocshArgString };
+/// command to send, a short query and reply, escape sequences allowed e.g. "*IDN?"
+static const iocshArg drvAsynVISAOptionBenchmarkArg1 = { "command", iocshArgString };
+/// number of transactions with each value (default 100)
+static const iocshArg drvAsynVISAOptionBenchmarkArg2 = { "count", iocshArgInt };
+/// timeout (seconds) for each transaction (default 1.0)
+static const iocshArg drvAsynVISAOptionBenchmarkArg3 = { "timeout", iocshArgDouble };
+/// asynOption key to vary e.g. "tcpnodelay"
+static const iocshArg drvAsynVISAOptionBenchmarkArg4 = { "key", iocshArgString };
+/// first value of option e.g. "Y"
+static const iocshArg drvAsynVISAOptionBenchmarkArg5 = { "valueA", iocshArgString };
+/// second value of option e.g. "N"
+static const iocshArg drvAsynVISAOptionBenchmarkArg6 = { "valueB", iocshArgString };
+/// size of read buffer, large enough for the whole reply (default 256)
+static const iocshArg drvAsynVISAOptionBenchmarkArg7 = { "maxchars", iocshArgInt };
+
+static const iocshArg *drvAsynVISAOptionBenchmarkArgs[] = {
+    &drvAsynVISAOptionBenchmarkArg0, &drvAsynVISAOptionBenchmarkArg1, &drvAsynVISAOptionBenchmarkArg2,
+    &drvAsynVISAOptionBenchmarkArg3, &drvAsynVISAOptionBenchmarkArg4, &drvAsynVISAOptionBenchmarkArg5,
+    &drvAsynVISAOptionBenchmarkArg6, &drvAsynVISAOptionBenchmarkArg7
+};
+
+static const iocshFuncDef drvAsynVISAOptionBenchmarkFuncDef =
+                      {"drvAsynVISAOptionBenchmark", sizeof(drvAsynVISAOptionBenchmarkArgs)/sizeof(iocshArg*), drvAsynVISAOptionBenchmarkArgs};
+
+static void drvAsynVISAOptionBenchmarkCallFunc(const iocshArgBuf *args)
+{
+    drvAsynVISAOptionBenchmark(args[0].sval, args[1].sval, args[2].ival, args[3].dval, args[4].sval, args[5].sval, args[6].sval,
+                               args[7].ival);
+}
+
+/// asyn port name to benchmark e.g. "L0"
+static const iocshArg drvAsynVISAFlushBenchmarkArg0 = { "portName", iocshArgString };
+/// command with a reply to leave partly read before each flush, escape sequences allowed e.g. "*IDN?".
+/// If empty the flushes are timed with no input waiting.
+static const iocshArg drvAsynVISAFlushBenchmarkArg1 = { "command", iocshArgString };
+/// number of flushes with each method (default 100)
+static const iocshArg drvAsynVISAFlushBenchmarkArg2 = { "count", iocshArgInt };
+/// timeout (seconds) for each command (default 1.0)
+static const iocshArg drvAsynVISAFlushBenchmarkArg3 = { "timeout", iocshArgDouble };
+/// readIntTmoMs for the zero timeout VISA reads, 0 for VI_TMO_IMMEDIATE (default 0)
+static const iocshArg drvAsynVISAFlushBenchmarkArg4 = { "readIntTmoMs", iocshArgInt };
+/// size of read buffer, large enough for the whole reply (default 256)
+static const iocshArg drvAsynVISAFlushBenchmarkArg5 = { "maxchars", iocshArgInt };
+
+static const iocshArg *drvAsynVISAFlushBenchmarkArgs[] = {
+    &drvAsynVISAFlushBenchmarkArg0, &drvAsynVISAFlushBenchmarkArg1, &drvAsynVISAFlushBenchmarkArg2,
+    &drvAsynVISAFlushBenchmarkArg3, &drvAsynVISAFlushBenchmarkArg4, &drvAsynVISAFlushBenchmarkArg5
+};
+
+static const iocshFuncDef drvAsynVISAFlushBenchmarkFuncDef =
+                      {"drvAsynVISAFlushBenchmark", sizeof(drvAsynVISAFlushBenchmarkArgs)/sizeof(iocshArg*), drvAsynVISAFlushBenchmarkArgs};
+
+static void drvAsynVISAFlushBenchmarkCallFunc(const iocshArgBuf *args)
+{
+    drvAsynVISAFlushBenchmark(args[0].sval, args[1].sval, args[2].ival, args[3].dval, args[4].ival, args[5].ival);
+}
+
+#ifndef _WIN32
+
+/// environment variable to set to the device path of the new pseudo terminal e.g. "PTY"
+static const iocshArg drvAsynVISAPtyEchoArg0 = { "envName", iocshArgString };
+
+static const iocshArg *drvAsynVISAPtyEchoArgs[] = { &drvAsynVISAPtyEchoArg0 };
+
+static const iocshFuncDef drvAsynVISAPtyEchoFuncDef =
+                      {"drvAsynVISAPtyEcho", sizeof(drvAsynVISAPtyEchoArgs)/sizeof(iocshArg*), drvAsynVISAPtyEchoArgs};
+
+static void drvAsynVISAPtyEchoCallFunc(const iocshArgBuf *args)
+{
+    drvAsynVISAPtyEcho(args[0].sval);
+}
+
+#endif /* _WIN32 */
+
+extern "C"
+{
+
+static void
+drvAsynVISABenchmarkRegister(void)
+{
+    static int firstTime = 1;
+    if (firstTime) {
+        iocshRegister(&drvAsynVISABenchmarkFuncDef, drvAsynVISABenchmarkCallFunc);
+        iocshRegister(&drvAsynVISABlockBenchmarkFuncDef, drvAsynVISABlockBenchmarkCallFunc);
+        iocshRegister(&drvAsynVISAQueryBenchmarkFuncDef, drvAsynVISAQueryBenchmarkCallFunc);
+        iocshRegister(&drvAsynVISAOptionBenchmarkFuncDef, drvAsynVISAOptionBenchmarkCallFunc);
+        iocshRegister(&drvAsynVISAFlushBenchmarkFuncDef, drvAsynVISAFlushBenchmarkCallFunc);
+#ifndef _WIN32
+        iocshRegister(&drvAsynVISAPtyEchoFuncDef, drvAsynVISAPtyEchoCallFunc);
+#endif
+        firstTime = 0;
+    }
+}
+
+epicsExportRegistrar(drvAsynVISABenchmarkRegister);
+
+}
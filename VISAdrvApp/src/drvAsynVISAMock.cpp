@@ -0,0 +1,1572 @@
+/// @file drvAsynVISAMock.cpp simulated instrument backend of drvAsynVISAPort
+///
+/// An instrument defined with drvAsynVISAMockInstrument() answers the commands given to drvAsynVISAMockReply()
+/// with the timing of a real link: its reply starts a latency after the command and then arrives a byte at a time.
+/// A port uses it by configuring the resource name MOCK::name, or the name itself when that is the VISA resource
+/// the instrument stands in for. Reads follow VISA semantics (termination character, END, count and timeout), and
+/// events, asynchronous I/O and viTerminate are simulated too, so every mode of the driver can be tested and
+/// benchmarked without VISA hardware.
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include <string>
+#include <map>
+#include <deque>
+#include <vector>
+
+#include <iocsh.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsString.h>
+#include <epicsStdio.h>
+
+#include <visa.h>
+
+#include <epicsExport.h>
+
+#include "drvAsynVISABackend.h"
+
+#define MOCK_MAX_SESSIONS 64
+#define MOCK_MAX_EVENTS   64
+#define MOCK_MAX_FINDS    8
+/// event contexts and find lists are numbered from these, so they are never mistaken for a session
+#define MOCK_EVENT_BASE   0x1000
+#define MOCK_FIND_BASE    0x2000
+#define MOCK_STB_MAV      0x10
+#define MOCK_STB_RQS      0x40
+
+/// the count attribute of an I/O completion event, as read by the driver
+#ifdef VI_ATTR_RET_COUNT_32
+#define MOCK_ATTR_RET_COUNT VI_ATTR_RET_COUNT_32
+#else
+#define MOCK_ATTR_RET_COUNT VI_ATTR_RET_COUNT
+#endif
+
+/// a simulated instrument, shared by every session open on it
+typedef struct mockInstrument {
+    std::string name;
+    ViUInt16    intfType;     ///< VI_ATTR_INTF_TYPE
+    const char* rsrcClass;    ///< VI_ATTR_RSRC_CLASS, INSTR or SOCKET
+    bool        hislip;       ///< VI_ATTR_TCPIP_IS_HISLIP
+    bool        sendEnd;      ///< END comes with the last byte of a reply, and ends a command (GPIB, USBTMC, VXI-11, HiSLIP)
+    std::string eos;          ///< sent after every reply
+    double      latency;      ///< s from the end of a command to the first byte of its reply
+    double      byteTime;     ///< s per byte on the link, in either direction
+    double      writeTime;    ///< s taken by every write, clear and serial poll e.g. GPIB addressing or a USB transfer
+    double      openTime;     ///< s taken by viOpen
+    bool        echo;         ///< reply to a command that is not in the table with the command itself
+    bool        srq;          ///< request service when a reply has arrived
+    bool        offline;      ///< viOpen fails with VI_ERROR_RSRC_NFOUND
+    int         hang;         ///< reads ignore their timeout: 1 until viTerminate or viClear, 2 until viClear
+    int         errors;       ///< the next this many reads and writes fail with VI_ERROR_IO
+    std::map<std::string, std::string> replies; ///< command, without its terminator, to reply
+    unsigned long nOpens;
+    unsigned long nWrites;    ///< write calls, synchronous or not
+    unsigned long nCommands;  ///< commands received
+    unsigned long nReads;     ///< read calls, synchronous or not
+    unsigned long nClears;
+} mockInstrument_t;
+
+/// a reply queued by a command
+typedef struct mockMessage {
+    size_t begin;             ///< index in mockSession_t::input of the first byte
+    size_t end;               ///< one past the last byte
+    double start;             ///< time the first byte arrives
+} mockMessage_t;
+
+/// a read posted with viReadAsync
+typedef struct mockJob {
+    ViJobId  id;
+    ViBuf    buf;
+    ViUInt32 count;
+    ViUInt32 timeout;         ///< VI_ATTR_TMO_VALUE when posted
+    bool     aborted;         ///< viTerminate was called for it
+} mockJob_t;
+
+/// a VI_EVENT_IO_COMPLETION waiting in the queue, or the context of any event returned by viWaitOnEvent
+typedef struct mockEvent {
+    bool        inUse;
+    ViEventType type;
+    ViJobId     id;
+    ViStatus    status;
+    ViUInt32    count;
+} mockEvent_t;
+
+/// the kinds of thread that can wait in a session, each has its own event so all can be woken
+enum { MOCK_WAIT_READ, MOCK_WAIT_ASYNC, MOCK_WAIT_CHAR, MOCK_WAIT_SRQ, MOCK_WAIT_IO, MOCK_WAIT_NUM };
+
+/// state of an open session to an instrument
+typedef struct mockSession {
+    bool              inUse;
+    bool              closing;
+    int               users;         ///< calls in progress, and the async thread, close waits for them
+    mockInstrument_t* inst;
+    epicsEventId      wake[MOCK_WAIT_NUM];
+    ViUInt32          timeout;       ///< VI_ATTR_TMO_VALUE (ms)
+    ViUInt8           termChar;      ///< VI_ATTR_TERMCHAR
+    bool              termCharEn;    ///< VI_ATTR_TERMCHAR_EN
+    ViUInt16          endIn;         ///< VI_ATTR_ASRL_END_IN
+    bool              sendEndEn;     ///< VI_ATTR_SEND_END_EN
+    bool              suppressEndEn; ///< VI_ATTR_SUPPRESS_END_EN
+    std::map<ViAttr, ViAttrState> attrs; ///< other attributes that have been set
+    std::string       input;         ///< replies, arrived or not
+    size_t            head;          ///< first unread byte of input
+    std::deque<mockMessage_t> messages;
+    std::string       command;       ///< command received so far
+    bool              reading;       ///< a synchronous read is in progress
+    bool              readAborted;   ///< viTerminate was called for it
+    unsigned          clears;        ///< viClear calls, reads in progress end when this changes
+    bool              srqPending;    ///< a service request is due at srqTime
+    double            srqTime;
+    bool              rqs;           ///< RQS bit of the status byte, cleared by a serial poll
+    bool              srqEvent;      ///< VI_EVENT_SERVICE_REQ waiting in the queue
+    bool              charEnabled;   ///< events enabled for the queue
+    bool              srqEnabled;
+    bool              ioEnabled;
+    std::deque<mockJob_t*>  jobs;    ///< posted reads, the first is in progress
+    std::deque<mockEvent_t> completions;
+    ViJobId           lastJob;
+    bool              asyncRunning;  ///< the thread doing posted reads has been started
+} mockSession_t;
+
+static mockSession_t mockSessions[MOCK_MAX_SESSIONS];
+static mockEvent_t mockEvents[MOCK_MAX_EVENTS];
+static std::vector<std::string> mockFinds[MOCK_MAX_FINDS];
+static bool mockFindsUsed[MOCK_MAX_FINDS];
+static std::map<std::string, mockInstrument_t*> mockInstruments;
+/// protects all of the above, released while a call waits
+static epicsMutexId mockLock = NULL;
+static epicsTimeStamp mockEpoch;
+static epicsThreadOnceId mockOnce = EPICS_THREAD_ONCE_INIT;
+
+static void mockInit(void*)
+{
+    mockLock = epicsMutexMustCreate();
+    epicsTimeGetCurrent(&mockEpoch);
+}
+
+/// seconds since the mock was first used
+static double mockNow()
+{
+    epicsTimeStamp now;
+    epicsTimeGetCurrent(&now);
+    return epicsTimeDiffInSeconds(&now, &mockEpoch);
+}
+
+/// the instrument for a resource name, called with mockLock held
+static mockInstrument_t* mockFind(const char *resourceName)
+{
+    if (epicsStrnCaseCmp(resourceName, "MOCK::", 6) == 0)
+    {
+        resourceName += 6;
+    }
+    std::map<std::string, mockInstrument_t*>::iterator it = mockInstruments.find(resourceName);
+    return (it != mockInstruments.end() ? it->second : NULL);
+}
+
+/// start a call on a session, session handles are the table index plus one so VI_NULL is never valid
+/// @return the session with mockLock held, or NULL
+static mockSession_t* mockEnter(ViSession vi)
+{
+    epicsThreadOnce(&mockOnce, mockInit, NULL);
+    epicsMutexMustLock(mockLock);
+    if (vi < 1 || vi > MOCK_MAX_SESSIONS || !mockSessions[vi - 1].inUse || mockSessions[vi - 1].closing)
+    {
+        epicsMutexUnlock(mockLock);
+        return NULL;
+    }
+    ++(mockSessions[vi - 1].users);
+    return &(mockSessions[vi - 1]);
+}
+
+static void mockLeave(mockSession_t *s)
+{
+    --(s->users);
+    epicsMutexUnlock(mockLock);
+}
+
+static void mockWakeAll(mockSession_t *s)
+{
+    for(int i = 0; i < MOCK_WAIT_NUM; ++i)
+    {
+        epicsEventSignal(s->wake[i]);
+    }
+}
+
+/// wait with mockLock released until woken, or for delay (s) if it is not negative
+static void mockWait(mockSession_t *s, int waiter, double delay)
+{
+    epicsMutexUnlock(mockLock);
+    if (delay < 0.0)
+    {
+        epicsEventMustWait(s->wake[waiter]);
+    }
+    else
+    {
+        epicsEventWaitWithTimeout(s->wake[waiter], delay);
+    }
+    epicsMutexMustLock(mockLock);
+}
+
+/// sleep with mockLock released for the time the instrument takes over something
+static void mockBusy(double delay)
+{
+    if (delay > 0.0)
+    {
+        epicsMutexUnlock(mockLock);
+        epicsThreadSleep(delay);
+        epicsMutexMustLock(mockLock);
+    }
+}
+
+/// index in input up to which bytes have arrived by now, and the time the next one will (negative if none is due)
+static size_t mockArrived(mockSession_t *s, double now, double *next)
+{
+    double byteTime = s->inst->byteTime;
+    size_t arrived = s->head;
+    *next = -1.0;
+    for(std::deque<mockMessage_t>::const_iterator it = s->messages.begin(); it != s->messages.end(); ++it)
+    {
+        size_t len = it->end - it->begin, n = len;
+        if (now < it->start)
+        {
+            n = 0;
+        }
+        else if (byteTime > 0.0 && (now - it->start) / byteTime + 1.0 < len)
+        {
+            n = static_cast<size_t>((now - it->start) / byteTime) + 1;
+        }
+        if (it->begin + n > arrived)
+        {
+            arrived = it->begin + n;
+        }
+        if (n < len)
+        {
+            *next = it->start + n * byteTime;
+            break;
+        }
+    }
+    return arrived;
+}
+
+/// forget replies that have been read
+static void mockRetire(mockSession_t *s)
+{
+    while(!s->messages.empty() && s->messages.front().end <= s->head)
+    {
+        s->messages.pop_front();
+    }
+    if (s->messages.empty() && s->head >= s->input.size())
+    {
+        s->input.clear();
+        s->head = 0;
+    }
+}
+
+/// a service request that has become due sets RQS and queues the event
+static void mockUpdateSrq(mockSession_t *s, double now)
+{
+    if (s->srqPending && now >= s->srqTime)
+    {
+        s->srqPending = false;
+        s->rqs = true;
+        s->srqEvent = s->srqEnabled;
+    }
+}
+
+/// the reply to a command, {block:N} is an IEEE 488.2 definite length block of N bytes and {values:N}
+/// is N comma separated numbers
+static std::string mockReply(mockInstrument_t *inst, const std::string& command)
+{
+    std::map<std::string, std::string>::const_iterator it = inst->replies.find(command);
+    std::string reply;
+    unsigned n = 0;
+    char buffer[32];
+    if (it != inst->replies.end())
+    {
+        reply = it->second;
+    }
+    else if (inst->echo)
+    {
+        reply = command;
+    }
+    else
+    {
+        return reply;
+    }
+    if (sscanf(reply.c_str(), "{block:%u}", &n) == 1)
+    {
+        epicsSnprintf(buffer, sizeof(buffer), "%u", n);
+        reply = std::string("#") + static_cast<char>('0' + strlen(buffer)) + buffer;
+        for(unsigned i = 0; i < n; ++i)
+        {
+            reply += static_cast<char>(i & 0xff);
+        }
+    }
+    else if (sscanf(reply.c_str(), "{values:%u}", &n) == 1)
+    {
+        reply.clear();
+        for(unsigned i = 0; i < n; ++i)
+        {
+            epicsSnprintf(buffer, sizeof(buffer), "%s%.6E", (i > 0 ? "," : ""), i * 0.001);
+            reply += buffer;
+        }
+    }
+    return reply + inst->eos;
+}
+
+/// act on a complete command, queueing its reply to arrive after the instrument latency and any reply before it
+static void mockCommand(mockSession_t *s, std::string command, double now)
+{
+    mockInstrument_t *inst = s->inst;
+    while(!command.empty() && (command[command.size() - 1] == '\r' || command[command.size() - 1] == '\n'))
+    {
+        command.erase(command.size() - 1);
+    }
+    ++(inst->nCommands);
+    std::string reply = mockReply(inst, command);
+    if (reply.empty())
+    {
+        return;
+    }
+    mockMessage_t m;
+    m.begin = s->input.size();
+    m.end = m.begin + reply.size();
+    m.start = now + inst->latency;
+    if (!s->messages.empty())
+    {
+        const mockMessage_t& last = s->messages.back();
+        double lastEnd = last.start + (last.end - last.begin) * inst->byteTime;
+        m.start = (m.start > lastEnd ? m.start : lastEnd);
+    }
+    s->input += reply;
+    s->messages.push_back(m);
+    if (inst->srq)
+    {
+        s->srqPending = true;
+        s->srqTime = m.start + (m.end - m.begin - 1) * inst->byteTime;
+    }
+    mockWakeAll(s);
+}
+
+/// VISA read semantics, called with mockLock held. Ends on the termination character, END, count, timeout,
+/// viTerminate (*aborted) or viClear. With SUPPRESS_END_EN false a raw socket treats a pause in the data as END.
+static ViStatus mockTransfer(mockSession_t *s, ViBuf buf, ViUInt32 count, ViUInt32 *retCount, ViUInt32 timeout,
+                             int waiter, bool *aborted)
+{
+    mockInstrument_t *inst = s->inst;
+    bool isSerial = (inst->intfType == VI_INTF_ASRL);
+    bool isSocket = (strcmp(inst->rsrcClass, "SOCKET") == 0);
+    bool termEnabled = (s->termCharEn || (isSerial && s->endIn == VI_ASRL_END_TERMCHAR));
+    bool endEnabled = (inst->sendEnd && !isSerial);
+    unsigned clears = s->clears;
+    double now = mockNow(), next;
+    double deadline = (timeout == VI_TMO_INFINITE || inst->hang > 0 ? -1.0 : now + timeout / 1000.0);
+    ViUInt32 n = 0;
+    ++(inst->nReads);
+    *retCount = 0;
+    if (inst->errors > 0)
+    {
+        --(inst->errors);
+        return VI_ERROR_IO;
+    }
+    while(true)
+    {
+        if (*aborted || s->clears != clears || s->closing)
+        {
+            *retCount = n;
+            return VI_ERROR_ABORT;
+        }
+        size_t avail = mockArrived(s, now, &next) - s->head;
+        for(; avail > 0 && n < count; --avail)
+        {
+            ViUInt8 c = static_cast<ViUInt8>(s->input[(s->head)++]);
+            buf[n++] = c;
+            if (termEnabled && c == s->termChar)
+            {
+                *retCount = n;
+                mockRetire(s);
+                return VI_SUCCESS_TERM_CHAR;
+            }
+            mockRetire(s);
+            if (endEnabled && (s->messages.empty() || s->head == s->messages.front().begin))
+            {
+                *retCount = n;
+                return VI_SUCCESS;
+            }
+        }
+        *retCount = n;
+        if (n == count)
+        {
+            return VI_SUCCESS_MAX_CNT;
+        }
+        if (n > 0 && isSocket && !s->suppressEndEn)
+        {
+            return VI_SUCCESS;
+        }
+        double delay = (next >= 0.0 ? next - now : -1.0);
+        if (deadline >= 0.0)
+        {
+            if (now >= deadline)
+            {
+                return VI_ERROR_TMO;
+            }
+            delay = (delay >= 0.0 && delay < deadline - now ? delay : deadline - now);
+        }
+        mockWait(s, waiter, delay);
+        now = mockNow();
+    }
+}
+
+/// VISA write semantics, called with mockLock held. Commands end with a line feed, or with END if the instrument uses it.
+static ViStatus mockWriteData(mockSession_t *s, ViBuf buf, ViUInt32 count, ViUInt32 *retCount)
+{
+    mockInstrument_t *inst = s->inst;
+    *retCount = 0;
+    ++(inst->nWrites);
+    mockBusy(inst->writeTime + count * inst->byteTime);
+    if (inst->errors > 0)
+    {
+        --(inst->errors);
+        return VI_ERROR_IO;
+    }
+    double now = mockNow();
+    s->command.append(reinterpret_cast<const char*>(buf), count);
+    size_t pos;
+    while( (pos = s->command.find('\n')) != std::string::npos )
+    {
+        std::string command = s->command.substr(0, pos);
+        s->command.erase(0, pos + 1);
+        mockCommand(s, command, now);
+    }
+    if (!s->command.empty() && inst->sendEnd && inst->intfType != VI_INTF_ASRL && s->sendEndEn)
+    {
+        mockCommand(s, s->command, now);
+        s->command.clear();
+    }
+    *retCount = count;
+    return VI_SUCCESS;
+}
+
+static bool mockMatch(const char *resourceName)
+{
+    if (epicsStrnCaseCmp(resourceName, "MOCK::", 6) == 0)
+    {
+        return true;
+    }
+    epicsThreadOnce(&mockOnce, mockInit, NULL);
+    epicsMutexMustLock(mockLock);
+    bool found = (mockFind(resourceName) != NULL);
+    epicsMutexUnlock(mockLock);
+    return found;
+}
+
+static ViStatus mockOpen(ViSession, char *resourceName, ViSession *vi)
+{
+    *vi = VI_NULL;
+    epicsThreadOnce(&mockOnce, mockInit, NULL);
+    epicsMutexMustLock(mockLock);
+    mockInstrument_t *inst = mockFind(resourceName);
+    if (inst == NULL || inst->offline)
+    {
+        epicsMutexUnlock(mockLock);
+        return VI_ERROR_RSRC_NFOUND;
+    }
+    int i = 0;
+    while(i < MOCK_MAX_SESSIONS && mockSessions[i].inUse)
+    {
+        ++i;
+    }
+    if (i == MOCK_MAX_SESSIONS)
+    {
+        epicsMutexUnlock(mockLock);
+        return VI_ERROR_ALLOC;
+    }
+    mockSession_t *s = &(mockSessions[i]);
+    s->inUse = true;
+    s->closing = false;
+    s->users = 1;
+    s->inst = inst;
+    for(int j = 0; j < MOCK_WAIT_NUM; ++j)
+    {
+        if (s->wake[j] == NULL)
+        {
+            s->wake[j] = epicsEventMustCreate(epicsEventEmpty);
+        }
+        epicsEventTryWait(s->wake[j]);
+    }
+    s->timeout = 2000;
+    s->termChar = '\n';
+    s->termCharEn = false;
+    s->endIn = (inst->intfType == VI_INTF_ASRL ? VI_ASRL_END_TERMCHAR : VI_ASRL_END_NONE);
+    s->sendEndEn = true;
+    s->suppressEndEn = false;
+    s->attrs.clear();
+    s->input.clear();
+    s->head = 0;
+    s->messages.clear();
+    s->command.clear();
+    s->reading = s->readAborted = false;
+    s->clears = 0;
+    s->srqPending = s->rqs = s->srqEvent = false;
+    s->charEnabled = s->srqEnabled = s->ioEnabled = false;
+    s->jobs.clear();
+    s->completions.clear();
+    s->lastJob = VI_NULL;
+    s->asyncRunning = false;
+    ++(inst->nOpens);
+    mockBusy(inst->openTime);
+    --(s->users);
+    epicsMutexUnlock(mockLock);
+    *vi = i + 1;
+    return VI_SUCCESS;
+}
+
+/// close a session, event context or find list. Calls in progress on a session end with VI_ERROR_ABORT.
+static ViStatus mockClose(ViSession vi)
+{
+    epicsThreadOnce(&mockOnce, mockInit, NULL);
+    epicsMutexMustLock(mockLock);
+    if (vi >= MOCK_EVENT_BASE && vi < MOCK_EVENT_BASE + MOCK_MAX_EVENTS && mockEvents[vi - MOCK_EVENT_BASE].inUse)
+    {
+        mockEvents[vi - MOCK_EVENT_BASE].inUse = false;
+        epicsMutexUnlock(mockLock);
+        return VI_SUCCESS;
+    }
+    if (vi >= MOCK_FIND_BASE && vi < MOCK_FIND_BASE + MOCK_MAX_FINDS && mockFindsUsed[vi - MOCK_FIND_BASE])
+    {
+        mockFindsUsed[vi - MOCK_FIND_BASE] = false;
+        epicsMutexUnlock(mockLock);
+        return VI_SUCCESS;
+    }
+    if (vi < 1 || vi > MOCK_MAX_SESSIONS || !mockSessions[vi - 1].inUse || mockSessions[vi - 1].closing)
+    {
+        epicsMutexUnlock(mockLock);
+        return VI_ERROR_INV_OBJECT;
+    }
+    mockSession_t *s = &(mockSessions[vi - 1]);
+    s->closing = true;
+    while(s->users > 0)
+    {
+        mockWakeAll(s);
+        mockBusy(0.001);
+    }
+    for(std::deque<mockJob_t*>::iterator it = s->jobs.begin(); it != s->jobs.end(); ++it)
+    {
+        delete *it;
+    }
+    s->jobs.clear();
+    s->inUse = false;
+    epicsMutexUnlock(mockLock);
+    return VI_SUCCESS;
+}
+
+static ViStatus mockRead(ViSession vi, ViBuf buf, ViUInt32 count, ViUInt32 *retCount)
+{
+    mockSession_t *s = mockEnter(vi);
+    if (s == NULL)
+    {
+        *retCount = 0;
+        return VI_ERROR_INV_OBJECT;
+    }
+    s->reading = true;
+    s->readAborted = false;
+    ViStatus status = mockTransfer(s, buf, count, retCount, s->timeout, MOCK_WAIT_READ, &(s->readAborted));
+    s->reading = false;
+    mockLeave(s);
+    return status;
+}
+
+static ViStatus mockWrite(ViSession vi, ViBuf buf, ViUInt32 count, ViUInt32 *retCount)
+{
+    mockSession_t *s = mockEnter(vi);
+    if (s == NULL)
+    {
+        *retCount = 0;
+        return VI_ERROR_INV_OBJECT;
+    }
+    ViStatus status = mockWriteData(s, buf, count, retCount);
+    mockLeave(s);
+    return status;
+}
+
+/// size of attributes kept for a session without affecting the simulation, the interface they belong to (0 for any)
+/// and their default. Some interfaces use the same number for different attributes.
+static const struct { ViAttr attr; size_t size; ViUInt16 intf; ViAttrState value; } mockAttrs[] = {
+    { VI_ATTR_INTF_NUM, sizeof(ViUInt16), 0, 0 },
+    { VI_ATTR_ASRL_END_OUT, sizeof(ViUInt16), VI_INTF_ASRL, VI_ASRL_END_NONE },
+    { VI_ATTR_ASRL_BAUD, sizeof(ViUInt32), VI_INTF_ASRL, 9600 },
+    { VI_ATTR_ASRL_DATA_BITS, sizeof(ViUInt16), VI_INTF_ASRL, 8 },
+    { VI_ATTR_ASRL_PARITY, sizeof(ViUInt16), VI_INTF_ASRL, VI_ASRL_PAR_NONE },
+    { VI_ATTR_ASRL_STOP_BITS, sizeof(ViUInt16), VI_INTF_ASRL, VI_ASRL_STOP_ONE },
+    { VI_ATTR_ASRL_FLOW_CNTRL, sizeof(ViUInt16), VI_INTF_ASRL, VI_ASRL_FLOW_NONE },
+    { VI_ATTR_GPIB_READDR_EN, sizeof(ViBoolean), VI_INTF_GPIB, VI_TRUE },
+    { VI_ATTR_GPIB_UNADDR_EN, sizeof(ViBoolean), VI_INTF_GPIB, VI_FALSE },
+    { VI_ATTR_GPIB_SECONDARY_ADDR, sizeof(ViUInt16), VI_INTF_GPIB, VI_NO_SEC_ADDR },
+    { VI_ATTR_TCPIP_NODELAY, sizeof(ViBoolean), VI_INTF_TCPIP, VI_TRUE },
+    { VI_ATTR_TCPIP_KEEPALIVE, sizeof(ViBoolean), VI_INTF_TCPIP, VI_FALSE },
+    { VI_ATTR_USB_MAX_INTR_SIZE, sizeof(ViUInt16), VI_INTF_USB, 8 },
+};
+
+static int mockAttrIndex(ViAttr attr, ViUInt16 intf)
+{
+    for(size_t i = 0; i < sizeof(mockAttrs) / sizeof(mockAttrs[0]); ++i)
+    {
+        if (mockAttrs[i].attr == attr && (mockAttrs[i].intf == 0 || mockAttrs[i].intf == intf))
+        {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+static void mockPut(void *value, size_t size, ViAttrState state)
+{
+    switch(size)
+    {
+        case 1: *static_cast<ViUInt8*>(value) = static_cast<ViUInt8>(state); break;
+        case 2: *static_cast<ViUInt16*>(value) = static_cast<ViUInt16>(state); break;
+        default: *static_cast<ViUInt32*>(value) = static_cast<ViUInt32>(state); break;
+    }
+}
+
+static ViStatus mockSetAttribute(ViSession vi, ViAttr attr, ViAttrState value)
+{
+    mockSession_t *s = mockEnter(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    ViStatus status = VI_SUCCESS;
+    switch(attr)
+    {
+        case VI_ATTR_TMO_VALUE:
+            s->timeout = static_cast<ViUInt32>(value);
+            break;
+        case VI_ATTR_TERMCHAR:
+            s->termChar = static_cast<ViUInt8>(value);
+            break;
+        case VI_ATTR_TERMCHAR_EN:
+            s->termCharEn = (value != VI_FALSE);
+            break;
+        case VI_ATTR_SEND_END_EN:
+            s->sendEndEn = (value != VI_FALSE);
+            break;
+        case VI_ATTR_SUPPRESS_END_EN:
+            s->suppressEndEn = (value != VI_FALSE);
+            break;
+        case VI_ATTR_ASRL_END_IN:
+            if (s->inst->intfType != VI_INTF_ASRL)
+            {
+                status = VI_ERROR_NSUP_ATTR;
+            }
+            s->endIn = static_cast<ViUInt16>(value);
+            break;
+        default:
+            if (mockAttrIndex(attr, s->inst->intfType) < 0)
+            {
+                status = VI_ERROR_NSUP_ATTR;
+            }
+            else
+            {
+                s->attrs[attr] = value;
+            }
+            break;
+    }
+    mockLeave(s);
+    return status;
+}
+
+/// attributes of an event context
+static ViStatus mockEventAttribute(ViEvent event, ViAttr attr, void *value)
+{
+    epicsMutexMustLock(mockLock);
+    mockEvent_t *e = &(mockEvents[event - MOCK_EVENT_BASE]);
+    ViStatus status = VI_SUCCESS;
+    if (!e->inUse)
+    {
+        status = VI_ERROR_INV_OBJECT;
+    }
+    else if (attr == VI_ATTR_EVENT_TYPE)
+    {
+        *static_cast<ViEventType*>(value) = e->type;
+    }
+    else if (attr == VI_ATTR_JOB_ID && e->type == VI_EVENT_IO_COMPLETION)
+    {
+        *static_cast<ViJobId*>(value) = e->id;
+    }
+    else if (attr == VI_ATTR_STATUS && e->type == VI_EVENT_IO_COMPLETION)
+    {
+        *static_cast<ViStatus*>(value) = e->status;
+    }
+    else if (attr == MOCK_ATTR_RET_COUNT && e->type == VI_EVENT_IO_COMPLETION)
+    {
+        *static_cast<ViUInt32*>(value) = e->count;
+    }
+    else
+    {
+        status = VI_ERROR_NSUP_ATTR;
+    }
+    epicsMutexUnlock(mockLock);
+    return status;
+}
+
+static ViStatus mockGetAttribute(ViSession vi, ViAttr attr, void *value)
+{
+    if (vi >= MOCK_EVENT_BASE && vi < MOCK_EVENT_BASE + MOCK_MAX_EVENTS)
+    {
+        epicsThreadOnce(&mockOnce, mockInit, NULL);
+        return mockEventAttribute(vi, attr, value);
+    }
+    mockSession_t *s = mockEnter(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    mockInstrument_t *inst = s->inst;
+    ViStatus status = VI_SUCCESS;
+    double next;
+    unsigned addr = 1;
+    int i;
+    switch(attr)
+    {
+        case VI_ATTR_TMO_VALUE:
+            *static_cast<ViUInt32*>(value) = s->timeout;
+            break;
+        case VI_ATTR_TERMCHAR:
+            *static_cast<ViUInt8*>(value) = s->termChar;
+            break;
+        case VI_ATTR_TERMCHAR_EN:
+            *static_cast<ViBoolean*>(value) = (s->termCharEn ? VI_TRUE : VI_FALSE);
+            break;
+        case VI_ATTR_SEND_END_EN:
+            *static_cast<ViBoolean*>(value) = (s->sendEndEn ? VI_TRUE : VI_FALSE);
+            break;
+        case VI_ATTR_SUPPRESS_END_EN:
+            *static_cast<ViBoolean*>(value) = (s->suppressEndEn ? VI_TRUE : VI_FALSE);
+            break;
+        case VI_ATTR_ASRL_END_IN:
+            *static_cast<ViUInt16*>(value) = s->endIn;
+            break;
+        case VI_ATTR_ASRL_AVAIL_NUM:
+            *static_cast<ViUInt32*>(value) = static_cast<ViUInt32>(mockArrived(s, mockNow(), &next) - s->head);
+            break;
+        case VI_ATTR_INTF_TYPE:
+            *static_cast<ViUInt16*>(value) = inst->intfType;
+            break;
+        case VI_ATTR_RSRC_CLASS:
+            strcpy(static_cast<char*>(value), inst->rsrcClass);
+            break;
+        case VI_ATTR_RSRC_NAME:
+            epicsSnprintf(static_cast<char*>(value), 256, "%s", inst->name.c_str());
+            break;
+        case VI_ATTR_INTF_INST_NAME:
+            epicsSnprintf(static_cast<char*>(value), 256, "simulated %s", inst->name.c_str());
+            break;
+        case VI_ATTR_TCPIP_IS_HISLIP:
+            if (inst->intfType != VI_INTF_TCPIP)
+            {
+                status = VI_ERROR_NSUP_ATTR;
+                break;
+            }
+            *static_cast<ViBoolean*>(value) = (inst->hislip ? VI_TRUE : VI_FALSE);
+            break;
+        case VI_ATTR_GPIB_PRIMARY_ADDR:
+            if (inst->intfType != VI_INTF_GPIB)
+            {
+                status = VI_ERROR_NSUP_ATTR;
+                break;
+            }
+            sscanf(inst->name.c_str(), "GPIB%*u::%u", &addr);
+            *static_cast<ViUInt16*>(value) = static_cast<ViUInt16>(addr);
+            break;
+        default:
+            if ( (i = mockAttrIndex(attr, inst->intfType)) < 0 )
+            {
+                status = VI_ERROR_NSUP_ATTR;
+            }
+            else
+            {
+                std::map<ViAttr, ViAttrState>::const_iterator it = s->attrs.find(attr);
+                mockPut(value, mockAttrs[i].size, (it != s->attrs.end() ? it->second : mockAttrs[i].value));
+            }
+            break;
+    }
+    mockLeave(s);
+    return status;
+}
+
+/// device clear: the instrument forgets its replies and the command it was receiving, and reads in progress end
+static ViStatus mockClear(ViSession vi)
+{
+    mockSession_t *s = mockEnter(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    ++(s->inst->nClears);
+    mockBusy(s->inst->writeTime);
+    s->input.clear();
+    s->head = 0;
+    s->messages.clear();
+    s->command.clear();
+    s->srqPending = s->rqs = false;
+    ++(s->clears);
+    mockWakeAll(s);
+    mockLeave(s);
+    return VI_SUCCESS;
+}
+
+/// discarding the read buffer throws away what has arrived, the rest of a reply still comes
+static ViStatus mockFlush(ViSession vi, ViUInt16 mask)
+{
+    mockSession_t *s = mockEnter(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    if (mask & (VI_READ_BUF | VI_READ_BUF_DISCARD | VI_IO_IN_BUF | VI_IO_IN_BUF_DISCARD))
+    {
+        double next;
+        s->head = mockArrived(s, mockNow(), &next);
+        mockRetire(s);
+    }
+    mockLeave(s);
+    return VI_SUCCESS;
+}
+
+static ViStatus mockSetBuf(ViSession vi, ViUInt16, ViUInt32)
+{
+    mockSession_t *s = mockEnter(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    mockLeave(s);
+    return VI_SUCCESS;
+}
+
+/// serial poll, MAV is set while a reply is arriving or unread and RQS until the poll after a service request
+static ViStatus mockReadSTB(ViSession vi, ViUInt16 *stb)
+{
+    mockSession_t *s = mockEnter(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    if (s->inst->intfType == VI_INTF_ASRL)
+    {
+        mockLeave(s);
+        return VI_ERROR_NSUP_OPER;
+    }
+    mockBusy(s->inst->writeTime);
+    double now = mockNow();
+    mockUpdateSrq(s, now);
+    *stb = (s->rqs ? MOCK_STB_RQS : 0);
+    if (!s->messages.empty() && now >= s->messages.front().start)
+    {
+        *stb |= MOCK_STB_MAV;
+    }
+    s->rqs = false;
+    mockLeave(s);
+    return VI_SUCCESS;
+}
+
+static ViStatus mockStatusDesc(ViSession, ViStatus status, ViChar *desc)
+{
+    static const struct { ViStatus status; const char* text; } descs[] = {
+        { VI_SUCCESS, "Operation completed successfully" },
+        { VI_SUCCESS_TERM_CHAR, "The specified termination character was read" },
+        { VI_SUCCESS_MAX_CNT, "The number of bytes read is equal to the input count" },
+        { VI_ERROR_TMO, "Timeout expired before operation completed" },
+        { VI_ERROR_ABORT, "The operation was aborted" },
+        { VI_ERROR_IO, "Simulated I/O error" },
+        { VI_ERROR_INV_OBJECT, "The given session reference is invalid" },
+        { VI_ERROR_RSRC_NFOUND, "No simulated instrument of this name" },
+        { VI_ERROR_ALLOC, "Insufficient system resources" },
+        { VI_ERROR_NSUP_ATTR, "The attribute is not supported by the simulated instrument" },
+        { VI_ERROR_NSUP_OPER, "The operation is not supported by the simulated instrument" },
+        { VI_ERROR_INV_EVENT, "The event type is not supported by the simulated instrument" },
+        { VI_ERROR_NENABLED, "The session is not enabled for this event" },
+        { VI_ERROR_INV_JOB_ID, "No posted operation has this job identifier" },
+    };
+    for (size_t i = 0; i < sizeof(descs) / sizeof(descs[0]); ++i)
+    {
+        if (descs[i].status == status)
+        {
+            epicsSnprintf(desc, 256, "%s", descs[i].text);
+            return VI_SUCCESS;
+        }
+    }
+    epicsSnprintf(desc, 256, "Unknown status 0x%08X", static_cast<unsigned>(status));
+    return VI_WARN_UNKNOWN_STATUS;
+}
+
+/// the queue flag for an event type, NULL if the session does not have it
+static bool* mockEventEnabled(mockSession_t *s, ViEventType eventType)
+{
+    switch(eventType)
+    {
+        case VI_EVENT_ASRL_CHAR:
+            return (s->inst->intfType == VI_INTF_ASRL ? &(s->charEnabled) : NULL);
+        case VI_EVENT_SERVICE_REQ:
+            return (s->inst->intfType != VI_INTF_ASRL ? &(s->srqEnabled) : NULL);
+        case VI_EVENT_IO_COMPLETION:
+            return &(s->ioEnabled);
+        default:
+            return NULL;
+    }
+}
+
+static ViStatus mockEnableEvent(ViSession vi, ViEventType eventType, ViUInt16 mechanism)
+{
+    mockSession_t *s = mockEnter(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    bool *enabled = mockEventEnabled(s, eventType);
+    ViStatus status = VI_SUCCESS;
+    if (enabled == NULL || mechanism != VI_QUEUE)
+    {
+        status = (enabled == NULL ? VI_ERROR_INV_EVENT : VI_ERROR_NSUP_OPER);
+    }
+    else
+    {
+        status = (*enabled ? VI_SUCCESS_EVENT_EN : VI_SUCCESS);
+        *enabled = true;
+    }
+    mockLeave(s);
+    return status;
+}
+
+static ViStatus mockDisableEvent(ViSession vi, ViEventType eventType, ViUInt16)
+{
+    mockSession_t *s = mockEnter(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    bool *enabled = mockEventEnabled(s, eventType);
+    ViStatus status = VI_ERROR_INV_EVENT;
+    if (enabled != NULL)
+    {
+        status = (*enabled ? VI_SUCCESS : VI_SUCCESS_EVENT_DIS);
+        *enabled = false;
+    }
+    mockLeave(s);
+    return status;
+}
+
+static ViStatus mockDiscardEvents(ViSession vi, ViEventType eventType, ViUInt16)
+{
+    mockSession_t *s = mockEnter(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    if (eventType == VI_EVENT_SERVICE_REQ)
+    {
+        s->srqEvent = false;
+    }
+    else if (eventType == VI_EVENT_IO_COMPLETION)
+    {
+        s->completions.clear();
+    }
+    ViStatus status = (mockEventEnabled(s, eventType) != NULL ? VI_SUCCESS : VI_ERROR_INV_EVENT);
+    mockLeave(s);
+    return status;
+}
+
+/// character events are not queued one per byte, one is waiting whenever unread data has arrived
+static ViStatus mockWaitOnEvent(ViSession vi, ViEventType eventType, ViUInt32 timeout, ViEventType *outEventType, ViEvent *outContext)
+{
+    mockSession_t *s = mockEnter(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    bool *enabled = mockEventEnabled(s, eventType);
+    if (enabled == NULL || !*enabled)
+    {
+        mockLeave(s);
+        return (enabled == NULL ? VI_ERROR_INV_EVENT : VI_ERROR_NENABLED);
+    }
+    double now = mockNow(), next = -1.0;
+    double deadline = (timeout == VI_TMO_INFINITE ? -1.0 : now + timeout / 1000.0);
+    mockEvent_t e;
+    e.inUse = true;
+    e.type = eventType;
+    e.id = VI_NULL;
+    e.status = VI_SUCCESS;
+    e.count = 0;
+    int waiter = (eventType == VI_EVENT_ASRL_CHAR ? MOCK_WAIT_CHAR : (eventType == VI_EVENT_SERVICE_REQ ? MOCK_WAIT_SRQ : MOCK_WAIT_IO));
+    ViStatus status = VI_SUCCESS;
+    while(true)
+    {
+        bool ready = false;
+        if (s->closing)
+        {
+            status = VI_ERROR_ABORT;
+            break;
+        }
+        if (eventType == VI_EVENT_ASRL_CHAR)
+        {
+            ready = (mockArrived(s, now, &next) > s->head);
+        }
+        else if (eventType == VI_EVENT_SERVICE_REQ)
+        {
+            mockUpdateSrq(s, now);
+            ready = s->srqEvent;
+            s->srqEvent = false;
+            next = (s->srqPending ? s->srqTime : -1.0);
+        }
+        else if (!s->completions.empty())
+        {
+            e = s->completions.front();
+            s->completions.pop_front();
+            ready = true;
+        }
+        if (ready)
+        {
+            break;
+        }
+        double delay = (next >= 0.0 ? next - now : -1.0);
+        if (deadline >= 0.0)
+        {
+            if (now >= deadline)
+            {
+                status = VI_ERROR_TMO;
+                break;
+            }
+            delay = (delay >= 0.0 && delay < deadline - now ? delay : deadline - now);
+        }
+        mockWait(s, waiter, delay);
+        now = mockNow();
+    }
+    if (status == VI_SUCCESS && outEventType != NULL)
+    {
+        *outEventType = eventType;
+    }
+    if (status == VI_SUCCESS && outContext != NULL)
+    {
+        int i = 0;
+        while(i < MOCK_MAX_EVENTS && mockEvents[i].inUse)
+        {
+            ++i;
+        }
+        if (i < MOCK_MAX_EVENTS)
+        {
+            mockEvents[i] = e;
+            *outContext = MOCK_EVENT_BASE + i;
+        }
+        else
+        {
+            status = VI_ERROR_ALLOC;
+        }
+    }
+    mockLeave(s);
+    return status;
+}
+
+/// a completed posted operation, queued if the session has I/O completion events enabled
+static void mockComplete(mockSession_t *s, ViJobId id, ViStatus status, ViUInt32 count)
+{
+    if (s->ioEnabled)
+    {
+        mockEvent_t e;
+        e.inUse = true;
+        e.type = VI_EVENT_IO_COMPLETION;
+        e.id = id;
+        e.status = status;
+        e.count = count;
+        s->completions.push_back(e);
+        mockWakeAll(s);
+    }
+}
+
+/// does the posted reads of a session one at a time
+static void mockAsyncThread(void *arg)
+{
+    mockSession_t *s = static_cast<mockSession_t*>(arg);
+    epicsMutexMustLock(mockLock);
+    while(!s->closing)
+    {
+        if (s->jobs.empty())
+        {
+            mockWait(s, MOCK_WAIT_ASYNC, -1.0);
+            continue;
+        }
+        mockJob_t *job = s->jobs.front();
+        ViUInt32 actual = 0;
+        ViStatus status = mockTransfer(s, job->buf, job->count, &actual, job->timeout, MOCK_WAIT_ASYNC, &(job->aborted));
+        if (!s->closing)
+        {
+            s->jobs.pop_front();
+            mockComplete(s, job->id, status, actual);
+            delete job;
+        }
+    }
+    s->asyncRunning = false;
+    --(s->users);
+    epicsMutexUnlock(mockLock);
+}
+
+static ViStatus mockReadAsync(ViSession vi, ViBuf buf, ViUInt32 count, ViJobId *jobId)
+{
+    mockSession_t *s = mockEnter(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    if (!s->asyncRunning)
+    {
+        char name[32];
+        epicsSnprintf(name, sizeof(name), "mockAsync%u", static_cast<unsigned>(vi));
+        ++(s->users);
+        s->asyncRunning = true;
+        epicsThreadMustCreate(name, epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackSmall),
+                              mockAsyncThread, s);
+    }
+    mockJob_t *job = new mockJob_t;
+    job->id = ++(s->lastJob);
+    job->buf = buf;
+    job->count = count;
+    job->timeout = s->timeout;
+    job->aborted = false;
+    s->jobs.push_back(job);
+    *jobId = job->id;
+    epicsEventSignal(s->wake[MOCK_WAIT_ASYNC]);
+    mockLeave(s);
+    return VI_SUCCESS;
+}
+
+/// the instrument accepts data as fast as it is sent, so a posted write is done before this returns
+static ViStatus mockWriteAsync(ViSession vi, ViBuf buf, ViUInt32 count, ViJobId *jobId)
+{
+    mockSession_t *s = mockEnter(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    ViUInt32 actual = 0;
+    *jobId = ++(s->lastJob);
+    ViStatus status = mockWriteData(s, buf, count, &actual);
+    mockComplete(s, *jobId, status, actual);
+    mockLeave(s);
+    return VI_SUCCESS;
+}
+
+/// abort a posted read, or with VI_NULL everything in progress on the session. An instrument with hang=2 ignores it.
+static ViStatus mockTerminate(ViSession vi, ViUInt16, ViJobId jobId)
+{
+    mockSession_t *s = mockEnter(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    ViStatus status = (jobId == VI_NULL ? VI_SUCCESS : VI_ERROR_INV_JOB_ID);
+    for(std::deque<mockJob_t*>::iterator it = s->jobs.begin(); it != s->jobs.end(); ++it)
+    {
+        if (jobId == VI_NULL || (*it)->id == jobId)
+        {
+            (*it)->aborted = (s->inst->hang < 2);
+            status = VI_SUCCESS;
+        }
+    }
+    if (jobId == VI_NULL && s->reading)
+    {
+        s->readAborted = (s->inst->hang < 2);
+    }
+    mockWakeAll(s);
+    mockLeave(s);
+    return status;
+}
+
+static const visaBackend_t mockBackend = {
+    "simulated instrument",
+    mockMatch,
+    mockOpen,
+    mockClose,
+    mockRead,
+    mockWrite,
+    mockSetAttribute,
+    mockGetAttribute,
+    mockClear,
+    mockFlush,
+    mockSetBuf,
+    mockReadSTB,
+    mockStatusDesc,
+    mockEnableEvent,
+    mockDisableEvent,
+    mockDiscardEvents,
+    mockWaitOnEvent,
+    mockReadAsync,
+    mockWriteAsync,
+    mockTerminate
+};
+
+const visaBackend_t *visaMockBackend = &mockBackend;
+
+/// match a VISA resource expression, of which only ? (any character) and * (any number of the one before) are supported
+static bool mockExprMatch(const char *expr, const char *name)
+{
+    if (*expr == '\0')
+    {
+        return (*name == '\0');
+    }
+    if (expr[1] == '*')
+    {
+        for(;; ++name)
+        {
+            if (mockExprMatch(expr + 2, name))
+            {
+                return true;
+            }
+            if (*name == '\0' || (*expr != '?' && toupper(*expr) != toupper(*name)))
+            {
+                return false;
+            }
+        }
+    }
+    return (*name != '\0' && (*expr == '?' || toupper(*expr) == toupper(*name)) && mockExprMatch(expr + 1, name + 1));
+}
+
+ViStatus visaMockFindRsrc(const char *expr, ViFindList *findList, ViUInt32 *retCount, ViChar *desc)
+{
+    epicsThreadOnce(&mockOnce, mockInit, NULL);
+    epicsMutexMustLock(mockLock);
+    int i = 0;
+    while(i < MOCK_MAX_FINDS && mockFindsUsed[i])
+    {
+        ++i;
+    }
+    if (i == MOCK_MAX_FINDS)
+    {
+        epicsMutexUnlock(mockLock);
+        return VI_ERROR_ALLOC;
+    }
+    mockFinds[i].clear();
+    for(std::map<std::string, mockInstrument_t*>::const_iterator it = mockInstruments.begin(); it != mockInstruments.end(); ++it)
+    {
+        std::string name = (strstr(it->first.c_str(), "::") != NULL ? it->first : "MOCK::" + it->first);
+        if (!it->second->offline && mockExprMatch(expr, name.c_str()))
+        {
+            mockFinds[i].push_back(name);
+        }
+    }
+    *retCount = static_cast<ViUInt32>(mockFinds[i].size());
+    if (mockFinds[i].empty())
+    {
+        epicsMutexUnlock(mockLock);
+        return VI_ERROR_RSRC_NFOUND;
+    }
+    mockFindsUsed[i] = true;
+    epicsSnprintf(desc, 256, "%s", mockFinds[i].front().c_str());
+    mockFinds[i].erase(mockFinds[i].begin());
+    *findList = MOCK_FIND_BASE + i;
+    epicsMutexUnlock(mockLock);
+    return VI_SUCCESS;
+}
+
+ViStatus visaMockFindNext(ViFindList findList, ViChar *desc)
+{
+    epicsThreadOnce(&mockOnce, mockInit, NULL);
+    epicsMutexMustLock(mockLock);
+    int i = static_cast<int>(findList) - MOCK_FIND_BASE;
+    ViStatus status = VI_ERROR_RSRC_NFOUND;
+    if (i < 0 || i >= MOCK_MAX_FINDS || !mockFindsUsed[i])
+    {
+        status = VI_ERROR_INV_OBJECT;
+    }
+    else if (!mockFinds[i].empty())
+    {
+        epicsSnprintf(desc, 256, "%s", mockFinds[i].front().c_str());
+        mockFinds[i].erase(mockFinds[i].begin());
+        status = VI_SUCCESS;
+    }
+    epicsMutexUnlock(mockLock);
+    return status;
+}
+
+/// interface type and the defaults that go with it
+static bool mockType(mockInstrument_t *inst, const char *type)
+{
+    static const struct { const char *type; ViUInt16 intf; const char *rsrcClass; bool hislip; bool sendEnd; const char *eos; } types[] = {
+        { "GPIB", VI_INTF_GPIB, "INSTR", false, true, "" },
+        { "ASRL", VI_INTF_ASRL, "INSTR", false, false, "\n" },
+        { "TCPIP", VI_INTF_TCPIP, "INSTR", false, true, "" },
+        { "HISLIP", VI_INTF_TCPIP, "INSTR", true, true, "" },
+        { "SOCKET", VI_INTF_TCPIP, "SOCKET", false, false, "\n" },
+        { "USB", VI_INTF_USB, "INSTR", false, true, "" },
+    };
+    for(size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i)
+    {
+        if (epicsStrCaseCmp(type, types[i].type) == 0)
+        {
+            inst->intfType = types[i].intf;
+            inst->rsrcClass = types[i].rsrcClass;
+            inst->hislip = types[i].hislip;
+            inst->sendEnd = types[i].sendEnd;
+            inst->eos = types[i].eos;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// apply space separated key=value options, times are in ms
+static bool mockOptions(mockInstrument_t *inst, const char *options)
+{
+    std::string opts = (options != NULL ? options : "");
+    size_t pos = 0;
+    while( (pos = opts.find_first_not_of(' ', pos)) != std::string::npos )
+    {
+        size_t end = opts.find(' ', pos);
+        std::string opt = opts.substr(pos, (end == std::string::npos ? std::string::npos : end - pos));
+        pos = end;
+        size_t eq = opt.find('=');
+        std::string key = opt.substr(0, eq);
+        const char *value = (eq != std::string::npos ? opt.c_str() + eq + 1 : "");
+        bool yes = (*value == 'Y' || *value == 'y' || *value == '1');
+        if (key == "latency")
+        {
+            inst->latency = atof(value) / 1000.0;
+        }
+        else if (key == "byte")
+        {
+            inst->byteTime = atof(value) / 1000.0;
+        }
+        else if (key == "write")
+        {
+            inst->writeTime = atof(value) / 1000.0;
+        }
+        else if (key == "open")
+        {
+            inst->openTime = atof(value) / 1000.0;
+        }
+        else if (key == "eos")
+        {
+            char eos[16];
+            int n = epicsStrnRawFromEscaped(eos, sizeof(eos), value, strlen(value));
+            inst->eos.assign(eos, n);
+        }
+        else if (key == "end")
+        {
+            inst->sendEnd = yes;
+        }
+        else if (key == "echo")
+        {
+            inst->echo = yes;
+        }
+        else if (key == "srq")
+        {
+            inst->srq = yes;
+        }
+        else if (key == "offline")
+        {
+            inst->offline = yes;
+        }
+        else if (key == "hang")
+        {
+            inst->hang = atoi(value);
+        }
+        else if (key == "errors")
+        {
+            inst->errors = atoi(value);
+        }
+        else
+        {
+            printf("drvAsynVISAMockInstrument: unknown option \"%s\"\n", opt.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Define a simulated instrument, or change the options of one already defined, e.g.
+///     drvAsynVISAMockInstrument("DMM", "GPIB", "latency=2 byte=0.01 write=0.1")
+///     drvAsynVISAMockReply("DMM", "*IDN?", "MOCK,DMM,0,1.0")
+///     drvAsynVISAPortConfigure("L0", "MOCK::DMM")
+/// The instrument replies after latency to each command it receives, a line feed ending a command or END when
+/// the interface has it. Options, with times in ms:
+///   - latency=ms  time from the end of a command to the first byte of its reply (0)
+///   - byte=ms     time per byte sent or received, 0.087 is 115200 baud serial (0)
+///   - write=ms    time taken by each write, device clear and serial poll (0)
+///   - open=ms     time taken by viOpen (0)
+///   - eos=chars   appended to every reply, escapes allowed (\\n for ASRL and SOCKET, none otherwise)
+///   - end=Y|N     END with the last byte of a reply (Y for GPIB, TCPIP, HISLIP and USB)
+///   - echo=Y|N    reply to a command not given to drvAsynVISAMockReply() with the command itself (N)
+///   - srq=Y|N     request service when a reply has arrived (N)
+///   - offline=Y|N viOpen fails, as if the instrument were switched off (N)
+///   - hang=0|1|2  reads ignore their timeout: 1 until viTerminate or viClear, 2 until viClear (0)
+///   - errors=n    the next n reads and writes fail with an I/O error (0)
+/// @param[in] name @copydoc drvAsynVISAMockInstrumentArg0
+/// @param[in] type @copydoc drvAsynVISAMockInstrumentArg1
+/// @param[in] options @copydoc drvAsynVISAMockInstrumentArg2
+static void drvAsynVISAMockInstrument(const char *name, const char *type, const char *options)
+{
+    if (name == NULL || *name == '\0')
+    {
+        printf("drvAsynVISAMockInstrument: name missing\n");
+        return;
+    }
+    epicsThreadOnce(&mockOnce, mockInit, NULL);
+    epicsMutexMustLock(mockLock);
+    mockInstrument_t *inst = mockFind(name);
+    bool created = (inst == NULL);
+    if (created)
+    {
+        inst = new mockInstrument_t;
+        inst->name = (epicsStrnCaseCmp(name, "MOCK::", 6) == 0 ? name + 6 : name);
+        mockType(inst, "GPIB");
+        inst->latency = inst->byteTime = inst->writeTime = inst->openTime = 0.0;
+        inst->echo = inst->srq = inst->offline = false;
+        inst->hang = inst->errors = 0;
+        inst->nOpens = inst->nWrites = inst->nCommands = inst->nReads = inst->nClears = 0;
+    }
+    if (type != NULL && *type != '\0' && !mockType(inst, type))
+    {
+        printf("drvAsynVISAMockInstrument: unknown type \"%s\", use GPIB, ASRL, TCPIP, HISLIP, SOCKET or USB\n", type);
+    }
+    else if (mockOptions(inst, options) && created)
+    {
+        mockInstruments[inst->name] = inst;
+        inst = NULL;
+    }
+    if (created && inst != NULL)
+    {
+        delete inst;
+    }
+    epicsMutexUnlock(mockLock);
+}
+
+/// Set the reply of a simulated instrument to a command, the reply {block:N} is an IEEE 488.2 definite length
+/// binary block of N bytes and {values:N} N comma separated numbers
+/// @param[in] name @copydoc drvAsynVISAMockReplyArg0
+/// @param[in] command @copydoc drvAsynVISAMockReplyArg1
+/// @param[in] reply @copydoc drvAsynVISAMockReplyArg2
+static void drvAsynVISAMockReply(const char *name, const char *command, const char *reply)
+{
+    if (name == NULL || command == NULL)
+    {
+        printf("drvAsynVISAMockReply: name and command needed\n");
+        return;
+    }
+    std::vector<char> cmd(strlen(command) + 1), rep(reply != NULL ? strlen(reply) + 1 : 1);
+    int ncmd = epicsStrnRawFromEscaped(&(cmd[0]), cmd.size(), command, strlen(command));
+    int nrep = (reply != NULL ? epicsStrnRawFromEscaped(&(rep[0]), rep.size(), reply, strlen(reply)) : 0);
+    epicsThreadOnce(&mockOnce, mockInit, NULL);
+    epicsMutexMustLock(mockLock);
+    mockInstrument_t *inst = mockFind(name);
+    if (inst == NULL)
+    {
+        printf("drvAsynVISAMockReply: no instrument \"%s\"\n", name);
+    }
+    else if (nrep > 0)
+    {
+        inst->replies[std::string(&(cmd[0]), ncmd)] = std::string(&(rep[0]), nrep);
+    }
+    else
+    {
+        inst->replies.erase(std::string(&(cmd[0]), ncmd));
+    }
+    epicsMutexUnlock(mockLock);
+}
+
+/// Print what simulated instruments have been asked to do
+/// @param[in] name @copydoc drvAsynVISAMockReportArg0
+static void drvAsynVISAMockReport(const char *name)
+{
+    epicsThreadOnce(&mockOnce, mockInit, NULL);
+    epicsMutexMustLock(mockLock);
+    for(std::map<std::string, mockInstrument_t*>::const_iterator it = mockInstruments.begin(); it != mockInstruments.end(); ++it)
+    {
+        const mockInstrument_t *inst = it->second;
+        if (name == NULL || *name == '\0' || inst->name == name)
+        {
+            printf("%s: opens %lu writes %lu commands %lu reads %lu clears %lu\n", inst->name.c_str(),
+                   inst->nOpens, inst->nWrites, inst->nCommands, inst->nReads, inst->nClears);
+        }
+    }
+    epicsMutexUnlock(mockLock);
+}
+
+/*
+ * IOC shell command registration
+ */
+
+/// instrument name, used as the resource name MOCK::name e.g. "DMM", or a VISA resource name e.g. "GPIB0::3::INSTR"
+static const iocshArg drvAsynVISAMockInstrumentArg0 = { "name", iocshArgString };
+/// interface: GPIB, ASRL, TCPIP (VXI-11), HISLIP, SOCKET or USB. Empty to leave it unchanged.
+static const iocshArg drvAsynVISAMockInstrumentArg1 = { "type", iocshArgString };
+/// space separated key=value options e.g. "latency=2 byte=0.087 echo=Y"
+static const iocshArg drvAsynVISAMockInstrumentArg2 = { "options", iocshArgString };
+
+static const iocshArg *drvAsynVISAMockInstrumentArgs[] = {
+    &drvAsynVISAMockInstrumentArg0, &drvAsynVISAMockInstrumentArg1, &drvAsynVISAMockInstrumentArg2
+};
+
+static const iocshFuncDef drvAsynVISAMockInstrumentFuncDef =
+                      {"drvAsynVISAMockInstrument", sizeof(drvAsynVISAMockInstrumentArgs)/sizeof(iocshArg*), drvAsynVISAMockInstrumentArgs};
+
+static void drvAsynVISAMockInstrumentCallFunc(const iocshArgBuf *args)
+{
+    drvAsynVISAMockInstrument(args[0].sval, args[1].sval, args[2].sval);
+}
+
+/// instrument name given to drvAsynVISAMockInstrument()
+static const iocshArg drvAsynVISAMockReplyArg0 = { "name", iocshArgString };
+/// command without its terminator, escape sequences allowed e.g. "*IDN?"
+static const iocshArg drvAsynVISAMockReplyArg1 = { "command", iocshArgString };
+/// reply without the instrument eos, escape sequences allowed. Empty to remove the command.
+static const iocshArg drvAsynVISAMockReplyArg2 = { "reply", iocshArgString };
+
+static const iocshArg *drvAsynVISAMockReplyArgs[] = {
+    &drvAsynVISAMockReplyArg0, &drvAsynVISAMockReplyArg1, &drvAsynVISAMockReplyArg2
+};
+
+static const iocshFuncDef drvAsynVISAMockReplyFuncDef =
+                      {"drvAsynVISAMockReply", sizeof(drvAsynVISAMockReplyArgs)/sizeof(iocshArg*), drvAsynVISAMockReplyArgs};
+
+static void drvAsynVISAMockReplyCallFunc(const iocshArgBuf *args)
+{
+    drvAsynVISAMockReply(args[0].sval, args[1].sval, args[2].sval);
+}
+
+/// instrument name, empty for all
+static const iocshArg drvAsynVISAMockReportArg0 = { "name", iocshArgString };
+
+static const iocshArg *drvAsynVISAMockReportArgs[] = { &drvAsynVISAMockReportArg0 };
+
+static const iocshFuncDef drvAsynVISAMockReportFuncDef =
+                      {"drvAsynVISAMockReport", sizeof(drvAsynVISAMockReportArgs)/sizeof(iocshArg*), drvAsynVISAMockReportArgs};
+
+static void drvAsynVISAMockReportCallFunc(const iocshArgBuf *args)
+{
+    drvAsynVISAMockReport(args[0].sval);
+}
+
+extern "C"
+{
+
+static void
+drvAsynVISAMockRegister(void)
+{
+    static int firstTime = 1;
+    if (firstTime) {
+        iocshRegister(&drvAsynVISAMockInstrumentFuncDef, drvAsynVISAMockInstrumentCallFunc);
+        iocshRegister(&drvAsynVISAMockReplyFuncDef, drvAsynVISAMockReplyCallFunc);
+        iocshRegister(&drvAsynVISAMockReportFuncDef, drvAsynVISAMockReportCallFunc);
+        firstTime = 0;
+    }
+}
+
+epicsExportRegistrar(drvAsynVISAMockRegister);
+
+}
@@ -0,0 +1,148 @@
+/// @file drvAsynVISAMockLib.cpp VISA library functions for a VISA_MOCK=YES build, where no VISA library is installed
+///
+/// Sessions are those of the simulated instrument backend, so a resource name reaches an instrument defined with
+/// drvAsynVISAMockInstrument() whichever backend the driver picks for it. There is no GPIB board, so the GPIB
+/// bus operations fail with VI_ERROR_NSUP_OPER as they would on a VISA library without GPIB support.
+
+#include <string.h>
+
+#include <visa.h>
+
+#include "drvAsynVISABackend.h"
+
+/// the session of the default resource manager, which is only used to open sessions and find resources
+#define MOCK_DEFAULT_RM 0x3000
+
+ViStatus _VI_FUNC viOpenDefaultRM(ViSession *vi)
+{
+    *vi = MOCK_DEFAULT_RM;
+    return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viOpen(ViSession sesn, ViConstRsrc name, ViAccessMode, ViUInt32, ViSession *vi)
+{
+    char resourceName[VI_FIND_BUFLEN];
+    if (sesn != MOCK_DEFAULT_RM)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    strncpy(resourceName, name, sizeof(resourceName));
+    resourceName[sizeof(resourceName)-1] = '\0';
+    return visaMockBackend->open(sesn, resourceName, vi);
+}
+
+ViStatus _VI_FUNC viClose(ViObject vi)
+{
+    return (vi == MOCK_DEFAULT_RM ? VI_SUCCESS : visaMockBackend->close(vi));
+}
+
+ViStatus _VI_FUNC viFindRsrc(ViSession sesn, ViConstString expr, ViFindList *findList, ViUInt32 *retCount, ViChar *desc)
+{
+    return (sesn == MOCK_DEFAULT_RM ? visaMockFindRsrc(expr, findList, retCount, desc) : VI_ERROR_INV_OBJECT);
+}
+
+ViStatus _VI_FUNC viFindNext(ViFindList findList, ViChar *desc)
+{
+    return visaMockFindNext(findList, desc);
+}
+
+ViStatus _VI_FUNC viSetAttribute(ViObject vi, ViAttr attrName, ViAttrState attrValue)
+{
+    return visaMockBackend->setAttribute(vi, attrName, attrValue);
+}
+
+ViStatus _VI_FUNC viGetAttribute(ViObject vi, ViAttr attrName, void *attrValue)
+{
+    return visaMockBackend->getAttribute(vi, attrName, attrValue);
+}
+
+ViStatus _VI_FUNC viStatusDesc(ViObject vi, ViStatus status, ViChar *desc)
+{
+    return visaMockBackend->statusDesc(vi, status, desc);
+}
+
+ViStatus _VI_FUNC viTerminate(ViObject vi, ViUInt16 degree, ViJobId jobId)
+{
+    return visaMockBackend->terminate(vi, degree, jobId);
+}
+
+ViStatus _VI_FUNC viEnableEvent(ViSession vi, ViEventType eventType, ViUInt16 mechanism, ViUInt32)
+{
+    return visaMockBackend->enableEvent(vi, eventType, mechanism);
+}
+
+ViStatus _VI_FUNC viDisableEvent(ViSession vi, ViEventType eventType, ViUInt16 mechanism)
+{
+    return visaMockBackend->disableEvent(vi, eventType, mechanism);
+}
+
+ViStatus _VI_FUNC viDiscardEvents(ViSession vi, ViEventType eventType, ViUInt16 mechanism)
+{
+    return visaMockBackend->discardEvents(vi, eventType, mechanism);
+}
+
+ViStatus _VI_FUNC viWaitOnEvent(ViSession vi, ViEventType inEventType, ViUInt32 timeout, ViEventType *outEventType, ViEvent *outContext)
+{
+    return visaMockBackend->waitOnEvent(vi, inEventType, timeout, outEventType, outContext);
+}
+
+ViStatus _VI_FUNC viRead(ViSession vi, ViBuf buf, ViUInt32 count, ViUInt32 *retCount)
+{
+    return visaMockBackend->read(vi, buf, count, retCount);
+}
+
+ViStatus _VI_FUNC viReadAsync(ViSession vi, ViBuf buf, ViUInt32 count, ViJobId *jobId)
+{
+    return visaMockBackend->readAsync(vi, buf, count, jobId);
+}
+
+ViStatus _VI_FUNC viWrite(ViSession vi, ViConstBuf buf, ViUInt32 count, ViUInt32 *retCount)
+{
+    return visaMockBackend->write(vi, const_cast<ViBuf>(buf), count, retCount);
+}
+
+ViStatus _VI_FUNC viWriteAsync(ViSession vi, ViConstBuf buf, ViUInt32 count, ViJobId *jobId)
+{
+    return visaMockBackend->writeAsync(vi, const_cast<ViBuf>(buf), count, jobId);
+}
+
+ViStatus _VI_FUNC viSetBuf(ViSession vi, ViUInt16 mask, ViUInt32 size)
+{
+    return visaMockBackend->setBuf(vi, mask, size);
+}
+
+ViStatus _VI_FUNC viFlush(ViSession vi, ViUInt16 mask)
+{
+    return visaMockBackend->flush(vi, mask);
+}
+
+ViStatus _VI_FUNC viClear(ViSession vi)
+{
+    return visaMockBackend->clear(vi);
+}
+
+ViStatus _VI_FUNC viReadSTB(ViSession vi, ViUInt16 *status)
+{
+    return visaMockBackend->readSTB(vi, status);
+}
+
+ViStatus _VI_FUNC viAssertTrigger(ViSession, ViUInt16)
+{
+    return VI_ERROR_NSUP_OPER;
+}
+
+ViStatus _VI_FUNC viGpibControlREN(ViSession, ViUInt16)
+{
+    return VI_ERROR_NSUP_OPER;
+}
+
+ViStatus _VI_FUNC viGpibCommand(ViSession, ViConstBuf, ViUInt32, ViUInt32 *retCnt)
+{
+    *retCnt = 0;
+    return VI_ERROR_NSUP_OPER;
+}
+
+ViStatus _VI_FUNC viGpibSendIFC(ViSession)
+{
+    return VI_ERROR_NSUP_OPER;
+}
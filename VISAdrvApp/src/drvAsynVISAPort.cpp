@@ -1,6 +1,7 @@
 /// @file drvAsynVISAPort.cpp ASYN driver for National Instruments VISA 
 
 #include <string.h>
+#include <math.h>
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,14 +12,25 @@
 #include <iocsh.h>
 #include <epicsAssert.h>
 #include <epicsExit.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsAtomic.h>
+#include <initHooks.h>
 #include <epicsStdio.h>
 #include <epicsString.h>
 #include <epicsThread.h>
 #include <epicsTime.h>
+#include <epicsTimer.h>
+#include <epicsTypes.h>
+#include <epicsEndian.h>
 #include <osiUnistd.h>
 
 #include <iostream>
 #include <string>
+#include <list>
+#include <vector>
+#include <map>
+#include <algorithm>
 
 #include <visa.h>
 
@@ -27,858 +39,5858 @@
 #include "asynOption.h"
 #include "asynInterposeCom.h"
 #include "asynInterposeEos.h"
+#include "asynDrvUser.h"
+#include "asynInt32.h"
+#include "asynUInt32Digital.h"
+#include "asynInt64.h"
+#include "asynFloat64.h"
+#include "asynInt8Array.h"
+#include "asynInt16Array.h"
+#include "asynInt32Array.h"
+#include "asynFloat32Array.h"
+#include "asynFloat64Array.h"
+#include "asynGpibDriver.h"
 
 #include <epicsExport.h>
 
 #include "drvAsynVISAPort.h"
+#include "drvAsynVISABackend.h"
 
-/// driver private data structure
+/// maximum number of VISA session attributes we keep a shadow copy of
+#define VISA_ATTR_CACHE_SIZE 16
+
+/// shadow copy of a VISA session attribute value
+typedef struct {
+    ViAttr             attr;   ///< VISA attribute
+    ViAttrState        value;  ///< last value set on or read from the session
+    bool               valid;  ///< is value current
+} visaAttrCache_t;
+
+/// number of buckets in a latency histogram. Bucket i counts latencies in the range [2^i, 2^(i+1)) microseconds,
+/// with bucket 0 also counting anything shorter and the last bucket anything longer 
+#define VISA_HIST_NBUCKETS 24
+
+/// log2 bucketed latency histogram
+typedef struct {
+    epicsUInt64        count;   ///< number of samples
+    double             sum;     ///< sum of samples (s)
+    double             max;     ///< largest sample (s)
+    epicsUInt64        bucket[VISA_HIST_NBUCKETS]; ///< sample counts
+} visaHist_t;
+
+/// number of recent transactions kept by the flight recorder of each port
+#define VISA_FLIGHT_ENTRIES 128
+
+/// number of payload bytes kept for each flight recorder transaction
+#define VISA_FLIGHT_PAYLOAD 32
+
+/// one transaction in the flight recorder. seq is 0 while the entry is being written, so a reader
+/// can tell if it was overwritten while being copied
+typedef struct {
+    size_t             seq;       ///< transaction number, starting at 1
+    epicsTimeStamp     start;     ///< time transaction started
+    double             duration;  ///< time (s) taken
+    epicsUInt32        nbytes;    ///< bytes transferred
+    ViStatus           viStatus;  ///< last VISA status of the transaction
+    epicsUInt8         write;     ///< 1 for a write, 0 for a read
+    epicsUInt8         status;    ///< asynStatus returned
+    epicsUInt8         eom;       ///< ASYN_EOM_ reason of a read
+    epicsUInt8         npayload;  ///< bytes of payload kept
+    char               payload[VISA_FLIGHT_PAYLOAD]; ///< start of the data transferred
+} visaFlightEntry_t;
+
+/// always on ring of recent transactions. Only the thread holding the port lock records, with no locks
+/// or allocation, and readers check each entry's sequence number rather than locking
+typedef struct {
+    visaFlightEntry_t  entry[VISA_FLIGHT_ENTRIES]; ///< ring of transactions
+    size_t             next;      ///< number of transactions recorded
+} visaFlight_t;
+
+/// single producer/single consumer ring buffer used by the serial read ahead thread.
+/// head and tail are running byte counts, only the producer changes head and only the consumer changes tail.
+typedef struct {
+    char              *buffer;    ///< ring data
+    size_t             size;      ///< size of buffer, a power of 2
+    size_t             head;      ///< total bytes written to ring
+    size_t             tail;      ///< total bytes read from ring
+} visaRing_t;
+
+/// number of recent reply gaps used to learn the adaptive stage 2 read timeout
+#define VISA_GAP_SAMPLES 64
+
+/// IEEE 488.2 status byte "message available" bit
+#define VISA_STB_MAV 0x10
+
+/// size of buffer used to read the pending response after a service request
+#define VISA_SRQ_READ_SIZE 4096
+
+/// size of the kept error message of a failed timed send of coalesced writes
+#define VISA_COALESCE_MESSAGE 256
+
+/// longest input or output terminator handled natively by the driver (asynOctetSetInputEos etc. with noProcessEos=1)
+#define VISA_EOS_MAX 8
+
+/// period (s) at which the deadline watchdog checks for overrun operations
+#define VISA_WATCHDOG_PERIOD 0.1
+
+/// time (s) an operation aborted with viTerminate has to return before it is aborted again
+#define VISA_WATCHDOG_GRACE 2.0
+
+/// number of bytes count attribute of an I/O completion event, VISA 5 and later may make VI_ATTR_RET_COUNT 64 bit
+#ifdef VI_ATTR_RET_COUNT_32
+#define VISA_ATTR_RET_COUNT VI_ATTR_RET_COUNT_32
+#else
+#define VISA_ATTR_RET_COUNT VI_ATTR_RET_COUNT
+#endif
+
+/// a VISA asynchronous read or write operation
+typedef struct {
+    ViJobId            id;      ///< VISA job id
+    bool               posted;  ///< operation has been started and its result not yet used
+    bool               done;    ///< VI_EVENT_IO_COMPLETION has been received
+    ViStatus           status;  ///< completion status
+    ViUInt32           count;   ///< bytes transferred
+} visaJob_t;
+
+/// element type of IEEE 488.2 definite length block data
+typedef enum {
+    visaBlockInt8,
+    visaBlockInt16,
+    visaBlockInt32,
+    visaBlockFloat32,
+    visaBlockFloat64,
+    visaBlockNum
+} visaBlockType_t;
+
+/// asynOption "blocktype" value and element size of each ::visaBlockType_t
+static const struct {
+    const char *name;
+    size_t size;
+} visaBlockTypeInfo[visaBlockNum] = {
+    { "int8",    sizeof(epicsInt8) },
+    { "int16",   sizeof(epicsInt16) },
+    { "int32",   sizeof(epicsInt32) },
+    { "float32", sizeof(epicsFloat32) },
+    { "float64", sizeof(epicsFloat64) }
+};
+
+/// longest reply kept by the response cache
+#define VISA_CACHE_MAX_REPLY 65536
+
+/// a reply held by the response cache
 typedef struct {
+    std::string        reply;     ///< bytes returned by the reads that followed the query
+    int                eom;       ///< ASYN_EOM_ reason of the last of those reads
+    epicsTimeStamp     time;      ///< when the reply was read from the device
+} visaCachedReply_t;
+
+/// replies to queries that do not change during a run, e.g. *IDN?, served from memory rather than
+/// the device for cacheTtl after being read (asynOptions "cachettl" and "cacheprefix")
+typedef struct {
+    std::vector<std::string> prefixes; ///< writes starting with one of these are cacheable queries
+    std::map<std::string, visaCachedReply_t> replies; ///< by the exact bytes written
+    std::string        query;     ///< cacheable query whose reply is being read from the device
+    std::string        captured;  ///< reply to query read so far
+    bool               capturing; ///< the reads are the reply to query
+    const visaCachedReply_t *serving; ///< reply being returned to the reads instead of the device's, or NULL
+    size_t             servingOffset; ///< next byte of serving to return
+} visaRespCache_t;
+
+struct visaDriver;
+
+/// sessions of a multi-device port by asyn address
+typedef std::map<int, struct visaDriver*> visaDeviceMap_t;
+
+/// driver private data structure. On a multi-device port there is one for the port and one for each
+/// asyn address used, see getDevice()
+typedef struct visaDriver {
     asynUser          *pasynUser; 
     char              *portName;  ///< asyn port name
-	ViSession 		   defaultRM;
+	ViSession 		   defaultRM;  ///< VISA resource manager session, shared by all ports (see acquireDefaultRM())
 	ViSession          vi;    ///< VISA session handle
+	const visaBackend_t *backend; ///< does the session operations on vi, see selectBackend()
 	bool               connected;  ///< are we currently connected 
     char              *resourceName; ///< VISA resource name session connected to 
-    unsigned long      nReadBytes;  ///< number of bytes read from this resource name
-    unsigned long      nWriteBytes; ///< number of bytes written to this resource
-    unsigned long      nReadCalls;  ///< number of read calls from this resource name
-    unsigned long      nWriteCalls; ///< number of written calls to this resource
+    epicsUInt64        nReadBytes;  ///< number of bytes read from this resource name
+    epicsUInt64        nWriteBytes; ///< number of bytes written to this resource
+    epicsUInt64        nReadCalls;  ///< number of read calls from this resource name
+    epicsUInt64        nWriteCalls; ///< number of written calls to this resource
+    epicsUInt64        nTimeouts;   ///< number of read/write calls that timed out
+    epicsUInt64        nErrors;     ///< number of read/write calls that failed
+    double             busyTime;    ///< total time (s) spent in read and write calls
+    visaHist_t         readHist;    ///< read call latency
+    visaHist_t         writeHist;   ///< write call latency
+    visaHist_t         firstByteHist; ///< time waiting for the first byte of a two stage read
+    visaHist_t         queryHist;     ///< round trip time of queries made through the asynVISAQuery interface
+    epicsTimeStamp     readStart;     ///< start time of current read call
+    double             firstByteWait; ///< time (s) first byte of current read arrived, or -1.0 
 	double 			   timeout;    ///< requested timeout for current operation
 	bool               isSerial;    ///< are we an RS232 style serial device?
 	bool               isGPIB;      ///< are we a GPIB device?
+	bool               isTCPIP;     ///< are we a LAN device (VXI-11, HiSLIP or raw socket)?
+	bool               isSocket;    ///< are we a TCPIP raw SOCKET resource?
+	bool               isHiSLIP;    ///< are we a TCPIP HiSLIP INSTR resource?
+	bool               tcpNoDelay;  ///< VI_ATTR_TCPIP_NODELAY on raw sockets, send small writes without waiting for Nagle's algorithm (asynOption "tcpnodelay")
+	bool               tcpKeepAlive; ///< VI_ATTR_TCPIP_KEEPALIVE on raw sockets, detect a dead connection while idle (asynOption "tcpkeepalive")
+	bool               tcpTermChar; ///< end reads on termCharIn on raw sockets, which have no END indicator (asynOption "tcptermchar")
+	bool               isUSB;       ///< are we a USB INSTR (USBTMC) device?
+	bool               usbEnd;      ///< treat END of a USBTMC transfer as end of message whatever deviceSendsEOM is (asynOption "usbend")
+	int                usbMaxIntrSize; ///< VI_ATTR_USB_MAX_INTR_SIZE, 0 for the VISA default (asynOption "usbmaxintrsize")
+	int                inBufSize;   ///< size of the VISA low level input buffer (viSetBuf VI_IO_IN_BUF), 0 for the VISA default (asynOption "inbufsize")
+	int                outBufSize;  ///< size of the VISA low level output buffer (viSetBuf VI_IO_OUT_BUF), 0 for the VISA default (asynOption "outbufsize")
 	bool               deviceSendsEOM; ///< @copydoc drvAsynVISAPortConfigureArg7
     int		   		   readIntTimeout; ///< @copydoc drvAsynVISAPortConfigureArg5
     ViUInt8            termCharIn;     ///< @copydoc drvAsynVISAPortConfigureArg6
+    ViUInt8            termCharConfigured; ///< termCharIn given to drvAsynVISAPortConfigure, used when no input EOS is set
+    char               inEos[VISA_EOS_MAX];  ///< native input terminator (asynOctet setInputEos)
+    int                inEosLen;             ///< number of bytes in inEos, 0 if none
+    char               outEos[VISA_EOS_MAX]; ///< native output terminator (asynOctet setOutputEos)
+    int                outEosLen;            ///< number of bytes in outEos, 0 if none
+    char              *eosLeftBuffer;        ///< bytes read after an input terminator, kept for the next read
+    size_t             eosLeftSize;          ///< allocated size of eosLeftBuffer
+    size_t             eosLeftOffset;        ///< offset of first unconsumed byte in eosLeftBuffer
+    size_t             eosLeftLength;        ///< end of valid data in eosLeftBuffer
+    char              *eosOutBuffer;         ///< message plus output terminator, so both go in one write
+    size_t             eosOutSize;           ///< allocated size of eosOutBuffer
 	bool 			   flush_on_write; ///< use viFlush to flush output buffer every write
+    bool               backgroundConnect; ///< initial connection made by the background connect pool rather than asyn auto connect
+    int                connectAttempts;   ///< number of background connect attempts made
+    double             connectBackoff;    ///< current delay (s) between background connect attempts
+    double             connectTime;       ///< time (s) from configure to connected by background pool, -1.0 if not yet
+    double             lastConnectDuration; ///< time (s) taken by last background connect attempt
+    epicsTimeStamp     configureTime;     ///< time port was configured
+    epicsTimeStamp     nextConnectAttempt; ///< earliest time for next background connect attempt
+    int                ioRetries;         ///< times a failed VISA read or write is repeated before recovering the session (asynOption "ioretries")
+    bool               recoverClear;      ///< try viClear on the open session before closing it after an I/O error (asynOption "recoverclear")
+    int                reopenMaxBackoff;  ///< longest delay (ms) between attempts to reopen a session closed after an error (asynOption "reopenmaxbackoff")
+    bool               reopenPending;     ///< session was closed after an error and has not yet been reopened
+    double             reopenBackoff;     ///< current delay (s) between reopen attempts, 0 before the first has failed
+    epicsTimeStamp     nextReopen;        ///< earliest time connectIt() will try to reopen the session
+    epicsUInt64        nRecoverRetries;   ///< VISA reads and writes repeated after an error
+    epicsUInt64        nRecoverClears;    ///< I/O errors recovered by viClear on the open session
+    epicsUInt64        nRecoverReopens;   ///< sessions reopened after being closed by an error
+    bool               inputStale;        ///< the last read stopped before the end of a reply, so the rest may still arrive
+    int                drainTmo;          ///< timeout (ms) of each read discarding the rest of a partly read reply (asynOption "draintmo")
+    int                drainMax;          ///< most bytes read when discarding stale input (asynOption "drainmax")
+    epicsUInt64        nDiscards;         ///< discards of pending input that found some
+    epicsUInt64        nDiscardBytes;     ///< bytes of pending input discarded
+    int                hardDeadline;      ///< longest (ms) an operation may run past its timeouts before the watchdog aborts it, also the VISA timeout for an asyn timeout of 0; 0 for no limit (asynOption "deadline")
+    epicsMutexId       opLock;            ///< protects opName, opDeadline, opStage and aborting the operation from another thread
+    int                opDepth;           ///< nesting of opBegin() calls
+    const char        *opName;            ///< operation in progress on the port thread, NULL if none
+    epicsTimeStamp     opDeadline;        ///< time by which opName should have returned
+    int                opStage;           ///< 0 within its deadline, 1 aborted with viTerminate so its session is to be closed
+    int                abortsPending;     ///< aborts taken by takeAbort() not yet carried out by runAbort()
+    epicsUInt64        nDeadlineOverruns; ///< operations that ran past their deadline
+    epicsUInt64        nAbortsIgnored;    ///< aborted operations that had not returned VISA_WATCHDOG_GRACE later
+    bool               intfKnown;         ///< intfType and intfName have been read from a session
+    ViUInt16           intfType;          ///< VI_ATTR_INTF_TYPE, which does not change between sessions to a resource
+    char               intfName[256];     ///< VI_ATTR_INTF_INST_NAME
+    char               rsrcClass[256];    ///< VI_ATTR_RSRC_CLASS e.g. INSTR or SOCKET
+    bool               intfHiSLIP;        ///< VI_ATTR_TCPIP_IS_HISLIP
+    bool               readAvail;         ///< use readAvail() read strategy on serial devices (asynOption "readstrategy")
+    bool               adaptiveTmo;       ///< learn stage 2 read timeout rather than using readIntTimeout (asynOption "adaptivetmo")
+    int                adaptiveMin;       ///< lower bound (ms) of learned timeout (asynOption "adaptivemin")
+    int                adaptiveMax;       ///< upper bound (ms) of learned timeout (asynOption "adaptivemax")
+    int                learnedTmo;        ///< current learned stage 2 timeout (ms), -1 until enough samples (asynOption "learnedtmo")
+    double             gapSamples[VISA_GAP_SAMPLES]; ///< recent times (s) from first byte to end of a reply
+    int                nGapSamples;       ///< number of valid entries in gapSamples
+    int                gapIndex;          ///< next entry of gapSamples to overwrite
+    bool               readAhead;         ///< serial read ahead mode requested (asynOption "readahead")
+    bool               readAheadRunning;  ///< read ahead thread is active for this session
+    bool               readAheadStuck;    ///< a read ahead thread did not exit when stopped, so none is started until it has
+    int                readAheadStop;     ///< set to ask read ahead thread to exit
+    ViStatus           readAheadStatus;   ///< VISA error that stopped read ahead thread
+    size_t             readAheadSize;     ///< requested ring size (asynOption "readaheadsize")
+    size_t             readAheadHigh;     ///< most bytes ever waiting in ring (asynOption "readaheadhigh")
+    epicsUInt64        readAheadVISAReads; ///< number of viRead calls made by read ahead thread
+    visaRing_t         ring;              ///< read ahead data
+    epicsEventId       readAheadDataEvent;  ///< signalled when data is added to ring
+    epicsEventId       readAheadSpaceEvent; ///< signalled when data is removed from ring
+    epicsEventId       readAheadExitEvent;  ///< signalled when read ahead thread exits
+    bool               srq;               ///< deliver service requests to I/O Intr records (asynOption "srq")
+    bool               srqRead;           ///< read the pending response on a service request with MAV set (asynOption "srqread")
+    bool               srqRunning;        ///< service request thread is active for this session
+    int                srqStop;           ///< set to ask service request thread to exit
+    int                srqQueued;         ///< a serial poll is queued on the port thread
+    ViStatus           srqStatus;         ///< VISA error that stopped service request thread
+    ViUInt16           srqStb;            ///< status byte from last serial poll
+    epicsUInt64        nSrq;              ///< number of serial polls made after a service request
+    epicsUInt64        nSrqReads;         ///< number of responses read after a service request
+    char              *srqReadBuffer;     ///< VISA_SRQ_READ_SIZE bytes for srqRead
+    asynUser          *srqUser;           ///< queued on the port thread to serial poll after a service request
+    epicsEventId       srqExitEvent;      ///< signalled when service request thread exits
+    void              *int32InterruptPvt;  ///< asynInt32 interrupt source
+    void              *uint32DigitalInterruptPvt; ///< asynUInt32Digital interrupt source
+    bool               asyncIO;           ///< post the reply read before each write (asynOption "asyncio")
+    bool               asyncRunning;      ///< I/O completion events are enabled for this session
+    size_t             asyncSize;         ///< size of the posted read (asynOption "asyncsize")
+    char              *asyncBuffer;       ///< data for the posted read
+    size_t             asyncBufferSize;   ///< allocated size of asyncBuffer
+    size_t             asyncOffset;       ///< next unread byte of asyncBuffer
+    size_t             asyncLength;       ///< number of valid bytes in asyncBuffer
+    ViStatus           asyncEndStatus;    ///< how the read that filled asyncBuffer ended
+    visaJob_t          readJob;           ///< read posted by the last write
+    visaJob_t          writeJob;          ///< write in progress
+    epicsUInt64        nAsyncReads;       ///< posted reads collected by readIt
+    epicsUInt64        nAsyncReady;       ///< posted reads that had already completed when readIt was called
+    bool               coalesce;          ///< buffer small writes and send them as one VISA write (asynOption "coalesce")
+    size_t             coalesceSize;      ///< send buffered writes when this many bytes are waiting (asynOption "coalescesize")
+    int                coalesceAge;       ///< send buffered writes this long (ms) after the first, 0 to wait for a read or flush (asynOption "coalesceage")
+    char              *coalesceBuffer;    ///< buffered write data
+    size_t             coalesceBufferSize; ///< allocated size of coalesceBuffer
+    size_t             coalesceLength;    ///< number of bytes in coalesceBuffer
+    double             coalesceTimeout;   ///< timeout of the most recent buffered write
+    int                coalesceQueued;    ///< coalesceUser is queued on the port thread
+    epicsTimerId       coalesceTimer;     ///< runs coalesceAge after the first buffered write
+    asynUser          *coalesceUser;      ///< queued on the port thread by coalesceTimer
+    epicsUInt64        nCoalescedWrites;  ///< asyn writes added to coalesceBuffer
+    epicsUInt64        nCoalesceTransfers; ///< VISA writes made to send coalesceBuffer
+    epicsUInt64        nCoalesceErrors;   ///< sends of coalesceBuffer by coalesceTimer that failed
+    asynStatus         coalesceStatus;    ///< failure of a send by coalesceTimer not yet returned to a read, query or flush
+    char               coalesceMessage[VISA_COALESCE_MESSAGE]; ///< error message of that failure
+    visaBlockType_t    blockType;         ///< element type of binary block data (asynOption "blocktype")
+    bool               blockBigEndian;    ///< binary block data is big endian (asynOption "blockendian")
+    char               blockEos[8];       ///< appended to block queries (asynOption "blockeos")
+    size_t             blockEosLen;       ///< number of bytes in blockEos
+    char              *blockScratch;      ///< block data that must be converted to a smaller element type
+    size_t             blockScratchSize;  ///< allocated size of blockScratch
+    epicsUInt64        nBlockReads;       ///< number of binary blocks read
+    epicsUInt64        nBlockBytes;       ///< number of bytes of binary block data read
+    visaFlight_t       flight;            ///< recent transactions, see drvAsynVISAFlightDump()
+    bool               flightDump;        ///< dump flight recorder when the session is closed after an error (asynOption "flightdump")
+    bool               flightDumpPending; ///< session closed after an error, dump once the failed transaction is recorded
+    ViStatus           lastViStatus;      ///< VISA status of the last read or write, for the flight recorder
+    bool               gpibReaddr;        ///< VI_ATTR_GPIB_READDR_EN, address the device before every read and write (asynOption "readdr")
+    bool               gpibUnaddr;        ///< VI_ATTR_GPIB_UNADDR_EN, unaddress the device after every read and write (asynOption "unaddr")
+    ViSession          gpibIntfc;         ///< GPIB interface session for bus commands, opened when first needed
+    int                addr;              ///< asyn address of a device on a multi-device port, -1 otherwise
+    int                gpibBoard;         ///< board number of a multi-device port
+    visaDeviceMap_t   *devices;           ///< devices of a multi-device port, NULL for a single device port
+    epicsMutexId       devicesLock;       ///< protects devices
+    visaAttrCache_t    attrCache[VISA_ATTR_CACHE_SIZE]; ///< shadow of session attributes, avoids VISA calls (network round trips for remote resources) when unchanged
+    int                nAttrCache;      ///< number of entries used in attrCache
+    int                cacheTtl;          ///< time (ms) a cached reply is used for, 0 disables the response cache (asynOption "cachettl")
+    visaRespCache_t   *respCache;         ///< response cache state
+    epicsUInt64        nCacheHits;        ///< cacheable queries answered from the response cache
+    epicsUInt64        nCacheMisses;      ///< cacheable queries sent to the device
+    epicsUInt64        nCacheInvalidations; ///< times the response cache was emptied by a write that was not a cacheable query
+    epicsUInt64        nAttrCallsSaved; ///< number of viSetAttribute/viGetAttribute calls avoided by attrCache
     asynInterface      common;
     asynInterface      option;
     asynInterface      octet;
+    asynInterface      drvUser;
+    asynInterface      int32;
+    asynInterface      uint32Digital;
+    asynInterface      int64;
+    asynInterface      float64;
+    asynInterface      int32Array;
+    asynInterface      int8Array;
+    asynInterface      int16Array;
+    asynInterface      float32Array;
+    asynInterface      float64Array;
+    asynInterface      gpib;
+    asynInterface      query;
 } visaDriver_t;
 
-/// translate VISA error code to readable string 
-static std::string errMsg(ViSession vi, ViStatus err)
+/// asyn parameters published by the driver for statistics, pasynUser->reason is set to one of these by drvUser
+typedef enum {
+    visaParamReadBytes,
+    visaParamWriteBytes,
+    visaParamReadCalls,
+    visaParamWriteCalls,
+    visaParamTimeouts,
+    visaParamErrors,
+    visaParamAttrCallsSaved,
+    visaParamBusyTime,
+    visaParamReadLatMean,
+    visaParamReadLatP50,
+    visaParamReadLatP99,
+    visaParamReadLatMax,
+    visaParamWriteLatMean,
+    visaParamWriteLatP50,
+    visaParamWriteLatP99,
+    visaParamWriteLatMax,
+    visaParamFirstByteP50,
+    visaParamFirstByteP99,
+    visaParamReadLatHist,
+    visaParamWriteLatHist,
+    visaParamFirstByteHist,
+    visaParamSrqStb,
+    visaParamSrqStbBits,
+    visaParamSrqCount,
+    visaParamWritesSaved,
+    visaParamBlock,
+    visaParamStb,
+    visaParamCacheHits,
+    visaParamCacheMisses,
+    visaParamRecoverRetries,
+    visaParamRecoverClears,
+    visaParamRecoverReopens,
+    visaParamDiscardBytes,
+    visaParamDeadlineOverruns,
+    visaParamNum
+} visaParam_t;
+
+/// drvInfo string and asyn interface type of each ::visaParam_t
+static const struct {
+    const char *name;
+    const char *type;
+} visaParamInfo[visaParamNum] = {
+    { "READ_BYTES",       asynInt64Type },
+    { "WRITE_BYTES",      asynInt64Type },
+    { "READ_CALLS",       asynInt64Type },
+    { "WRITE_CALLS",      asynInt64Type },
+    { "TIMEOUTS",         asynInt64Type },
+    { "ERRORS",           asynInt64Type },
+    { "ATTR_CALLS_SAVED", asynInt64Type },
+    { "BUSY_TIME",        asynFloat64Type },
+    { "READ_LAT_MEAN",    asynFloat64Type },
+    { "READ_LAT_P50",     asynFloat64Type },
+    { "READ_LAT_P99",     asynFloat64Type },
+    { "READ_LAT_MAX",     asynFloat64Type },
+    { "WRITE_LAT_MEAN",   asynFloat64Type },
+    { "WRITE_LAT_P50",    asynFloat64Type },
+    { "WRITE_LAT_P99",    asynFloat64Type },
+    { "WRITE_LAT_MAX",    asynFloat64Type },
+    { "FIRST_BYTE_P50",   asynFloat64Type },
+    { "FIRST_BYTE_P99",   asynFloat64Type },
+    { "READ_LAT_HIST",    asynInt32ArrayType },
+    { "WRITE_LAT_HIST",   asynInt32ArrayType },
+    { "FIRST_BYTE_HIST",  asynInt32ArrayType },
+    { "SRQ_STB",          asynInt32Type },
+    { "SRQ_STB_BITS",     asynUInt32DigitalType },
+    { "SRQ_COUNT",        asynInt64Type },
+    { "WRITES_SAVED",     asynInt64Type },
+    { "BLOCK",            asynFloat64ArrayType },
+    { "STB",              asynInt32Type },
+    { "CACHE_HITS",       asynInt64Type },
+    { "CACHE_MISSES",     asynInt64Type },
+    { "RECOVER_RETRIES",  asynInt64Type },
+    { "RECOVER_CLEARS",   asynInt64Type },
+    { "RECOVER_REOPENS",  asynInt64Type },
+    { "DISCARD_BYTES",    asynInt64Type },
+    { "DEADLINE_OVERRUNS", asynInt64Type }
+};
+
+/// VISA default resource manager session shared by all ports, opening one per port is slow
+/// and each holds its own resources in the VISA library
+static ViSession sharedDefaultRM = VI_NULL;
+/// number of ports currently using sharedDefaultRM
+static int sharedDefaultRMRefCount = 0;
+/// protects sharedDefaultRM and sharedDefaultRMRefCount
+static epicsMutexId sharedDefaultRMLock = NULL;
+
+/// timer queue for the write coalescing age limit, shared by all ports
+static epicsTimerQueueId coalesceTimerQueue = NULL;
+
+/// get the shared VISA resource manager session, opening it if this is the first user
+static ViStatus acquireDefaultRM(ViSession* rm)
+{
+    ViStatus err = VI_SUCCESS;
+    epicsMutexMustLock(sharedDefaultRMLock);
+    if (sharedDefaultRMRefCount == 0)
+    {
+        epicsTimeStamp epicsTS1, epicsTS2;
+        epicsTimeGetCurrent(&epicsTS1);
+        err = viOpenDefaultRM(&sharedDefaultRM);
+        epicsTimeGetCurrent(&epicsTS2);
+        if (err == VI_SUCCESS)
+        {
+            printf("drvAsynVISAPortConfigure: opened VISA resource manager in %f seconds\n", epicsTimeDiffInSeconds(&epicsTS2, &epicsTS1));
+        }
+    }
+    if (err == VI_SUCCESS)
+    {
+        ++sharedDefaultRMRefCount;
+        *rm = sharedDefaultRM;
+    }
+    epicsMutexUnlock(sharedDefaultRMLock);
+    return err;
+}
+
+/// release our use of the shared VISA resource manager session, it is closed when the last port releases it
+static void releaseDefaultRM(ViSession* rm)
+{
+    if (*rm == VI_NULL)
+    {
+        return;
+    }
+    epicsMutexMustLock(sharedDefaultRMLock);
+    if (--sharedDefaultRMRefCount == 0)
+    {
+        viClose(sharedDefaultRM); // this will automatically close any remaining sessions
+        sharedDefaultRM = VI_NULL;
+    }
+    epicsMutexUnlock(sharedDefaultRMLock);
+    *rm = VI_NULL;
+}
+
+static asynStatus closeConnection(asynUser *pasynUser, visaDriver_t *driver, const char* reason);
+static void flightDump(visaDriver_t* driver, FILE* fp, int count);
+static visaDriver_t *getDevice(visaDriver_t *driver, asynUser *pasynUser);
+static asynStatus coalesceFlush(visaDriver_t *driver, asynUser *pasynUser);
+static void cacheClear(visaDriver_t *driver);
+static asynStatus setTermCharAttrs(visaDriver_t *driver, asynUser *pasynUser);
+static asynStatus setTcpipAttrs(visaDriver_t *driver, asynUser *pasynUser);
+static asynStatus setBufferAttrs(visaDriver_t *driver, asynUser *pasynUser);
+
+/// translate VISA error code to readable string, using the port's backend
+static std::string errMsg(visaDriver_t *driver, ViStatus err)
 {
     char err_msg[1024]={0};
-    viStatusDesc (vi, err, err_msg);
+    driver->backend->statusDesc((driver->vi != VI_NULL ? driver->vi : driver->defaultRM), err, err_msg);
     return std::string(err_msg);
 }
 
-#define VI_CHECK_ERROR(__command, __err) \
-    if (__err < 0) \
-    { \
-        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize, \
-                              "%s: %s %s", driver->resourceName, __command, errMsg(driver->vi, err).c_str()); \
-        return asynError; \
+static ViStatus visaLibOpen(ViSession rm, char *resourceName, ViSession *vi)
+{
+    return viOpen(rm, resourceName, VI_NULL, VI_NULL, vi);
+}
+
+static ViStatus visaLibClose(ViSession vi)
+{
+    return viClose(vi);
+}
+
+static ViStatus visaLibRead(ViSession vi, ViBuf buf, ViUInt32 count, ViUInt32 *retCount)
+{
+    return viRead(vi, buf, count, retCount);
+}
+
+static ViStatus visaLibWrite(ViSession vi, ViBuf buf, ViUInt32 count, ViUInt32 *retCount)
+{
+    return viWrite(vi, buf, count, retCount);
+}
+
+static ViStatus visaLibSetAttribute(ViSession vi, ViAttr attr, ViAttrState value)
+{
+    return viSetAttribute(vi, attr, value);
+}
+
+static ViStatus visaLibGetAttribute(ViSession vi, ViAttr attr, void *value)
+{
+    return viGetAttribute(vi, attr, value);
+}
+
+static ViStatus visaLibClear(ViSession vi)
+{
+    return viClear(vi);
+}
+
+static ViStatus visaLibFlush(ViSession vi, ViUInt16 mask)
+{
+    return viFlush(vi, mask);
+}
+
+static ViStatus visaLibSetBuf(ViSession vi, ViUInt16 mask, ViUInt32 size)
+{
+    return viSetBuf(vi, mask, size);
+}
+
+static ViStatus visaLibReadSTB(ViSession vi, ViUInt16 *stb)
+{
+    return viReadSTB(vi, stb);
+}
+
+static ViStatus visaLibStatusDesc(ViSession vi, ViStatus status, ViChar *desc)
+{
+    return viStatusDesc(vi, status, desc);
+}
+
+static ViStatus visaLibEnableEvent(ViSession vi, ViEventType eventType, ViUInt16 mechanism)
+{
+    return viEnableEvent(vi, eventType, mechanism, VI_NULL);
+}
+
+static ViStatus visaLibDisableEvent(ViSession vi, ViEventType eventType, ViUInt16 mechanism)
+{
+    return viDisableEvent(vi, eventType, mechanism);
+}
+
+static ViStatus visaLibDiscardEvents(ViSession vi, ViEventType eventType, ViUInt16 mechanism)
+{
+    return viDiscardEvents(vi, eventType, mechanism);
+}
+
+static ViStatus visaLibWaitOnEvent(ViSession vi, ViEventType eventType, ViUInt32 timeout, ViEventType *outEventType, ViEvent *outContext)
+{
+    return viWaitOnEvent(vi, eventType, timeout, outEventType, outContext);
+}
+
+static ViStatus visaLibReadAsync(ViSession vi, ViBuf buf, ViUInt32 count, ViJobId *jobId)
+{
+    return viReadAsync(vi, buf, count, jobId);
+}
+
+static ViStatus visaLibWriteAsync(ViSession vi, ViBuf buf, ViUInt32 count, ViJobId *jobId)
+{
+    return viWriteAsync(vi, buf, count, jobId);
+}
+
+static ViStatus visaLibTerminate(ViSession vi, ViUInt16 degree, ViJobId jobId)
+{
+    return viTerminate(vi, degree, jobId);
+}
+
+static bool visaLibMatch(const char *)
+{
+    return true;
+}
+
+/// the VISA library, used for every resource no other backend claims
+static const visaBackend_t visaLibBackend = {
+    "VISA",
+    visaLibMatch,
+    visaLibOpen,
+    visaLibClose,
+    visaLibRead,
+    visaLibWrite,
+    visaLibSetAttribute,
+    visaLibGetAttribute,
+    visaLibClear,
+    visaLibFlush,
+    visaLibSetBuf,
+    visaLibReadSTB,
+    visaLibStatusDesc,
+    visaLibEnableEvent,
+    visaLibDisableEvent,
+    visaLibDiscardEvents,
+    visaLibWaitOnEvent,
+    visaLibReadAsync,
+    visaLibWriteAsync,
+    visaLibTerminate
+};
+
+/// choose the backend for a resource: a simulated instrument for MOCK::name or a name given to
+/// drvAsynVISAMockInstrument(), a tty device path e.g. /dev/ttyUSB0 is opened natively with termios,
+/// anything else (including ASRL/dev/ttyUSB0::INSTR) goes through VISA
+static const visaBackend_t* selectBackend(const char *resourceName)
+{
+    if (visaMockBackend->match(resourceName))
+    {
+        return visaMockBackend;
     }
+    if (visaTermiosBackend != NULL && visaTermiosBackend->match(resourceName))
+    {
+        return visaTermiosBackend;
+    }
+    return &visaLibBackend;
+}
 
-///
-/// asynOption interface - get options
-///
-static asynStatus
-getOption(void *drvPvt, asynUser *pasynUser,
-                              const char *key, char *val, int valSize)
+/// GPIB bus operations and the resource manager need a session of the VISA library itself
+static bool usesVISA(visaDriver_t *driver)
 {
-    visaDriver_t *driver = (visaDriver_t*)drvPvt;
-    assert(driver);
-	if (!driver->connected)
-	{
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                          "%s disconnected:", driver->resourceName);
-            return asynError;
-	}
-	if (!driver->isSerial)
-	{
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                          "%s getOption - not a serial device", driver->resourceName);
-            return asynError;
-	}
-	ViUInt32 viu32;
-	ViUInt16 viu16, flow;
-	int l = -1;
-	ViStatus err = viGetAttribute(driver->vi, VI_ATTR_ASRL_FLOW_CNTRL, &flow);
-	VI_CHECK_ERROR(key, err);
-    if (epicsStrCaseCmp(key, "baud") == 0) {
-		if ( (err = viGetAttribute(driver->vi, VI_ATTR_ASRL_BAUD, &viu32)) == VI_SUCCESS ) {
-            l = epicsSnprintf(val, valSize, "%u", (unsigned)viu32);		
-		}
+    return driver->backend == &visaLibBackend;
+}
+
+/// does the backend of the port have events and asynchronous I/O
+static bool hasEvents(visaDriver_t *driver)
+{
+    return driver->backend->waitOnEvent != NULL;
+}
+
+/// the VISA timeout (ms) for an asyn timeout (s). A timeout of 0 waits for ever in asyn, here it is limited
+/// to the hard deadline so a device that never answers does not hold the port thread for ever
+static int visaTimeout(visaDriver_t *driver, double timeout)
+{
+    if (timeout != 0)
+    {
+        return static_cast<int>(timeout * 1000.0);
     }
-    else if (epicsStrCaseCmp(key, "bits") == 0) {
-		if ( (err = viGetAttribute(driver->vi, VI_ATTR_ASRL_DATA_BITS, &viu16)) == VI_SUCCESS ) {
-            l = epicsSnprintf(val, valSize, "%u", (unsigned)viu16);		
-		}
+    return (driver->hardDeadline > 0 ? driver->hardDeadline : static_cast<int>(VI_TMO_INFINITE));
+}
+
+/// note the start of an operation on the port thread for the deadline watchdog. Each attempt may take timeout,
+/// or the hard deadline for a timeout of 0, and the operation is overrun hardDeadline ms after all of them.
+/// Nested calls, e.g. a coalesced write sent by a read, keep the deadline of the outermost.
+static void opBegin(visaDriver_t *driver, const char *name, double timeout)
+{
+    double attempt = (timeout > 0.0 ? timeout : driver->hardDeadline / 1000.0);
+    epicsMutexMustLock(driver->opLock);
+    if (driver->opDepth++ == 0)
+    {
+        epicsTimeGetCurrent(&(driver->opDeadline));
+        epicsTimeAddSeconds(&(driver->opDeadline), attempt * (1 + driver->ioRetries) + driver->hardDeadline / 1000.0);
+        driver->opName = name;
+        epicsAtomicSetIntT(&(driver->opStage), 0);
     }
-    else if (epicsStrCaseCmp(key, "parity") == 0) {
-		if ( (err = viGetAttribute(driver->vi, VI_ATTR_ASRL_PARITY, &viu16)) == VI_SUCCESS ) {
-            switch (viu16) {
-                case VI_ASRL_PAR_NONE:
-                    l = epicsSnprintf(val, valSize, "none");
-                    break;
-                case VI_ASRL_PAR_ODD:
-                    l = epicsSnprintf(val, valSize, "odd");
-                    break;
-                case VI_ASRL_PAR_EVEN:
-                    l = epicsSnprintf(val, valSize, "even");
-                    break;
-                case VI_ASRL_PAR_MARK:
-                    l = epicsSnprintf(val, valSize, "mark");
-                    break;
-                case VI_ASRL_PAR_SPACE:
-                    l = epicsSnprintf(val, valSize, "space");
-                    break;
-				default:
-                    l = epicsSnprintf(val, valSize, "unknown");
-                    break;
-			}
-        }
+    epicsMutexUnlock(driver->opLock);
+}
+
+/// note the end of an operation started with opBegin()
+static void opEnd(visaDriver_t *driver)
+{
+    epicsMutexMustLock(driver->opLock);
+    if (--(driver->opDepth) == 0)
+    {
+        driver->opName = NULL;
+        epicsAtomicSetIntT(&(driver->opStage), 0);
     }
-    else if (epicsStrCaseCmp(key, "stop") == 0) {
-		if ( (err = viGetAttribute(driver->vi, VI_ATTR_ASRL_STOP_BITS, &viu16)) == VI_SUCCESS ) {
-            switch (viu16) {
-                case VI_ASRL_STOP_ONE:
-                    l = epicsSnprintf(val, valSize, "1");
-                    break;
-                case VI_ASRL_STOP_ONE5:
-                    l = epicsSnprintf(val, valSize, "1.5");
-                    break;
-                case VI_ASRL_STOP_TWO:
-                    l = epicsSnprintf(val, valSize, "2");
-                    break;
-				default:
-                    l = epicsSnprintf(val, valSize, "unknown");
-                    break;
-			}
+    epicsMutexUnlock(driver->opLock);
+}
+
+/// wait, with opLock held, for the aborts already taken on the sessions of a port to be carried out, so that
+/// closing a session cannot let them reach a new session given the same handle
+static void waitAborts(visaDriver_t *driver)
+{
+    while(driver->abortsPending > 0)
+    {
+        epicsMutexUnlock(driver->opLock);
+        epicsThreadSleep(0.01);
+        epicsMutexMustLock(driver->opLock);
+    }
+}
+
+/// close the session. Under opLock so the watchdog or exit cannot abort an operation on it as it goes,
+/// or on a new session given the same handle
+static ViStatus closeSession(visaDriver_t *driver)
+{
+    epicsMutexMustLock(driver->opLock);
+    waitAborts(driver);
+    ViStatus err = driver->backend->close(driver->vi);
+    if (err == VI_SUCCESS)
+    {
+        driver->vi = VI_NULL;
+    }
+    epicsMutexUnlock(driver->opLock);
+    return err;
+}
+
+/// an abort of the operation on the port thread, taken by takeAbort() and carried out by runAbort()
+typedef struct {
+    visaDriver_t *driver;
+    ViSession     vi;        ///< session to terminate, VI_NULL if none or its backend cannot
+    ViSession     gpibIntfc; ///< GPIB interface session to terminate, VI_NULL if none
+    bool          clear;     ///< also viClear the session, for a call that ignored viTerminate
+} visaAbort_t;
+
+/// take the sessions of the operation on the port thread to abort. Called with opLock held; the abort itself
+/// is made by runAbort() once every lock has been released, as viTerminate and viClear may block too. Until
+/// then closeSession() and closeGpibIntfc() wait, so the handles stay those of the sessions in use.
+static visaAbort_t takeAbort(visaDriver_t *driver, bool clear)
+{
+    visaAbort_t abort;
+    abort.driver = driver;
+    abort.vi = (driver->backend->terminate != NULL ? driver->vi : VI_NULL);
+    abort.gpibIntfc = driver->gpibIntfc;
+    abort.clear = clear;
+    ++(driver->abortsPending);
+    epicsAtomicSetIntT(&(driver->opStage), 1);
+    return abort;
+}
+
+/// ask the backend to end the calls in progress on the sessions taken by takeAbort(), with viTerminate and,
+/// for a call that ignored that, also viClear. The call returns with an error, and the session is then closed
+/// on the port thread as after any other lost session. Called with no lock held. Native serial sessions have
+/// no terminate, their reads already poll against the timeout.
+static void runAbort(const visaAbort_t *abort)
+{
+    visaDriver_t *driver = abort->driver;
+    if (abort->vi != VI_NULL)
+    {
+        driver->backend->terminate(abort->vi, VI_NULL, VI_NULL);
+        if (abort->clear)
+        {
+            driver->backend->clear(abort->vi);
         }
     }
-    else if (epicsStrCaseCmp(key, "clocal") == 0) {
-        l = epicsSnprintf(val, valSize, "%c",  (flow & VI_ASRL_FLOW_DTR_DSR) ? 'N' : 'Y');
+    if (abort->gpibIntfc != VI_NULL)
+    {
+        viTerminate(abort->gpibIntfc, VI_NULL, VI_NULL);
     }
-    else if (epicsStrCaseCmp(key, "crtscts") == 0) {
-        l = epicsSnprintf(val, valSize, "%c",  (flow & VI_ASRL_FLOW_RTS_CTS) ? 'Y' : 'N');
+    epicsMutexMustLock(driver->opLock);
+    --(driver->abortsPending);
+    epicsMutexUnlock(driver->opLock);
+}
+
+/// add a latency sample (s) to a histogram
+static void histAdd(visaHist_t* hist, double t)
+{
+    int i = 0, e;
+    if (t >= 1.0e-6)
+    {
+        frexp(t * 1.0e6, &e); // t (us) = m * 2^e with 0.5 <= m < 1 so bucket is e - 1
+        i = (e - 1 < VISA_HIST_NBUCKETS ? e - 1 : VISA_HIST_NBUCKETS - 1);
     }
-    else if (epicsStrCaseCmp(key, "ixon") == 0) {
-        l = epicsSnprintf(val, valSize, "%c",  (flow & VI_ASRL_FLOW_XON_XOFF) ? 'Y' : 'N');
+    ++(hist->bucket[i]);
+    ++(hist->count);
+    hist->sum += t;
+    if (t > hist->max)
+    {
+        hist->max = t;
     }
-    else if (epicsStrCaseCmp(key, "ixany") == 0) {
-        l = epicsSnprintf(val, valSize, "%c",  'N'); // ixany not supported on windows?
+}
+
+/// estimate a percentile (0 < p <= 1) of a histogram, returns the upper edge (s) of the bucket it lies in
+static double histPercentile(const visaHist_t* hist, double p)
+{
+    epicsUInt64 n = 0, target = static_cast<epicsUInt64>(ceil(p * hist->count));
+    if (hist->count == 0)
+    {
+        return 0.0;
     }
-    else if (epicsStrCaseCmp(key, "ixoff") == 0) {
-        l = epicsSnprintf(val, valSize, "%c",  (flow & VI_ASRL_FLOW_XON_XOFF) ? 'Y' : 'N');
+    for(int i = 0; i < VISA_HIST_NBUCKETS - 1; ++i)
+    {
+        n += hist->bucket[i];
+        if (n >= target)
+        {
+            return ldexp(1.0e-6, i + 1);
+        }
     }
-// this is the formatted io buffer, not the low level one
-//    else if (epicsStrCaseCmp(key, "rbuff") == 0) {
-//		err = viGetAttribute(driver->vi, VI_ATTR_RD_BUF_SIZE, &viu32);
-//      l = epicsSnprintf(val, valSize, "%u", (unsigned)viu32);		
-//    }
-//    else if (epicsStrCaseCmp(key, "wbuff") == 0) {
-//		err = viGetAttribute(driver->vi, VI_ATTR_WR_BUF_SIZE, &viu32);
-//      l = epicsSnprintf(val, valSize, "%u", (unsigned)viu32);		
-//    }
-    else {
-        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                                                "Unsupported key \"%s\"", key);
-        return asynError;
-    }
-	VI_CHECK_ERROR(key, err);
-    if (l >= valSize) {
-        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                            "Value buffer for key '%s' is too small.", key);
-        return asynError;
-    }
-    asynPrint(driver->pasynUser, ASYN_TRACEIO_DRIVER,
-              "%s getOption, key=%s, val=%s\n",
-              driver->portName, key, val);
-    return asynSuccess;
+    return hist->max;
 }
 
-///
-/// asynOption interface - set options
-///
-static asynStatus
-setOption(void *drvPvt, asynUser *pasynUser, const char *key, const char *val)
+/// mean latency (s) of a histogram
+static double histMean(const visaHist_t* hist)
 {
-    visaDriver_t *driver = (visaDriver_t*)drvPvt;
-    assert(driver);
-	if (!driver->connected)
-	{
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                          "%s disconnected:", driver->resourceName);
-            return asynError;
-	}
-	if (!driver->isSerial)
-	{
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                          "%s setOption - not a serial device", driver->resourceName);
-            return asynError;
-	}
-    asynPrint(pasynUser, ASYN_TRACE_FLOW,
-                    "%s setOption key %s val %s\n", driver->portName, key, val);
-	ViUInt16 flow, old_flow;
-	ViStatus err = viGetAttribute(driver->vi, VI_ATTR_ASRL_FLOW_CNTRL, &flow);
-	VI_CHECK_ERROR(key, err);
-	old_flow = flow;
-    if (epicsStrCaseCmp(key, "baud") == 0) {
-        int baud;
-        if(sscanf(val, "%d", &baud) != 1) {
-            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-                                                                "Bad number");
-            return asynError;
-        }
-        err = viSetAttribute(driver->vi, VI_ATTR_ASRL_BAUD, baud);
-    }
-    else if (epicsStrCaseCmp(key, "bits") == 0) {
-        int bits;
-        if(sscanf(val, "%d", &bits) != 1) {
-            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-                                                                "Bad number");
-            return asynError;
-        }
-        err = viSetAttribute(driver->vi, VI_ATTR_ASRL_DATA_BITS, bits);
+    return (hist->count > 0 ? hist->sum / hist->count : 0.0);
+}
+
+/// account for a completed read or write call
+static void recordTransaction(visaDriver_t* driver, visaHist_t* hist, asynStatus status, double duration)
+{
+    driver->busyTime += duration;
+    histAdd(hist, duration);
+    if (status == asynTimeout)
+    {
+        ++(driver->nTimeouts);
     }
-    else if (epicsStrCaseCmp(key, "parity") == 0) {
-        if (epicsStrCaseCmp(val, "none") == 0) {
-            err = viSetAttribute(driver->vi, VI_ATTR_ASRL_PARITY, VI_ASRL_PAR_NONE);
-        }
-        else if (epicsStrCaseCmp(val, "odd") == 0) {
-            err = viSetAttribute(driver->vi, VI_ATTR_ASRL_PARITY, VI_ASRL_PAR_ODD);
-        }
-        else if (epicsStrCaseCmp(val, "even") == 0) {
-            err = viSetAttribute(driver->vi, VI_ATTR_ASRL_PARITY, VI_ASRL_PAR_EVEN);
-        }
-        else if (epicsStrCaseCmp(val, "mark") == 0) {
-            err = viSetAttribute(driver->vi, VI_ATTR_ASRL_PARITY, VI_ASRL_PAR_MARK);
-        }
-        else if (epicsStrCaseCmp(val, "space") == 0) {
-            err = viSetAttribute(driver->vi, VI_ATTR_ASRL_PARITY, VI_ASRL_PAR_SPACE);
-        }
-        else {
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                                                            "Invalid parity.");
-            return asynError;
-        }
+    else if (status != asynSuccess)
+    {
+        ++(driver->nErrors);
     }
-    else if (epicsStrCaseCmp(key, "stop") == 0) {
-        if (epicsStrCaseCmp(val, "1") == 0) {
-            err = viSetAttribute(driver->vi, VI_ATTR_ASRL_STOP_BITS, VI_ASRL_STOP_ONE);
-        }
-        else if (epicsStrCaseCmp(val, "1.5") == 0) {
-            err = viSetAttribute(driver->vi, VI_ATTR_ASRL_STOP_BITS, VI_ASRL_STOP_ONE5);
-        }
-        else if (epicsStrCaseCmp(val, "2") == 0) {
-            err = viSetAttribute(driver->vi, VI_ATTR_ASRL_STOP_BITS, VI_ASRL_STOP_TWO);
-        }
-        else {
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                                                "Invalid number of stop bits.");
-            return asynError;
-        }
+}
+
+/// add a transaction to the flight recorder
+static void flightRecord(visaDriver_t* driver, bool write, const epicsTimeStamp* start, double duration,
+                         asynStatus status, int eom, const char* data, size_t nbytes)
+{
+    visaFlight_t* flight = &(driver->flight);
+    size_t seq = flight->next + 1;
+    visaFlightEntry_t* entry = &(flight->entry[flight->next % VISA_FLIGHT_ENTRIES]);
+    epicsAtomicSetSizeT(&(entry->seq), 0);
+    epicsAtomicWriteMemoryBarrier();
+    entry->start = *start;
+    entry->duration = duration;
+    entry->nbytes = static_cast<epicsUInt32>(nbytes);
+    entry->viStatus = driver->lastViStatus;
+    entry->write = (write ? 1 : 0);
+    entry->status = static_cast<epicsUInt8>(status);
+    entry->eom = static_cast<epicsUInt8>(eom);
+    entry->npayload = static_cast<epicsUInt8>(nbytes < VISA_FLIGHT_PAYLOAD ? nbytes : VISA_FLIGHT_PAYLOAD);
+    memcpy(entry->payload, data, entry->npayload);
+    epicsAtomicWriteMemoryBarrier();
+    epicsAtomicSetSizeT(&(entry->seq), seq);
+    epicsAtomicSetSizeT(&(flight->next), seq);
+    if (driver->flightDumpPending)
+    {
+        driver->flightDumpPending = false;
+        flightDump(driver, stdout, 0);
     }
-    else if (epicsStrCaseCmp(key, "clocal") == 0) {
-        if (epicsStrCaseCmp(val, "Y") == 0) {
-			flow &= ~VI_ASRL_FLOW_DTR_DSR;
-        }
-        else if (epicsStrCaseCmp(val, "N") == 0) {
-			flow |= VI_ASRL_FLOW_DTR_DSR;
+}
+
+/// print the last count (all if <= 0) transactions in the flight recorder, oldest first
+static void flightDump(visaDriver_t* driver, FILE* fp, int count)
+{
+    visaFlight_t* flight = &(driver->flight);
+    visaFlightEntry_t entry;
+    char tbuf[40], payload[4 * VISA_FLIGHT_PAYLOAD + 1], desc[256];
+    size_t next = epicsAtomicGetSizeT(&(flight->next));
+    size_t n = (count > 0 && (size_t)count < VISA_FLIGHT_ENTRIES ? count : VISA_FLIGHT_ENTRIES);
+    size_t first = (next > n ? next - n : 0);
+    fprintf(fp, "Port %s (%s): last %lu of %lu transactions\n", driver->portName, driver->resourceName,
+            (unsigned long)(next - first), (unsigned long)next);
+    for(size_t i = first; i < next; ++i)
+    {
+        const visaFlightEntry_t* e = &(flight->entry[i % VISA_FLIGHT_ENTRIES]);
+        size_t seq = epicsAtomicGetSizeT(&(e->seq));
+        epicsAtomicReadMemoryBarrier();
+        memcpy(&entry, e, sizeof(entry));
+        epicsAtomicReadMemoryBarrier();
+        if (seq != i + 1 || epicsAtomicGetSizeT(&(e->seq)) != seq)
+        {
+            continue; // overwritten by a newer transaction while we looked
         }
-        else {
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                                                    "Invalid clocal value.");
-            return asynError;
+        epicsTimeToStrftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S.%06f", &(entry.start));
+        epicsStrnEscapedFromRaw(payload, sizeof(payload), entry.payload, entry.npayload);
+        desc[0] = '\0';
+        if (entry.viStatus != VI_SUCCESS)
+        {
+            driver->backend->statusDesc(driver->defaultRM, entry.viStatus, desc);
         }
+        fprintf(fp, "%8lu %s %s %10.6f s %6lu bytes %-7s eom%s%s%s VISA 0x%08x %s\n    \"%s\"%s\n",
+                (unsigned long)seq, tbuf, (entry.write ? "write" : "read "), entry.duration,
+                (unsigned long)entry.nbytes, pasynManager->strStatus((asynStatus)entry.status),
+                (entry.eom & ASYN_EOM_CNT ? " CNT" : ""), (entry.eom & ASYN_EOM_EOS ? " EOS" : ""),
+                (entry.eom & ASYN_EOM_END ? " END" : (entry.eom == 0 ? " -" : "")),
+                (unsigned)entry.viStatus, desc, payload, (entry.nbytes > entry.npayload ? "..." : ""));
     }
-    else if (epicsStrCaseCmp(key, "crtscts") == 0) {
-        if (epicsStrCaseCmp(val, "Y") == 0) {
-			flow |= VI_ASRL_FLOW_RTS_CTS;
-        }
-        else if (epicsStrCaseCmp(val, "N") == 0) {
-			flow &= ~VI_ASRL_FLOW_RTS_CTS;
-        }
-        else {
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                                                      "Invalid crtscts value.");
-            return asynError;
+}
+
+/// find the shadow cache entry for an attribute, creating one if there is room
+static visaAttrCache_t* findAttrCache(visaDriver_t* driver, ViAttr attr)
+{
+    for(int i = 0; i < driver->nAttrCache; ++i)
+    {
+        if (driver->attrCache[i].attr == attr)
+        {
+            return &(driver->attrCache[i]);
         }
     }
-    else if ( (epicsStrCaseCmp(key, "ixon") == 0) || (epicsStrCaseCmp(key, "ixoff") == 0 ) ) {
-        if (epicsStrCaseCmp(val, "Y") == 0) {
-			flow |= VI_ASRL_FLOW_XON_XOFF;
-        }
-        else if (epicsStrCaseCmp(val, "N") == 0) {
-			flow &= ~VI_ASRL_FLOW_XON_XOFF;
-        }
-        else {
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                                                    "Invalid %s value.", key);
-            return asynError;
-        }
+    if (driver->nAttrCache < VISA_ATTR_CACHE_SIZE)
+    {
+        visaAttrCache_t* entry = &(driver->attrCache[driver->nAttrCache++]);
+        entry->attr = attr;
+        entry->valid = false;
+        return entry;
     }
-    else if (epicsStrCaseCmp(key, "ixany") == 0) {
-        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                                                    "Option ixany not supported on Windows");
-        return asynError;       
+    return NULL;
+}
+
+/// mark all cached attribute values as unknown, needed whenever the session is opened or closed
+static void invalidateAttrCache(visaDriver_t* driver)
+{
+    for(int i = 0; i < driver->nAttrCache; ++i)
+    {
+        driver->attrCache[i].valid = false;
     }
-    else if (epicsStrCaseCmp(key, "wbuff") == 0) {
-        int buflen;
-        if(sscanf(val, "%d", &buflen) != 1) {
-            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-                                                                "Bad number");
-            return asynError;
-        }
-        err = viSetBuf(driver->vi, VI_IO_OUT_BUF, buflen);
+}
+
+/// set a session attribute, only calling viSetAttribute if the value differs from that last set
+static ViStatus setAttr(visaDriver_t* driver, ViAttr attr, ViAttrState value)
+{
+    visaAttrCache_t* entry = findAttrCache(driver, attr);
+    if (entry != NULL && entry->valid && entry->value == value)
+    {
+        ++(driver->nAttrCallsSaved);
+        return VI_SUCCESS;
     }
-    else if (epicsStrCaseCmp(key, "rbuff") == 0) {
-        int buflen;
-        if(sscanf(val, "%d", &buflen) != 1) {
-            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-                                                                "Bad number");
-            return asynError;
-        }
-        err = viSetBuf(driver->vi, VI_IO_IN_BUF, buflen);
+    ViStatus err = driver->backend->setAttribute(driver->vi, attr, value);
+    if (entry != NULL)
+    {
+        // a warning may mean VISA used a different value to the one asked for, so don't trust it
+        entry->valid = (err == VI_SUCCESS);
+        entry->value = value;
     }
-    else if (epicsStrCaseCmp(key, "flush") == 0) {
-        if (epicsStrCaseCmp(val, "Y") == 0) {
-			driver->flush_on_write = true;
-        }
-        else if (epicsStrCaseCmp(val, "N") == 0) {
-			driver->flush_on_write = false;
-        }
-        else {
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                                                      "Invalid flush value.");
-            return asynError;
-        }
+    return err;
+}
+
+/// get a session attribute, using the shadow copy if we have one.
+/// Only use for attributes that change solely as a result of us setting them.
+template <typename T>
+static ViStatus getAttr(visaDriver_t* driver, ViAttr attr, T* value)
+{
+    visaAttrCache_t* entry = findAttrCache(driver, attr);
+    if (entry != NULL && entry->valid)
+    {
+        *value = static_cast<T>(entry->value);
+        ++(driver->nAttrCallsSaved);
+        return VI_SUCCESS;
     }
-    else if (epicsStrCaseCmp(key, "") != 0) {
-        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                                                "Unsupported key \"%s\"", key);
-        return asynError;
+    ViStatus err = driver->backend->getAttribute(driver->vi, attr, value);
+    if (entry != NULL && err == VI_SUCCESS)
+    {
+        entry->value = *value;
+        entry->valid = true;
     }
-	if (err == VI_SUCCESS && flow != old_flow)
-	{
-	    err = viSetAttribute(driver->vi, VI_ATTR_ASRL_FLOW_CNTRL, flow);
-	}
-	VI_CHECK_ERROR(key, err);
-    asynPrint(driver->pasynUser, ASYN_TRACEIO_DRIVER,
-              "%s setOption, key=%s, val=%s\n",
-              driver->portName, key, val);
-    return asynSuccess;
+    return err;
 }
 
-static const struct asynOption asynOptionMethods = { setOption, getOption };
+#define VI_CHECK_ERROR(__command, __err) \
+    if (__err < 0) \
+    { \
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize, \
+                              "%s: %s %s", driver->resourceName, __command, errMsg(driver, err).c_str()); \
+        return asynError; \
+    }
 
-/// close a VISA session
-static asynStatus
-closeConnection(asynUser *pasynUser, visaDriver_t *driver, const char* reason)
+/// does a VISA read that ends with VI_SUCCESS mean the whole message has arrived. USBTMC marks the last
+/// transfer of every message, so on USB INSTR sessions it does whatever deviceSendsEOM was configured as
+static bool endIsEOM(visaDriver_t *driver)
 {
-    asynPrint(pasynUser, ASYN_TRACE_FLOW,
-              "Close %s connection %s\n", driver->resourceName, reason);
-    if (!driver->connected) {
-        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                              "%s: session already closed", driver->resourceName);
-        return asynError;
-    }
-	ViStatus err;
-	if ( (err = viClose(driver->vi)) != VI_SUCCESS )
-	{
-        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                              "%s: viClose error", driver->resourceName);
-        return asynError;
-	}
-    driver->connected = false;
-	driver->vi = VI_NULL;
-	pasynManager->exceptionDisconnect(pasynUser);
-    return asynSuccess;
+    return (driver->deviceSendsEOM || (driver->isUSB && driver->usbEnd));
 }
 
-
-/// asynCommon interface - Report link parameters
-static void
-asynCommonReport(void *drvPvt, FILE *fp, int details)
+/// did the last read get the whole reply, so nothing more of it can still be on its way. A GPIB or USB
+/// read that VISA ended with END (VI_SUCCESS) did even when END isn't passed on as ASYN_EOM_END
+static bool replyComplete(visaDriver_t *driver, asynStatus status, int eom)
 {
-    visaDriver_t *driver = (visaDriver_t*)drvPvt;
-    char termChar[16]; // bit of space for encoding an escape sequence
-    assert(driver);
-    if (details >= 1) {
-        fprintf(fp, "    Port %s: %sonnected\n",
-                                                driver->resourceName,
-                                                (driver->connected ? "C" : "Disc"));
-    }
-	if (driver->termCharIn != 0)
-	{
-	    epicsStrnEscapedFromRaw(termChar, sizeof(termChar), reinterpret_cast<const char*>(&(driver->termCharIn)), 1);
-	}
-	else
-	{
-		strncpy(termChar, "<none>", sizeof(termChar));
-	}
-    if (details >= 2) {
-        fprintf(fp, "    Characters written: %lu\n", driver->nWriteBytes);
-        fprintf(fp, "       Characters read: %lu\n", driver->nReadBytes);
-        fprintf(fp, "      write operations: %lu\n", driver->nWriteCalls);
-        fprintf(fp, "       read operations: %lu\n", driver->nReadCalls);
-        fprintf(fp, "      Is serial device: %c\n", (driver->isSerial ? 'Y' : 'N'));
-        fprintf(fp, "        Is GPIB device: %c\n", (driver->isGPIB ? 'Y' : 'N'));
-        fprintf(fp, "      Device sends EOM: %c\n", (driver->deviceSendsEOM ? 'Y' : 'N'));
-        fprintf(fp, "  Input term char hint: \"%s\" (0x%x)\n", termChar, (unsigned)driver->termCharIn);
-        fprintf(fp, "Internal read tmo (ms): %d\n", ((int)driver->readIntTimeout));
+    if (status != asynSuccess)
+    {
+        return false;
     }
+    return ((eom & (ASYN_EOM_EOS | ASYN_EOM_END)) != 0 ||
+            ((driver->isGPIB || driver->isUSB) && driver->lastViStatus == VI_SUCCESS));
 }
 
-static void
-visaCleanup (void *arg)
+/// number of bytes waiting in ring, called by consumer
+static size_t ringCount(visaRing_t *ring)
 {
-    asynStatus status;
-    visaDriver_t *driver = (visaDriver_t*)arg;
-	
-    if (!arg) return;
-    status=pasynManager->lockPort(driver->pasynUser);
-    if(status!=asynSuccess)
-        asynPrint(driver->pasynUser, ASYN_TRACE_ERROR, "%s: cleanup locking error\n", driver->portName);
-
-    if(status==asynSuccess)
-        pasynManager->unlockPort(driver->pasynUser);
+    size_t n = epicsAtomicGetSizeT(&(ring->head)) - ring->tail;
+    epicsAtomicReadMemoryBarrier();
+    return n;
+}
 
-	viClose(driver->defaultRM); // this will automatically close all sessions 
+/// number of bytes that can be added to ring, called by producer
+static size_t ringSpace(visaRing_t *ring)
+{
+    return ring->size - (ring->head - epicsAtomicGetSizeT(&(ring->tail)));
 }
 
-static void
-driverCleanup(visaDriver_t *driver)
+/// remove up to maxchars bytes from ring, stopping after termChar (if non zero) which sets *eos 
+static size_t ringGet(visaRing_t *ring, char *data, size_t maxchars, char termChar, bool *eos)
 {
-	if (driver)
-	{
-        free(driver->portName);
-        free(driver->resourceName);
-        free(driver);
+    size_t n = 0, avail = ringCount(ring);
+    *eos = false;
+    while(n < maxchars && avail > 0 && !*eos)
+    {
+        size_t offset = ring->tail & (ring->size - 1);
+        size_t len = ring->size - offset; // contiguous bytes before wrap
+        len = (len < avail ? len : avail);
+        len = (len < maxchars - n ? len : maxchars - n);
+        if (termChar != 0)
+        {
+            const char *pterm = static_cast<const char*>(memchr(ring->buffer + offset, termChar, len));
+            if (pterm != NULL)
+            {
+                len = pterm - (ring->buffer + offset) + 1;
+                *eos = true;
+            }
+        }
+        memcpy(data + n, ring->buffer + offset, len);
+        n += len;
+        avail -= len;
+        epicsAtomicWriteMemoryBarrier(); // finish reading data before giving space back
+        epicsAtomicSetSizeT(&(ring->tail), ring->tail + len);
     }
+    return n;
 }
 
-/// create a link
-static asynStatus
-connectIt(void *drvPvt, asynUser *pasynUser)
+/// serial read ahead thread, moves data from the VISA input queue into driver->ring so readIt
+/// can be served from memory. We wait on VI_EVENT_ASRL_CHAR rather than in a blocking viRead so
+/// that we never depend on the session VI_ATTR_TMO_VALUE, which the port thread changes for writes.
+static void readAheadThread(void *arg)
 {
-    visaDriver_t *driver = (visaDriver_t*)drvPvt;
-    assert(driver);
-    asynPrint(pasynUser, ASYN_TRACE_FLOW,
-              "Open connection to \"%s\"  reason: %d\n", driver->resourceName,
-                                                           pasynUser->reason);
+    visaDriver_t *driver = (visaDriver_t*)arg;
+    visaRing_t *ring = &(driver->ring);
+    ViSession vi = driver->vi; // never a later session, should this thread outlive the one it was started for
+    ViStatus err = driver->backend->enableEvent(vi, VI_EVENT_ASRL_CHAR, VI_QUEUE);
+    while(err >= 0 && !epicsAtomicGetIntT(&(driver->readAheadStop)))
+    {
+        ViUInt32 avail = 0, actual = 0;
+        size_t space = ringSpace(ring);
+        if (space == 0)
+        {
+            // leave data in the VISA queue until readIt makes room
+            epicsEventWaitWithTimeout(driver->readAheadSpaceEvent, 0.1);
+            continue;
+        }
+        if ( (err = driver->backend->getAttribute(vi, VI_ATTR_ASRL_AVAIL_NUM, &avail)) < 0 )
+        {
+            break;
+        }
+        if (avail == 0)
+        {
+            // short timeout so we notice readAheadStop
+            err = driver->backend->waitOnEvent(vi, VI_EVENT_ASRL_CHAR, 100, NULL, NULL);
+            if (err == VI_ERROR_TMO)
+            {
+                err = VI_SUCCESS;
+            }
+            continue;
+        }
+        driver->backend->discardEvents(vi, VI_EVENT_ASRL_CHAR, VI_QUEUE); // we are about to read everything they refer to
+        size_t offset = ring->head & (ring->size - 1);
+        size_t len = ring->size - offset;
+        len = (len < space ? len : space);
+        len = (len < avail ? len : avail);
+        // data is already waiting, so this returns without depending on VI_ATTR_TMO_VALUE
+        err = driver->backend->read(vi, reinterpret_cast<ViBuf>(ring->buffer + offset), static_cast<ViUInt32>(len), &actual);
+        ++(driver->readAheadVISAReads);
+        if (actual > 0)
+        {
+            epicsAtomicWriteMemoryBarrier(); // data must be visible before head moves
+            epicsAtomicSetSizeT(&(ring->head), ring->head + actual);
+            size_t used = ring->size - ringSpace(ring);
+            if (used > driver->readAheadHigh)
+            {
+                driver->readAheadHigh = used;
+            }
+            epicsEventSignal(driver->readAheadDataEvent);
+        }
+        if (err == VI_ERROR_TMO)
+        {
+            err = VI_SUCCESS;
+        }
+    }
+    driver->backend->disableEvent(vi, VI_EVENT_ASRL_CHAR, VI_QUEUE);
+    driver->readAheadStatus = (err < 0 ? err : VI_SUCCESS);
+    epicsEventSignal(driver->readAheadDataEvent); // wake any reader waiting for data so it sees the error
+    epicsEventSignal(driver->readAheadExitEvent);
+}
 
-    if (driver->connected) {
-        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                              "%s: session already open.", driver->resourceName);
-        return asynError;
+/// start the serial read ahead thread for the current session
+static void startReadAhead(visaDriver_t *driver)
+{
+    if (driver->readAheadRunning || !driver->connected || !driver->isSerial || !hasEvents(driver))
+    {
+        return;
     }
-	ViStatus err;
-	if ( (err = viOpen(driver->defaultRM, driver->resourceName,VI_NULL,VI_NULL,&(driver->vi))) != VI_SUCCESS )
-	{
-        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                              "%s: viOpen %s", driver->resourceName, errMsg(driver->defaultRM, err).c_str());
-		return asynError;
-	}
-	ViUInt16 intf_type;
-	char intf_name[256];
-	intf_name[0] = '\0';
-	err = viGetAttribute(driver->vi, VI_ATTR_INTF_INST_NAME, intf_name);
-	VI_CHECK_ERROR("intf_name", err);
-	err = viGetAttribute(driver->vi, VI_ATTR_INTF_TYPE, &intf_type);
-	VI_CHECK_ERROR("intf_type", err);
-	
-	if (intf_type == VI_INTF_ASRL) // is it a serial device?
-	{
-		driver->isSerial = true;
-		err = viSetAttribute(driver->vi, VI_ATTR_ASRL_END_OUT, VI_ASRL_END_NONE);
-	    VI_CHECK_ERROR("VI_ATTR_ASRL_END_OUT", err);
-        err = viSetAttribute(driver->vi, VI_ATTR_SEND_END_EN, VI_FALSE);
-	    VI_CHECK_ERROR("VI_ATTR_SEND_END_EN", err);
-        err = viSetAttribute(driver->vi, VI_ATTR_SUPPRESS_END_EN, VI_TRUE);
-	    VI_CHECK_ERROR("VI_ATTR_SUPPRESS_END_EN", err);
-	}
-	else
-	{
-		driver->isSerial = false;		
-	}
-	if (intf_type == VI_INTF_GPIB)
-	{
-		driver->isGPIB = true;
-		// we should make these configurable
-		err = viSetAttribute(driver->vi, VI_ATTR_GPIB_READDR_EN, VI_TRUE);
-	    VI_CHECK_ERROR("VI_ATTR_GPIB_READDR_EN", err);
-// The LabVIEW driver set this to VI_TRUE (default is VI_FALSE) but causes problems for stress rig if we set it
-//		err = viSetAttribute(driver->vi, VI_ATTR_GPIB_UNADDR_EN, VI_TRUE);
-//	    VI_CHECK_ERROR("VI_ATTR_GPIB_UNADDR_EN", err);
-		err = viSetAttribute(driver->vi, VI_ATTR_SEND_END_EN, VI_TRUE);
-	    VI_CHECK_ERROR("VI_ATTR_SEND_END_EN", err);
-	}
-	else
-	{
-		driver->isGPIB = false;		
-	}
-	if (driver->termCharIn != 0)
-	{
-		// tell VISA to terminate a read early when this character is seen
-		if (driver->isSerial)
-		{
-		    err = viSetAttribute(driver->vi, VI_ATTR_ASRL_END_IN, VI_ASRL_END_TERMCHAR);
-	        VI_CHECK_ERROR("VI_ATTR_ASTR_END_IN", err);
-		}			
-	    err = viSetAttribute(driver->vi, VI_ATTR_TERMCHAR, driver->termCharIn);
-	    VI_CHECK_ERROR("VI_ATTR_TERMCHAR", err);
-	    err = viSetAttribute(driver->vi, VI_ATTR_TERMCHAR_EN, VI_TRUE);
-	}
-	else
-	{
-	    // disable read/write command exit on termination character VI_ATTR_TERMCHAR in general
-		if (driver->isSerial)
-		{
-		    err = viSetAttribute(driver->vi, VI_ATTR_ASRL_END_IN, VI_ASRL_END_NONE);
-	        VI_CHECK_ERROR("VI_ATTR_ASTR_END_IN", err);
-		}			
-	    err = viSetAttribute(driver->vi, VI_ATTR_TERMCHAR_EN, VI_FALSE);
-	}
-	VI_CHECK_ERROR("VI_ATTR_TERMCHAR_EN", err);
+    if (driver->readAheadStuck)
+    {
+        if (epicsEventTryWait(driver->readAheadExitEvent) != epicsEventOK)
+        {
+            asynPrint(driver->pasynUser, ASYN_TRACE_ERROR, "%s: read ahead thread has still not exited, not restarted\n", driver->portName);
+            return;
+        }
+        driver->readAheadStuck = false;
+    }
+    size_t size = 256;
+    while(size < driver->readAheadSize)
+    {
+        size *= 2;
+    }
+    if (driver->ring.buffer == NULL || driver->ring.size != size)
+    {
+        free(driver->ring.buffer);
+        driver->ring.buffer = (char*)callocMustSucceed(size, 1, "drvAsynVISAPort read ahead");
+        driver->ring.size = size;
+    }
+    driver->ring.head = driver->ring.tail = 0;
+    driver->readAheadStop = 0;
+    driver->readAheadStatus = VI_SUCCESS;
+    epicsEventTryWait(driver->readAheadExitEvent);
+    epicsEventTryWait(driver->readAheadDataEvent);
+    char name[64];
+    epicsSnprintf(name, sizeof(name), "%sRA", driver->portName);
+    epicsThreadMustCreate(name, epicsThreadPriorityHigh, epicsThreadGetStackSize(epicsThreadStackSmall),
+                          readAheadThread, driver);
+    driver->readAheadRunning = true;
+}
 
-	err = viClear(driver->vi);
-	VI_CHECK_ERROR("viClear", err);
-	
-    // these are the defaults, need to change?
-//	viSetAttribute(driver->vi, VI_ATTR_SEND_END_EN, VI_TRUE);
-//	viSetAttribute(driver->vi, VI_ATTR_SUPPRESS_END_EN, VI_FALSE);
+/// stop the serial read ahead thread, any unread data in the ring is discarded. A thread still in a VISA call
+/// after 5 s is aborted with viTerminate, and if it has not exited 1 s after that returns false: the caller
+/// must then close the session, as nothing else may read it alongside the thread, which gives up on the
+/// closed session's errors. Read ahead is not started again until it has exited.
+static bool stopReadAhead(visaDriver_t *driver)
+{
+    if (!driver->readAheadRunning)
+    {
+        return true;
+    }
+    epicsAtomicSetIntT(&(driver->readAheadStop), 1);
+    epicsEventSignal(driver->readAheadSpaceEvent);
+    driver->readAheadRunning = false;
+    if (epicsEventWaitWithTimeout(driver->readAheadExitEvent, 5.0) == epicsEventOK)
+    {
+        return true;
+    }
+    if (driver->backend->terminate != NULL)
+    {
+        driver->backend->terminate(driver->vi, VI_NULL, VI_NULL);
+    }
+    if (epicsEventWaitWithTimeout(driver->readAheadExitEvent, 1.0) == epicsEventOK)
+    {
+        return true;
+    }
+    asynPrint(driver->pasynUser, ASYN_TRACE_ERROR, "%s: read ahead thread did not exit\n", driver->portName);
+    driver->readAheadStuck = true;
+    return false;
+}
 
-	// don't think we need to do anything about these as we using raw rather than buffered io
-	//	VI_ATTR_RD_BUF_OPER_MODE
-	//	VI_ATTR_WR_BUF_OPER_MODE    -> VI_FLUSH_ON_ACCESS
-	
-    asynPrint(pasynUser, ASYN_TRACE_FLOW,
-                          "Opened connection to \"%s\" (%s) isSerial=%c isGPIB=%c\n", driver->resourceName, 
-						  intf_name, (driver->isSerial ? 'Y' : 'N'), (driver->isGPIB ? 'Y' : 'N'));
-    driver->connected = true;
-    return asynSuccess;
+/// service request thread, waits for VI_EVENT_SERVICE_REQ and queues srqProcess() on the port thread.
+/// The serial poll is not done here so that it never interleaves with I/O the port thread has in progress.
+/// Service requests that arrive while a poll is already queued are handled by that poll.
+static void srqThread(void *arg)
+{
+    visaDriver_t *driver = (visaDriver_t*)arg;
+    ViStatus err = driver->backend->enableEvent(driver->vi, VI_EVENT_SERVICE_REQ, VI_QUEUE);
+    while(err >= 0 && !epicsAtomicGetIntT(&(driver->srqStop)))
+    {
+        // short timeout so we notice srqStop
+        err = driver->backend->waitOnEvent(driver->vi, VI_EVENT_SERVICE_REQ, 100, NULL, NULL);
+        if (err == VI_ERROR_TMO)
+        {
+            err = VI_SUCCESS;
+            continue;
+        }
+        if (err >= 0 && !epicsAtomicGetIntT(&(driver->srqQueued)))
+        {
+            epicsAtomicSetIntT(&(driver->srqQueued), 1);
+            if (pasynManager->queueRequest(driver->srqUser, asynQueuePriorityHigh, 0.0) != asynSuccess)
+            {
+                epicsAtomicSetIntT(&(driver->srqQueued), 0);
+            }
+        }
+    }
+    driver->backend->disableEvent(driver->vi, VI_EVENT_SERVICE_REQ, VI_QUEUE);
+    driver->srqStatus = (err < 0 ? err : VI_SUCCESS);
+    if (err < 0)
+    {
+        asynPrint(driver->srqUser, ASYN_TRACE_ERROR, "%s: service request thread stopped: %s\n",
+                  driver->portName, errMsg(driver, err).c_str());
+    }
+    epicsEventSignal(driver->srqExitEvent);
 }
 
+/// is an I/O Intr client for this device, clients on a multi-device port are for one address
+static bool isClient(visaDriver_t *driver, asynUser *pasynUser)
+{
+    int addr = -1;
+    return (driver->addr < 0 || (pasynManager->getAddr(pasynUser, &addr) == asynSuccess && addr == driver->addr));
+}
 
-static asynStatus
-asynCommonConnect(void *drvPvt, asynUser *pasynUser)
+/// pass the status byte to asynInt32 and asynUInt32Digital I/O Intr clients
+static void srqCallbacks(visaDriver_t *driver, ViUInt16 stb)
 {
-    asynStatus status = asynSuccess;
+    ELLLIST *pclientList;
+    interruptNode *pnode;
+    pasynManager->interruptStart(driver->int32InterruptPvt, &pclientList);
+    for(pnode = (interruptNode*)ellFirst(pclientList); pnode != NULL; pnode = (interruptNode*)ellNext(&(pnode->node)))
+    {
+        asynInt32Interrupt *pint32 = (asynInt32Interrupt*)pnode->drvPvt;
+        if (pint32->pasynUser->reason == visaParamSrqStb && isClient(driver, pint32->pasynUser))
+        {
+            pint32->callback(pint32->userPvt, pint32->pasynUser, stb);
+        }
+    }
+    pasynManager->interruptEnd(driver->int32InterruptPvt);
+    pasynManager->interruptStart(driver->uint32DigitalInterruptPvt, &pclientList);
+    for(pnode = (interruptNode*)ellFirst(pclientList); pnode != NULL; pnode = (interruptNode*)ellNext(&(pnode->node)))
+    {
+        asynUInt32DigitalInterrupt *pdigital = (asynUInt32DigitalInterrupt*)pnode->drvPvt;
+        if (pdigital->pasynUser->reason == visaParamSrqStbBits && isClient(driver, pdigital->pasynUser))
+        {
+            pdigital->callback(pdigital->userPvt, pdigital->pasynUser, pdigital->mask & stb);
+        }
+    }
+    pasynManager->interruptEnd(driver->uint32DigitalInterruptPvt);
+}
 
-    status = connectIt(drvPvt, pasynUser);
-    if (status == asynSuccess)
-        pasynManager->exceptionConnect(pasynUser);
-    return status;
+/// read the response a service request says is waiting. This goes through the top of the asynOctet
+/// interface stack, so input EOS processing is applied and asynOctet I/O Intr records receive the data.
+static void srqReadResponse(visaDriver_t *driver, asynUser *pasynUser)
+{
+    asynInterface *pasynInterface = pasynManager->findInterface(pasynUser, asynOctetType, 1);
+    size_t nbytes = 0;
+    int eom = 0;
+    if (pasynInterface == NULL)
+    {
+        return;
+    }
+    asynOctet *pasynOctet = (asynOctet*)pasynInterface->pinterface;
+    if (driver->srqReadBuffer == NULL)
+    {
+        driver->srqReadBuffer = (char*)callocMustSucceed(VISA_SRQ_READ_SIZE, 1, "drvAsynVISAPort srq read");
+    }
+    pasynUser->timeout = 1.0; // MAV says the response is ready, so this is just a safety limit
+    if (pasynOctet->read(pasynInterface->drvPvt, pasynUser, driver->srqReadBuffer, VISA_SRQ_READ_SIZE - 1, &nbytes, &eom) == asynSuccess)
+    {
+        ++(driver->nSrqReads);
+    }
+    else
+    {
+        asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: read after service request failed: %s\n",
+                  driver->portName, pasynUser->errorMessage);
+    }
 }
 
-static asynStatus
-asynCommonDisconnect(void *drvPvt, asynUser *pasynUser)
+/// queued by srqThread(), runs on the port thread to serial poll the device and notify clients
+static void srqProcess(asynUser *pasynUser)
 {
-    visaDriver_t *driver = (visaDriver_t*)drvPvt;
+    visaDriver_t *driver = (visaDriver_t*)pasynUser->userPvt;
+    ViUInt16 stb = 0;
+    epicsAtomicSetIntT(&(driver->srqQueued), 0);
+    if (!driver->connected)
+    {
+        return;
+    }
+    ViStatus err = driver->backend->readSTB(driver->vi, &stb);
+    if (err < 0)
+    {
+        asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: serial poll failed: %s\n",
+                  driver->portName, errMsg(driver, err).c_str());
+        return;
+    }
+    asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: service request, status byte 0x%02x\n", driver->portName, (unsigned)stb);
+    driver->srqStb = stb;
+    ++(driver->nSrq);
+    if (driver->srqRead && (stb & VISA_STB_MAV))
+    {
+        srqReadResponse(driver, pasynUser);
+    }
+    srqCallbacks(driver, stb);
+}
 
-    assert(driver);
-    return closeConnection(pasynUser,driver,"Disconnect request");
+/// start the service request thread for the current session
+static void startSrq(visaDriver_t *driver)
+{
+    if (driver->srqRunning || !driver->connected || driver->isSerial || !hasEvents(driver))
+    {
+        return;
+    }
+    if (driver->srqUser == NULL)
+    {
+        driver->srqUser = pasynManager->createAsynUser(srqProcess, 0);
+        driver->srqUser->userPvt = driver;
+        if (pasynManager->connectDevice(driver->srqUser, driver->portName, driver->addr) != asynSuccess)
+        {
+            asynPrint(driver->pasynUser, ASYN_TRACE_ERROR, "%s: service request connectDevice failed %s\n",
+                      driver->portName, driver->srqUser->errorMessage);
+            pasynManager->freeAsynUser(driver->srqUser);
+            driver->srqUser = NULL;
+            return;
+        }
+    }
+    driver->srqStop = 0;
+    driver->srqStatus = VI_SUCCESS;
+    epicsEventTryWait(driver->srqExitEvent);
+    char name[64];
+    epicsSnprintf(name, sizeof(name), "%sSRQ", driver->portName);
+    epicsThreadMustCreate(name, epicsThreadPriorityHigh, epicsThreadGetStackSize(epicsThreadStackSmall),
+                          srqThread, driver);
+    driver->srqRunning = true;
 }
 
-/// write values to device
-static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
-    const char *data, size_t numchars, size_t *nbytesTransfered)
+/// stop the service request thread, a poll already queued does nothing once the session is closed
+static void stopSrq(visaDriver_t *driver)
 {
-    visaDriver_t *driver = (visaDriver_t*)drvPvt;
-    asynStatus status = asynSuccess;
-	bool timedout = false;
-	epicsTimeStamp epicsTS1, epicsTS2;
+    if (!driver->srqRunning)
+    {
+        return;
+    }
+    epicsAtomicSetIntT(&(driver->srqStop), 1);
+    if (epicsEventWaitWithTimeout(driver->srqExitEvent, 5.0) != epicsEventOK)
+    {
+        asynPrint(driver->pasynUser, ASYN_TRACE_ERROR, "%s: service request thread did not exit\n", driver->portName);
+    }
+    driver->srqRunning = false;
+}
 
-    assert(driver);
-    asynPrint(pasynUser, ASYN_TRACE_FLOW,
-              "%s write.\n", driver->resourceName);
-    asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, numchars,
-                "%s write %lu\n", driver->resourceName, (unsigned long)numchars);
-	epicsTimeGetCurrent(&epicsTS1);
-    *nbytesTransfered = 0;
-	if (!driver->connected)
-	{
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                          "%s disconnected:", driver->resourceName);
-            return asynError;
-	}
-	++(driver->nWriteCalls);
-    if (numchars == 0)
-	{
-        return asynSuccess;
-	}
-	ViStatus err;
-	// always need to set timeout as use immediate as part of read
-        driver->timeout = pasynUser->timeout;
-		if (driver->timeout == 0)
-		{			
-			err = viSetAttribute(driver->vi, VI_ATTR_TMO_VALUE, VI_TMO_INFINITE);
-		}
-		else
-		{
-			err = viSetAttribute(driver->vi, VI_ATTR_TMO_VALUE, static_cast<int>(driver->timeout * 1000.0));
-		}
-		VI_CHECK_ERROR("set timeout", err);
-	ViUInt32 actual = 0;
-	err = viWrite(driver->vi, (ViBuf)data, static_cast<ViUInt32>(numchars), &actual);
-	if ( err == VI_ERROR_TMO )
-	{
-		timedout = true;
-	}
-	else if ( err != VI_SUCCESS )
-	{
-            closeConnection(pasynUser,driver,"Write error");
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                          "%s write error %s", driver->resourceName, errMsg(driver->vi, err).c_str());
-            return asynError;		
-	}
-	if (driver->flush_on_write)
-	{
-		err = viFlush(driver->vi, VI_IO_OUT_BUF);
-	    if ( err == VI_ERROR_TMO )
-	    {
-		    timedout = true;
-	    }
-	    else if ( err != VI_SUCCESS )
-	    {
-            closeConnection(pasynUser,driver,"Write error");
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                          "%s write error %s", driver->resourceName, errMsg(driver->vi, err).c_str());
-            return asynError;		
-	    }
-	}
-    driver->nWriteBytes += actual;
-    *nbytesTransfered = actual;
-	if (timedout)
-	{
-		status = asynTimeout;
-	}
-	epicsTimeGetCurrent(&epicsTS2);
-    asynPrint(pasynUser, ASYN_TRACE_FLOW,
-              "wrote %lu/%lu chars to %s, return %s.\n", (unsigned long)*nbytesTransfered, (unsigned long)numchars,
-                                               driver->resourceName,
-                                               pasynManager->strStatus(status));
-	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s Write took %f timeout was %f\n", 
-	          driver->resourceName, epicsTimeDiffInSeconds(&epicsTS2, &epicsTS1), pasynUser->timeout);
-    return status;
+/// wait up to tmo (ms) for one VI_EVENT_IO_COMPLETION and record its result against our read or write job
+static ViStatus collectCompletion(visaDriver_t *driver, ViUInt32 tmo)
+{
+    ViEventType etype;
+    ViEvent event;
+    ViJobId id = VI_NULL;
+    ViStatus status = VI_SUCCESS;
+    ViUInt32 count = 0;
+    ViStatus err = driver->backend->waitOnEvent(driver->vi, VI_EVENT_IO_COMPLETION, tmo, &etype, &event);
+    if (err < 0)
+    {
+        return err;
+    }
+    driver->backend->getAttribute(event, VI_ATTR_JOB_ID, &id);
+    driver->backend->getAttribute(event, VI_ATTR_STATUS, &status);
+    driver->backend->getAttribute(event, VISA_ATTR_RET_COUNT, &count);
+    driver->backend->close(event);
+    visaJob_t *job = (id == driver->readJob.id ? &(driver->readJob) : (id == driver->writeJob.id ? &(driver->writeJob) : NULL));
+    if (job != NULL && job->posted && !job->done)
+    {
+        job->done = true;
+        job->status = status;
+        job->count = count;
+    }
+    return VI_SUCCESS;
 }
 
-/// read values from device
-static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
-    char *data, size_t maxchars, size_t *nbytesTransfered, int *gotEom)
+/// wait up to timeout (s, negative for ever) for a posted job to complete
+/// @return VI_SUCCESS if job->done, else VI_ERROR_TMO or the error from viWaitOnEvent
+static ViStatus waitJob(visaDriver_t *driver, visaJob_t *job, double timeout)
 {
-    visaDriver_t *driver = (visaDriver_t*)drvPvt;
-    int reason = 0;
-    asynStatus status = asynSuccess;
-	epicsTimeStamp epicsTS1, epicsTS2;
-        ViUInt32 actual = 0, actualex = 0;
-	ViStatus err;
+    epicsTimeStamp start, now;
+    epicsTimeGetCurrent(&start);
+    while(!job->done)
+    {
+        ViUInt32 tmo = VI_TMO_INFINITE;
+        if (timeout >= 0.0)
+        {
+            epicsTimeGetCurrent(&now);
+            double remaining = timeout - epicsTimeDiffInSeconds(&now, &start);
+            tmo = (remaining > 0.0 ? static_cast<ViUInt32>(ceil(remaining * 1000.0)) : VI_TMO_IMMEDIATE);
+        }
+        ViStatus err = collectCompletion(driver, tmo);
+        if (err < 0)
+        {
+            return err;
+        }
+    }
+    return VI_SUCCESS;
+}
 
-    assert(driver);
-    asynPrint(pasynUser, ASYN_TRACE_FLOW,
-              "%s read.\n", driver->resourceName);
-	epicsTimeGetCurrent(&epicsTS1);
-    *nbytesTransfered = 0;
-    if (gotEom) *gotEom = 0;
-	if (!driver->connected)
-	{
-            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                          "%s disconnected:", driver->resourceName);
-            return asynError;
-	}
-	++(driver->nReadCalls);
-    if (maxchars <= 0) {
-        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-                  "%s maxchars %d. Why <=0?",driver->resourceName,(int)maxchars);
-        return asynError;
+/// stop a posted job with viTerminate and collect its completion, any data it transferred is left in job->count
+static void cancelJob(visaDriver_t *driver, visaJob_t *job)
+{
+    if (job->posted && !job->done)
+    {
+        driver->backend->terminate(driver->vi, VI_NULL, job->id);
+        waitJob(driver, job, 1.0);
     }
-	driver->timeout = pasynUser->timeout;
-	// this is an optimisation - stream device does a zero timeout read to clear the input buffer
-	if (driver->timeout == 0 && driver->readIntTimeout < 0)
-	{
-//	    err = viFlush(driver->vi, VI_IO_IN_BUF_DISCARD);
-		// this seems to error on GPIB?
-//		VI_CHECK_ERROR("viFlush", err);
-        data[0] = 0; // already checked maxchars > 0 above
-		status = asynTimeout;
-		epicsTimeGetCurrent(&epicsTS2);
-		asynPrint(pasynUser, ASYN_TRACE_FLOW,
-			"read %lu from %s, return %s.\n", (unsigned long)*nbytesTransfered,
-			driver->resourceName,
-			pasynManager->strStatus(status));
-		asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s Read took %f timeout was %f\n", driver->resourceName,
-			epicsTimeDiffInSeconds(&epicsTS2, &epicsTS1), pasynUser->timeout);
-		return asynTimeout;
-	}		
-//	ViUInt32 avail = 0;
-	// should we only ever try and read one character?
-//	if (driver->isSerial)
-//	{
-//		if (viGetAttribute(driver->vi, VI_ATTR_ASRL_AVAIL_NUM, &avail) == VI_SUCCESS)
-//		{
-//			if (avail > maxchars)
-//			{
-//				avail = maxchars;
-//			}
-//		}
-//	}
+}
 
-// try and read one character, if we don't time out try and read more with an immediate timeout
-// we always need to set timeout as we reset to immediate below
-// we don't use driver->readIntTimeout
-// whatever out timeout, we can get called with a timeout of 0 by higher levels to flush the input queue 
-// prior to a write, hence we need to map to  readIntTimeout  to avois problems on GPIB-ENET
-	if (driver->timeout == 0)
-	{
-		err = viSetAttribute(driver->vi, VI_ATTR_TMO_VALUE, (driver->readIntTimeout == 0 ? VI_TMO_IMMEDIATE  : driver->readIntTimeout) );
-	}
-	else
-	{
-		err = viSetAttribute(driver->vi, VI_ATTR_TMO_VALUE, static_cast<int>(driver->timeout * 1000.0));
-	}
-	VI_CHECK_ERROR("set timeout", err);
-	// if the device sends an EOM the read will terminate then rather than on timeout
-	if (driver->deviceSendsEOM)
-	{
-	    err = viRead(driver->vi, (ViBuf)data, static_cast<ViUInt32>(maxchars), &actual);
-		// we have had issues with GPIB-ENET and immediate timeout, it returns bus error sometimes
-		// so don't close connectuion here, but ultimately return asynError via later logic
-		if (err < 0 && err != VI_ERROR_TMO && (driver->timeout != 0 || (driver->timeout == 0 && driver->readIntTimeout != 0)) )
-		{
-			closeConnection(pasynUser, driver, "Read error");
-			epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-				"%s read error %s", driver->resourceName, errMsg(driver->vi, err).c_str());
-			return asynError;
-		}
-	}
-	else
-	{
-		err = viRead(driver->vi, (ViBuf)data, 1, &actual);
-		// we have had issues with GPIB-ENET and immediate timeout, returns bus error sometimes
-		// so don't close connectuion here, but ultimately return asynError via later logic
-		if (err < 0 && err != VI_ERROR_TMO && (driver->timeout != 0 || (driver->timeout == 0 && driver->readIntTimeout != 0)) )
-		{
-			closeConnection(pasynUser, driver, "Read error (stage 1)");
-			epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-				"%s read error %s", driver->resourceName, errMsg(driver->vi, err).c_str());
-			return asynError;
-		}
-		if (actual > 0 && err == VI_SUCCESS_MAX_CNT)
-		{
-			// read anything else that might be there, originally this used VI_TMO_IMMEDIATE
-			// but we had a few timeout issues with GPIP over ethernet so this is now 
-			// configurable to a small finite value
-			err = viSetAttribute(driver->vi, VI_ATTR_TMO_VALUE, (driver->readIntTimeout > 0 ? driver->readIntTimeout : VI_TMO_IMMEDIATE));
-			VI_CHECK_ERROR("set timeout", err);
-			err = viRead(driver->vi, reinterpret_cast<ViBuf>(data + actual), static_cast<ViUInt32>(maxchars - actual), &actualex);
-			if (err < 0 && err != VI_ERROR_TMO)
-			{
-				closeConnection(pasynUser, driver, "Read error (stage 2)");
-				epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-					"%s read error %s", driver->resourceName, errMsg(driver->vi, err).c_str());
-				return asynError;
-			}
-			actual += actualex;
-			// a VI_SUCCESS on GPIB means we got the EOM, on serial it doesn't necessarily mean this
-			// so on timeout don't convert to VI_SUCCESS but to something that will get ignored in the
-			// next case statement
-			// remove expected VI_ERROR_TMO, but leave VI_SUCCESS_TERM_CHAR etc.
-			if (err < 0)
-			{
-				err = VI_WARN_UNKNOWN_STATUS;
-			}
-		}
-	}
-	switch(err)
-	{
-		case VI_SUCCESS:
-			if (driver->deviceSendsEOM && actual > 0)
-			{
-				reason |= ASYN_EOM_END;
-			}
-		    break;
-			
-		case VI_SUCCESS_TERM_CHAR:
-			reason |= ASYN_EOM_EOS;  
-			break;
-			
-		case VI_SUCCESS_MAX_CNT:
-//			reason |= ASYN_EOM_CNT;  // we read avail not maxchars, add this later if needed
-			break;
-			
-		case VI_ERROR_TMO:
-			status = asynTimeout;
-			break;
-			
-		default:
-			if (err < 0)
-			{
-				status = asynError;
-				epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-					"%s read error %s", driver->resourceName, errMsg(driver->vi, err).c_str());
-			}
-			break;
-	}
-	if (actual > 0)
-	{
-        asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, actual,
-                   "%s read %d\n", driver->resourceName, actual);
-        driver->nReadBytes += (unsigned long)actual;
+/// can overlapped I/O be used on this session. GPIB is excluded as the device can't talk while
+/// being addressed to listen, and serial needs termCharIn to end the posted read.
+static bool asyncSupported(visaDriver_t *driver)
+{
+    return hasEvents(driver) && !driver->isGPIB && (!driver->isSerial || driver->termCharIn != 0);
+}
+
+/// enable I/O completion events for overlapped write and read on the current session
+static void startAsyncIO(visaDriver_t *driver)
+{
+    if (driver->asyncRunning || !driver->connected || !asyncSupported(driver))
+    {
+        return;
     }
-//	else
-//	{
-//           epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
-//                          "%s read", driver->resourceName);
-//            closeConnection(pasynUser,driver,"Read error");
-//            status = asynError;
-//    }
-    *nbytesTransfered = actual;
-    /* If there is room add a null byte */
-    if (actual < (int) maxchars)
-        data[actual] = 0;
+    if (driver->asyncBuffer == NULL || driver->asyncBufferSize != driver->asyncSize)
+    {
+        free(driver->asyncBuffer);
+        driver->asyncBuffer = (char*)callocMustSucceed(driver->asyncSize, 1, "drvAsynVISAPort async read");
+        driver->asyncBufferSize = driver->asyncSize;
+    }
+    ViStatus err = driver->backend->enableEvent(driver->vi, VI_EVENT_IO_COMPLETION, VI_QUEUE);
+    if (err < 0)
+    {
+        asynPrint(driver->pasynUser, ASYN_TRACE_ERROR, "%s: cannot enable I/O completion events: %s\n",
+                  driver->portName, errMsg(driver, err).c_str());
+        return;
+    }
+    driver->readJob.posted = driver->writeJob.posted = false;
+    driver->asyncOffset = driver->asyncLength = 0;
+    driver->asyncRunning = true;
+}
+
+/// end overlapped I/O, terminating anything still in progress
+static void stopAsyncIO(visaDriver_t *driver)
+{
+    if (!driver->asyncRunning)
+    {
+        return;
+    }
+    cancelJob(driver, &(driver->readJob));
+    cancelJob(driver, &(driver->writeJob));
+    driver->readJob.posted = driver->writeJob.posted = false;
+    driver->asyncOffset = driver->asyncLength = 0;
+    driver->backend->disableEvent(driver->vi, VI_EVENT_IO_COMPLETION, VI_QUEUE);
+    driver->backend->discardEvents(driver->vi, VI_EVENT_IO_COMPLETION, VI_QUEUE);
+    driver->asyncRunning = false;
+}
+
+/// overlapped write: post a read for the reply, then write with viWriteAsync. The reply is collected
+/// by asyncRead(), so a device that starts replying before the write has completed can't be missed
+/// and readIt doesn't pay the cost of starting a read.
+/// @return VISA status of the write, VI_ERROR_TMO if it did not complete within driver->timeout
+static ViStatus asyncWrite(visaDriver_t *driver, const char *data, size_t numchars, ViUInt32 *actual)
+{
+    ViStatus err;
+    *actual = 0;
+    // an uncollected reply from a previous write is stale, as is anything left unread from it
+    cancelJob(driver, &(driver->readJob));
+    driver->readJob.posted = false;
+    driver->asyncOffset = driver->asyncLength = 0;
+    // our posted read may wait for as long as it likes, asyncRead() applies the caller's timeout with viTerminate
+    if ( (err = setAttr(driver, VI_ATTR_TMO_VALUE, VI_TMO_INFINITE)) < 0 )
+    {
+        return err;
+    }
+    // if the job never completes, e.g. the session failed, these are what asyncRead() sees
+    driver->readJob.done = false;
+    driver->readJob.count = 0;
+    driver->readJob.status = VI_ERROR_TMO;
+    if ( (err = driver->backend->readAsync(driver->vi, reinterpret_cast<ViBuf>(driver->asyncBuffer), static_cast<ViUInt32>(driver->asyncBufferSize), &(driver->readJob.id))) < 0 )
+    {
+        return err;
+    }
+    driver->readJob.posted = true;
+    driver->writeJob.done = false;
+    driver->writeJob.count = 0;
+    driver->writeJob.status = VI_ERROR_TMO;
+    if ( (err = driver->backend->writeAsync(driver->vi, (ViBuf)data, static_cast<ViUInt32>(numchars), &(driver->writeJob.id))) < 0 )
+    {
+        return err;
+    }
+    driver->writeJob.posted = true;
+    if (waitJob(driver, &(driver->writeJob), (driver->timeout != 0 ? driver->timeout :
+                                             (driver->hardDeadline > 0 ? driver->hardDeadline / 1000.0 : -1.0))) != VI_SUCCESS)
+    {
+        cancelJob(driver, &(driver->writeJob));
+        *actual = driver->writeJob.count;
+        driver->writeJob.posted = false;
+        return VI_ERROR_TMO;
+    }
+    *actual = driver->writeJob.count;
+    driver->writeJob.posted = false;
+    return (driver->writeJob.status == VI_ERROR_ABORT ? VI_ERROR_TMO : driver->writeJob.status);
+}
+
+/// read from the reply posted by asyncWrite(), waiting for it to complete if necessary
+static asynStatus asyncRead(visaDriver_t *driver, asynUser *pasynUser,
+    char *data, size_t maxchars, size_t *nbytesTransfered, int *gotEom)
+{
+    int reason = 0;
+    size_t n = 0;
+    if (driver->readJob.posted)
+    {
+        if (driver->readJob.done)
+        {
+            ++(driver->nAsyncReady);
+        }
+        if (waitJob(driver, &(driver->readJob), (driver->timeout < 0 ? -1.0 : driver->timeout)) != VI_SUCCESS)
+        {
+            cancelJob(driver, &(driver->readJob));
+        }
+        ++(driver->nAsyncReads);
+        driver->readJob.posted = false;
+        driver->asyncOffset = 0;
+        driver->asyncLength = driver->readJob.count;
+        driver->asyncEndStatus = driver->readJob.status;
+        driver->lastViStatus = driver->asyncEndStatus;
+        if (driver->asyncEndStatus < 0 && driver->asyncEndStatus != VI_ERROR_TMO && driver->asyncEndStatus != VI_ERROR_ABORT)
+        {
+            ViStatus err = driver->asyncEndStatus;
+            closeConnection(pasynUser, driver, "Read error (async)");
+            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                "%s read error %s", driver->resourceName, errMsg(driver, err).c_str());
+            return asynError;
+        }
+    }
+    n = driver->asyncLength - driver->asyncOffset;
+    n = (n < maxchars ? n : maxchars);
+    memcpy(data, driver->asyncBuffer + driver->asyncOffset, n);
+    driver->asyncOffset += n;
+    if (n > 0)
+    {
+        asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, n,
+                   "%s read %lu\n", driver->resourceName, (unsigned long)n);
+        driver->nReadBytes += n;
+    }
+    // the posted read stopped where VISA saw the end of the reply, so only report that with its last byte
+    if (n > 0 && driver->asyncOffset == driver->asyncLength)
+    {
+        if (driver->asyncEndStatus == VI_SUCCESS_TERM_CHAR)
+        {
+            reason |= ASYN_EOM_EOS;
+        }
+        else if (driver->asyncEndStatus == VI_SUCCESS && endIsEOM(driver))
+        {
+            reason |= ASYN_EOM_END;
+        }
+    }
+    *nbytesTransfered = n;
+    if (n < maxchars)
+        data[n] = 0;
     else
         reason |= ASYN_EOM_CNT;
     if (gotEom) *gotEom = reason;
-	epicsTimeGetCurrent(&epicsTS2);
-    asynPrint(pasynUser, ASYN_TRACE_FLOW,
-              "read %lu from %s, return %s.\n", (unsigned long)*nbytesTransfered,
-                                               driver->resourceName,
-                                               pasynManager->strStatus(status));
-	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s Read took %f timeout was %f\n", driver->resourceName, 
-	          epicsTimeDiffInSeconds(&epicsTS2, &epicsTS1), pasynUser->timeout);
-    return status;
+    return (n > 0 ? asynSuccess : asynTimeout);
 }
 
-/// flush device
-static asynStatus
-flushIt(void *drvPvt,asynUser *pasynUser)
+/// queued by coalesceTimerCallback(), runs on the port thread to send writes that have waited coalesceAge.
+/// Their writers have already been told they succeeded, so a failure is kept for the next read, query or flush
+static void coalesceProcess(asynUser *pasynUser)
 {
-	epicsTimeStamp epicsTS1, epicsTS2;
-	epicsTimeGetCurrent(&epicsTS1);
-    visaDriver_t *driver = (visaDriver_t*)drvPvt;
-    assert(driver);
-	if (!driver->connected)
-	{
-		epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
-			"%s disconnected:", driver->resourceName);
-		return asynError;
-	}
-	//	ViStatus err = viFlush(driver->vi, VI_IO_OUT_BUF);
-//	ViStatus err = viFlush(driver->vi, VI_IO_IN_BUF_DISCARD);
-//	VI_CHECK_ERROR("flush", err);
-	epicsTimeGetCurrent(&epicsTS2);
-    asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s flush\n", driver->resourceName);
-	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s flush took %f\n", driver->resourceName, 
-	          epicsTimeDiffInSeconds(&epicsTS2, &epicsTS1));
+    visaDriver_t *driver = (visaDriver_t*)pasynUser->userPvt;
+    asynStatus status;
+    epicsAtomicSetIntT(&(driver->coalesceQueued), 0);
+    if (driver->connected && (status = coalesceFlush(driver, pasynUser)) != asynSuccess)
+    {
+        ++(driver->nCoalesceErrors);
+        driver->coalesceStatus = status;
+        epicsSnprintf(driver->coalesceMessage, sizeof(driver->coalesceMessage), "coalesced write failed: %s",
+                      pasynUser->errorMessage);
+        asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: %s\n", driver->portName, driver->coalesceMessage);
+    }
+}
+
+/// the oldest buffered write has waited coalesceAge, ask the port thread to send them
+static void coalesceTimerCallback(void *arg)
+{
+    visaDriver_t *driver = (visaDriver_t*)arg;
+    if (driver->coalesceUser != NULL && !epicsAtomicGetIntT(&(driver->coalesceQueued)))
+    {
+        epicsAtomicSetIntT(&(driver->coalesceQueued), 1);
+        if (pasynManager->queueRequest(driver->coalesceUser, asynQueuePriorityLow, 0.0) != asynSuccess)
+        {
+            epicsAtomicSetIntT(&(driver->coalesceQueued), 0);
+        }
+    }
+}
+
+/// allocate the write coalescing buffer, timer and asynUser, returns false if the asynUser cannot be connected
+static bool startCoalesce(visaDriver_t *driver, asynUser *pasynUser)
+{
+    if (driver->coalesceLength == 0 && driver->coalesceBufferSize != driver->coalesceSize)
+    {
+        free(driver->coalesceBuffer);
+        driver->coalesceBuffer = (char*)callocMustSucceed(driver->coalesceSize, 1, "drvAsynVISAPort coalesce");
+        driver->coalesceBufferSize = driver->coalesceSize;
+    }
+    if (driver->coalesceUser == NULL)
+    {
+        driver->coalesceUser = pasynManager->createAsynUser(coalesceProcess, 0);
+        driver->coalesceUser->userPvt = driver;
+        if (pasynManager->connectDevice(driver->coalesceUser, driver->portName, driver->addr) != asynSuccess)
+        {
+            // without it the timer could not send the writes, so there is no coalescing
+            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize, "%s: coalesce connectDevice failed %s",
+                          driver->portName, driver->coalesceUser->errorMessage);
+            pasynManager->freeAsynUser(driver->coalesceUser);
+            driver->coalesceUser = NULL;
+            return false;
+        }
+    }
+    if (driver->coalesceTimer == NULL)
+    {
+        if (coalesceTimerQueue == NULL)
+        {
+            coalesceTimerQueue = epicsTimerQueueAllocate(1, epicsThreadPriorityScanHigh);
+        }
+        driver->coalesceTimer = epicsTimerQueueCreateTimer(coalesceTimerQueue, coalesceTimerCallback, driver);
+    }
+    return true;
+}
+
+/// the timeout (ms) to use when waiting for the rest of a reply after its first byte, 0 means immediate
+static int stage2Timeout(visaDriver_t *driver)
+{
+    if (driver->adaptiveTmo)
+    {
+        return (driver->learnedTmo >= 0 ? driver->learnedTmo : driver->adaptiveMax);
+    }
+    return (driver->readIntTimeout > 0 ? driver->readIntTimeout : 0);
+}
+
+/// record the time (s) between the first byte of a reply and its end, and update the learned stage 2
+/// timeout to twice the 95th percentile of recent gaps, within adaptiveMin and adaptiveMax
+static void learnReplyGap(visaDriver_t *driver, double gap)
+{
+    double sorted[VISA_GAP_SAMPLES];
+    if (gap < 0.0)
+    {
+        gap = 0.0;
+    }
+    driver->gapSamples[driver->gapIndex] = gap;
+    driver->gapIndex = (driver->gapIndex + 1) % VISA_GAP_SAMPLES;
+    if (driver->nGapSamples < VISA_GAP_SAMPLES)
+    {
+        ++(driver->nGapSamples);
+    }
+    if (driver->nGapSamples < 8)
+    {
+        return; // too few to trust yet
+    }
+    int n = driver->nGapSamples, k = (95 * (n - 1)) / 100;
+    std::copy(driver->gapSamples, driver->gapSamples + n, sorted);
+    std::nth_element(sorted, sorted + k, sorted + n);
+    int tmo = static_cast<int>(ceil(2000.0 * sorted[k]));
+    driver->learnedTmo = (tmo < driver->adaptiveMin ? driver->adaptiveMin : (tmo > driver->adaptiveMax ? driver->adaptiveMax : tmo));
+}
+
+/// read from the serial read ahead ring rather than VISA
+static asynStatus readAheadRead(visaDriver_t *driver, asynUser *pasynUser,
+    char *data, size_t maxchars, size_t *nbytesTransfered, int *gotEom)
+{
+    visaRing_t *ring = &(driver->ring);
+    epicsTimeStamp now;
+    int reason = 0;
+    bool eos = false;
+    size_t n = 0;
+    double timeout = pasynUser->timeout;
+    while(ringCount(ring) == 0 && driver->readAheadStatus >= 0 && timeout != 0)
+    {
+        if (timeout < 0)
+        {
+            epicsEventWait(driver->readAheadDataEvent);
+            continue;
+        }
+        epicsTimeGetCurrent(&now);
+        double remaining = timeout - epicsTimeDiffInSeconds(&now, &(driver->readStart));
+        if (remaining <= 0.0 || epicsEventWaitWithTimeout(driver->readAheadDataEvent, remaining) != epicsEventOK)
+        {
+            break;
+        }
+    }
+    n = ringGet(ring, data, maxchars, driver->termCharIn, &eos);
+    if (n > 0)
+    {
+        epicsTimeGetCurrent(&now);
+        driver->firstByteWait = epicsTimeDiffInSeconds(&now, &(driver->readStart));
+        // as with a VISA read, allow up to stage2Timeout() between characters for the rest of the reply
+        int tmo = stage2Timeout(driver);
+        bool timedOut = (tmo <= 0 && !eos && n < maxchars);
+        while(!eos && n < maxchars && tmo > 0)
+        {
+            if (ringCount(ring) == 0 &&
+                epicsEventWaitWithTimeout(driver->readAheadDataEvent, tmo / 1000.0) != epicsEventOK)
+            {
+                timedOut = true;
+                break;
+            }
+            n += ringGet(ring, data + n, maxchars - n, driver->termCharIn, &eos);
+        }
+        epicsEventSignal(driver->readAheadSpaceEvent);
+        if (driver->adaptiveTmo)
+        {
+            // as in readVISA(), a reply that ended with a timeout stopped arriving tmo before now
+            epicsTimeStamp end;
+            epicsTimeGetCurrent(&end);
+            learnReplyGap(driver, epicsTimeDiffInSeconds(&end, &now) - (timedOut ? tmo / 1000.0 : 0.0));
+        }
+    }
+    else if (driver->readAheadStatus < 0)
+    {
+        ViStatus err = driver->readAheadStatus;
+        std::string msg = errMsg(driver, err);
+        closeConnection(pasynUser, driver, "Read ahead error");
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+            "%s read error %s", driver->resourceName, msg.c_str());
+        return asynError;
+    }
+    *nbytesTransfered = n;
+    if (n > 0)
+    {
+        asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, n,
+                   "%s read %lu\n", driver->resourceName, (unsigned long)n);
+        driver->nReadBytes += n;
+    }
+    if (eos)
+    {
+        reason |= ASYN_EOM_EOS;
+    }
+    if (n < maxchars)
+        data[n] = 0;
+    else
+        reason |= ASYN_EOM_CNT;
+    if (gotEom) *gotEom = reason;
+    return (n > 0 ? asynSuccess : asynTimeout);
+}
+
+/// does this asynOption key map onto VI_ATTR_ASRL_FLOW_CNTRL
+static bool isFlowKey(const char* key)
+{
+    return (epicsStrCaseCmp(key, "clocal") == 0 || epicsStrCaseCmp(key, "crtscts") == 0 ||
+            epicsStrCaseCmp(key, "ixon") == 0 || epicsStrCaseCmp(key, "ixoff") == 0);
+}
+
+/// parse a Y/N asynOption value
+static asynStatus parseYesNo(asynUser *pasynUser, const char *key, const char *val, bool *value)
+{
+    if (epicsStrCaseCmp(val, "Y") == 0) {
+        *value = true;
+    }
+    else if (epicsStrCaseCmp(val, "N") == 0) {
+        *value = false;
+    }
+    else {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                "Invalid %s value.", key);
+        return asynError;
+    }
     return asynSuccess;
 }
 
-static asynOctet asynOctetMethods = { writeIt, readIt, flushIt };
+/// parse an integer asynOption value
+static asynStatus parseInt(asynUser *pasynUser, const char *val, int *value)
+{
+    if(sscanf(val, "%d", value) != 1) {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                                                            "Bad number");
+        return asynError;
+    }
+    return asynSuccess;
+}
+
+/// asynOption keys that configure the driver itself rather than VISA serial attributes. These
+/// can be set whether or not we are connected, and apply to all interface types unless noted.
+/// @return true if key is a driver option, in which case *status is the result
+static bool
+setDriverOption(visaDriver_t *driver, asynUser *pasynUser, const char *key, const char *val, asynStatus *status)
+{
+    bool b;
+    int i;
+    *status = asynSuccess;
+    if (epicsStrCaseCmp(key, "readahead") == 0) {
+        if ( (*status = parseYesNo(pasynUser, key, val, &b)) != asynSuccess ) {
+            return true;
+        }
+        if (b && driver->connected && !driver->isSerial) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s readahead - not a serial device", driver->resourceName);
+            *status = asynError;
+            return true;
+        }
+        if (b && driver->asyncIO) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s readahead - cannot be used with asyncio", driver->resourceName);
+            *status = asynError;
+            return true;
+        }
+        driver->readAhead = b;
+        if (b) {
+            startReadAhead(driver);
+        }
+        else if (!stopReadAhead(driver)) {
+            closeConnection(pasynUser, driver, "Read ahead thread did not exit");
+        }
+    }
+    else if (epicsStrCaseCmp(key, "readaheadsize") == 0) {
+        if ( (*status = parseInt(pasynUser, val, &i)) != asynSuccess ) {
+            return true;
+        }
+        driver->readAheadSize = (i > 0 ? i : 0);
+        if (driver->readAheadRunning) {
+            if (stopReadAhead(driver)) {
+                startReadAhead(driver);
+            }
+            else {
+                closeConnection(pasynUser, driver, "Read ahead thread did not exit");
+            }
+        }
+    }
+    else if (epicsStrCaseCmp(key, "readaheadhigh") == 0) {
+        driver->readAheadHigh = 0; // any value resets the high water mark
+    }
+    else if (epicsStrCaseCmp(key, "adaptivetmo") == 0) {
+        if ( (*status = parseYesNo(pasynUser, key, val, &b)) != asynSuccess ) {
+            return true;
+        }
+        if (b && !driver->adaptiveTmo) {
+            driver->nGapSamples = driver->gapIndex = 0; // start learning afresh
+            driver->learnedTmo = -1;
+        }
+        driver->adaptiveTmo = b;
+    }
+    else if (epicsStrCaseCmp(key, "adaptivemin") == 0 || epicsStrCaseCmp(key, "adaptivemax") == 0) {
+        if ( (*status = parseInt(pasynUser, val, &i)) != asynSuccess ) {
+            return true;
+        }
+        if (i < 0) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid %s value.", key);
+            *status = asynError;
+            return true;
+        }
+        bool isMin = (epicsStrCaseCmp(key, "adaptivemin") == 0);
+        if (isMin ? i > driver->adaptiveMax : i < driver->adaptiveMin) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s %d - adaptivemin must not be more than adaptivemax (%d..%d)", key, i,
+                          driver->adaptiveMin, driver->adaptiveMax);
+            *status = asynError;
+            return true;
+        }
+        if (isMin) {
+            driver->adaptiveMin = i;
+        }
+        else {
+            driver->adaptiveMax = i;
+        }
+        if (driver->learnedTmo >= 0) {
+            driver->learnedTmo = (driver->learnedTmo < driver->adaptiveMin ? driver->adaptiveMin :
+                                 (driver->learnedTmo > driver->adaptiveMax ? driver->adaptiveMax : driver->learnedTmo));
+        }
+    }
+    else if (epicsStrCaseCmp(key, "learnedtmo") == 0) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                "%s is read only", key);
+        *status = asynError;
+        return true;
+    }
+    else if (epicsStrCaseCmp(key, "asyncio") == 0) {
+        if ( (*status = parseYesNo(pasynUser, key, val, &b)) != asynSuccess ) {
+            return true;
+        }
+        if (b && driver->readAhead) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s asyncio - cannot be used with readahead", driver->resourceName);
+            *status = asynError;
+            return true;
+        }
+        if (b && driver->connected && !asyncSupported(driver)) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s asyncio - not supported on GPIB, or serial without termCharIn", driver->resourceName);
+            *status = asynError;
+            return true;
+        }
+        driver->asyncIO = b;
+        if (b) {
+            startAsyncIO(driver);
+        }
+        else {
+            stopAsyncIO(driver);
+        }
+    }
+    else if (epicsStrCaseCmp(key, "asyncsize") == 0) {
+        if ( (*status = parseInt(pasynUser, val, &i)) != asynSuccess ) {
+            return true;
+        }
+        if (i <= 0) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid %s value.", key);
+            *status = asynError;
+            return true;
+        }
+        driver->asyncSize = i;
+        if (driver->asyncRunning) {
+            stopAsyncIO(driver);
+            startAsyncIO(driver);
+        }
+    }
+    else if (epicsStrCaseCmp(key, "readdr") == 0 || epicsStrCaseCmp(key, "unaddr") == 0) {
+        if ( (*status = parseYesNo(pasynUser, key, val, &b)) != asynSuccess ) {
+            return true;
+        }
+        bool readdr = (epicsStrCaseCmp(key, "readdr") == 0);
+        if (readdr) {
+            driver->gpibReaddr = b;
+        }
+        else {
+            driver->gpibUnaddr = b;
+        }
+        if (driver->connected && driver->isGPIB) {
+            ViStatus err = setAttr(driver, (readdr ? VI_ATTR_GPIB_READDR_EN : VI_ATTR_GPIB_UNADDR_EN), (b ? VI_TRUE : VI_FALSE));
+            if (err < 0) {
+                epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                              "%s: %s %s", driver->resourceName, key, errMsg(driver, err).c_str());
+                *status = asynError;
+                return true;
+            }
+        }
+    }
+    else if (epicsStrCaseCmp(key, "tcpnodelay") == 0 || epicsStrCaseCmp(key, "tcpkeepalive") == 0) {
+        if ( (*status = parseYesNo(pasynUser, key, val, &b)) != asynSuccess ) {
+            return true;
+        }
+        if (epicsStrCaseCmp(key, "tcpnodelay") == 0) {
+            driver->tcpNoDelay = b;
+        }
+        else {
+            driver->tcpKeepAlive = b;
+        }
+        if (driver->connected && (*status = setTcpipAttrs(driver, pasynUser)) != asynSuccess) {
+            return true;
+        }
+    }
+    else if (epicsStrCaseCmp(key, "tcptermchar") == 0) {
+        if ( (*status = parseYesNo(pasynUser, key, val, &b)) != asynSuccess ) {
+            return true;
+        }
+        driver->tcpTermChar = b;
+        if (driver->connected && (*status = setTermCharAttrs(driver, pasynUser)) != asynSuccess) {
+            return true;
+        }
+    }
+    else if (epicsStrCaseCmp(key, "usbend") == 0) {
+        if ( (*status = parseYesNo(pasynUser, key, val, &b)) != asynSuccess ) {
+            return true;
+        }
+        driver->usbEnd = b;
+    }
+    else if (epicsStrCaseCmp(key, "usbmaxintrsize") == 0 || epicsStrCaseCmp(key, "inbufsize") == 0 ||
+             epicsStrCaseCmp(key, "outbufsize") == 0) {
+        if ( (*status = parseInt(pasynUser, val, &i)) != asynSuccess ) {
+            return true;
+        }
+        if (i < 0 || (i > 65535 && epicsStrCaseCmp(key, "usbmaxintrsize") == 0)) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid %s value.", key);
+            *status = asynError;
+            return true;
+        }
+        if (epicsStrCaseCmp(key, "usbmaxintrsize") == 0) {
+            driver->usbMaxIntrSize = i;
+        }
+        else if (epicsStrCaseCmp(key, "inbufsize") == 0) {
+            driver->inBufSize = i;
+        }
+        else {
+            driver->outBufSize = i;
+        }
+        if (driver->connected && (*status = setBufferAttrs(driver, pasynUser)) != asynSuccess) {
+            return true;
+        }
+    }
+    else if (epicsStrCaseCmp(key, "flightdump") == 0) {
+        if ( (*status = parseYesNo(pasynUser, key, val, &b)) != asynSuccess ) {
+            return true;
+        }
+        driver->flightDump = b;
+    }
+    else if (epicsStrCaseCmp(key, "coalesce") == 0) {
+        if ( (*status = parseYesNo(pasynUser, key, val, &b)) != asynSuccess ) {
+            return true;
+        }
+        if (b && !startCoalesce(driver, pasynUser)) {
+            *status = asynError;
+            return true;
+        }
+        if (!b && driver->coalesce && driver->connected) {
+            // send what we have now rather than leave it waiting
+            coalesceFlush(driver, pasynUser);
+        }
+        driver->coalesce = b;
+    }
+    else if (epicsStrCaseCmp(key, "coalescesize") == 0 || epicsStrCaseCmp(key, "coalesceage") == 0) {
+        if ( (*status = parseInt(pasynUser, val, &i)) != asynSuccess ) {
+            return true;
+        }
+        if (i < 0 || (i == 0 && epicsStrCaseCmp(key, "coalescesize") == 0)) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid %s value.", key);
+            *status = asynError;
+            return true;
+        }
+        if (driver->coalesceLength > 0) {
+            coalesceFlush(driver, pasynUser);
+        }
+        if (epicsStrCaseCmp(key, "coalescesize") == 0) {
+            driver->coalesceSize = i;
+            if (driver->coalesce && !startCoalesce(driver, pasynUser)) {
+                driver->coalesce = false;
+                *status = asynError;
+                return true;
+            }
+        }
+        else {
+            driver->coalesceAge = i;
+        }
+    }
+    else if (epicsStrCaseCmp(key, "ioretries") == 0 || epicsStrCaseCmp(key, "reopenmaxbackoff") == 0) {
+        if ( (*status = parseInt(pasynUser, val, &i)) != asynSuccess ) {
+            return true;
+        }
+        if (i < 0) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid %s value.", key);
+            *status = asynError;
+            return true;
+        }
+        if (epicsStrCaseCmp(key, "ioretries") == 0) {
+            driver->ioRetries = i;
+        }
+        else {
+            driver->reopenMaxBackoff = i;
+        }
+    }
+    else if (epicsStrCaseCmp(key, "draintmo") == 0 || epicsStrCaseCmp(key, "drainmax") == 0) {
+        if ( (*status = parseInt(pasynUser, val, &i)) != asynSuccess ) {
+            return true;
+        }
+        if (i < 0) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid %s value.", key);
+            *status = asynError;
+            return true;
+        }
+        if (epicsStrCaseCmp(key, "draintmo") == 0) {
+            driver->drainTmo = i;
+        }
+        else {
+            driver->drainMax = i;
+        }
+    }
+    else if (epicsStrCaseCmp(key, "deadline") == 0) {
+        if ( (*status = parseInt(pasynUser, val, &i)) != asynSuccess ) {
+            return true;
+        }
+        if (i < 0) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid deadline value.");
+            *status = asynError;
+            return true;
+        }
+        driver->hardDeadline = i;
+    }
+    else if (epicsStrCaseCmp(key, "readinttmo") == 0) {
+        if ( (*status = parseInt(pasynUser, val, &i)) != asynSuccess ) {
+            return true;
+        }
+        driver->readIntTimeout = i;
+    }
+    else if (epicsStrCaseCmp(key, "recoverclear") == 0) {
+        if ( (*status = parseYesNo(pasynUser, key, val, &b)) != asynSuccess ) {
+            return true;
+        }
+        driver->recoverClear = b;
+    }
+    else if (epicsStrCaseCmp(key, "cachettl") == 0) {
+        if ( (*status = parseInt(pasynUser, val, &i)) != asynSuccess ) {
+            return true;
+        }
+        if (i < 0) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid %s value.", key);
+            *status = asynError;
+            return true;
+        }
+        driver->cacheTtl = i;
+        cacheClear(driver);
+    }
+    else if (epicsStrCaseCmp(key, "cacheprefix") == 0) {
+        std::vector<char> raw(strlen(val) + 1);
+        int n = epicsStrnRawFromEscaped(&(raw[0]), raw.size(), val, strlen(val));
+        std::vector<std::string>& prefixes = driver->respCache->prefixes;
+        prefixes.clear();
+        for(int start = 0, end = 0; start < n; start = end + 1) {
+            for(end = start; end < n && raw[end] != '|'; ++end)
+                ;
+            if (end > start) {
+                prefixes.push_back(std::string(&(raw[start]), end - start));
+            }
+        }
+        cacheClear(driver);
+    }
+    else if (epicsStrCaseCmp(key, "blocktype") == 0) {
+        for(i = 0; i < visaBlockNum && epicsStrCaseCmp(val, visaBlockTypeInfo[i].name) != 0; ++i)
+            ;
+        if (i == visaBlockNum) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid blocktype value.");
+            *status = asynError;
+            return true;
+        }
+        driver->blockType = static_cast<visaBlockType_t>(i);
+    }
+    else if (epicsStrCaseCmp(key, "blockendian") == 0) {
+        if (epicsStrCaseCmp(val, "big") == 0) {
+            driver->blockBigEndian = true;
+        }
+        else if (epicsStrCaseCmp(val, "little") == 0) {
+            driver->blockBigEndian = false;
+        }
+        else {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid blockendian value.");
+            *status = asynError;
+            return true;
+        }
+    }
+    else if (epicsStrCaseCmp(key, "blockeos") == 0) {
+        char eos[sizeof(driver->blockEos)];
+        int n = epicsStrnRawFromEscaped(eos, sizeof(eos), val, strlen(val));
+        if (n >= static_cast<int>(sizeof(eos))) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "blockeos too long.");
+            *status = asynError;
+            return true;
+        }
+        memcpy(driver->blockEos, eos, n);
+        driver->blockEosLen = n;
+    }
+    else if (epicsStrCaseCmp(key, "srq") == 0) {
+        if ( (*status = parseYesNo(pasynUser, key, val, &b)) != asynSuccess ) {
+            return true;
+        }
+        if (b && driver->connected && driver->isSerial) {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s srq - not supported on a serial device", driver->resourceName);
+            *status = asynError;
+            return true;
+        }
+        driver->srq = b;
+        if (b) {
+            startSrq(driver);
+        }
+        else {
+            stopSrq(driver);
+        }
+    }
+    else if (epicsStrCaseCmp(key, "srqread") == 0) {
+        if ( (*status = parseYesNo(pasynUser, key, val, &b)) != asynSuccess ) {
+            return true;
+        }
+        driver->srqRead = b;
+    }
+    else if (epicsStrCaseCmp(key, "readstrategy") == 0) {
+        if (epicsStrCaseCmp(val, "twostage") == 0) {
+            driver->readAvail = false;
+        }
+        else if (epicsStrCaseCmp(val, "avail") == 0) {
+            driver->readAvail = true;
+        }
+        else {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid readstrategy value.");
+            *status = asynError;
+            return true;
+        }
+    }
+    else {
+        return false;
+    }
+    asynPrint(driver->pasynUser, ASYN_TRACEIO_DRIVER,
+              "%s setOption, key=%s, val=%s\n",
+              driver->portName, key, val);
+    return true;
+}
+
+/// get value of a driver asynOption, see setDriverOption()
+/// @return true if key is a driver option, in which case *status is the result
+static bool
+getDriverOption(visaDriver_t *driver, asynUser *pasynUser, const char *key, char *val, int valSize, asynStatus *status)
+{
+    int l;
+    *status = asynSuccess;
+    if (epicsStrCaseCmp(key, "readahead") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", (driver->readAhead ? 'Y' : 'N'));
+    }
+    else if (epicsStrCaseCmp(key, "readaheadsize") == 0) {
+        l = epicsSnprintf(val, valSize, "%lu", (unsigned long)(driver->ring.size > 0 ? driver->ring.size : driver->readAheadSize));
+    }
+    else if (epicsStrCaseCmp(key, "readaheadhigh") == 0) {
+        l = epicsSnprintf(val, valSize, "%lu", (unsigned long)driver->readAheadHigh);
+    }
+    else if (epicsStrCaseCmp(key, "readstrategy") == 0) {
+        l = epicsSnprintf(val, valSize, "%s", (driver->readAvail ? "avail" : "twostage"));
+    }
+    else if (epicsStrCaseCmp(key, "adaptivetmo") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", (driver->adaptiveTmo ? 'Y' : 'N'));
+    }
+    else if (epicsStrCaseCmp(key, "adaptivemin") == 0) {
+        l = epicsSnprintf(val, valSize, "%d", driver->adaptiveMin);
+    }
+    else if (epicsStrCaseCmp(key, "adaptivemax") == 0) {
+        l = epicsSnprintf(val, valSize, "%d", driver->adaptiveMax);
+    }
+    else if (epicsStrCaseCmp(key, "learnedtmo") == 0) {
+        l = epicsSnprintf(val, valSize, "%d", driver->learnedTmo);
+    }
+    else if (epicsStrCaseCmp(key, "asyncio") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", (driver->asyncIO ? 'Y' : 'N'));
+    }
+    else if (epicsStrCaseCmp(key, "asyncsize") == 0) {
+        l = epicsSnprintf(val, valSize, "%lu", (unsigned long)driver->asyncSize);
+    }
+    else if (epicsStrCaseCmp(key, "readdr") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", (driver->gpibReaddr ? 'Y' : 'N'));
+    }
+    else if (epicsStrCaseCmp(key, "unaddr") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", (driver->gpibUnaddr ? 'Y' : 'N'));
+    }
+    else if (epicsStrCaseCmp(key, "tcpnodelay") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", (driver->tcpNoDelay ? 'Y' : 'N'));
+    }
+    else if (epicsStrCaseCmp(key, "tcpkeepalive") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", (driver->tcpKeepAlive ? 'Y' : 'N'));
+    }
+    else if (epicsStrCaseCmp(key, "tcptermchar") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", (driver->tcpTermChar ? 'Y' : 'N'));
+    }
+    else if (epicsStrCaseCmp(key, "usbend") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", (driver->usbEnd ? 'Y' : 'N'));
+    }
+    else if (epicsStrCaseCmp(key, "usbmaxintrsize") == 0) {
+        l = epicsSnprintf(val, valSize, "%d", driver->usbMaxIntrSize);
+    }
+    else if (epicsStrCaseCmp(key, "inbufsize") == 0) {
+        l = epicsSnprintf(val, valSize, "%d", driver->inBufSize);
+    }
+    else if (epicsStrCaseCmp(key, "outbufsize") == 0) {
+        l = epicsSnprintf(val, valSize, "%d", driver->outBufSize);
+    }
+    else if (epicsStrCaseCmp(key, "flightdump") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", (driver->flightDump ? 'Y' : 'N'));
+    }
+    else if (epicsStrCaseCmp(key, "coalesce") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", (driver->coalesce ? 'Y' : 'N'));
+    }
+    else if (epicsStrCaseCmp(key, "coalescesize") == 0) {
+        l = epicsSnprintf(val, valSize, "%lu", (unsigned long)driver->coalesceSize);
+    }
+    else if (epicsStrCaseCmp(key, "coalesceage") == 0) {
+        l = epicsSnprintf(val, valSize, "%d", driver->coalesceAge);
+    }
+    else if (epicsStrCaseCmp(key, "ioretries") == 0) {
+        l = epicsSnprintf(val, valSize, "%d", driver->ioRetries);
+    }
+    else if (epicsStrCaseCmp(key, "draintmo") == 0) {
+        l = epicsSnprintf(val, valSize, "%d", driver->drainTmo);
+    }
+    else if (epicsStrCaseCmp(key, "drainmax") == 0) {
+        l = epicsSnprintf(val, valSize, "%d", driver->drainMax);
+    }
+    else if (epicsStrCaseCmp(key, "deadline") == 0) {
+        l = epicsSnprintf(val, valSize, "%d", driver->hardDeadline);
+    }
+    else if (epicsStrCaseCmp(key, "readinttmo") == 0) {
+        l = epicsSnprintf(val, valSize, "%d", driver->readIntTimeout);
+    }
+    else if (epicsStrCaseCmp(key, "recoverclear") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", (driver->recoverClear ? 'Y' : 'N'));
+    }
+    else if (epicsStrCaseCmp(key, "reopenmaxbackoff") == 0) {
+        l = epicsSnprintf(val, valSize, "%d", driver->reopenMaxBackoff);
+    }
+    else if (epicsStrCaseCmp(key, "cachettl") == 0) {
+        l = epicsSnprintf(val, valSize, "%d", driver->cacheTtl);
+    }
+    else if (epicsStrCaseCmp(key, "cacheprefix") == 0) {
+        std::string raw;
+        const std::vector<std::string>& prefixes = driver->respCache->prefixes;
+        for(size_t i = 0; i < prefixes.size(); ++i) {
+            raw += (i > 0 ? "|" : "") + prefixes[i];
+        }
+        l = epicsStrnEscapedFromRaw(val, valSize, raw.c_str(), raw.size());
+    }
+    else if (epicsStrCaseCmp(key, "blocktype") == 0) {
+        l = epicsSnprintf(val, valSize, "%s", visaBlockTypeInfo[driver->blockType].name);
+    }
+    else if (epicsStrCaseCmp(key, "blockendian") == 0) {
+        l = epicsSnprintf(val, valSize, "%s", (driver->blockBigEndian ? "big" : "little"));
+    }
+    else if (epicsStrCaseCmp(key, "blockeos") == 0) {
+        l = epicsStrnEscapedFromRaw(val, valSize, driver->blockEos, driver->blockEosLen);
+    }
+    else if (epicsStrCaseCmp(key, "srq") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", (driver->srq ? 'Y' : 'N'));
+    }
+    else if (epicsStrCaseCmp(key, "srqread") == 0) {
+        l = epicsSnprintf(val, valSize, "%c", (driver->srqRead ? 'Y' : 'N'));
+    }
+    else {
+        return false;
+    }
+    if (l >= valSize) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                            "Value buffer for key '%s' is too small.", key);
+        *status = asynError;
+    }
+    return true;
+}
+
+///
+/// asynOption interface - get options
+///
+static asynStatus
+getOption(void *drvPvt, asynUser *pasynUser,
+                              const char *key, char *val, int valSize)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    asynStatus status;
+    assert(driver);
+    if (getDriverOption(driver, pasynUser, key, val, valSize, &status))
+    {
+        return status;
+    }
+	if (!driver->connected)
+	{
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s disconnected:", driver->resourceName);
+            return asynError;
+	}
+	if (!driver->isSerial)
+	{
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s getOption - not a serial device", driver->resourceName);
+            return asynError;
+	}
+	ViUInt32 viu32;
+	ViUInt16 viu16, flow = 0;
+	int l = -1;
+	ViStatus err = VI_SUCCESS;
+	// only the flow control keys need the current flow control settings
+	if (isFlowKey(key))
+	{
+	    err = getAttr(driver, VI_ATTR_ASRL_FLOW_CNTRL, &flow);
+	    VI_CHECK_ERROR(key, err);
+	}
+    if (epicsStrCaseCmp(key, "baud") == 0) {
+		if ( (err = getAttr(driver, VI_ATTR_ASRL_BAUD, &viu32)) == VI_SUCCESS ) {
+            l = epicsSnprintf(val, valSize, "%u", (unsigned)viu32);		
+		}
+    }
+    else if (epicsStrCaseCmp(key, "bits") == 0) {
+		if ( (err = getAttr(driver, VI_ATTR_ASRL_DATA_BITS, &viu16)) == VI_SUCCESS ) {
+            l = epicsSnprintf(val, valSize, "%u", (unsigned)viu16);		
+		}
+    }
+    else if (epicsStrCaseCmp(key, "parity") == 0) {
+		if ( (err = getAttr(driver, VI_ATTR_ASRL_PARITY, &viu16)) == VI_SUCCESS ) {
+            switch (viu16) {
+                case VI_ASRL_PAR_NONE:
+                    l = epicsSnprintf(val, valSize, "none");
+                    break;
+                case VI_ASRL_PAR_ODD:
+                    l = epicsSnprintf(val, valSize, "odd");
+                    break;
+                case VI_ASRL_PAR_EVEN:
+                    l = epicsSnprintf(val, valSize, "even");
+                    break;
+                case VI_ASRL_PAR_MARK:
+                    l = epicsSnprintf(val, valSize, "mark");
+                    break;
+                case VI_ASRL_PAR_SPACE:
+                    l = epicsSnprintf(val, valSize, "space");
+                    break;
+				default:
+                    l = epicsSnprintf(val, valSize, "unknown");
+                    break;
+			}
+        }
+    }
+    else if (epicsStrCaseCmp(key, "stop") == 0) {
+		if ( (err = getAttr(driver, VI_ATTR_ASRL_STOP_BITS, &viu16)) == VI_SUCCESS ) {
+            switch (viu16) {
+                case VI_ASRL_STOP_ONE:
+                    l = epicsSnprintf(val, valSize, "1");
+                    break;
+                case VI_ASRL_STOP_ONE5:
+                    l = epicsSnprintf(val, valSize, "1.5");
+                    break;
+                case VI_ASRL_STOP_TWO:
+                    l = epicsSnprintf(val, valSize, "2");
+                    break;
+				default:
+                    l = epicsSnprintf(val, valSize, "unknown");
+                    break;
+			}
+        }
+    }
+    else if (epicsStrCaseCmp(key, "clocal") == 0) {
+        l = epicsSnprintf(val, valSize, "%c",  (flow & VI_ASRL_FLOW_DTR_DSR) ? 'N' : 'Y');
+    }
+    else if (epicsStrCaseCmp(key, "crtscts") == 0) {
+        l = epicsSnprintf(val, valSize, "%c",  (flow & VI_ASRL_FLOW_RTS_CTS) ? 'Y' : 'N');
+    }
+    else if (epicsStrCaseCmp(key, "ixon") == 0) {
+        l = epicsSnprintf(val, valSize, "%c",  (flow & VI_ASRL_FLOW_XON_XOFF) ? 'Y' : 'N');
+    }
+    else if (epicsStrCaseCmp(key, "ixany") == 0) {
+        l = epicsSnprintf(val, valSize, "%c",  'N'); // ixany not supported on windows?
+    }
+    else if (epicsStrCaseCmp(key, "ixoff") == 0) {
+        l = epicsSnprintf(val, valSize, "%c",  (flow & VI_ASRL_FLOW_XON_XOFF) ? 'Y' : 'N');
+    }
+// this is the formatted io buffer, not the low level one
+//    else if (epicsStrCaseCmp(key, "rbuff") == 0) {
+//		err = viGetAttribute(driver->vi, VI_ATTR_RD_BUF_SIZE, &viu32);
+//      l = epicsSnprintf(val, valSize, "%u", (unsigned)viu32);		
+//    }
+//    else if (epicsStrCaseCmp(key, "wbuff") == 0) {
+//		err = viGetAttribute(driver->vi, VI_ATTR_WR_BUF_SIZE, &viu32);
+//      l = epicsSnprintf(val, valSize, "%u", (unsigned)viu32);		
+//    }
+    else {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                "Unsupported key \"%s\"", key);
+        return asynError;
+    }
+	VI_CHECK_ERROR(key, err);
+    if (l >= valSize) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                            "Value buffer for key '%s' is too small.", key);
+        return asynError;
+    }
+    asynPrint(driver->pasynUser, ASYN_TRACEIO_DRIVER,
+              "%s getOption, key=%s, val=%s\n",
+              driver->portName, key, val);
+    return asynSuccess;
+}
+
+///
+/// asynOption interface - set options
+///
+static asynStatus
+setOption(void *drvPvt, asynUser *pasynUser, const char *key, const char *val)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    asynStatus status;
+    assert(driver);
+    if (setDriverOption(driver, pasynUser, key, val, &status))
+    {
+        return status;
+    }
+	if (!driver->connected)
+	{
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s disconnected:", driver->resourceName);
+            return asynError;
+	}
+	if (!driver->isSerial)
+	{
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s setOption - not a serial device", driver->resourceName);
+            return asynError;
+	}
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+                    "%s setOption key %s val %s\n", driver->portName, key, val);
+	ViUInt16 flow = 0, old_flow;
+	ViStatus err = VI_SUCCESS;
+	if (isFlowKey(key))
+	{
+	    err = getAttr(driver, VI_ATTR_ASRL_FLOW_CNTRL, &flow);
+	    VI_CHECK_ERROR(key, err);
+	}
+	old_flow = flow;
+    if (epicsStrCaseCmp(key, "baud") == 0) {
+        int baud;
+        if(sscanf(val, "%d", &baud) != 1) {
+            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                                                                "Bad number");
+            return asynError;
+        }
+        err = setAttr(driver, VI_ATTR_ASRL_BAUD, baud);
+    }
+    else if (epicsStrCaseCmp(key, "bits") == 0) {
+        int bits;
+        if(sscanf(val, "%d", &bits) != 1) {
+            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                                                                "Bad number");
+            return asynError;
+        }
+        err = setAttr(driver, VI_ATTR_ASRL_DATA_BITS, bits);
+    }
+    else if (epicsStrCaseCmp(key, "parity") == 0) {
+        if (epicsStrCaseCmp(val, "none") == 0) {
+            err = setAttr(driver, VI_ATTR_ASRL_PARITY, VI_ASRL_PAR_NONE);
+        }
+        else if (epicsStrCaseCmp(val, "odd") == 0) {
+            err = setAttr(driver, VI_ATTR_ASRL_PARITY, VI_ASRL_PAR_ODD);
+        }
+        else if (epicsStrCaseCmp(val, "even") == 0) {
+            err = setAttr(driver, VI_ATTR_ASRL_PARITY, VI_ASRL_PAR_EVEN);
+        }
+        else if (epicsStrCaseCmp(val, "mark") == 0) {
+            err = setAttr(driver, VI_ATTR_ASRL_PARITY, VI_ASRL_PAR_MARK);
+        }
+        else if (epicsStrCaseCmp(val, "space") == 0) {
+            err = setAttr(driver, VI_ATTR_ASRL_PARITY, VI_ASRL_PAR_SPACE);
+        }
+        else {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                            "Invalid parity.");
+            return asynError;
+        }
+    }
+    else if (epicsStrCaseCmp(key, "stop") == 0) {
+        if (epicsStrCaseCmp(val, "1") == 0) {
+            err = setAttr(driver, VI_ATTR_ASRL_STOP_BITS, VI_ASRL_STOP_ONE);
+        }
+        else if (epicsStrCaseCmp(val, "1.5") == 0) {
+            err = setAttr(driver, VI_ATTR_ASRL_STOP_BITS, VI_ASRL_STOP_ONE5);
+        }
+        else if (epicsStrCaseCmp(val, "2") == 0) {
+            err = setAttr(driver, VI_ATTR_ASRL_STOP_BITS, VI_ASRL_STOP_TWO);
+        }
+        else {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                "Invalid number of stop bits.");
+            return asynError;
+        }
+    }
+    else if (epicsStrCaseCmp(key, "clocal") == 0) {
+        if (epicsStrCaseCmp(val, "Y") == 0) {
+			flow &= ~VI_ASRL_FLOW_DTR_DSR;
+        }
+        else if (epicsStrCaseCmp(val, "N") == 0) {
+			flow |= VI_ASRL_FLOW_DTR_DSR;
+        }
+        else {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid clocal value.");
+            return asynError;
+        }
+    }
+    else if (epicsStrCaseCmp(key, "crtscts") == 0) {
+        if (epicsStrCaseCmp(val, "Y") == 0) {
+			flow |= VI_ASRL_FLOW_RTS_CTS;
+        }
+        else if (epicsStrCaseCmp(val, "N") == 0) {
+			flow &= ~VI_ASRL_FLOW_RTS_CTS;
+        }
+        else {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                      "Invalid crtscts value.");
+            return asynError;
+        }
+    }
+    else if ( (epicsStrCaseCmp(key, "ixon") == 0) || (epicsStrCaseCmp(key, "ixoff") == 0 ) ) {
+        if (epicsStrCaseCmp(val, "Y") == 0) {
+			flow |= VI_ASRL_FLOW_XON_XOFF;
+        }
+        else if (epicsStrCaseCmp(val, "N") == 0) {
+			flow &= ~VI_ASRL_FLOW_XON_XOFF;
+        }
+        else {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Invalid %s value.", key);
+            return asynError;
+        }
+    }
+    else if (epicsStrCaseCmp(key, "ixany") == 0) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                    "Option ixany not supported on Windows");
+        return asynError;       
+    }
+    else if (epicsStrCaseCmp(key, "wbuff") == 0) {
+        int buflen;
+        if(sscanf(val, "%d", &buflen) != 1) {
+            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                                                                "Bad number");
+            return asynError;
+        }
+        err = driver->backend->setBuf(driver->vi, VI_IO_OUT_BUF, buflen);
+    }
+    else if (epicsStrCaseCmp(key, "rbuff") == 0) {
+        int buflen;
+        if(sscanf(val, "%d", &buflen) != 1) {
+            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                                                                "Bad number");
+            return asynError;
+        }
+        err = driver->backend->setBuf(driver->vi, VI_IO_IN_BUF, buflen);
+    }
+    else if (epicsStrCaseCmp(key, "flush") == 0) {
+        if (epicsStrCaseCmp(val, "Y") == 0) {
+			driver->flush_on_write = true;
+        }
+        else if (epicsStrCaseCmp(val, "N") == 0) {
+			driver->flush_on_write = false;
+        }
+        else {
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                      "Invalid flush value.");
+            return asynError;
+        }
+    }
+    else if (epicsStrCaseCmp(key, "") != 0) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                                                "Unsupported key \"%s\"", key);
+        return asynError;
+    }
+	if (err == VI_SUCCESS && flow != old_flow)
+	{
+	    err = setAttr(driver, VI_ATTR_ASRL_FLOW_CNTRL, flow);
+	}
+	VI_CHECK_ERROR(key, err);
+    asynPrint(driver->pasynUser, ASYN_TRACEIO_DRIVER,
+              "%s setOption, key=%s, val=%s\n",
+              driver->portName, key, val);
+    return asynSuccess;
+}
+
+static const struct asynOption asynOptionMethods = { setOption, getOption };
+
+/// forget all cached replies, and any reply being captured or served
+static void cacheClear(visaDriver_t *driver)
+{
+    visaRespCache_t *cache = driver->respCache;
+    cache->replies.clear();
+    cache->capturing = false;
+    cache->serving = NULL;
+}
+
+/// close the GPIB interface session used for bus commands
+static void closeGpibIntfc(visaDriver_t *driver)
+{
+    epicsMutexMustLock(driver->opLock);
+    waitAborts(driver);
+    if (driver->gpibIntfc != VI_NULL)
+    {
+        viClose(driver->gpibIntfc);
+        driver->gpibIntfc = VI_NULL;
+    }
+    epicsMutexUnlock(driver->opLock);
+}
+
+/// close a VISA session
+static asynStatus
+closeConnection(asynUser *pasynUser, visaDriver_t *driver, const char* reason)
+{
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+              "Close %s connection %s\n", driver->resourceName, reason);
+    if (!driver->connected) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                              "%s: session already closed", driver->resourceName);
+        return asynError;
+    }
+	if (strcmp(reason, "Disconnect request") != 0)
+	{
+	    driver->flightDumpPending = driver->flightDump;
+	    driver->reopenPending = true; // connectIt() paces the attempts to reopen
+	}
+	stopReadAhead(driver);
+	stopSrq(driver);
+	stopAsyncIO(driver);
+	driver->coalesceLength = 0; // unsent writes are lost with the session
+	driver->coalesceStatus = asynSuccess;
+	driver->eosLeftOffset = driver->eosLeftLength = 0; // as are unread replies
+	cacheClear(driver); // and a new session may be a different, or reconfigured, device
+	closeGpibIntfc(driver);
+	ViStatus err;
+	if ( (err = closeSession(driver)) != VI_SUCCESS )
+	{
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                              "%s: viClose error", driver->resourceName);
+        return asynError;
+	}
+    driver->connected = false;
+	invalidateAttrCache(driver);
+	pasynManager->exceptionDisconnect(pasynUser);
+    return asynSuccess;
+}
+
+
+/// can an I/O error be recovered on the open session, or has VISA lost the session or its connection. An operation
+/// the watchdog had to abort is not repeated, the session is reopened instead
+static bool sessionUsable(visaDriver_t *driver, ViStatus err)
+{
+    return (err != VI_ERROR_INV_OBJECT && err != VI_ERROR_CONN_LOST &&
+            epicsAtomicGetIntT(&(driver->opStage)) == 0 &&
+            !driver->asyncRunning && !driver->readAheadRunning); // their own posted read or thread would need restarting
+}
+
+/// first tier of recovery from a VISA read or write error: should the operation just be made again
+static bool retryIO(visaDriver_t *driver, asynUser *pasynUser, const char *op, ViStatus err, int attempt)
+{
+    if (attempt >= driver->ioRetries || !sessionUsable(driver, err))
+    {
+        return false;
+    }
+    ++(driver->nRecoverRetries);
+    asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s %s error %s, retrying\n", driver->resourceName, op,
+              errMsg(driver, err).c_str());
+    return true;
+}
+
+/// recover from a VISA I/O error that retrying did not fix. The second tier is viClear on the open session,
+/// which resets the I/O state of VISA and the device; the last is closing the session, after which
+/// connectIt() reopens it with an exponential backoff rather than on every request.
+static void recoverSession(asynUser *pasynUser, visaDriver_t *driver, const char *reason, ViStatus err)
+{
+    if (driver->recoverClear && sessionUsable(driver, err) && driver->backend->clear(driver->vi) == VI_SUCCESS)
+    {
+        ++(driver->nRecoverClears);
+        driver->eosLeftOffset = driver->eosLeftLength = 0; // any partial reply went with the clear
+        driver->respCache->capturing = false;
+        driver->flightDumpPending = driver->flightDump;
+        asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s %s %s, session kept after viClear\n", driver->resourceName,
+                  reason, errMsg(driver, err).c_str());
+        return;
+    }
+    closeConnection(pasynUser, driver, reason);
+}
+
+/// print a latency histogram summary, and the bucket counts if details >= 3
+static void
+reportHist(FILE *fp, const char* name, const visaHist_t* hist, int details)
+{
+    fprintf(fp, "%12s latency (ms): mean %.3f p50 <%.3f p99 <%.3f max %.3f (%llu samples)\n", name,
+            1000.0 * histMean(hist), 1000.0 * histPercentile(hist, 0.50),
+            1000.0 * histPercentile(hist, 0.99), 1000.0 * hist->max, (unsigned long long)hist->count);
+    if (details >= 3)
+    {
+        for(int i = 0; i < VISA_HIST_NBUCKETS; ++i)
+        {
+            if (hist->bucket[i] > 0)
+            {
+                fprintf(fp, "        < %10.3f ms: %llu\n", ldexp(1.0e-3, i + 1), (unsigned long long)hist->bucket[i]);
+            }
+        }
+    }
+}
+
+/// report link parameters of a port, or of one address of a multi-device port
+static void
+reportDevice(visaDriver_t *driver, FILE *fp, int details)
+{
+    char termChar[16]; // bit of space for encoding an escape sequence
+    assert(driver);
+    if (details >= 1) {
+        fprintf(fp, "    Port %s: %sonnected\n",
+                                                driver->resourceName,
+                                                (driver->connected ? "C" : "Disc"));
+    }
+	if (driver->termCharIn != 0)
+	{
+	    epicsStrnEscapedFromRaw(termChar, sizeof(termChar), reinterpret_cast<const char*>(&(driver->termCharIn)), 1);
+	}
+	else
+	{
+		strncpy(termChar, "<none>", sizeof(termChar));
+	}
+    if (details >= 2) {
+        fprintf(fp, "    Characters written: %llu\n", (unsigned long long)driver->nWriteBytes);
+        fprintf(fp, "       Characters read: %llu\n", (unsigned long long)driver->nReadBytes);
+        fprintf(fp, "      write operations: %llu\n", (unsigned long long)driver->nWriteCalls);
+        fprintf(fp, "       read operations: %llu\n", (unsigned long long)driver->nReadCalls);
+        fprintf(fp, "              timeouts: %llu\n", (unsigned long long)driver->nTimeouts);
+        fprintf(fp, "                errors: %llu\n", (unsigned long long)driver->nErrors);
+        fprintf(fp, " attribute calls saved: %llu\n", (unsigned long long)driver->nAttrCallsSaved);
+        fprintf(fp, "         busy time (s): %f\n", driver->busyTime);
+        reportHist(fp, "read", &(driver->readHist), details);
+        reportHist(fp, "write", &(driver->writeHist), details);
+        reportHist(fp, "first byte", &(driver->firstByteHist), details);
+        if (driver->queryHist.count > 0)
+        {
+            reportHist(fp, "query", &(driver->queryHist), details);
+        }
+        fprintf(fp, "           I/O backend: %s\n", driver->backend->name);
+        fprintf(fp, "      Is serial device: %c\n", (driver->isSerial ? 'Y' : 'N'));
+        fprintf(fp, "        Is GPIB device: %c\n", (driver->isGPIB ? 'Y' : 'N'));
+        if (driver->isTCPIP)
+        {
+            fprintf(fp, "         TCPIP session: %s%s", driver->rsrcClass, (driver->isHiSLIP ? " (HiSLIP)" : ""));
+            if (driver->isSocket)
+            {
+                fprintf(fp, ", nodelay %c, keepalive %c, termchar %c", (driver->tcpNoDelay ? 'Y' : 'N'),
+                        (driver->tcpKeepAlive ? 'Y' : 'N'), (driver->tcpTermChar ? 'Y' : 'N'));
+            }
+            fprintf(fp, "\n");
+        }
+        if (driver->isUSB || driver->usbMaxIntrSize > 0 || driver->inBufSize > 0 || driver->outBufSize > 0)
+        {
+            fprintf(fp, "   USB / VISA buffers: USBTMC %c, max intr size %d, in buf %d, out buf %d (0 is default)\n",
+                    (driver->isUSB ? 'Y' : 'N'), driver->usbMaxIntrSize, driver->inBufSize, driver->outBufSize);
+        }
+        if (driver->isGPIB)
+        {
+            fprintf(fp, "  GPIB readdr / unaddr: %c / %c\n", (driver->gpibReaddr ? 'Y' : 'N'), (driver->gpibUnaddr ? 'Y' : 'N'));
+        }
+        fprintf(fp, "      Device sends EOM: %c%s\n", (driver->deviceSendsEOM ? 'Y' : 'N'),
+                (driver->isUSB && driver->usbEnd && !driver->deviceSendsEOM ? " (USBTMC END used)" : ""));
+        fprintf(fp, "  Input term char hint: \"%s\" (0x%x)\n", termChar, (unsigned)driver->termCharIn);
+        if (driver->inEosLen > 0 || driver->outEosLen > 0)
+        {
+            char inEos[4 * VISA_EOS_MAX + 1], outEos[4 * VISA_EOS_MAX + 1];
+            epicsStrnEscapedFromRaw(inEos, sizeof(inEos), driver->inEos, driver->inEosLen);
+            epicsStrnEscapedFromRaw(outEos, sizeof(outEos), driver->outEos, driver->outEosLen);
+            fprintf(fp, "    Native terminators: in \"%s\" out \"%s\", %lu bytes retained\n", inEos, outEos,
+                    (unsigned long)(driver->eosLeftLength - driver->eosLeftOffset));
+        }
+        fprintf(fp, "Internal read tmo (ms): %d\n", ((int)driver->readIntTimeout));
+        fprintf(fp, "         Read strategy: %s\n", (driver->readAvail ? "avail" : "twostage"));
+        if (driver->adaptiveTmo)
+        {
+            fprintf(fp, " Learned read tmo (ms): %d (bounds %d to %d, %d samples)\n", driver->learnedTmo,
+                    driver->adaptiveMin, driver->adaptiveMax, driver->nGapSamples);
+        }
+        fprintf(fp, " Ports sharing VISA RM: %d\n", sharedDefaultRMRefCount);
+        if (driver->readAhead)
+        {
+            fprintf(fp, "            Read ahead: %s, ring %lu bytes, high water %lu bytes, %llu VISA reads\n",
+                    (driver->readAheadRunning ? "running" : "stopped"), (unsigned long)driver->ring.size,
+                    (unsigned long)driver->readAheadHigh, (unsigned long long)driver->readAheadVISAReads);
+        }
+        if (driver->asyncIO)
+        {
+            fprintf(fp, "        Overlapped I/O: %s, %llu posted reads collected, %llu already complete\n",
+                    (driver->asyncRunning ? "running" : "stopped"), (unsigned long long)driver->nAsyncReads,
+                    (unsigned long long)driver->nAsyncReady);
+        }
+        if (driver->coalesce)
+        {
+            fprintf(fp, "      Write coalescing: %llu writes sent in %llu VISA writes, %lu bytes waiting, %llu timed sends failed\n",
+                    (unsigned long long)driver->nCoalescedWrites, (unsigned long long)driver->nCoalesceTransfers,
+                    (unsigned long)driver->coalesceLength, (unsigned long long)driver->nCoalesceErrors);
+        }
+        if (driver->cacheTtl > 0)
+        {
+            fprintf(fp, "        Response cache: %llu hits, %llu misses, %lu replies held for %d ms, %lu prefixes, %llu invalidations\n",
+                    (unsigned long long)driver->nCacheHits, (unsigned long long)driver->nCacheMisses,
+                    (unsigned long)driver->respCache->replies.size(), driver->cacheTtl,
+                    (unsigned long)driver->respCache->prefixes.size(), (unsigned long long)driver->nCacheInvalidations);
+        }
+        if (driver->nRecoverRetries > 0 || driver->nRecoverClears > 0 || driver->reopenPending || driver->nRecoverReopens > 0)
+        {
+            fprintf(fp, "        Error recovery: %llu retries, %llu cleared, %llu reopened%s, backoff %.1f s\n",
+                    (unsigned long long)driver->nRecoverRetries, (unsigned long long)driver->nRecoverClears,
+                    (unsigned long long)driver->nRecoverReopens, (driver->reopenPending ? ", reopen pending" : ""),
+                    driver->reopenBackoff);
+        }
+        if (driver->nDiscards > 0 || driver->inputStale)
+        {
+            fprintf(fp, "       Discarded input: %llu bytes in %llu flushes, drain %d ms up to %d bytes%s\n",
+                    (unsigned long long)driver->nDiscardBytes, (unsigned long long)driver->nDiscards,
+                    driver->drainTmo, driver->drainMax, (driver->inputStale ? ", input stale" : ""));
+        }
+        epicsMutexMustLock(driver->opLock);
+        if (driver->hardDeadline > 0 || driver->nDeadlineOverruns > 0)
+        {
+            fprintf(fp, "           Op deadline: %d ms past timeout, %llu overruns, %llu ignored viTerminate%s%s\n",
+                    driver->hardDeadline, (unsigned long long)driver->nDeadlineOverruns,
+                    (unsigned long long)driver->nAbortsIgnored, (driver->opName != NULL ? ", in " : ""),
+                    (driver->opName != NULL ? driver->opName : ""));
+        }
+        epicsMutexUnlock(driver->opLock);
+        fprintf(fp, "       Flight recorder: %lu transactions, last %d kept, dump on error %c\n",
+                (unsigned long)epicsAtomicGetSizeT(&(driver->flight.next)), VISA_FLIGHT_ENTRIES,
+                (driver->flightDump ? 'Y' : 'N'));
+        if (driver->nBlockReads > 0)
+        {
+            fprintf(fp, "   Binary block reads: %llu, %llu bytes, %s %s\n", (unsigned long long)driver->nBlockReads,
+                    (unsigned long long)driver->nBlockBytes, (driver->blockBigEndian ? "big endian" : "little endian"),
+                    visaBlockTypeInfo[driver->blockType].name);
+        }
+        if (driver->srq)
+        {
+            fprintf(fp, "      Service requests: %s, %llu polls, %llu responses read, last status byte 0x%02x\n",
+                    (driver->srqRunning ? "enabled" : "stopped"), (unsigned long long)driver->nSrq,
+                    (unsigned long long)driver->nSrqReads, (unsigned)driver->srqStb);
+        }
+        if (driver->backgroundConnect)
+        {
+            fprintf(fp, "  Background connected: after %.3f s, %d attempt(s)\n", driver->connectTime, driver->connectAttempts);
+        }
+    }
+}
+
+/// asynCommon interface - Report link parameters, of each address in use on a multi-device port
+static void
+asynCommonReport(void *drvPvt, FILE *fp, int details)
+{
+    visaDriver_t *driver = (visaDriver_t*)drvPvt;
+    assert(driver);
+    if (driver->devices == NULL)
+    {
+        reportDevice(driver, fp, details);
+        return;
+    }
+    epicsMutexMustLock(driver->devicesLock);
+    if (details >= 1)
+    {
+        fprintf(fp, "    Multi-device port on GPIB%d, %lu address(es) in use\n", driver->gpibBoard, (unsigned long)driver->devices->size());
+    }
+    for(visaDeviceMap_t::iterator it = driver->devices->begin(); it != driver->devices->end(); ++it)
+    {
+        if (details >= 1)
+        {
+            fprintf(fp, "    Address %d\n", it->first);
+        }
+        reportDevice(it->second, fp, details);
+    }
+    epicsMutexUnlock(driver->devicesLock);
+}
+
+/// stop background work and close the session of a port or device at IOC exit
+static void
+closeAtExit(visaDriver_t *driver)
+{
+	stopReadAhead(driver);
+	stopSrq(driver);
+	stopAsyncIO(driver);
+	closeGpibIntfc(driver);
+	if (driver->vi != VI_NULL)
+	{
+		closeSession(driver);
+		driver->vi = VI_NULL;
+		driver->connected = false;
+	}
+}
+
+/// wait up to timeout (s) for the port thread to leave the operation it is in
+/// @return true if no operation is in progress
+static bool opWait(visaDriver_t *driver, double timeout)
+{
+    for(double waited = 0.0; ; waited += VISA_WATCHDOG_PERIOD)
+    {
+        epicsMutexMustLock(driver->opLock);
+        bool idle = (driver->opName == NULL);
+        epicsMutexUnlock(driver->opLock);
+        if (idle || waited >= timeout)
+        {
+            return idle;
+        }
+        epicsThreadSleep(VISA_WATCHDOG_PERIOD);
+    }
+}
+
+/// at IOC exit abort an operation the port thread is in with runAbort(), so cleanup does not wait for it for ever,
+/// and again with viClear if it has not returned a second later. The session is never closed under the port thread.
+/// Called with no lock held.
+/// @return true if the port thread is free for cleanup
+static bool abortAtExit(visaDriver_t *driver)
+{
+    for(int attempt = 0; attempt < 2; ++attempt)
+    {
+        if (opWait(driver, (attempt == 0 ? 0.0 : 1.0)))
+        {
+            return true;
+        }
+        epicsMutexMustLock(driver->opLock);
+        bool busy = (driver->opName != NULL);
+        visaAbort_t abort;
+        if (busy)
+        {
+            abort = takeAbort(driver, attempt > 0);
+        }
+        epicsMutexUnlock(driver->opLock);
+        if (busy)
+        {
+            runAbort(&abort);
+        }
+    }
+    return opWait(driver, 1.0);
+}
+
+static void
+visaCleanup (void *arg)
+{
+    asynStatus status;
+    visaDriver_t *driver = (visaDriver_t*)arg;
+	
+    if (!arg) return;
+	// the port and its devices, taken under devicesLock so no VISA call is made with it held
+	std::vector<visaDriver_t*> drivers(1, driver);
+	if (driver->devices != NULL)
+	{
+	    epicsMutexMustLock(driver->devicesLock);
+	    for(visaDeviceMap_t::iterator it = driver->devices->begin(); it != driver->devices->end(); ++it)
+	    {
+	        drivers.push_back(it->second);
+	    }
+	    epicsMutexUnlock(driver->devicesLock);
+	}
+	// the port thread may be blocked in VISA, and exit must not wait for it to time out or for ever
+	bool idle = true;
+	for(size_t i = 0; i < drivers.size(); ++i)
+	{
+	    idle = abortAtExit(drivers[i]) && idle;
+	}
+	if (!idle)
+	{
+	    // closing the resource manager would close the sessions under the call still using them
+	    errlogPrintf("%s: port thread still blocked at exit, sessions and resource manager left open\n", driver->portName);
+	    return;
+	}
+	status=pasynManager->lockPort(driver->pasynUser);
+	if(status!=asynSuccess)
+	    asynPrint(driver->pasynUser, ASYN_TRACE_ERROR, "%s: cleanup locking error\n", driver->portName);
+
+	// other ports may still be using the resource manager, so close our own sessions first
+	for(size_t i = 0; i < drivers.size(); ++i)
+	{
+	    closeAtExit(drivers[i]);
+	}
+	if(status==asynSuccess)
+	    pasynManager->unlockPort(driver->pasynUser);
+
+	for(size_t i = 0; i < drivers.size(); ++i)
+	{
+	    releaseDefaultRM(&(drivers[i]->defaultRM));
+	}
+}
+
+static void
+driverCleanup(visaDriver_t *driver)
+{
+	if (driver)
+	{
+        releaseDefaultRM(&(driver->defaultRM));
+        free(driver->ring.buffer);
+        free(driver->srqReadBuffer);
+        free(driver->asyncBuffer);
+        free(driver->coalesceBuffer);
+        free(driver->blockScratch);
+        free(driver->eosLeftBuffer);
+        free(driver->eosOutBuffer);
+        free(driver->portName);
+        free(driver->resourceName);
+        delete driver->devices;
+        delete driver->respCache;
+        if (driver->devicesLock != NULL)
+        {
+            epicsMutexDestroy(driver->devicesLock);
+        }
+        epicsMutexDestroy(driver->opLock);
+        free(driver);
+    }
+}
+
+/// set the session attributes that let VISA end a read on termCharIn
+static asynStatus
+setTermCharAttrs(visaDriver_t *driver, asynUser *pasynUser)
+{
+	ViStatus err;
+	bool useTermChar = (driver->termCharIn != 0 && (!driver->isSocket || driver->tcpTermChar));
+	if (useTermChar)
+	{
+		// tell VISA to terminate a read early when this character is seen
+		if (driver->isSerial)
+		{
+		    err = setAttr(driver, VI_ATTR_ASRL_END_IN, VI_ASRL_END_TERMCHAR);
+	        VI_CHECK_ERROR("VI_ATTR_ASTR_END_IN", err);
+		}			
+	    err = setAttr(driver, VI_ATTR_TERMCHAR, driver->termCharIn);
+	    VI_CHECK_ERROR("VI_ATTR_TERMCHAR", err);
+	    err = setAttr(driver, VI_ATTR_TERMCHAR_EN, VI_TRUE);
+	}
+	else
+	{
+	    // disable read/write command exit on termination character VI_ATTR_TERMCHAR in general
+		if (driver->isSerial)
+		{
+		    err = setAttr(driver, VI_ATTR_ASRL_END_IN, VI_ASRL_END_NONE);
+	        VI_CHECK_ERROR("VI_ATTR_ASTR_END_IN", err);
+		}			
+	    err = setAttr(driver, VI_ATTR_TERMCHAR_EN, VI_FALSE);
+	}
+	VI_CHECK_ERROR("VI_ATTR_TERMCHAR_EN", err);
+	if (driver->isSocket)
+	{
+		// a raw socket has no END, VISA treats running out of received data as one. With a term char
+		// that would split replies that arrive in more than one TCP segment, without one it ends the read
+		err = setAttr(driver, VI_ATTR_SUPPRESS_END_EN, (useTermChar ? VI_TRUE : VI_FALSE));
+		VI_CHECK_ERROR("VI_ATTR_SUPPRESS_END_EN", err);
+	}
+	return asynSuccess;
+}
+
+/// set the TCP options of a raw socket session, VXI-11 and HiSLIP sessions manage their own connections
+static asynStatus
+setTcpipAttrs(visaDriver_t *driver, asynUser *pasynUser)
+{
+	ViStatus err;
+	if (!driver->isSocket)
+	{
+		return asynSuccess;
+	}
+	// otherwise a short query can wait ~40 ms for the delayed ACK of the previous one before it is sent
+	err = setAttr(driver, VI_ATTR_TCPIP_NODELAY, (driver->tcpNoDelay ? VI_TRUE : VI_FALSE));
+	VI_CHECK_ERROR("VI_ATTR_TCPIP_NODELAY", err);
+	err = setAttr(driver, VI_ATTR_TCPIP_KEEPALIVE, (driver->tcpKeepAlive ? VI_TRUE : VI_FALSE));
+	VI_CHECK_ERROR("VI_ATTR_TCPIP_KEEPALIVE", err);
+	return asynSuccess;
+}
+
+/// set the USB interrupt-in size and low level I/O buffer sizes that have been configured, others keep VISA's defaults
+static asynStatus
+setBufferAttrs(visaDriver_t *driver, asynUser *pasynUser)
+{
+	ViStatus err;
+	if (driver->isUSB && driver->usbMaxIntrSize > 0)
+	{
+		err = setAttr(driver, VI_ATTR_USB_MAX_INTR_SIZE, driver->usbMaxIntrSize);
+		VI_CHECK_ERROR("VI_ATTR_USB_MAX_INTR_SIZE", err);
+	}
+	if (driver->inBufSize > 0)
+	{
+		err = driver->backend->setBuf(driver->vi, VI_IO_IN_BUF, driver->inBufSize);
+		VI_CHECK_ERROR("viSetBuf VI_IO_IN_BUF", err);
+	}
+	if (driver->outBufSize > 0)
+	{
+		err = driver->backend->setBuf(driver->vi, VI_IO_OUT_BUF, driver->outBufSize);
+		VI_CHECK_ERROR("viSetBuf VI_IO_OUT_BUF", err);
+	}
+	return asynSuccess;
+}
+
+/// configure a newly opened VISA session
+static asynStatus
+setupSession(visaDriver_t *driver, asynUser *pasynUser)
+{
+	ViStatus err;
+	invalidateAttrCache(driver);
+	// the interface of a resource does not change, so a reopen after an error need not ask again
+	if (!driver->intfKnown)
+	{
+		driver->intfName[0] = '\0';
+		err = driver->backend->getAttribute(driver->vi, VI_ATTR_INTF_INST_NAME, driver->intfName);
+		VI_CHECK_ERROR("intf_name", err);
+		err = driver->backend->getAttribute(driver->vi, VI_ATTR_INTF_TYPE, &(driver->intfType));
+		VI_CHECK_ERROR("intf_type", err);
+		driver->rsrcClass[0] = '\0';
+		err = driver->backend->getAttribute(driver->vi, VI_ATTR_RSRC_CLASS, driver->rsrcClass);
+		VI_CHECK_ERROR("rsrc_class", err);
+		driver->intfHiSLIP = false;
+#ifdef VI_ATTR_TCPIP_IS_HISLIP
+		ViBoolean hislip = VI_FALSE;
+		// only in VISA 5.0 and later, and not supported by every implementation
+		if (driver->intfType == VI_INTF_TCPIP && driver->backend->getAttribute(driver->vi, VI_ATTR_TCPIP_IS_HISLIP, &hislip) == VI_SUCCESS)
+		{
+			driver->intfHiSLIP = (hislip == VI_TRUE);
+		}
+#endif
+		driver->intfKnown = true;
+	}
+	ViUInt16 intf_type = driver->intfType;
+	const char *intf_name = driver->intfName;
+	
+	if (intf_type == VI_INTF_ASRL) // is it a serial device?
+	{
+		driver->isSerial = true;
+		err = setAttr(driver, VI_ATTR_ASRL_END_OUT, VI_ASRL_END_NONE);
+	    VI_CHECK_ERROR("VI_ATTR_ASRL_END_OUT", err);
+        err = setAttr(driver, VI_ATTR_SEND_END_EN, VI_FALSE);
+	    VI_CHECK_ERROR("VI_ATTR_SEND_END_EN", err);
+        err = setAttr(driver, VI_ATTR_SUPPRESS_END_EN, VI_TRUE);
+	    VI_CHECK_ERROR("VI_ATTR_SUPPRESS_END_EN", err);
+	}
+	else
+	{
+		driver->isSerial = false;		
+	}
+	if (intf_type == VI_INTF_GPIB)
+	{
+		driver->isGPIB = true;
+		err = setAttr(driver, VI_ATTR_GPIB_READDR_EN, (driver->gpibReaddr ? VI_TRUE : VI_FALSE));
+	    VI_CHECK_ERROR("VI_ATTR_GPIB_READDR_EN", err);
+		// The LabVIEW driver set this to VI_TRUE (default is VI_FALSE) but it causes problems for the stress rig,
+		// so it is left off unless asked for
+		err = setAttr(driver, VI_ATTR_GPIB_UNADDR_EN, (driver->gpibUnaddr ? VI_TRUE : VI_FALSE));
+	    VI_CHECK_ERROR("VI_ATTR_GPIB_UNADDR_EN", err);
+		err = setAttr(driver, VI_ATTR_SEND_END_EN, VI_TRUE);
+	    VI_CHECK_ERROR("VI_ATTR_SEND_END_EN", err);
+	}
+	else
+	{
+		driver->isGPIB = false;		
+	}
+	driver->isTCPIP = (intf_type == VI_INTF_TCPIP);
+	driver->isSocket = (driver->isTCPIP && strcmp(driver->rsrcClass, "SOCKET") == 0);
+	driver->isHiSLIP = (driver->isTCPIP && driver->intfHiSLIP);
+	// USB RAW resources have no USBTMC framing, so no END
+	driver->isUSB = (intf_type == VI_INTF_USB && strcmp(driver->rsrcClass, "INSTR") == 0);
+	// these only tune transfers, so a session that will not take them is still used
+	if (setBufferAttrs(driver, pasynUser) != asynSuccess)
+	{
+	    asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s, VISA defaults kept\n", pasynUser->errorMessage);
+	}
+	if (setTcpipAttrs(driver, pasynUser) != asynSuccess)
+	{
+	    return asynError;
+	}
+	if (setTermCharAttrs(driver, pasynUser) != asynSuccess)
+	{
+	    return asynError;
+	}
+
+	err = driver->backend->clear(driver->vi);
+	VI_CHECK_ERROR("viClear", err);
+	
+    // these are the defaults, need to change?
+//	viSetAttribute(driver->vi, VI_ATTR_SEND_END_EN, VI_TRUE);
+//	viSetAttribute(driver->vi, VI_ATTR_SUPPRESS_END_EN, VI_FALSE);
+
+	// don't think we need to do anything about these as we using raw rather than buffered io
+	//	VI_ATTR_RD_BUF_OPER_MODE
+	//	VI_ATTR_WR_BUF_OPER_MODE    -> VI_FLUSH_ON_ACCESS
+	
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+                          "Opened connection to \"%s\" (%s) isSerial=%c isGPIB=%c isTCPIP=%c (%s%s)\n", driver->resourceName, 
+						  intf_name, (driver->isSerial ? 'Y' : 'N'), (driver->isGPIB ? 'Y' : 'N'), (driver->isTCPIP ? 'Y' : 'N'),
+						  driver->rsrcClass, (driver->isHiSLIP ? " HiSLIP" : ""));
+    return asynSuccess;
+}
+
+/// create a link
+/// a reopen after an error failed, wait longer before the next, doubling up to reopenMaxBackoff
+static void reopenFailed(visaDriver_t *driver)
+{
+    if (!driver->reopenPending)
+    {
+        return;
+    }
+    driver->reopenBackoff = (driver->reopenBackoff > 0.0 ? 2.0 * driver->reopenBackoff : 0.5);
+    if (driver->reopenBackoff > driver->reopenMaxBackoff / 1000.0)
+    {
+        driver->reopenBackoff = driver->reopenMaxBackoff / 1000.0;
+    }
+    epicsTimeGetCurrent(&(driver->nextReopen));
+    epicsTimeAddSeconds(&(driver->nextReopen), driver->reopenBackoff);
+}
+
+static asynStatus
+connectIt(void *drvPvt, asynUser *pasynUser)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+              "Open connection to \"%s\"  reason: %d\n", driver->resourceName,
+                                                           pasynUser->reason);
+
+    if (driver->devices != NULL) {
+        return asynSuccess; // the port of a multi-device port has no session, each address opens its own
+    }
+    if (driver->connected) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                              "%s: session already open.", driver->resourceName);
+        return asynError;
+    }
+	ViStatus err;
+	epicsTimeStamp now;
+	epicsTimeGetCurrent(&now);
+	if (driver->reopenPending && epicsTimeLessThan(&now, &(driver->nextReopen)))
+	{
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                              "%s: reopen deferred %.1f s after error", driver->resourceName,
+                              epicsTimeDiffInSeconds(&(driver->nextReopen), &now));
+		return asynError;
+	}
+	// an open of a device behind a hung network or GPIB-ENET box, or the viClear of setupSession(), can block too
+	opBegin(driver, "open", pasynUser->timeout);
+	if ( (err = driver->backend->open(driver->defaultRM, driver->resourceName, &(driver->vi))) != VI_SUCCESS )
+	{
+		opEnd(driver);
+		driver->vi = VI_NULL;
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                              "%s: viOpen %s", driver->resourceName, errMsg(driver, err).c_str());
+		reopenFailed(driver);
+		return asynError;
+	}
+	// don't leave a half configured session open, we would leak it on the next attempt
+	asynStatus status = setupSession(driver, pasynUser);
+	opEnd(driver);
+	if (status != asynSuccess)
+	{
+		closeSession(driver);
+		driver->vi = VI_NULL;
+		reopenFailed(driver);
+		return asynError;
+	}
+    driver->connected = true;
+    driver->inputStale = false; // setupSession() cleared the device
+	if (driver->reopenPending)
+	{
+		++(driver->nRecoverReopens);
+		driver->reopenPending = false;
+		driver->reopenBackoff = 0.0;
+	}
+	if (driver->readAhead)
+	{
+		startReadAhead(driver);
+	}
+	if (driver->srq)
+	{
+		startSrq(driver);
+	}
+	if (driver->asyncIO)
+	{
+		startAsyncIO(driver);
+	}
+    return asynSuccess;
+}
+
+
+/// number of threads in the background connect pool, see drvAsynVISAConnectPool()
+static int connectPoolThreads = 4;
+/// maximum delay (s) between background connect retries
+static double connectPoolMaxBackoff = 60.0;
+/// should ports use background connection unless told otherwise in drvAsynVISAPortConfigure()
+static bool connectPoolDefault = false;
+/// has the connect pool been started
+static bool connectPoolStarted = false;
+/// ports waiting for a background connect attempt
+static std::list<visaDriver_t*> connectPoolQueue;
+/// all ports using background connection, for the end of boot report
+static std::vector<visaDriver_t*> connectPoolPorts;
+/// protects the connectPool variables
+static epicsMutexId connectPoolLock = NULL;
+/// signalled when work is added to connectPoolQueue
+static epicsEventId connectPoolEvent = NULL;
+
+/// make one background connection attempt, returns true if port is now connected
+static bool backgroundConnectPort(visaDriver_t *driver)
+{
+    asynUser *pasynUser = driver->pasynUser;
+    epicsTimeStamp epicsTS1, epicsTS2;
+    bool done = false;
+    if (pasynManager->lockPort(pasynUser) != asynSuccess)
+    {
+        return false;
+    }
+    if (driver->connected)
+    {
+        done = true;
+    }
+    else
+    {
+        ++(driver->connectAttempts);
+        epicsTimeGetCurrent(&epicsTS1);
+        asynStatus status = connectIt(driver, pasynUser);
+        epicsTimeGetCurrent(&epicsTS2);
+        driver->lastConnectDuration = epicsTimeDiffInSeconds(&epicsTS2, &epicsTS1);
+        if (status == asynSuccess)
+        {
+            driver->connectTime = epicsTimeDiffInSeconds(&epicsTS2, &(driver->configureTime));
+            pasynManager->exceptionConnect(pasynUser);
+            done = true;
+        }
+        else
+        {
+            asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: background connect attempt %d failed: %s\n",
+                      driver->portName, driver->connectAttempts, pasynUser->errorMessage);
+        }
+    }
+    pasynManager->unlockPort(pasynUser);
+    if (done)
+    {
+        // from now on asyn handles any reconnection
+        pasynManager->autoConnect(pasynUser, 1);
+    }
+    return done;
+}
+
+/// worker thread of the background connect pool
+static void connectPoolThread(void *)
+{
+    epicsTimeStamp now;
+    epicsMutexMustLock(connectPoolLock);
+    while(true)
+    {
+        visaDriver_t *driver = NULL;
+        double wait = 10.0;
+        epicsTimeGetCurrent(&now);
+        for(std::list<visaDriver_t*>::iterator it = connectPoolQueue.begin(); it != connectPoolQueue.end(); ++it)
+        {
+            double dt = epicsTimeDiffInSeconds(&((*it)->nextConnectAttempt), &now);
+            if (dt <= 0.0)
+            {
+                driver = *it;
+                connectPoolQueue.erase(it);
+                break;
+            }
+            wait = (dt < wait ? dt : wait);
+        }
+        if (driver == NULL)
+        {
+            epicsMutexUnlock(connectPoolLock);
+            epicsEventWaitWithTimeout(connectPoolEvent, wait);
+            epicsMutexMustLock(connectPoolLock);
+            continue;
+        }
+        if (!connectPoolQueue.empty())
+        {
+            epicsEventSignal(connectPoolEvent); // let another worker look at the rest of the queue
+        }
+        epicsMutexUnlock(connectPoolLock);
+        bool done = backgroundConnectPort(driver);
+        epicsMutexMustLock(connectPoolLock);
+        if (!done)
+        {
+            epicsTimeGetCurrent(&(driver->nextConnectAttempt));
+            epicsTimeAddSeconds(&(driver->nextConnectAttempt), driver->connectBackoff);
+            driver->connectBackoff *= 2.0;
+            if (driver->connectBackoff > connectPoolMaxBackoff)
+            {
+                driver->connectBackoff = connectPoolMaxBackoff;
+            }
+            connectPoolQueue.push_back(driver);
+        }
+    }
+}
+
+/// print how long each background connected port took to connect
+static void connectPoolReport(FILE *fp)
+{
+    epicsMutexMustLock(connectPoolLock);
+    if (connectPoolPorts.size() > 0)
+    {
+        fprintf(fp, "drvAsynVISAPort: background connection summary\n");
+    }
+    for(size_t i = 0; i < connectPoolPorts.size(); ++i)
+    {
+        visaDriver_t *driver = connectPoolPorts[i];
+        if (driver->connectTime >= 0.0)
+        {
+            fprintf(fp, "    %s (%s): connected after %.3f s, %d attempt(s), last open took %.3f s\n", driver->portName,
+                    driver->resourceName, driver->connectTime, driver->connectAttempts, driver->lastConnectDuration);
+        }
+        else
+        {
+            fprintf(fp, "    %s (%s): NOT CONNECTED after %d attempt(s), retrying every %.0f s\n", driver->portName,
+                    driver->resourceName, driver->connectAttempts, driver->connectBackoff);
+        }
+    }
+    epicsMutexUnlock(connectPoolLock);
+}
+
+static void connectPoolInitHook(initHookState state)
+{
+    if (state == initHookAfterIocRunning)
+    {
+        connectPoolReport(stdout);
+    }
+}
+
+/// hand a port to the background connect pool, starting the pool if needed
+static void connectPoolAdd(visaDriver_t *driver)
+{
+    epicsMutexMustLock(connectPoolLock);
+    if (!connectPoolStarted)
+    {
+        for(int i = 0; i < connectPoolThreads; ++i)
+        {
+            char name[32];
+            epicsSnprintf(name, sizeof(name), "VISAconnect%d", i);
+            epicsThreadMustCreate(name, epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium),
+                                  connectPoolThread, NULL);
+        }
+        connectPoolStarted = true;
+    }
+    driver->connectBackoff = 1.0;
+    driver->connectTime = -1.0;
+    epicsTimeGetCurrent(&(driver->nextConnectAttempt));
+    connectPoolPorts.push_back(driver);
+    connectPoolQueue.push_back(driver);
+    epicsMutexUnlock(connectPoolLock);
+    epicsEventSignal(connectPoolEvent);
+}
+
+/// ports checked by the deadline watchdog
+static std::vector<visaDriver_t*> watchdogPorts;
+/// protects watchdogPorts
+static epicsMutexId watchdogLock = NULL;
+
+/// take an abort of the operation of a port or device if it has run past its deadline, with takeAbort(), and again
+/// with viClear every VISA_WATCHDOG_GRACE while it has not returned. The session is closed by the port thread once the
+/// call returns, closing it here could free it under a call still using it. A session being opened cannot be
+/// aborted, but the overrun is still counted.
+static void watchdogCheck(visaDriver_t *driver, const epicsTimeStamp *now, std::vector<visaAbort_t>& aborts)
+{
+    epicsMutexMustLock(driver->opLock);
+    if (driver->opName == NULL || driver->hardDeadline <= 0 || epicsTimeLessThan(now, &(driver->opDeadline)))
+    {
+        epicsMutexUnlock(driver->opLock);
+        return;
+    }
+    if (epicsAtomicGetIntT(&(driver->opStage)) == 0)
+    {
+        ++(driver->nDeadlineOverruns);
+        errlogPrintf("%s: %s overran its deadline, aborting with viTerminate\n", driver->resourceName, driver->opName);
+    }
+    else
+    {
+        ++(driver->nAbortsIgnored);
+        errlogPrintf("%s: %s ignored viTerminate, aborting again with viClear\n", driver->resourceName, driver->opName);
+    }
+    aborts.push_back(takeAbort(driver, epicsAtomicGetIntT(&(driver->opStage)) != 0));
+    epicsTimeAddSeconds(&(driver->opDeadline), VISA_WATCHDOG_GRACE);
+    epicsMutexUnlock(driver->opLock);
+}
+
+/// deadline watchdog thread, shared by all ports. Aborts are made once watchdogLock, devicesLock and opLock
+/// have been released, so a VISA call that blocks holds up neither the other ports nor the port thread.
+static void watchdogThread(void *)
+{
+    epicsTimeStamp now;
+    std::vector<visaAbort_t> aborts;
+    while(true)
+    {
+        epicsThreadSleep(VISA_WATCHDOG_PERIOD);
+        epicsTimeGetCurrent(&now);
+        epicsMutexMustLock(watchdogLock);
+        for(std::vector<visaDriver_t*>::iterator it = watchdogPorts.begin(); it != watchdogPorts.end(); ++it)
+        {
+            visaDriver_t *driver = *it;
+            if (driver->devices == NULL)
+            {
+                watchdogCheck(driver, &now, aborts);
+                continue;
+            }
+            epicsMutexMustLock(driver->devicesLock);
+            for(visaDeviceMap_t::iterator dev = driver->devices->begin(); dev != driver->devices->end(); ++dev)
+            {
+                watchdogCheck(dev->second, &now, aborts);
+            }
+            epicsMutexUnlock(driver->devicesLock);
+        }
+        epicsMutexUnlock(watchdogLock);
+        for(std::vector<visaAbort_t>::iterator it = aborts.begin(); it != aborts.end(); ++it)
+        {
+            runAbort(&(*it));
+        }
+        aborts.clear();
+    }
+}
+
+/// hand a port to the deadline watchdog, starting it if needed
+static void watchdogAdd(visaDriver_t *driver)
+{
+    epicsMutexMustLock(watchdogLock);
+    if (watchdogPorts.empty())
+    {
+        epicsThreadMustCreate("VISAwatchdog", epicsThreadPriorityHigh, epicsThreadGetStackSize(epicsThreadStackSmall),
+                              watchdogThread, NULL);
+    }
+    watchdogPorts.push_back(driver);
+    epicsMutexUnlock(watchdogLock);
+}
+
+static asynStatus
+asynCommonConnect(void *drvPvt, asynUser *pasynUser)
+{
+    asynStatus status = asynSuccess;
+
+    status = connectIt(drvPvt, pasynUser);
+    if (status == asynSuccess)
+        pasynManager->exceptionConnect(pasynUser);
+    return status;
+}
+
+static asynStatus
+asynCommonDisconnect(void *drvPvt, asynUser *pasynUser)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+
+    assert(driver);
+    if (driver->devices != NULL) {
+        pasynManager->exceptionDisconnect(pasynUser);
+        return asynSuccess;
+    }
+    return closeConnection(pasynUser,driver,"Disconnect request");
+}
+
+/// write values to device
+static asynStatus writeVISA(void *drvPvt, asynUser *pasynUser,
+    const char *data, size_t numchars, size_t *nbytesTransfered)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    asynStatus status = asynSuccess;
+	bool timedout = false;
+
+    assert(driver);
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+              "%s write.\n", driver->resourceName);
+    asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, numchars,
+                "%s write %lu\n", driver->resourceName, (unsigned long)numchars);
+    *nbytesTransfered = 0;
+	if (!driver->connected)
+	{
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s disconnected:", driver->resourceName);
+            return asynError;
+	}
+	++(driver->nWriteCalls);
+	driver->lastViStatus = VI_SUCCESS;
+    if (numchars == 0)
+	{
+        return asynSuccess;
+	}
+	ViStatus err;
+	ViUInt32 actual = 0;
+    driver->timeout = pasynUser->timeout;
+	if (driver->asyncRunning)
+	{
+		err = asyncWrite(driver, data, numchars, &actual);
+	}
+	else
+	{
+	// always need to set timeout as use immediate as part of read
+		err = setAttr(driver, VI_ATTR_TMO_VALUE, visaTimeout(driver, driver->timeout));
+		VI_CHECK_ERROR("set timeout", err);
+		int attempt = 0;
+		do
+		{
+			err = driver->backend->write(driver->vi, (ViBuf)data, static_cast<ViUInt32>(numchars), &actual);
+		} while (err < 0 && err != VI_ERROR_TMO && actual == 0 && retryIO(driver, pasynUser, "write", err, attempt++));
+	}
+	driver->lastViStatus = err;
+	if ( err == VI_ERROR_TMO )
+	{
+		timedout = true;
+	}
+	else if ( err != VI_SUCCESS )
+	{
+            std::string msg = errMsg(driver, err);
+            recoverSession(pasynUser,driver,"Write error",err);
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s write error %s", driver->resourceName, msg.c_str());
+            return asynError;		
+	}
+	if (driver->flush_on_write)
+	{
+		err = driver->backend->flush(driver->vi, VI_IO_OUT_BUF);
+	    if ( err == VI_ERROR_TMO )
+	    {
+		    timedout = true;
+	    }
+	    else if ( err != VI_SUCCESS )
+	    {
+            std::string msg = errMsg(driver, err);
+            recoverSession(pasynUser,driver,"Write error",err);
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s write error %s", driver->resourceName, msg.c_str());
+            return asynError;		
+	    }
+	}
+    driver->nWriteBytes += actual;
+    *nbytesTransfered = actual;
+	if (timedout)
+	{
+		status = asynTimeout;
+	}
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+              "wrote %lu/%lu chars to %s, return %s.\n", (unsigned long)*nbytesTransfered, (unsigned long)numchars,
+                                               driver->resourceName,
+                                               pasynManager->strStatus(status));
+    return status;
+}
+
+/// serial read strategy used after the first byte of a reply has arrived: read exactly the number of bytes
+/// VISA already has queued, repeating while more arrive within stage2Timeout(), until the term char or maxchars.
+/// This avoids the short reads of a single immediate/readIntTimeout read on long replies.
+/// @return status of last viRead, VI_ERROR_TMO if we stopped because no more data arrived
+static ViStatus readAvail(visaDriver_t *driver, char *data, size_t maxchars, ViUInt32 *nread)
+{
+    ViStatus err = VI_SUCCESS_MAX_CNT;
+    ViUInt32 avail = 0, actual = 0;
+    *nread = 0;
+    while(*nread < maxchars)
+    {
+        if ( (err = driver->backend->getAttribute(driver->vi, VI_ATTR_ASRL_AVAIL_NUM, &avail)) < 0 )
+        {
+            return err;
+        }
+        if (avail == 0)
+        {
+            int tmo = stage2Timeout(driver);
+            if (tmo <= 0)
+            {
+                return VI_ERROR_TMO;
+            }
+            // block for the next character
+            if ( (err = setAttr(driver, VI_ATTR_TMO_VALUE, tmo)) < 0 )
+            {
+                return err;
+            }
+            avail = 1;
+        }
+        else if (avail > maxchars - *nread)
+        {
+            avail = static_cast<ViUInt32>(maxchars - *nread);
+        }
+        // if avail came from VI_ATTR_ASRL_AVAIL_NUM the data is already queued so this returns immediately 
+        err = driver->backend->read(driver->vi, reinterpret_cast<ViBuf>(data + *nread), avail, &actual);
+        *nread += actual;
+        if (err != VI_SUCCESS_MAX_CNT)
+        {
+            return err; // term char, END, timeout or error
+        }
+    }
+    return err;
+}
+
+/// Discard input left from an earlier reply so it is not taken as the reply to the next command, returns the
+/// VISA status. Serial ports always ask VI_ATTR_ASRL_AVAIL_NUM, as a device may also send unprompted, and throw
+/// away what is queued with one viFlush. Other interfaces have no count of waiting input and a read that finds
+/// nothing costs a timeout, so they drain with reads of drainTmo ms up to drainMax bytes only after a read
+/// stopped before the end of a reply (timeout, buffer full or error). After such a read serial ports drain
+/// the same way, as the rest of the reply may not have been queued yet. A reply being read by a posted
+/// asynchronous read is stopped and discarded too.
+static ViStatus discardInput(visaDriver_t *driver, asynUser *pasynUser)
+{
+    ViStatus err = VI_SUCCESS;
+    ViUInt32 avail = 0, actual = 0;
+    size_t n = 0;
+    char discard[512];
+    // the reply posted for by asyncWrite() and anything left unread from it, the posted read must be stopped
+    // before any other read of the session
+    if (driver->asyncRunning)
+    {
+        if (driver->readJob.posted)
+        {
+            cancelJob(driver, &(driver->readJob));
+            driver->readJob.posted = false;
+            driver->asyncOffset = 0;
+            driver->asyncLength = driver->readJob.count;
+        }
+        n += driver->asyncLength - driver->asyncOffset;
+        driver->asyncOffset = driver->asyncLength = 0;
+    }
+    if (driver->readAheadRunning)
+    {
+        // we are the consumer, so can move the tail
+        n = ringCount(&(driver->ring));
+        epicsAtomicSetSizeT(&(driver->ring.tail), driver->ring.tail + n);
+        epicsEventSignal(driver->readAheadSpaceEvent);
+    }
+    else if (driver->isSerial)
+    {
+        if ( (err = driver->backend->getAttribute(driver->vi, VI_ATTR_ASRL_AVAIL_NUM, &avail)) >= 0 && avail > 0 )
+        {
+            if (driver->backend->flush(driver->vi, VI_IO_IN_BUF_DISCARD) >= 0)
+            {
+                n = avail;
+            }
+            else if ( (err = setAttr(driver, VI_ATTR_TMO_VALUE, VI_TMO_IMMEDIATE)) >= 0 )
+            {
+                // not every VISA implementation can flush every port, read exactly what is queued instead
+                while(avail > 0 && n < static_cast<size_t>(driver->drainMax))
+                {
+                    err = driver->backend->read(driver->vi, reinterpret_cast<ViBuf>(discard),
+                                                (avail < sizeof(discard) ? avail : sizeof(discard)), &actual);
+                    n += actual;
+                    if ( (err < 0 && err != VI_ERROR_TMO) || actual == 0 ||
+                         (err = driver->backend->getAttribute(driver->vi, VI_ATTR_ASRL_AVAIL_NUM, &avail)) < 0 )
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    // the rest of a reply that was only partly read may still be arriving, on serial ports too
+    if (!driver->readAheadRunning && driver->inputStale && (err >= 0 || err == VI_ERROR_TMO))
+    {
+        err = setAttr(driver, VI_ATTR_TMO_VALUE, (driver->drainTmo == 0 ? VI_TMO_IMMEDIATE : driver->drainTmo));
+        while(err >= 0 && n < static_cast<size_t>(driver->drainMax))
+        {
+            err = driver->backend->read(driver->vi, reinterpret_cast<ViBuf>(discard), sizeof(discard), &actual);
+            n += actual;
+            if (actual == 0)
+            {
+                break;
+            }
+        }
+    }
+    if (err == VI_ERROR_TMO)
+    {
+        err = VI_SUCCESS;
+    }
+    driver->inputStale = false;
+    if (n > 0)
+    {
+        ++(driver->nDiscards);
+        driver->nDiscardBytes += n;
+        asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s discarded %lu bytes of input\n", driver->resourceName, (unsigned long)n);
+    }
+    return err;
+}
+
+/// read values from device
+static asynStatus readVISA(void *drvPvt, asynUser *pasynUser,
+    char *data, size_t maxchars, size_t *nbytesTransfered, int *gotEom)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    int reason = 0;
+    asynStatus status = asynSuccess;
+        ViUInt32 actual = 0, actualex = 0;
+	ViStatus err;
+
+    assert(driver);
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+              "%s read.\n", driver->resourceName);
+    *nbytesTransfered = 0;
+    if (gotEom) *gotEom = 0;
+	if (!driver->connected)
+	{
+            epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                          "%s disconnected:", driver->resourceName);
+            return asynError;
+	}
+	++(driver->nReadCalls);
+	driver->lastViStatus = VI_SUCCESS;
+    if (maxchars <= 0) {
+        epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+                  "%s maxchars %d. Why <=0?",driver->resourceName,(int)maxchars);
+        return asynError;
+    }
+	driver->timeout = pasynUser->timeout;
+	if (driver->readAheadRunning)
+	{
+		return readAheadRead(driver, pasynUser, data, maxchars, nbytesTransfered, gotEom);
+	}
+	// the reply to the last write is already being read by asyncWrite()
+	if (driver->asyncRunning && (driver->readJob.posted || driver->asyncOffset < driver->asyncLength))
+	{
+		return asyncRead(driver, pasynUser, data, maxchars, nbytesTransfered, gotEom);
+	}
+	// this is an optimisation - stream device does a zero timeout read to clear the input buffer, so
+	// discard any input rather than reading it. An error is not passed on, the read is only a flush
+	if (driver->timeout == 0 && driver->readIntTimeout < 0)
+	{
+		if ( (err = discardInput(driver, pasynUser)) < 0 )
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s discard input %s\n", driver->resourceName, errMsg(driver, err).c_str());
+		}
+        data[0] = 0; // already checked maxchars > 0 above
+		status = asynTimeout;
+		asynPrint(pasynUser, ASYN_TRACE_FLOW,
+			"read %lu from %s, return %s.\n", (unsigned long)*nbytesTransfered,
+			driver->resourceName,
+			pasynManager->strStatus(status));
+		return asynTimeout;
+	}		
+//	ViUInt32 avail = 0;
+	// should we only ever try and read one character?
+//	if (driver->isSerial)
+//	{
+//		if (viGetAttribute(driver->vi, VI_ATTR_ASRL_AVAIL_NUM, &avail) == VI_SUCCESS)
+//		{
+//			if (avail > maxchars)
+//			{
+//				avail = maxchars;
+//			}
+//		}
+//	}
+
+// try and read one character, if we don't time out try and read more with an immediate timeout
+// we always need to set timeout as we reset to immediate below
+// we don't use driver->readIntTimeout
+// whatever out timeout, we can get called with a timeout of 0 by higher levels to flush the input queue 
+// prior to a write, hence we need to map to  readIntTimeout  to avois problems on GPIB-ENET
+	if (driver->timeout == 0)
+	{
+		err = setAttr(driver, VI_ATTR_TMO_VALUE, (driver->readIntTimeout == 0 ? VI_TMO_IMMEDIATE  : driver->readIntTimeout) );
+	}
+	else
+	{
+		err = setAttr(driver, VI_ATTR_TMO_VALUE, static_cast<int>(driver->timeout * 1000.0));
+	}
+	VI_CHECK_ERROR("set timeout", err);
+	// we have had issues with GPIB-ENET and immediate timeout, it returns bus error sometimes
+	// so don't recover the session then, but ultimately return asynError via later logic
+	bool recoverOnError = (driver->timeout != 0 || driver->readIntTimeout != 0);
+	int attempt = 0;
+	// if the device sends an EOM the read will terminate then rather than on timeout. This is also one
+	// USBTMC bulk-in transfer of the whole caller's buffer, rather than one byte and then the rest
+	if (endIsEOM(driver))
+	{
+		do
+		{
+		    err = driver->backend->read(driver->vi, (ViBuf)data, static_cast<ViUInt32>(maxchars), &actual);
+		} while (err < 0 && err != VI_ERROR_TMO && actual == 0 && recoverOnError && retryIO(driver, pasynUser, "read", err, attempt++));
+		driver->lastViStatus = err;
+		if (err < 0 && err != VI_ERROR_TMO && recoverOnError)
+		{
+			std::string msg = errMsg(driver, err);
+			recoverSession(pasynUser, driver, "Read error", err);
+			epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+				"%s read error %s", driver->resourceName, msg.c_str());
+			return asynError;
+		}
+	}
+	else
+	{
+		do
+		{
+			err = driver->backend->read(driver->vi, (ViBuf)data, 1, &actual);
+		} while (err < 0 && err != VI_ERROR_TMO && actual == 0 && recoverOnError && retryIO(driver, pasynUser, "read", err, attempt++));
+		driver->lastViStatus = err;
+		if (err < 0 && err != VI_ERROR_TMO && recoverOnError)
+		{
+			std::string msg = errMsg(driver, err);
+			recoverSession(pasynUser, driver, "Read error (stage 1)", err);
+			epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+				"%s read error %s", driver->resourceName, msg.c_str());
+			return asynError;
+		}
+		if (actual > 0 && err == VI_SUCCESS_MAX_CNT)
+		{
+			epicsTimeStamp epicsTS;
+			epicsTimeGetCurrent(&epicsTS);
+			driver->firstByteWait = epicsTimeDiffInSeconds(&epicsTS, &(driver->readStart));
+			int tmo = stage2Timeout(driver);
+			if (driver->isSerial && driver->readAvail)
+			{
+				err = readAvail(driver, data + actual, maxchars - actual, &actualex);
+			}
+			else
+			{
+				// read anything else that might be there, originally this used VI_TMO_IMMEDIATE
+				// but we had a few timeout issues with GPIP over ethernet so this is now 
+				// configurable to a small finite value, or learned from the device if adaptivetmo is set
+				err = setAttr(driver, VI_ATTR_TMO_VALUE, (tmo > 0 ? tmo : VI_TMO_IMMEDIATE));
+				VI_CHECK_ERROR("set timeout", err);
+				err = driver->backend->read(driver->vi, reinterpret_cast<ViBuf>(data + actual), static_cast<ViUInt32>(maxchars - actual), &actualex);
+			}
+			driver->lastViStatus = err;
+			// how long the rest of the reply took to arrive, a reply that ended with a timeout (no terminator
+			// or END) stopped arriving tmo before that
+			if (driver->adaptiveTmo && (err >= 0 || err == VI_ERROR_TMO))
+			{
+				epicsTimeStamp epicsTS2;
+				epicsTimeGetCurrent(&epicsTS2);
+				learnReplyGap(driver, epicsTimeDiffInSeconds(&epicsTS2, &epicsTS) - (err == VI_ERROR_TMO ? tmo / 1000.0 : 0.0));
+			}
+			if (err < 0 && err != VI_ERROR_TMO)
+			{
+				// part of the reply has been read, so this is not retried
+				std::string msg = errMsg(driver, err);
+				recoverSession(pasynUser, driver, "Read error (stage 2)", err);
+				epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+					"%s read error %s", driver->resourceName, msg.c_str());
+				return asynError;
+			}
+			actual += actualex;
+			// a VI_SUCCESS on GPIB means we got the EOM, on serial it doesn't necessarily mean this
+			// so on timeout don't convert to VI_SUCCESS but to something that will get ignored in the
+			// next case statement
+			// remove expected VI_ERROR_TMO, but leave VI_SUCCESS_TERM_CHAR etc.
+			if (err < 0)
+			{
+				err = VI_WARN_UNKNOWN_STATUS;
+			}
+		}
+	}
+	switch(err)
+	{
+		case VI_SUCCESS:
+			if (endIsEOM(driver) && actual > 0)
+			{
+				reason |= ASYN_EOM_END;
+			}
+		    break;
+			
+		case VI_SUCCESS_TERM_CHAR:
+			reason |= ASYN_EOM_EOS;  
+			break;
+			
+		case VI_SUCCESS_MAX_CNT:
+//			reason |= ASYN_EOM_CNT;  // we read avail not maxchars, add this later if needed
+			break;
+			
+		case VI_ERROR_TMO:
+			status = asynTimeout;
+			break;
+			
+		default:
+			if (err < 0)
+			{
+				status = asynError;
+				epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+					"%s read error %s", driver->resourceName, errMsg(driver, err).c_str());
+			}
+			break;
+	}
+	if (actual > 0)
+	{
+        asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, actual,
+                   "%s read %d\n", driver->resourceName, actual);
+        driver->nReadBytes += (unsigned long)actual;
+    }
+//	else
+//	{
+//           epicsSnprintf(pasynUser->errorMessage,pasynUser->errorMessageSize,
+//                          "%s read", driver->resourceName);
+//            closeConnection(pasynUser,driver,"Read error");
+//            status = asynError;
+//    }
+    *nbytesTransfered = actual;
+    /* If there is room add a null byte */
+    if (actual < (int) maxchars)
+        data[actual] = 0;
+    else
+        reason |= ASYN_EOM_CNT;
+    if (gotEom) *gotEom = reason;
+    asynPrint(pasynUser, ASYN_TRACE_FLOW,
+              "read %lu from %s, return %s.\n", (unsigned long)*nbytesTransfered,
+                                               driver->resourceName,
+                                               pasynManager->strStatus(status));
+    return status;
+}
+
+/// write values to device and record statistics
+static asynStatus timedWrite(visaDriver_t *driver, asynUser *pasynUser,
+    const char *data, size_t numchars, size_t *nbytesTransfered)
+{
+	epicsTimeStamp epicsTS1, epicsTS2;
+	epicsTimeGetCurrent(&epicsTS1);
+    opBegin(driver, "write", pasynUser->timeout);
+    asynStatus status = writeVISA(driver, pasynUser, data, numchars, nbytesTransfered);
+    opEnd(driver);
+	epicsTimeGetCurrent(&epicsTS2);
+    double duration = epicsTimeDiffInSeconds(&epicsTS2, &epicsTS1);
+    recordTransaction(driver, &(driver->writeHist), status, duration);
+    flightRecord(driver, true, &epicsTS1, duration, status, 0, data, *nbytesTransfered);
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s Write took %f timeout was %f\n", 
+	          driver->resourceName, duration, pasynUser->timeout);
+    return status;
+}
+
+/// return the failure of a timed send of coalesced writes that nobody has been told of yet, or send any
+/// coalesced writes now. Called before a read, query or flush, whose caller may be waiting for their reply
+static asynStatus coalesceSync(visaDriver_t *driver, asynUser *pasynUser)
+{
+    asynStatus status = driver->coalesceStatus;
+    if (status != asynSuccess)
+    {
+        driver->coalesceStatus = asynSuccess;
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize, "%s: %s",
+                      driver->resourceName, driver->coalesceMessage);
+        return status;
+    }
+    return coalesceFlush(driver, pasynUser);
+}
+
+/// send any coalesced writes as one VISA write
+static asynStatus coalesceFlush(visaDriver_t *driver, asynUser *pasynUser)
+{
+    size_t nbytes = 0;
+    if (driver->coalesceLength == 0)
+    {
+        return asynSuccess;
+    }
+    if (driver->coalesceTimer != NULL)
+    {
+        epicsTimerCancel(driver->coalesceTimer);
+    }
+    double timeout = pasynUser->timeout;
+    pasynUser->timeout = driver->coalesceTimeout;
+    asynStatus status = timedWrite(driver, pasynUser, driver->coalesceBuffer, driver->coalesceLength, &nbytes);
+    pasynUser->timeout = timeout;
+    ++(driver->nCoalesceTransfers);
+    // the writes were acknowledged when buffered, so there is nothing useful to do with a partial write
+    driver->coalesceLength = 0;
+    return status;
+}
+
+/// asynOctet interface - write values to device. When coalescing small writes are buffered and sent
+/// together at the next read or flush, when coalesceSize is reached or coalesceAge after the first.
+static asynStatus writeIt(void *drvPvt, asynUser *pasynUser,
+    const char *data, size_t numchars, size_t *nbytesTransfered)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    asynStatus status;
+    assert(driver);
+    if (!driver->coalesce || !driver->connected || driver->coalesceBuffer == NULL || numchars == 0)
+    {
+        return timedWrite(driver, pasynUser, data, numchars, nbytesTransfered);
+    }
+    *nbytesTransfered = 0;
+    if (driver->coalesceLength + numchars > driver->coalesceBufferSize &&
+        (status = coalesceFlush(driver, pasynUser)) != asynSuccess)
+    {
+        return status;
+    }
+    if (numchars >= driver->coalesceBufferSize)
+    {
+        return timedWrite(driver, pasynUser, data, numchars, nbytesTransfered);
+    }
+    if (driver->coalesceLength == 0 && driver->coalesceAge > 0)
+    {
+        epicsTimerStartDelay(driver->coalesceTimer, driver->coalesceAge / 1000.0);
+    }
+    memcpy(driver->coalesceBuffer + driver->coalesceLength, data, numchars);
+    driver->coalesceLength += numchars;
+    driver->coalesceTimeout = pasynUser->timeout;
+    ++(driver->nCoalescedWrites);
+    *nbytesTransfered = numchars;
+    asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, numchars,
+                "%s write %lu (coalesced)\n", driver->resourceName, (unsigned long)numchars);
+    return (driver->coalesceLength == driver->coalesceBufferSize ? coalesceFlush(driver, pasynUser) : asynSuccess);
+}
+
+/// asynOctet interface - read values from device and record statistics
+static asynStatus readIt(void *drvPvt, asynUser *pasynUser,
+    char *data, size_t maxchars, size_t *nbytesTransfered, int *gotEom)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+	epicsTimeStamp epicsTS2;
+    assert(driver);
+    // a read normally means a reply is wanted, so anything we are holding back must go first
+    if (driver->coalesceLength > 0 || driver->coalesceStatus != asynSuccess)
+    {
+        asynStatus status = coalesceSync(driver, pasynUser);
+        if (status != asynSuccess)
+        {
+            *nbytesTransfered = 0;
+            if (gotEom) *gotEom = 0;
+            return status;
+        }
+    }
+	epicsTimeGetCurrent(&(driver->readStart));
+    driver->firstByteWait = -1.0;
+    int eom = 0;
+    opBegin(driver, "read", pasynUser->timeout);
+    asynStatus status = readVISA(driver, pasynUser, data, maxchars, nbytesTransfered, &eom);
+    opEnd(driver);
+	epicsTimeGetCurrent(&epicsTS2);
+    if (gotEom) *gotEom = eom;
+    double duration = epicsTimeDiffInSeconds(&epicsTS2, &(driver->readStart));
+    // a zero timeout read that finds nothing is stream device flushing the input queue, so
+    // it is not a real timeout and would distort the latency histogram
+    if (pasynUser->timeout == 0 && *nbytesTransfered == 0 && status == asynTimeout)
+    {
+        driver->busyTime += duration;
+    }
+    else
+    {
+        recordTransaction(driver, &(driver->readHist), status, duration);
+        flightRecord(driver, false, &(driver->readStart), duration, status, eom, data, *nbytesTransfered);
+    }
+    if (driver->firstByteWait >= 0.0)
+    {
+        histAdd(&(driver->firstByteHist), driver->firstByteWait);
+    }
+    // unless the reply ended properly, the rest of it may still be on its way
+    if (pasynUser->timeout != 0)
+    {
+        driver->inputStale = !replyComplete(driver, status, eom);
+    }
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s Read took %f timeout was %f\n", driver->resourceName, 
+	          duration, pasynUser->timeout);
+    return status;
+}
+
+/// flush device
+static asynStatus
+flushIt(void *drvPvt,asynUser *pasynUser)
+{
+	epicsTimeStamp epicsTS1, epicsTS2;
+	epicsTimeGetCurrent(&epicsTS1);
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+	if (!driver->connected)
+	{
+		epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+			"%s disconnected:", driver->resourceName);
+		return asynError;
+	}
+	asynStatus status = coalesceSync(driver, pasynUser);
+	driver->eosLeftOffset = driver->eosLeftLength = 0;
+	driver->respCache->serving = NULL;
+	driver->respCache->capturing = false;
+	opBegin(driver, "flush", 0.0);
+	ViStatus err = discardInput(driver, pasynUser);
+	opEnd(driver);
+	if (err < 0 && status == asynSuccess)
+	{
+		epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+			"%s: flush %s", driver->resourceName, errMsg(driver, err).c_str());
+		status = asynError;
+	}
+	epicsTimeGetCurrent(&epicsTS2);
+    asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s flush\n", driver->resourceName);
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s flush took %f\n", driver->resourceName, 
+	          epicsTimeDiffInSeconds(&epicsTS2, &epicsTS1));
+    return status;
+}
+
+/// find the first occurrence of a multi-byte terminator, memchr() for its first byte is usually vectorised by the C library
+static const char *findEos(const char *buffer, size_t len, const char *eos, int eosLen)
+{
+    const char *end = buffer + len;
+    const char *p = buffer;
+    while (p + eosLen <= end && (p = (const char*)memchr(p, eos[0], end - p - eosLen + 1)) != NULL)
+    {
+        if (memcmp(p, eos, eosLen) == 0)
+        {
+            return p;
+        }
+        ++p;
+    }
+    return NULL;
+}
+
+/// keep bytes read beyond an input terminator for the next read, retained is true if they were copied
+/// out of eosLeftBuffer by this read rather than read from the device
+static void eosKeepLeftover(visaDriver_t *driver, const char *data, size_t n, bool retained)
+{
+    if (n == 0)
+    {
+        return;
+    }
+    if (retained)
+    {
+        // they are still in eosLeftBuffer, so just step back over them
+        driver->eosLeftOffset -= n;
+        return;
+    }
+    if (n > driver->eosLeftSize)
+    {
+        free(driver->eosLeftBuffer);
+        driver->eosLeftBuffer = (char*)mallocMustSucceed(n, "drvAsynVISAPort eosLeftBuffer");
+        driver->eosLeftSize = n;
+    }
+    memcpy(driver->eosLeftBuffer, data, n);
+    driver->eosLeftOffset = 0;
+    driver->eosLeftLength = n;
+}
+
+/// a driver read function, readIt() or readVISA()
+typedef asynStatus (*visaReadFunc_t)(void *drvPvt, asynUser *pasynUser,
+    char *data, size_t maxchars, size_t *nbytesTransfered, int *gotEom);
+
+/// read one message ending with the input terminator eos using readFunc, keeping any bytes after it for the next read
+static asynStatus eosReadWith(visaReadFunc_t readFunc, visaDriver_t *driver, asynUser *pasynUser, const char *eos, int eosLen,
+    char *data, size_t maxchars, size_t *nbytesTransfered, int *gotEom)
+{
+    asynStatus status = asynSuccess;
+    size_t n = 0;
+    int eom = 0;
+    if (eosLen == 0 && driver->eosLeftLength == driver->eosLeftOffset)
+    {
+        return readFunc(driver, pasynUser, data, maxchars, nbytesTransfered, gotEom);
+    }
+    while (n < maxchars)
+    {
+        size_t nread = 0;
+        int lowEom = 0;
+        bool retained = (driver->eosLeftLength > driver->eosLeftOffset);
+        if (retained)
+        {
+            nread = driver->eosLeftLength - driver->eosLeftOffset;
+            if (nread > maxchars - n)
+            {
+                nread = maxchars - n;
+            }
+            memcpy(data + n, driver->eosLeftBuffer + driver->eosLeftOffset, nread);
+            driver->eosLeftOffset += nread;
+            asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data + n, nread,
+                        "%s read %lu (retained)\n", driver->resourceName, (unsigned long)nread);
+        }
+        else
+        {
+            status = readFunc(driver, pasynUser, data + n, maxchars - n, &nread, &lowEom);
+        }
+        // a terminator may straddle this and the previous read
+        size_t start = (n + 1 >= (size_t)eosLen ? n + 1 - eosLen : 0);
+        n += nread;
+        if (eosLen > 0)
+        {
+            const char *p = findEos(data + start, n - start, eos, eosLen);
+            if (p != NULL)
+            {
+                size_t end = (p - data) + eosLen;
+                // a terminator is found as soon as all of it has been read, so the bytes after it
+                // all came with this last chunk
+                eosKeepLeftover(driver, data + end, n - end, retained);
+                n = p - data;
+                eom |= ASYN_EOM_EOS;
+                break;
+            }
+        }
+        else
+        {
+            break;
+        }
+        if (status != asynSuccess || nread == 0 || (lowEom & ASYN_EOM_END))
+        {
+            eom |= (lowEom & ASYN_EOM_END);
+            break;
+        }
+    }
+    if (n == maxchars && !(eom & ASYN_EOM_EOS))
+    {
+        eom |= ASYN_EOM_CNT;
+    }
+    if (n < maxchars)
+    {
+        data[n] = '\0';
+    }
+    *nbytesTransfered = n;
+    if (gotEom) *gotEom = eom;
+    return status;
+}
+
+/// asynOctet interface - read one message ending with the native input terminator. Replaces asynInterposeEos
+/// when noProcessEos=1, VISA ends each read at the last terminator byte so normally a single VISA read is made.
+static asynStatus eosRead(void *drvPvt, asynUser *pasynUser,
+    char *data, size_t maxchars, size_t *nbytesTransfered, int *gotEom)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    return eosReadWith(readIt, driver, pasynUser, driver->inEos, driver->inEosLen, data, maxchars, nbytesTransfered, gotEom);
+}
+
+/// append the output terminator eos to a message in eosOutBuffer, returning the buffer
+static const char *eosAppend(visaDriver_t *driver, const char *data, size_t numchars, const char *eos, int eosLen)
+{
+    size_t len = numchars + eosLen;
+    if (len > driver->eosOutSize)
+    {
+        free(driver->eosOutBuffer);
+        driver->eosOutBuffer = (char*)mallocMustSucceed(len, "drvAsynVISAPort eosOutBuffer");
+        driver->eosOutSize = len;
+    }
+    memcpy(driver->eosOutBuffer, data, numchars);
+    memcpy(driver->eosOutBuffer + numchars, eos, eosLen);
+    return driver->eosOutBuffer;
+}
+
+/// asynOctet interface - write a message with the native output terminator appended, as one write
+static asynStatus eosWrite(void *drvPvt, asynUser *pasynUser,
+    const char *data, size_t numchars, size_t *nbytesTransfered)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    if (driver->outEosLen == 0)
+    {
+        return writeIt(driver, pasynUser, data, numchars, nbytesTransfered);
+    }
+    size_t len = numchars + driver->outEosLen;
+    size_t nbytes = 0;
+    asynStatus status = writeIt(driver, pasynUser, eosAppend(driver, data, numchars, driver->outEos, driver->outEosLen), len, &nbytes);
+    *nbytesTransfered = (nbytes > numchars ? numchars : nbytes);
+    return status;
+}
+
+/// asynOctet interface - set the native input terminator
+static asynStatus
+setInputEos(void *drvPvt, asynUser *pasynUser, const char *eos, int eoslen)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    if (eoslen < 0 || eoslen > VISA_EOS_MAX || (eoslen > 0 && eos == NULL))
+    {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s: illegal input eoslen %d (maximum %d)", driver->resourceName, eoslen, VISA_EOS_MAX);
+        return asynError;
+    }
+    if (eoslen > 0)
+    {
+        memcpy(driver->inEos, eos, eoslen);
+    }
+    driver->inEosLen = eoslen;
+    // let VISA end a read on the last terminator byte rather than waiting for a timeout
+    driver->termCharIn = (eoslen > 0 ? (ViUInt8)eos[eoslen - 1] : driver->termCharConfigured);
+    asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s set input eos length %d\n", driver->resourceName, eoslen);
+    if (driver->connected)
+    {
+        return setTermCharAttrs(driver, pasynUser);
+    }
+    return asynSuccess;
+}
+
+/// asynOctet interface - get the native input terminator
+static asynStatus
+getInputEos(void *drvPvt, asynUser *pasynUser, char *eos, int eossize, int *eoslen)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    if (eossize < driver->inEosLen)
+    {
+        *eoslen = -1;
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s: eossize %d too small for input eos", driver->resourceName, eossize);
+        return asynError;
+    }
+    memcpy(eos, driver->inEos, driver->inEosLen);
+    if (eossize > driver->inEosLen)
+    {
+        eos[driver->inEosLen] = '\0';
+    }
+    *eoslen = driver->inEosLen;
+    return asynSuccess;
+}
+
+/// asynOctet interface - set the native output terminator
+static asynStatus
+setOutputEos(void *drvPvt, asynUser *pasynUser, const char *eos, int eoslen)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    if (eoslen < 0 || eoslen > VISA_EOS_MAX || (eoslen > 0 && eos == NULL))
+    {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s: illegal output eoslen %d (maximum %d)", driver->resourceName, eoslen, VISA_EOS_MAX);
+        return asynError;
+    }
+    if (eoslen > 0)
+    {
+        memcpy(driver->outEos, eos, eoslen);
+    }
+    driver->outEosLen = eoslen;
+    asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s set output eos length %d\n", driver->resourceName, eoslen);
+    return asynSuccess;
+}
+
+/// asynOctet interface - get the native output terminator
+static asynStatus
+getOutputEos(void *drvPvt, asynUser *pasynUser, char *eos, int eossize, int *eoslen)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    if (eossize < driver->outEosLen)
+    {
+        *eoslen = -1;
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s: eossize %d too small for output eos", driver->resourceName, eossize);
+        return asynError;
+    }
+    memcpy(eos, driver->outEos, driver->outEosLen);
+    if (eossize > driver->outEosLen)
+    {
+        eos[driver->outEosLen] = '\0';
+    }
+    *eoslen = driver->outEosLen;
+    return asynSuccess;
+}
+
+/// is a write one of the configured cacheable queries
+static bool cacheable(const visaRespCache_t *cache, const char *data, size_t numchars)
+{
+    for(size_t i = 0; i < cache->prefixes.size(); ++i)
+    {
+        const std::string& prefix = cache->prefixes[i];
+        if (numchars >= prefix.size() && memcmp(data, prefix.data(), prefix.size()) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// asynOctet interface - write, unless it is a cacheable query with a reply in the response cache that
+/// is younger than cacheTtl, in which case the following reads return that reply. Any other write may
+/// change the device's configuration, so empties the cache.
+static asynStatus cacheWrite(void *drvPvt, asynUser *pasynUser,
+    const char *data, size_t numchars, size_t *nbytesTransfered)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    visaRespCache_t *cache = driver->respCache;
+    cache->serving = NULL;
+    cache->capturing = false;
+    if (driver->cacheTtl <= 0)
+    {
+        return eosWrite(driver, pasynUser, data, numchars, nbytesTransfered);
+    }
+    if (!cacheable(cache, data, numchars))
+    {
+        if (!cache->replies.empty())
+        {
+            cache->replies.clear();
+            ++(driver->nCacheInvalidations);
+        }
+        return eosWrite(driver, pasynUser, data, numchars, nbytesTransfered);
+    }
+    std::string query(data, numchars);
+    std::map<std::string, visaCachedReply_t>::const_iterator it = cache->replies.find(query);
+    if (it != cache->replies.end())
+    {
+        epicsTimeStamp now;
+        epicsTimeGetCurrent(&now);
+        if (epicsTimeDiffInSeconds(&now, &(it->second.time)) * 1000.0 < driver->cacheTtl)
+        {
+            cache->serving = &(it->second);
+            cache->servingOffset = 0;
+            ++(driver->nCacheHits);
+            *nbytesTransfered = numchars;
+            asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, numchars,
+                        "%s write %lu (cached reply)\n", driver->resourceName, (unsigned long)numchars);
+            return asynSuccess;
+        }
+    }
+    ++(driver->nCacheMisses);
+    asynStatus status = eosWrite(driver, pasynUser, data, numchars, nbytesTransfered);
+    if (status == asynSuccess)
+    {
+        cache->query.swap(query);
+        cache->captured.clear();
+        cache->capturing = true;
+    }
+    return status;
+}
+
+/// asynOctet interface - read, returning a cached reply if cacheWrite() found one, and keeping the
+/// reply to a cacheable query once it has been read completely
+static asynStatus cacheRead(void *drvPvt, asynUser *pasynUser,
+    char *data, size_t maxchars, size_t *nbytesTransfered, int *gotEom)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    visaRespCache_t *cache = driver->respCache;
+    if (cache->serving != NULL)
+    {
+        const visaCachedReply_t *cached = cache->serving;
+        size_t n = cached->reply.size() - cache->servingOffset;
+        int eom = cached->eom;
+        if (n > maxchars)
+        {
+            n = maxchars;
+            eom = ASYN_EOM_CNT;
+        }
+        memcpy(data, cached->reply.data() + cache->servingOffset, n);
+        cache->servingOffset += n;
+        if (cache->servingOffset == cached->reply.size())
+        {
+            cache->serving = NULL;
+        }
+        if (n < maxchars)
+        {
+            data[n] = '\0';
+        }
+        *nbytesTransfered = n;
+        if (gotEom) *gotEom = eom;
+        asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, data, n,
+                    "%s read %lu (cached)\n", driver->resourceName, (unsigned long)n);
+        return asynSuccess;
+    }
+    int eom = 0;
+    asynStatus status = eosRead(driver, pasynUser, data, maxchars, nbytesTransfered, &eom);
+    if (gotEom) *gotEom = eom;
+    if (cache->capturing)
+    {
+        // only a reply that ended cleanly is worth keeping
+        if (status != asynSuccess || cache->captured.size() + *nbytesTransfered > VISA_CACHE_MAX_REPLY)
+        {
+            cache->capturing = false;
+        }
+        else
+        {
+            cache->captured.append(data, *nbytesTransfered);
+            if (eom & (ASYN_EOM_EOS | ASYN_EOM_END))
+            {
+                visaCachedReply_t& cached = cache->replies[cache->query];
+                cached.reply.swap(cache->captured);
+                cached.eom = eom;
+                epicsTimeGetCurrent(&(cached.time));
+                cache->capturing = false;
+            }
+        }
+    }
+    return status;
+}
+
+/// with noProcessEos=1 there is no asynInterposeEos layer and terminators are handled by eosRead() and eosWrite()
+static asynOctet asynOctetMethods = { cacheWrite, cacheRead, flushIt, NULL, NULL,
+                                      setInputEos, getInputEos, setOutputEos, getOutputEos };
+
+/// asynVISAQuery interface - write a query and read its reply as one transaction on the port thread. Compared
+/// with separate asynOctet write and read calls there is no flush, EOS interpose layer, response cache or second
+/// queued request: the connection is checked, the VISA timeout set and the time taken once, then writeVISA() and
+/// readVISA() are called directly. The output terminator is appended to the query and the input terminator removed
+/// from the reply, those of the asynInterposeEos layer if the port has one (noProcessEos=0). With asyncio the read
+/// of the reply is posted before the query is written. The transaction goes in the query latency histogram.
+static asynStatus
+queryIt(void *drvPvt, asynUser *pasynUser, const char *query, size_t nquery,
+        char *reply, size_t maxchars, size_t *nbytesTransfered, int *gotEom)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    epicsTimeStamp epicsTS1, epicsTS2;
+    char inEos[VISA_EOS_MAX], outEos[VISA_EOS_MAX];
+    int inEosLen = 0, outEosLen = 0;
+    size_t nwritten = 0;
+    int eom = 0;
+    assert(driver);
+    *nbytesTransfered = 0;
+    if (gotEom) *gotEom = 0;
+    if (!driver->connected)
+    {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s disconnected:", driver->resourceName);
+        return asynError;
+    }
+    asynInterface *pasynInterface = pasynManager->findInterface(pasynUser, asynOctetType, 1);
+    if (pasynInterface != NULL && pasynInterface->pinterface != &asynOctetMethods)
+    {
+        // the terminators are held by the interpose layer, not by us
+        asynOctet *pasynOctet = (asynOctet*)pasynInterface->pinterface;
+        if (pasynOctet->getInputEos(pasynInterface->drvPvt, pasynUser, inEos, sizeof(inEos), &inEosLen) != asynSuccess ||
+            pasynOctet->getOutputEos(pasynInterface->drvPvt, pasynUser, outEos, sizeof(outEos), &outEosLen) != asynSuccess)
+        {
+            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                          "%s: query needs terminators of at most %d characters", driver->resourceName, VISA_EOS_MAX);
+            return asynError;
+        }
+    }
+    else
+    {
+        memcpy(inEos, driver->inEos, driver->inEosLen);
+        inEosLen = driver->inEosLen;
+        memcpy(outEos, driver->outEos, driver->outEosLen);
+        outEosLen = driver->outEosLen;
+    }
+    // anything still held back by write coalescing must go first, and its failure is the caller's
+    asynStatus status = coalesceSync(driver, pasynUser);
+    if (status != asynSuccess)
+    {
+        return status;
+    }
+    visaRespCache_t *cache = driver->respCache;
+    cache->serving = NULL;
+    cache->capturing = false;
+    if (!cache->replies.empty() && !cacheable(cache, query, nquery))
+    {
+        cache->replies.clear();
+        ++(driver->nCacheInvalidations);
+    }
+    epicsTimeGetCurrent(&epicsTS1);
+    // the rest of an earlier reply would otherwise be taken as ours
+    driver->eosLeftOffset = driver->eosLeftLength = 0;
+    driver->readStart = epicsTS1;
+    driver->timeout = pasynUser->timeout;
+    opBegin(driver, "query", pasynUser->timeout);
+    // for a non-zero timeout writeVISA() and readVISA() then find this already set
+    ViStatus err = setAttr(driver, VI_ATTR_TMO_VALUE, visaTimeout(driver, driver->timeout));
+    if (err < 0)
+    {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s: set timeout %s", driver->resourceName, errMsg(driver, err).c_str());
+        status = asynError;
+    }
+    else
+    {
+        status = writeVISA(driver, pasynUser, eosAppend(driver, query, nquery, outEos, outEosLen), nquery + outEosLen, &nwritten);
+    }
+    asynStatus writeStatus = status;
+    if (status == asynSuccess)
+    {
+        status = eosReadWith(readVISA, driver, pasynUser, inEos, inEosLen, reply, maxchars, nbytesTransfered, &eom);
+    }
+    opEnd(driver);
+    epicsTimeGetCurrent(&epicsTS2);
+    double duration = epicsTimeDiffInSeconds(&epicsTS2, &epicsTS1);
+    if (gotEom) *gotEom = eom;
+    recordTransaction(driver, &(driver->queryHist), status, duration);
+    flightRecord(driver, true, &epicsTS1, duration, writeStatus, 0, query, (nwritten > nquery ? nquery : nwritten));
+    if (writeStatus == asynSuccess)
+    {
+        flightRecord(driver, false, &epicsTS1, duration, status, eom, reply, *nbytesTransfered);
+    }
+    // unless the reply ended properly, the rest of it may still be on its way
+    driver->inputStale = !replyComplete(driver, status, eom);
+    asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s query took %f timeout was %f\n", driver->resourceName,
+              duration, pasynUser->timeout);
+    return status;
+}
+
+static asynVISAQuery asynVISAQueryMethods = { queryIt };
+
+/// size of one value of a ::visaParam_t of the given asyn interface type, for an array the size of one element
+static size_t paramSize(const char *type)
+{
+    if (strcmp(type, asynInt64Type) == 0)
+    {
+        return sizeof(epicsInt64);
+    }
+    else if (strcmp(type, asynFloat64Type) == 0 || strcmp(type, asynFloat64ArrayType) == 0)
+    {
+        return sizeof(epicsFloat64);
+    }
+    else if (strcmp(type, asynUInt32DigitalType) == 0)
+    {
+        return sizeof(epicsUInt32);
+    }
+    else
+    {
+        return sizeof(epicsInt32);
+    }
+}
+
+/// asynDrvUser interface - map a drvInfo string onto a ::visaParam_t statistics parameter
+static asynStatus
+drvUserCreate(void *drvPvt, asynUser *pasynUser, const char *drvInfo, const char **pptypeName, size_t *psize)
+{
+    visaDriver_t *driver = (visaDriver_t*)drvPvt;
+    assert(driver);
+    if (drvInfo == NULL || *drvInfo == '\0')
+    {
+        return asynSuccess;
+    }
+    // "BLOCK <query>" reads the binary block returned by query through an array interface
+    if (epicsStrnCaseCmp(drvInfo, "BLOCK ", 6) == 0 && drvInfo[6] != '\0')
+    {
+        pasynUser->reason = visaParamBlock;
+        pasynUser->drvUser = epicsStrDup(drvInfo + 6);
+        if (pptypeName) *pptypeName = visaParamInfo[visaParamBlock].type;
+        if (psize) *psize = paramSize(visaParamInfo[visaParamBlock].type);
+        return asynSuccess;
+    }
+    for(int i = 0; i < visaParamNum; ++i)
+    {
+        if (epicsStrCaseCmp(drvInfo, visaParamInfo[i].name) == 0)
+        {
+            pasynUser->reason = i;
+            if (pptypeName) *pptypeName = visaParamInfo[i].type;
+            if (psize) *psize = paramSize(visaParamInfo[i].type);
+            return asynSuccess;
+        }
+    }
+    epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                  "%s: unknown drvInfo \"%s\"", driver->portName, drvInfo);
+    return asynError;
+}
+
+static asynStatus
+drvUserGetType(void *, asynUser *pasynUser, const char **pptypeName, size_t *psize)
+{
+    if (pasynUser->reason >= 0 && pasynUser->reason < visaParamNum)
+    {
+        if (pptypeName) *pptypeName = visaParamInfo[pasynUser->reason].type;
+        if (psize) *psize = paramSize(visaParamInfo[pasynUser->reason].type);
+    }
+    return asynSuccess;
+}
+
+static asynStatus
+drvUserDestroy(void *, asynUser *pasynUser)
+{
+    if (pasynUser->reason == visaParamBlock)
+    {
+        free(pasynUser->drvUser);
+        pasynUser->drvUser = NULL;
+    }
+    return asynSuccess;
+}
+
+static asynDrvUser asynDrvUserMethods = { drvUserCreate, drvUserGetType, drvUserDestroy };
+
+/// check pasynUser->reason is a statistics parameter of the given asyn interface type
+static asynStatus
+checkParam(visaDriver_t *driver, asynUser *pasynUser, const char *type)
+{
+    if (pasynUser->reason < 0 || pasynUser->reason >= visaParamNum ||
+        strcmp(visaParamInfo[pasynUser->reason].type, type) != 0)
+    {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s: invalid %s reason %d", driver->portName, type, pasynUser->reason);
+        return asynError;
+    }
+    return asynSuccess;
+}
+
+/// asynInt64 interface - read a statistics counter
+static asynStatus
+readInt64(void *drvPvt, asynUser *pasynUser, epicsInt64 *value)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    if (checkParam(driver, pasynUser, asynInt64Type) != asynSuccess)
+    {
+        return asynError;
+    }
+    switch(pasynUser->reason)
+    {
+        case visaParamReadBytes:
+            *value = driver->nReadBytes;
+            break;
+        case visaParamWriteBytes:
+            *value = driver->nWriteBytes;
+            break;
+        case visaParamReadCalls:
+            *value = driver->nReadCalls;
+            break;
+        case visaParamWriteCalls:
+            *value = driver->nWriteCalls;
+            break;
+        case visaParamTimeouts:
+            *value = driver->nTimeouts;
+            break;
+        case visaParamErrors:
+            *value = driver->nErrors;
+            break;
+        case visaParamAttrCallsSaved:
+            *value = driver->nAttrCallsSaved;
+            break;
+        case visaParamSrqCount:
+            *value = driver->nSrq;
+            break;
+        case visaParamWritesSaved:
+            *value = (driver->nCoalescedWrites > driver->nCoalesceTransfers ? driver->nCoalescedWrites - driver->nCoalesceTransfers : 0);
+            break;
+        case visaParamCacheHits:
+            *value = driver->nCacheHits;
+            break;
+        case visaParamCacheMisses:
+            *value = driver->nCacheMisses;
+            break;
+        case visaParamRecoverRetries:
+            *value = driver->nRecoverRetries;
+            break;
+        case visaParamRecoverClears:
+            *value = driver->nRecoverClears;
+            break;
+        case visaParamRecoverReopens:
+            *value = driver->nRecoverReopens;
+            break;
+        case visaParamDiscardBytes:
+            *value = driver->nDiscardBytes;
+            break;
+        case visaParamDeadlineOverruns:
+            *value = driver->nDeadlineOverruns;
+            break;
+        default:
+            break;
+    }
+    return asynSuccess;
+}
+
+static asynInt64 asynInt64Methods = { NULL, readInt64, NULL, NULL, NULL };
+
+/// asynInt32 interface - read the status byte from the last serial poll after a service request (SRQ_STB),
+/// or serial poll the device now (STB)
+static asynStatus
+readInt32(void *drvPvt, asynUser *pasynUser, epicsInt32 *value)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    if (checkParam(driver, pasynUser, asynInt32Type) != asynSuccess)
+    {
+        return asynError;
+    }
+    if (pasynUser->reason != visaParamStb)
+    {
+        *value = driver->srqStb;
+        return asynSuccess;
+    }
+    if (!driver->connected)
+    {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s disconnected:", driver->resourceName);
+        return asynError;
+    }
+    ViUInt16 stb = 0;
+    ViStatus err = setAttr(driver, VI_ATTR_TMO_VALUE, visaTimeout(driver, pasynUser->timeout));
+    if (err >= 0)
+    {
+        opBegin(driver, "readSTB", pasynUser->timeout);
+        err = driver->backend->readSTB(driver->vi, &stb);
+        opEnd(driver);
+    }
+    if (err < 0)
+    {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s: viReadSTB %s", driver->resourceName, errMsg(driver, err).c_str());
+        return (err == VI_ERROR_TMO ? asynTimeout : asynError);
+    }
+    *value = stb;
+    return asynSuccess;
+}
+
+static asynInt32 asynInt32Methods = { NULL, readInt32, NULL, NULL, NULL };
+
+/// report a failed asynGpib operation
+static asynStatus gpibError(visaDriver_t *driver, asynUser *pasynUser, const char *op, ViStatus err)
+{
+    epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                  "%s: %s %s", driver->resourceName, op, errMsg(driver, err).c_str());
+    return (err == VI_ERROR_TMO ? asynTimeout : asynError);
+}
+
+/// check the session can take an asynGpib operation and set its timeout. On success the
+/// operation is started for the deadline watchdog, and must be ended with opEnd()
+static asynStatus gpibBegin(visaDriver_t *driver, asynUser *pasynUser, const char *op, bool needGPIB)
+{
+    if (!driver->connected)
+    {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s disconnected:", driver->resourceName);
+        return asynError;
+    }
+    if (!usesVISA(driver) || (needGPIB && !driver->isGPIB))
+    {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s: %s needs a GPIB resource", driver->resourceName, op);
+        return asynError;
+    }
+    ViStatus err = setAttr(driver, VI_ATTR_TMO_VALUE, visaTimeout(driver, pasynUser->timeout));
+    if (err < 0)
+    {
+        return gpibError(driver, pasynUser, op, err);
+    }
+    opBegin(driver, op, pasynUser->timeout);
+    return asynSuccess;
+}
+
+/// send bytes with ATN asserted. An INSTR session cannot do this, so a session to the
+/// GPIB board the device is on is opened the first time it is needed
+static ViStatus gpibCommand(visaDriver_t *driver, asynUser *pasynUser, const char *cmd, size_t len)
+{
+    ViStatus err;
+    ViUInt32 actual = 0;
+    if (driver->gpibIntfc == VI_NULL)
+    {
+        ViUInt16 intfNum = 0;
+        char name[32];
+        if ( (err = getAttr(driver, VI_ATTR_INTF_NUM, &intfNum)) < 0 )
+        {
+            return err;
+        }
+        epicsSnprintf(name, sizeof(name), "GPIB%u::INTFC", (unsigned)intfNum);
+        if ( (err = viOpen(driver->defaultRM, name, VI_NULL, VI_NULL, &(driver->gpibIntfc))) < 0 )
+        {
+            driver->gpibIntfc = VI_NULL;
+            return err;
+        }
+    }
+    if ( (err = viSetAttribute(driver->gpibIntfc, VI_ATTR_TMO_VALUE, visaTimeout(driver, pasynUser->timeout))) < 0 )
+    {
+        return err;
+    }
+    if (len == 0)
+    {
+        return VI_SUCCESS;
+    }
+    asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, cmd, len, "%s bus command %lu\n", driver->resourceName, (unsigned long)len);
+    return viGpibCommand(driver->gpibIntfc, (ViConstBuf)cmd, static_cast<ViUInt32>(len), &actual);
+}
+
+/// asynGpib interface - send addressed commands to the device. Trigger, selected device clear and go to
+/// local use the INSTR session, other commands are sent on the bus after addressing the device to listen
+static asynStatus
+gpibAddressedCmd(void *drvPvt, asynUser *pasynUser, const char *data, int length)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    asynStatus status;
+    ViStatus err;
+    assert(driver);
+    if (length == 1 && (data[0] == IBGET || data[0] == IBSDC || data[0] == IBGTL))
+    {
+        if ( (status = gpibBegin(driver, pasynUser, "addressedCmd", false)) != asynSuccess )
+        {
+            return status;
+        }
+        switch(data[0])
+        {
+            case IBGET:
+                err = viAssertTrigger(driver->vi, VI_TRIG_PROT_DEFAULT);
+                break;
+            case IBSDC:
+                err = driver->backend->clear(driver->vi);
+                // the device has discarded its output, so must we
+                driver->eosLeftOffset = driver->eosLeftLength = 0;
+                break;
+            default:
+                err = viGpibControlREN(driver->vi, VI_GPIB_REN_ADDRESS_GTL);
+                break;
+        }
+    }
+    else
+    {
+        if (length <= 0 || (status = gpibBegin(driver, pasynUser, "addressedCmd", true)) != asynSuccess)
+        {
+            return (length <= 0 ? asynSuccess : status);
+        }
+        ViUInt16 pad = 0, sad = VI_NO_SEC_ADDR;
+        if ( (err = getAttr(driver, VI_ATTR_GPIB_PRIMARY_ADDR, &pad)) >= 0 &&
+             (err = getAttr(driver, VI_ATTR_GPIB_SECONDARY_ADDR, &sad)) >= 0 )
+        {
+            std::string cmd;
+            cmd += static_cast<char>(IBUNT);
+            cmd += static_cast<char>(IBUNL);
+            cmd += static_cast<char>(0x20 | pad); // listen address
+            if (sad != VI_NO_SEC_ADDR)
+            {
+                cmd += static_cast<char>(0x60 | sad);
+            }
+            cmd.append(data, length);
+            cmd += static_cast<char>(IBUNL);
+            err = gpibCommand(driver, pasynUser, cmd.c_str(), cmd.size());
+        }
+    }
+    opEnd(driver);
+    if (err < 0)
+    {
+        return gpibError(driver, pasynUser, "addressedCmd", err);
+    }
+    asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s addressedCmd 0x%02x length %d\n", driver->resourceName, (unsigned)(data[0] & 0xff), length);
+    return asynSuccess;
+}
+
+/// asynGpib interface - send a universal command to all devices on the bus. On a non GPIB resource
+/// a device clear is sent to just this device
+static asynStatus
+gpibUniversalCmd(void *drvPvt, asynUser *pasynUser, int cmd)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    asynStatus status;
+    ViStatus err;
+    assert(driver);
+    if ( (status = gpibBegin(driver, pasynUser, "universalCmd", (cmd != IBDCL))) != asynSuccess )
+    {
+        return status;
+    }
+    if (!driver->isGPIB)
+    {
+        err = driver->backend->clear(driver->vi);
+    }
+    else
+    {
+        char c = static_cast<char>(cmd);
+        err = gpibCommand(driver, pasynUser, &c, 1);
+    }
+    opEnd(driver);
+    if (cmd == IBDCL)
+    {
+        driver->eosLeftOffset = driver->eosLeftLength = 0;
+    }
+    if (err < 0)
+    {
+        return gpibError(driver, pasynUser, "universalCmd", err);
+    }
+    asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s universalCmd 0x%02x\n", driver->resourceName, (unsigned)cmd);
+    return asynSuccess;
+}
+
+/// asynGpib interface - pulse interface clear on the bus
+static asynStatus
+gpibIfc(void *drvPvt, asynUser *pasynUser)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    asynStatus status;
+    assert(driver);
+    if ( (status = gpibBegin(driver, pasynUser, "ifc", true)) != asynSuccess )
+    {
+        return status;
+    }
+    // gpibCommand opens the interface session, an empty command is not sent
+    ViStatus err = gpibCommand(driver, pasynUser, NULL, 0);
+    if (err >= 0)
+    {
+        err = viGpibSendIFC(driver->gpibIntfc);
+    }
+    opEnd(driver);
+    if (err < 0)
+    {
+        return gpibError(driver, pasynUser, "ifc", err);
+    }
+    asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s ifc\n", driver->resourceName);
+    return asynSuccess;
+}
+
+/// asynGpib interface - assert or unassert remote enable, asserting also addresses the device
+static asynStatus
+gpibRen(void *drvPvt, asynUser *pasynUser, int onOff)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    asynStatus status;
+    assert(driver);
+    if ( (status = gpibBegin(driver, pasynUser, "ren", false)) != asynSuccess )
+    {
+        return status;
+    }
+    ViStatus err = viGpibControlREN(driver->vi, (onOff ? VI_GPIB_REN_ASSERT_ADDRESS : VI_GPIB_REN_DEASSERT));
+    opEnd(driver);
+    if (err < 0)
+    {
+        return gpibError(driver, pasynUser, "ren", err);
+    }
+    asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s ren %d\n", driver->resourceName, onOff);
+    return asynSuccess;
+}
+
+/// asynGpib interface - turn serial polling of the device on service requests on or off, the same as the "srq"
+/// option. VISA tells us of a service request, so the bus is not polled while there is none, and the status
+/// byte read by viReadSTB goes to the STB and STB_BITS I/O Intr records
+static asynStatus
+gpibPollAddr(void *drvPvt, asynUser *pasynUser, int onOff)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    if (onOff && (!usesVISA(driver) || driver->isSerial))
+    {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s: pollAddr needs a VISA GPIB resource", driver->resourceName);
+        return asynError;
+    }
+    driver->srq = (onOff != 0);
+    if (driver->srq)
+    {
+        startSrq(driver);
+    }
+    else
+    {
+        stopSrq(driver);
+    }
+    asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s pollAddr %d\n", driver->resourceName, onOff);
+    return asynSuccess;
+}
+
+static asynGpib asynGpibMethods = { gpibAddressedCmd, gpibUniversalCmd, gpibIfc, gpibRen, gpibPollAddr, NULL, NULL };
+
+/// asynUInt32Digital interface - read bits of the status byte from the last serial poll after a service request
+static asynStatus
+readUInt32Digital(void *drvPvt, asynUser *pasynUser, epicsUInt32 *value, epicsUInt32 mask)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    if (checkParam(driver, pasynUser, asynUInt32DigitalType) != asynSuccess)
+    {
+        return asynError;
+    }
+    *value = driver->srqStb & mask;
+    return asynSuccess;
+}
+
+static asynUInt32Digital asynUInt32DigitalMethods = { NULL, readUInt32Digital, NULL, NULL, NULL, NULL, NULL };
+
+/// asynFloat64 interface - read a statistics latency (s) or busy time (s)
+static asynStatus
+readFloat64(void *drvPvt, asynUser *pasynUser, epicsFloat64 *value)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    if (checkParam(driver, pasynUser, asynFloat64Type) != asynSuccess)
+    {
+        return asynError;
+    }
+    switch(pasynUser->reason)
+    {
+        case visaParamBusyTime:
+            *value = driver->busyTime;
+            break;
+        case visaParamReadLatMean:
+            *value = histMean(&(driver->readHist));
+            break;
+        case visaParamReadLatP50:
+            *value = histPercentile(&(driver->readHist), 0.50);
+            break;
+        case visaParamReadLatP99:
+            *value = histPercentile(&(driver->readHist), 0.99);
+            break;
+        case visaParamReadLatMax:
+            *value = driver->readHist.max;
+            break;
+        case visaParamWriteLatMean:
+            *value = histMean(&(driver->writeHist));
+            break;
+        case visaParamWriteLatP50:
+            *value = histPercentile(&(driver->writeHist), 0.50);
+            break;
+        case visaParamWriteLatP99:
+            *value = histPercentile(&(driver->writeHist), 0.99);
+            break;
+        case visaParamWriteLatMax:
+            *value = driver->writeHist.max;
+            break;
+        case visaParamFirstByteP50:
+            *value = histPercentile(&(driver->firstByteHist), 0.50);
+            break;
+        case visaParamFirstByteP99:
+            *value = histPercentile(&(driver->firstByteHist), 0.99);
+            break;
+        default:
+            break;
+    }
+    return asynSuccess;
+}
+
+static asynFloat64 asynFloat64Methods = { NULL, readFloat64, NULL, NULL };
+
+/// read count bytes of a block. A raw socket read also ends when the data received so far runs out, so reads
+/// go on until all have arrived, stopping early only on an error or at END on an interface that has it.
+/// @return VISA status of the last read
+static ViStatus readBlockBytes(visaDriver_t *driver, char *buf, size_t count, size_t *nbytes)
+{
+    ViStatus err = VI_SUCCESS;
+    ViUInt32 actual = 0;
+    *nbytes = 0;
+    while(*nbytes < count)
+    {
+        err = driver->backend->read(driver->vi, reinterpret_cast<ViBuf>(buf + *nbytes), static_cast<ViUInt32>(count - *nbytes), &actual);
+        *nbytes += actual;
+        if (err < 0 || (*nbytes < count && err == VI_SUCCESS && !driver->isSocket))
+        {
+            break;
+        }
+    }
+    return err;
+}
+
+/// read the header and payload of an IEEE 488.2 definite length block "#<n><len><data>" with termination
+/// characters disabled. The payload is read straight into buf with readBlockBytes(), and anything beyond maxbytes
+/// discarded. A block that ends before its length is an error.
+/// @return VISA status of the last read
+static ViStatus readBlock(visaDriver_t *driver, asynUser *pasynUser, char *buf, size_t maxbytes, size_t *nbytes)
+{
+    char header[16];
+    ViUInt32 actual = 0;
+    ViStatus err;
+    size_t len = 0, ndigits, nskip = 0;
+    *nbytes = 0;
+    // skip anything before the '#', such as a command echo or ":CURVE "
+    do
+    {
+        if ( (err = driver->backend->read(driver->vi, reinterpret_cast<ViBuf>(header), 1, &actual)) < 0 )
+        {
+            return err;
+        }
+    } while(actual == 1 && header[0] != '#' && ++nskip < 256 && err == VI_SUCCESS_MAX_CNT);
+    if (actual != 1 || header[0] != '#' ||
+        (err = driver->backend->read(driver->vi, reinterpret_cast<ViBuf>(header), 1, &actual)) < 0 || actual != 1 ||
+        header[0] < '1' || header[0] > '9')
+    {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s: no definite length block header in reply", driver->resourceName);
+        return (err < 0 ? err : VI_ERROR_INP_PROT_VIOL);
+    }
+    ndigits = header[0] - '0';
+    size_t got = 0;
+    if ( (err = readBlockBytes(driver, header, ndigits, &got)) < 0 )
+    {
+        return err;
+    }
+    for(size_t i = 0; i < ndigits; ++i)
+    {
+        if (i >= got || !isdigit(header[i]))
+        {
+            epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                          "%s: invalid block length in reply", driver->resourceName);
+            return VI_ERROR_INP_PROT_VIOL;
+        }
+        len = 10 * len + (header[i] - '0');
+    }
+    size_t n = (len < maxbytes ? len : maxbytes);
+    if (n > 0)
+    {
+        err = readBlockBytes(driver, buf, n, nbytes);
+    }
+    if (*nbytes < n)
+    {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s: block of %lu bytes ended after %lu", driver->resourceName, (unsigned long)len, (unsigned long)*nbytes);
+        return (err < 0 ? err : VI_ERROR_INP_PROT_VIOL);
+    }
+    // caller's array is full, throw the rest away
+    for(len -= n; len > 0 && (err == VI_SUCCESS_MAX_CNT || (err == VI_SUCCESS && driver->isSocket)); len -= actual)
+    {
+        char discard[256];
+        err = driver->backend->read(driver->vi, reinterpret_cast<ViBuf>(discard), static_cast<ViUInt32>(len < sizeof(discard) ? len : sizeof(discard)), &actual);
+        if (err < 0)
+        {
+            return err;
+        }
+    }
+    return err;
+}
+
+/// send a query and read the IEEE 488.2 definite length binary block it returns into buf
+static asynStatus blockQuery(visaDriver_t *driver, asynUser *pasynUser, const char *query, char *buf, size_t maxbytes, size_t *nbytes)
+{
+    ViStatus err;
+    ViUInt32 actual = 0;
+    asynStatus restored = asynSuccess;
+    *nbytes = 0;
+    if (!driver->connected)
+    {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s disconnected:", driver->resourceName);
+        return asynError;
+    }
+    if (query == NULL || driver->readAheadRunning)
+    {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s: block read needs a query and cannot be used with readahead", driver->resourceName);
+        return asynError;
+    }
+    // the query must follow anything already written, and a reply posted for an earlier write is stale
+    asynStatus status = coalesceSync(driver, pasynUser);
+    if (status != asynSuccess)
+    {
+        return status;
+    }
+    if (driver->asyncRunning)
+    {
+        cancelJob(driver, &(driver->readJob));
+        driver->readJob.posted = false;
+        driver->asyncOffset = driver->asyncLength = 0;
+    }
+    driver->timeout = pasynUser->timeout;
+    err = setAttr(driver, VI_ATTR_TMO_VALUE, visaTimeout(driver, driver->timeout));
+    VI_CHECK_ERROR("set timeout", err);
+    std::string cmd = std::string(query) + std::string(driver->blockEos, driver->blockEosLen);
+    asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, cmd.c_str(), cmd.size(),
+                "%s write %lu\n", driver->resourceName, (unsigned long)cmd.size());
+    err = driver->backend->write(driver->vi, (ViBuf)cmd.c_str(), static_cast<ViUInt32>(cmd.size()), &actual);
+    ++(driver->nWriteCalls);
+    driver->nWriteBytes += actual;
+    if (err >= 0)
+    {
+        // binary data may contain the term char
+        err = setAttr(driver, VI_ATTR_TERMCHAR_EN, VI_FALSE);
+        if (err >= 0 && driver->isSerial)
+        {
+            err = setAttr(driver, VI_ATTR_ASRL_END_IN, VI_ASRL_END_NONE);
+        }
+        if (err >= 0)
+        {
+            ++(driver->nReadCalls);
+            err = readBlock(driver, pasynUser, buf, maxbytes, nbytes);
+            // the rest of a block cut short may still arrive
+            driver->inputStale = (err < 0);
+        }
+        // back to the port's own settings, which on a raw socket also depend on "tcptermchar"
+        restored = setTermCharAttrs(driver, pasynUser);
+    }
+    driver->nReadBytes += *nbytes;
+    if (err == VI_SUCCESS_MAX_CNT)
+    {
+        // consume the terminator after the block so it isn't seen by the next read
+        int tmo = stage2Timeout(driver);
+        char discard[16];
+        if (setAttr(driver, VI_ATTR_TMO_VALUE, (tmo > 0 ? tmo : VI_TMO_IMMEDIATE)) >= 0)
+        {
+            driver->backend->read(driver->vi, reinterpret_cast<ViBuf>(discard), sizeof(discard), &actual);
+        }
+    }
+    if (err == VI_ERROR_TMO)
+    {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s: timeout reading block after %lu bytes", driver->resourceName, (unsigned long)*nbytes);
+        return asynTimeout;
+    }
+    if (err == VI_ERROR_INP_PROT_VIOL)
+    {
+        return asynError; // reply was not a whole block, errorMessage already set
+    }
+    if (err < 0)
+    {
+        std::string msg = errMsg(driver, err);
+        recoverSession(pasynUser, driver, "Block read error", err);
+        if (driver->flightDumpPending)
+        {
+            driver->flightDumpPending = false;
+            flightDump(driver, stdout, 0);
+        }
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize,
+                      "%s block read error %s", driver->resourceName, msg.c_str());
+        return asynError;
+    }
+    if (restored != asynSuccess)
+    {
+        // the session would go on reading with no termination character, a new one is set up as the port's
+        std::string msg = pasynUser->errorMessage;
+        closeConnection(pasynUser, driver, "Block read error");
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize, "%s", msg.c_str());
+        return asynError;
+    }
+    ++(driver->nBlockReads);
+    driver->nBlockBytes += *nbytes;
+    asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: read block of %lu bytes\n", driver->resourceName, (unsigned long)*nbytes);
+    return asynSuccess;
+}
+
+/// reverse the byte order of a value
+template <typename S>
+static void byteSwap(S *value)
+{
+    char *p = reinterpret_cast<char*>(value);
+    std::reverse(p, p + sizeof(S));
+}
+
+/// convert n block elements of type S at raw to T. raw may be the start of value, as
+/// working from the last element to the first never overwrites an element not yet converted.
+template <typename S, typename T>
+static void blockConvert(const char *raw, T *value, size_t n, bool swap)
+{
+    for(size_t j = n; j-- > 0; )
+    {
+        S s;
+        memcpy(&s, raw + j * sizeof(S), sizeof(S));
+        if (swap)
+        {
+            byteSwap(&s);
+        }
+        value[j] = static_cast<T>(s);
+    }
+}
+
+/// read a binary block for an array interface, pasynUser->drvUser is the query from the drvInfo "BLOCK <query>".
+/// Unless the block elements are larger than T the payload is read directly into value and converted in place.
+template <typename T>
+static asynStatus readBlockArray(visaDriver_t *driver, asynUser *pasynUser, T *value, size_t nelements, size_t *nIn)
+{
+    size_t size = visaBlockTypeInfo[driver->blockType].size, nbytes = 0;
+    char *raw = reinterpret_cast<char*>(value);
+    epicsTimeStamp epicsTS1, epicsTS2;
+    *nIn = 0;
+    if (size > sizeof(T))
+    {
+        if (driver->blockScratchSize < nelements * size)
+        {
+            free(driver->blockScratch);
+            driver->blockScratch = (char*)callocMustSucceed(nelements, size, "drvAsynVISAPort block read");
+            driver->blockScratchSize = nelements * size;
+        }
+        raw = driver->blockScratch;
+    }
+    epicsTimeGetCurrent(&epicsTS1);
+    opBegin(driver, "block query", pasynUser->timeout);
+    asynStatus status = blockQuery(driver, pasynUser, static_cast<const char*>(pasynUser->drvUser), raw, nelements * size, &nbytes);
+    opEnd(driver);
+    epicsTimeGetCurrent(&epicsTS2);
+    recordTransaction(driver, &(driver->readHist), status, epicsTimeDiffInSeconds(&epicsTS2, &epicsTS1));
+    if (status != asynSuccess)
+    {
+        return status;
+    }
+    size_t n = nbytes / size;
+    bool swap = (driver->blockBigEndian != (EPICS_BYTE_ORDER == EPICS_ENDIAN_BIG));
+    switch(driver->blockType)
+    {
+        case visaBlockInt8:
+            blockConvert<epicsInt8, T>(raw, value, n, swap);
+            break;
+        case visaBlockInt16:
+            blockConvert<epicsInt16, T>(raw, value, n, swap);
+            break;
+        case visaBlockInt32:
+            blockConvert<epicsInt32, T>(raw, value, n, swap);
+            break;
+        case visaBlockFloat32:
+            blockConvert<epicsFloat32, T>(raw, value, n, swap);
+            break;
+        default:
+            blockConvert<epicsFloat64, T>(raw, value, n, swap);
+            break;
+    }
+    *nIn = n;
+    return asynSuccess;
+}
+
+/// asynInt8Array interface - read a binary block
+static asynStatus
+readInt8Array(void *drvPvt, asynUser *pasynUser, epicsInt8 *value, size_t nelements, size_t *nIn)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    if (pasynUser->reason != visaParamBlock)
+    {
+        return checkParam(driver, pasynUser, asynInt8ArrayType);
+    }
+    return readBlockArray(driver, pasynUser, value, nelements, nIn);
+}
+
+static asynInt8Array asynInt8ArrayMethods = { NULL, readInt8Array, NULL, NULL };
+
+/// asynInt16Array interface - read a binary block
+static asynStatus
+readInt16Array(void *drvPvt, asynUser *pasynUser, epicsInt16 *value, size_t nelements, size_t *nIn)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    if (pasynUser->reason != visaParamBlock)
+    {
+        return checkParam(driver, pasynUser, asynInt16ArrayType);
+    }
+    return readBlockArray(driver, pasynUser, value, nelements, nIn);
+}
+
+static asynInt16Array asynInt16ArrayMethods = { NULL, readInt16Array, NULL, NULL };
+
+/// asynFloat32Array interface - read a binary block
+static asynStatus
+readFloat32Array(void *drvPvt, asynUser *pasynUser, epicsFloat32 *value, size_t nelements, size_t *nIn)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    if (pasynUser->reason != visaParamBlock)
+    {
+        return checkParam(driver, pasynUser, asynFloat32ArrayType);
+    }
+    return readBlockArray(driver, pasynUser, value, nelements, nIn);
+}
+
+static asynFloat32Array asynFloat32ArrayMethods = { NULL, readFloat32Array, NULL, NULL };
+
+/// asynFloat64Array interface - read a binary block
+static asynStatus
+readFloat64Array(void *drvPvt, asynUser *pasynUser, epicsFloat64 *value, size_t nelements, size_t *nIn)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    assert(driver);
+    if (pasynUser->reason != visaParamBlock)
+    {
+        return checkParam(driver, pasynUser, asynFloat64ArrayType);
+    }
+    return readBlockArray(driver, pasynUser, value, nelements, nIn);
+}
+
+static asynFloat64Array asynFloat64ArrayMethods = { NULL, readFloat64Array, NULL, NULL };
+
+/// asynInt32Array interface - read the bucket counts of a latency histogram, or a binary block
+static asynStatus
+readInt32Array(void *drvPvt, asynUser *pasynUser, epicsInt32 *value, size_t nelements, size_t *nIn)
+{
+    visaDriver_t *driver = getDevice((visaDriver_t*)drvPvt, pasynUser);
+    const visaHist_t *hist = NULL;
+    assert(driver);
+    if (pasynUser->reason == visaParamBlock)
+    {
+        return readBlockArray(driver, pasynUser, value, nelements, nIn);
+    }
+    if (checkParam(driver, pasynUser, asynInt32ArrayType) != asynSuccess)
+    {
+        return asynError;
+    }
+    switch(pasynUser->reason)
+    {
+        case visaParamReadLatHist:
+            hist = &(driver->readHist);
+            break;
+        case visaParamWriteLatHist:
+            hist = &(driver->writeHist);
+            break;
+        default:
+            hist = &(driver->firstByteHist);
+            break;
+    }
+    size_t n = (nelements < VISA_HIST_NBUCKETS ? nelements : VISA_HIST_NBUCKETS);
+    for(size_t i = 0; i < n; ++i)
+    {
+        value[i] = (hist->bucket[i] > 0x7fffffff ? 0x7fffffff : static_cast<epicsInt32>(hist->bucket[i]));
+    }
+    *nIn = n;
+    return asynSuccess;
+}
+
+static asynInt32Array asynInt32ArrayMethods = { NULL, readInt32Array, NULL, NULL };
+
+/*
+ * asynCommon methods
+ */
+static const struct asynCommon asynCommonMethods = {
+    asynCommonReport,
+    asynCommonConnect,
+    asynCommonDisconnect
+};
+
+
+/// allocate driver state with default settings
+static visaDriver_t *
+createDriver(const char *portName, const char *resourceName)
+{
+    visaDriver_t *driver = (visaDriver_t *)callocMustSucceed(1, sizeof(visaDriver_t), "drvAsyVISAPortConfigure()");
+    driver->connected = false;
+    driver->resourceName = epicsStrDup(resourceName);
+    driver->portName = epicsStrDup(portName);
+    driver->backend = selectBackend(resourceName);
+    driver->timeout = -0.1;
+    driver->isSerial = false;
+    driver->isGPIB = false;
+    driver->flush_on_write = false;
+	driver->connectTime = -1.0;
+	epicsTimeGetCurrent(&(driver->configureTime));
+	driver->readAheadSize = 4096;
+	driver->asyncSize = 4096;
+	driver->coalesceSize = 1024;
+	driver->coalesceAge = 20;
+	driver->blockType = visaBlockInt8;
+	driver->blockBigEndian = true;
+	driver->blockEos[0] = '\n';
+	driver->blockEosLen = 1;
+	driver->gpibReaddr = true;
+	driver->addr = -1;
+	driver->adaptiveMin = 2;
+	driver->adaptiveMax = 500;
+	driver->learnedTmo = -1;
+	driver->respCache = new visaRespCache_t();
+	driver->ioRetries = 1;
+	driver->recoverClear = true;
+	driver->reopenMaxBackoff = 30000;
+	driver->drainTmo = 10;
+	driver->drainMax = 65536;
+	driver->hardDeadline = 30000;
+	driver->opLock = epicsMutexMustCreate();
+	driver->tcpNoDelay = true;
+	driver->tcpKeepAlive = true;
+	driver->tcpTermChar = true;
+	driver->usbEnd = true;
+	driver->readAheadDataEvent = epicsEventMustCreate(epicsEventEmpty);
+	driver->readAheadSpaceEvent = epicsEventMustCreate(epicsEventEmpty);
+	driver->readAheadExitEvent = epicsEventMustCreate(epicsEventEmpty);
+	driver->srqExitEvent = epicsEventMustCreate(epicsEventEmpty);
+    return driver;
+}
+
+/// create the device for an asyn address of a multi-device port. addr is the primary GPIB address,
+/// or 100 * primary + secondary as for other asyn GPIB drivers. The device starts with the settings of the port
+static visaDriver_t *
+createDevice(visaDriver_t *port, int addr)
+{
+    int pad = (addr < 100 ? addr : addr / 100), sad = (addr < 100 ? -1 : addr % 100);
+    char resourceName[64];
+    if (pad > 30 || sad > 30)
+    {
+        return NULL;
+    }
+    if (sad < 0)
+    {
+        epicsSnprintf(resourceName, sizeof(resourceName), "GPIB%d::%d::INSTR", port->gpibBoard, pad);
+    }
+    else
+    {
+        epicsSnprintf(resourceName, sizeof(resourceName), "GPIB%d::%d::%d::INSTR", port->gpibBoard, pad, sad);
+    }
+    visaDriver_t *device = createDriver(port->portName, resourceName);
+    if (acquireDefaultRM(&(device->defaultRM)) != VI_SUCCESS)
+    {
+        driverCleanup(device);
+        return NULL;
+    }
+    device->addr = addr;
+    device->pasynUser = port->pasynUser;
+    device->int32InterruptPvt = port->int32InterruptPvt;
+    device->uint32DigitalInterruptPvt = port->uint32DigitalInterruptPvt;
+    device->deviceSendsEOM = port->deviceSendsEOM;
+    device->readIntTimeout = port->readIntTimeout;
+    device->termCharIn = port->termCharIn;
+    device->termCharConfigured = port->termCharConfigured;
+    memcpy(device->inEos, port->inEos, sizeof(device->inEos));
+    device->inEosLen = port->inEosLen;
+    memcpy(device->outEos, port->outEos, sizeof(device->outEos));
+    device->outEosLen = port->outEosLen;
+    device->adaptiveTmo = port->adaptiveTmo;
+    device->adaptiveMin = port->adaptiveMin;
+    device->adaptiveMax = port->adaptiveMax;
+    device->srq = port->srq;
+    device->srqRead = port->srqRead;
+    device->asyncIO = port->asyncIO;
+    device->asyncSize = port->asyncSize;
+    device->coalesceSize = port->coalesceSize;
+    device->coalesceAge = port->coalesceAge;
+    device->blockType = port->blockType;
+    device->blockBigEndian = port->blockBigEndian;
+    memcpy(device->blockEos, port->blockEos, sizeof(device->blockEos));
+    device->blockEosLen = port->blockEosLen;
+    device->flightDump = port->flightDump;
+    device->gpibReaddr = port->gpibReaddr;
+    device->gpibUnaddr = port->gpibUnaddr;
+    device->cacheTtl = port->cacheTtl;
+    device->ioRetries = port->ioRetries;
+    device->recoverClear = port->recoverClear;
+    device->reopenMaxBackoff = port->reopenMaxBackoff;
+    device->drainTmo = port->drainTmo;
+    device->drainMax = port->drainMax;
+    device->hardDeadline = port->hardDeadline;
+    device->inBufSize = port->inBufSize;
+    device->outBufSize = port->outBufSize;
+    device->respCache->prefixes = port->respCache->prefixes;
+    if (port->coalesce)
+    {
+        device->coalesce = startCoalesce(device, port->pasynUser);
+        if (!device->coalesce)
+        {
+            asynPrint(port->pasynUser, ASYN_TRACE_ERROR, "%s\n", port->pasynUser->errorMessage);
+        }
+    }
+    return device;
+}
+
+/// the driver state a request is for. On a multi-device port each asyn address has its own session,
+/// created when the address is first used, and the port itself (address -1) has none. All addresses
+/// share the port thread, so the bus is used by one of them at a time without VISA locking
+static visaDriver_t *
+getDevice(visaDriver_t *driver, asynUser *pasynUser)
+{
+    int addr = -1;
+    if (driver->devices == NULL || pasynManager->getAddr(pasynUser, &addr) != asynSuccess || addr < 0)
+    {
+        return driver;
+    }
+    epicsMutexMustLock(driver->devicesLock);
+    visaDeviceMap_t::iterator it = driver->devices->find(addr);
+    visaDriver_t *device = (it != driver->devices->end() ? it->second : NULL);
+    if (device == NULL && (device = createDevice(driver, addr)) != NULL)
+    {
+        (*(driver->devices))[addr] = device;
+    }
+    epicsMutexUnlock(driver->devicesLock);
+    return (device != NULL ? device : driver);
+}
+
+/// prefix of a drvAsynVISAPortConfigure() resource name that is an instrument identity to look up in the resource map
+#define VISA_IDN_PREFIX "IDN:"
+
+/// resource names by instrument identity, see drvAsynVISAResourceMap() and drvAsynVISAFindResources()
+static std::map<std::string, std::string> resourceMap;
+/// file resourceMap was last loaded from or written to
+static std::string resourceMapFile;
+
+/// one time set up of the shared state used by ports and the iocsh commands
+static void driverInit(void)
+{
+    static int firstTime = 1;
+    if (firstTime) {
+        sharedDefaultRMLock = epicsMutexMustCreate();
+        connectPoolLock = epicsMutexMustCreate();
+        connectPoolEvent = epicsEventMustCreate(epicsEventEmpty);
+        watchdogLock = epicsMutexMustCreate();
+        initHookRegister(connectPoolInitHook);
+        firstTime = 0;
+    }
+}
+
+/// remove leading and trailing white space and line ends
+static std::string trimSpace(const std::string& s)
+{
+    size_t start = s.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos)
+    {
+        return "";
+    }
+    return s.substr(start, s.find_last_not_of(" \t\r\n") - start + 1);
+}
+
+/// the identity of an instrument from its *IDN? reply: manufacturer, model and serial number in upper case.
+/// The firmware version is left out so a firmware update does not break the map. Empty if the reply does not
+/// look like an IEEE 488.2 identification, e.g. a serial device at the wrong baud rate.
+static std::string identityKey(const std::string& idn)
+{
+    std::string key;
+    size_t start = 0;
+    for(int field = 0; field < 3; ++field)
+    {
+        size_t comma = idn.find(',', start);
+        if (comma == std::string::npos && field < 2)
+        {
+            return "";
+        }
+        std::string value = trimSpace(idn.substr(start, (comma == std::string::npos ? std::string::npos : comma - start)));
+        if (value.size() == 0 && field < 2)
+        {
+            return "";
+        }
+        for(size_t i = 0; i < value.size(); ++i)
+        {
+            if (!isprint(static_cast<unsigned char>(value[i])))
+            {
+                return "";
+            }
+            value[i] = static_cast<char>(toupper(static_cast<unsigned char>(value[i])));
+        }
+        key += (field > 0 ? "," : "") + value;
+        start = (comma == std::string::npos ? idn.size() : comma + 1);
+    }
+    return key;
+}
+
+/// key of a resource map line: the identity, or for a name added by hand e.g. "DMM1" the name in upper case
+static std::string mapKey(const std::string& name)
+{
+    std::string key = identityKey(name);
+    if (key.size() == 0)
+    {
+        key = trimSpace(name);
+        for(size_t i = 0; i < key.size(); ++i)
+        {
+            key[i] = static_cast<char>(toupper(static_cast<unsigned char>(key[i])));
+        }
+    }
+    return key;
+}
 
-/*
- * asynCommon methods
- */
-static const struct asynCommon asynCommonMethods = {
-    asynCommonReport,
-    asynCommonConnect,
-    asynCommonDisconnect
-};
+/// read a resource map file of tab separated identity and resource name lines, # starts a comment
+static int loadResourceMap(const char *fileName, std::map<std::string, std::string>& rmap)
+{
+    FILE *fp = fopen(fileName, "r");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    char line[1024];
+    while(fgets(line, sizeof(line), fp) != NULL)
+    {
+        std::string s(line);
+        size_t tab = s.find('\t');
+        if (s[0] == '#' || tab == std::string::npos)
+        {
+            continue;
+        }
+        std::string key = mapKey(s.substr(0, tab));
+        size_t end = s.find('\t', tab + 1);
+        std::string rsrc = trimSpace(s.substr(tab + 1, (end == std::string::npos ? std::string::npos : end - tab - 1)));
+        if (key.size() > 0 && rsrc.size() > 0 && rmap.find(key) == rmap.end())
+        {
+            rmap[key] = rsrc;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
 
+/// turn an IDN: resource name into the resource it was last found at, other names are returned unchanged
+static bool resolveResourceName(const char *resourceName, std::string& resolved)
+{
+    resolved = resourceName;
+    if (epicsStrnCaseCmp(resourceName, VISA_IDN_PREFIX, strlen(VISA_IDN_PREFIX)) != 0)
+    {
+        return true;
+    }
+    std::string key = mapKey(resourceName + strlen(VISA_IDN_PREFIX));
+    std::map<std::string, std::string>::const_iterator it = resourceMap.find(key);
+    if (key.size() == 0 || it == resourceMap.end())
+    {
+        return false;
+    }
+    resolved = it->second;
+    return true;
+}
 
 /// Create a VISA device.
 /// @param[in] portName @copydoc drvAsynVISAPortConfigureArg0
@@ -889,6 +5901,7 @@ static const struct asynCommon asynCommonMethods = {
 /// @param[in] readIntTmoMs @copydoc drvAsynVISAPortConfigureArg5
 /// @param[in] termCharIn @copydoc drvAsynVISAPortConfigureArg6
 /// @param[in] deviceSendsEOM @copydoc drvAsynVISAPortConfigureArg7
+/// @param[in] connectMode @copydoc drvAsynVISAPortConfigureArg8
 epicsShareFunc int
 drvAsynVISAPortConfigure(const char *portName,
                          const char *resourceName, 
@@ -897,11 +5910,11 @@ drvAsynVISAPortConfigure(const char *portName,
                          int noProcessEos,
                          int readIntTmoMs,
                          const char* termCharIn,
-						 int deviceSendsEOM)
+						 int deviceSendsEOM,
+						 int connectMode)
 {
     visaDriver_t *driver;
     asynStatus status;
-    static int firstTime = 1;
 
     /*
      * Check arguments
@@ -914,26 +5927,40 @@ drvAsynVISAPortConfigure(const char *portName,
         printf("drvAsynVISAPortConfigure: resourceName information missing.\n");
         return -1;
     }
+    std::string resolvedName;
+    if (!resolveResourceName(resourceName, resolvedName)) {
+        printf("drvAsynVISAPortConfigure: \"%s\" not in resource map \"%s\", run drvAsynVISAFindResources()\n",
+               resourceName, resourceMapFile.c_str());
+        return -1;
+    }
+    if (resolvedName != resourceName) {
+        printf("drvAsynVISAPortConfigure: %s is %s\n", resourceName, resolvedName.c_str());
+        resourceName = resolvedName.c_str();
+    }
 
     /*
      * Perform some one-time-only initializations
      */
-    if (firstTime) {
-        firstTime = 0;
-    }
+    driverInit();
 
     /*
      * Create a driver
      */
-    driver = (visaDriver_t *)callocMustSucceed(1, sizeof(visaDriver_t), "drvAsyVISAPortConfigure()");
-    driver->connected = false;
-    driver->resourceName = epicsStrDup(resourceName);
-    driver->portName = epicsStrDup(portName);
-    driver->timeout = -0.1;
-    driver->isSerial = false;
-    driver->isGPIB = false;
-    driver->flush_on_write = false;
+    driver = createDriver(portName, resourceName);
 	driver->deviceSendsEOM = (deviceSendsEOM != 0);
+	int gpibBoard = 0, nIntfc = 0;
+	// the whole name must match, GPIB0::3::INSTR also starts with GPIB%d::
+	if ((sscanf(resourceName, "GPIB%d::INTFC%n", &gpibBoard, &nIntfc) == 1 && nIntfc > 0 && resourceName[nIntfc] == '\0') ||
+	    epicsStrCaseCmp(resourceName, "GPIB::INTFC") == 0)
+	{
+	    driver->gpibBoard = gpibBoard;
+	    // one port for every device on the board, asyn addresses map to lazily opened sessions
+	    driver->devices = new visaDeviceMap_t;
+	    driver->devicesLock = epicsMutexMustCreate();
+	    connectMode = -1;
+	    printf("drvAsynVISAPortConfigure: multi-device port for GPIB%d, asyn address is the GPIB address\n", driver->gpibBoard);
+	}
+	driver->backgroundConnect = !noAutoConnect && (connectMode > 0 || (connectMode == 0 && connectPoolDefault));
 	if (readIntTmoMs != 0)
 	{
         printf("drvAsynVISAPortConfigure: using internal read timeout of %d ms\n", readIntTmoMs);
@@ -949,17 +5976,35 @@ drvAsynVISAPortConfigure(const char *portName,
     {
 		char termChar[16];
 	    epicsStrnRawFromEscaped(termChar, sizeof(termChar), termCharIn, strlen(termCharIn));
-        if (strlen(termChar) == 1)
+        size_t len = strlen(termChar);
+        if (len == 1)
 		{
 			driver->termCharIn = termChar[0];
             printf("drvAsynVISAPortConfigure: using term char hint \"%s\" (0x%x)\n", termCharIn, (unsigned)driver->termCharIn);
 		}
+		else if (len <= VISA_EOS_MAX)
+		{
+		    // VISA can only end a read on one character, the last of the terminator
+			driver->termCharIn = termChar[len - 1];
+			if (noProcessEos)
+			{
+			    memcpy(driver->inEos, termChar, len);
+			    driver->inEosLen = (int)len;
+                printf("drvAsynVISAPortConfigure: using input terminator \"%s\"\n", termCharIn);
+			}
+			else
+			{
+                printf("drvAsynVISAPortConfigure: using term char hint 0x%x, last character of \"%s\"\n",
+				       (unsigned)driver->termCharIn, termCharIn);
+			}
+		}
 		else
 		{
-            printf("drvAsynVISAPortConfigure: termChar must be single character - NOT SET\n");
+            printf("drvAsynVISAPortConfigure: termChar longer than %d characters - NOT SET\n", VISA_EOS_MAX);
 		}
 	}
-	if (viOpenDefaultRM(&(driver->defaultRM)) != VI_SUCCESS)
+	driver->termCharConfigured = driver->termCharIn;
+	if (usesVISA(driver) && acquireDefaultRM(&(driver->defaultRM)) != VI_SUCCESS)
 	{
 		printf("drvAsynVISAPortConfigure: viOpenDefaultRM failed for port \"%s\"\n", driver->portName);
 		driverCleanup(driver);
@@ -977,9 +6022,10 @@ drvAsynVISAPortConfigure(const char *portName,
     driver->option.pinterface  = (void *)&asynOptionMethods;
     driver->option.drvPvt = driver;
 
+	// for background connection asyn auto connect is only enabled once the pool has connected the port
 	if (pasynManager->registerPort(driver->portName,
-                                   ASYN_CANBLOCK,
-                                   !noAutoConnect,
+                                   ASYN_CANBLOCK | (driver->devices != NULL ? ASYN_MULTIDEVICE : 0),
+                                   !noAutoConnect && !driver->backgroundConnect,
                                    priority,
                                    0) != asynSuccess) {
         printf("drvAsynVISAPortConfigure: Can't register myself.\n");
@@ -1008,6 +6054,123 @@ drvAsynVISAPortConfigure(const char *portName,
         driverCleanup(driver);
         return -1;
     }
+    driver->drvUser.interfaceType = asynDrvUserType;
+    driver->drvUser.pinterface  = &asynDrvUserMethods;
+    driver->drvUser.drvPvt = driver;
+    status = pasynManager->registerInterface(driver->portName,&driver->drvUser);
+    if(status != asynSuccess) {
+        printf("drvAsynVISAPortConfigure: Can't register drvUser.\n");
+        driverCleanup(driver);
+        return -1;
+    }
+    driver->int32.interfaceType = asynInt32Type;
+    driver->int32.pinterface  = &asynInt32Methods;
+    driver->int32.drvPvt = driver;
+    status = pasynInt32Base->initialize(driver->portName,&driver->int32);
+    if(status == asynSuccess) {
+        status = pasynManager->registerInterruptSource(driver->portName, &driver->int32, &driver->int32InterruptPvt);
+    }
+    if(status != asynSuccess) {
+        printf("drvAsynVISAPortConfigure: Can't register int32.\n");
+        driverCleanup(driver);
+        return -1;
+    }
+    driver->uint32Digital.interfaceType = asynUInt32DigitalType;
+    driver->uint32Digital.pinterface  = &asynUInt32DigitalMethods;
+    driver->uint32Digital.drvPvt = driver;
+    status = pasynUInt32DigitalBase->initialize(driver->portName,&driver->uint32Digital);
+    if(status == asynSuccess) {
+        status = pasynManager->registerInterruptSource(driver->portName, &driver->uint32Digital, &driver->uint32DigitalInterruptPvt);
+    }
+    if(status != asynSuccess) {
+        printf("drvAsynVISAPortConfigure: Can't register uint32Digital.\n");
+        driverCleanup(driver);
+        return -1;
+    }
+    driver->int64.interfaceType = asynInt64Type;
+    driver->int64.pinterface  = &asynInt64Methods;
+    driver->int64.drvPvt = driver;
+    status = pasynInt64Base->initialize(driver->portName,&driver->int64);
+    if(status != asynSuccess) {
+        printf("drvAsynVISAPortConfigure: Can't register int64.\n");
+        driverCleanup(driver);
+        return -1;
+    }
+    driver->float64.interfaceType = asynFloat64Type;
+    driver->float64.pinterface  = &asynFloat64Methods;
+    driver->float64.drvPvt = driver;
+    status = pasynFloat64Base->initialize(driver->portName,&driver->float64);
+    if(status != asynSuccess) {
+        printf("drvAsynVISAPortConfigure: Can't register float64.\n");
+        driverCleanup(driver);
+        return -1;
+    }
+    driver->int32Array.interfaceType = asynInt32ArrayType;
+    driver->int32Array.pinterface  = &asynInt32ArrayMethods;
+    driver->int32Array.drvPvt = driver;
+    status = pasynInt32ArrayBase->initialize(driver->portName,&driver->int32Array);
+    if(status != asynSuccess) {
+        printf("drvAsynVISAPortConfigure: Can't register int32Array.\n");
+        driverCleanup(driver);
+        return -1;
+    }
+    driver->int8Array.interfaceType = asynInt8ArrayType;
+    driver->int8Array.pinterface  = &asynInt8ArrayMethods;
+    driver->int8Array.drvPvt = driver;
+    status = pasynInt8ArrayBase->initialize(driver->portName,&driver->int8Array);
+    if(status != asynSuccess) {
+        printf("drvAsynVISAPortConfigure: Can't register int8Array.\n");
+        driverCleanup(driver);
+        return -1;
+    }
+    driver->int16Array.interfaceType = asynInt16ArrayType;
+    driver->int16Array.pinterface  = &asynInt16ArrayMethods;
+    driver->int16Array.drvPvt = driver;
+    status = pasynInt16ArrayBase->initialize(driver->portName,&driver->int16Array);
+    if(status != asynSuccess) {
+        printf("drvAsynVISAPortConfigure: Can't register int16Array.\n");
+        driverCleanup(driver);
+        return -1;
+    }
+    driver->float32Array.interfaceType = asynFloat32ArrayType;
+    driver->float32Array.pinterface  = &asynFloat32ArrayMethods;
+    driver->float32Array.drvPvt = driver;
+    status = pasynFloat32ArrayBase->initialize(driver->portName,&driver->float32Array);
+    if(status != asynSuccess) {
+        printf("drvAsynVISAPortConfigure: Can't register float32Array.\n");
+        driverCleanup(driver);
+        return -1;
+    }
+    driver->float64Array.interfaceType = asynFloat64ArrayType;
+    driver->float64Array.pinterface  = &asynFloat64ArrayMethods;
+    driver->float64Array.drvPvt = driver;
+    status = pasynFloat64ArrayBase->initialize(driver->portName,&driver->float64Array);
+    if(status != asynSuccess) {
+        printf("drvAsynVISAPortConfigure: Can't register float64Array.\n");
+        driverCleanup(driver);
+        return -1;
+    }
+    driver->query.interfaceType = asynVISAQueryType;
+    driver->query.pinterface  = &asynVISAQueryMethods;
+    driver->query.drvPvt = driver;
+    status = pasynManager->registerInterface(driver->portName,&driver->query);
+    if(status != asynSuccess) {
+        printf("drvAsynVISAPortConfigure: Can't register query.\n");
+        driverCleanup(driver);
+        return -1;
+    }
+    // GPIBn::... INSTR and INTFC resources only, devGpib would take any other port for a GPIB bus
+    if (epicsStrnCaseCmp(resourceName, "GPIB", 4) == 0) {
+        driver->gpib.interfaceType = asynGpibType;
+        driver->gpib.pinterface  = &asynGpibMethods;
+        driver->gpib.drvPvt = driver;
+        status = pasynManager->registerInterface(driver->portName,&driver->gpib);
+        if(status != asynSuccess) {
+            printf("drvAsynVISAPortConfigure: Can't register gpib.\n");
+            driverCleanup(driver);
+            return -1;
+        }
+    }
     status = pasynManager->connectDevice(driver->pasynUser,driver->portName,-1);
     if(status != asynSuccess) {
         printf("drvAsynVISAPortConfigure: connectDevice failed %s\n",driver->pasynUser->errorMessage);
@@ -1020,6 +6183,398 @@ drvAsynVISAPortConfigure(const char *portName,
      * Register for socket cleanup
      */
     epicsAtExit(visaCleanup, driver);
+    watchdogAdd(driver);
+    if (driver->backgroundConnect)
+    {
+        printf("drvAsynVISAPortConfigure: port \"%s\" will connect in background\n", driver->portName);
+        connectPoolAdd(driver);
+    }
+    return 0;
+}
+
+/// Configure the background connect pool used to open ports concurrently at IOC startup.
+/// Must be called before the drvAsynVISAPortConfigure() commands it should apply to.
+/// @param[in] nThreads @copydoc drvAsynVISAConnectPoolArg0
+/// @param[in] maxBackoff @copydoc drvAsynVISAConnectPoolArg1
+/// @param[in] allPorts @copydoc drvAsynVISAConnectPoolArg2
+epicsShareFunc int
+drvAsynVISAConnectPool(int nThreads, double maxBackoff, int allPorts)
+{
+    if (connectPoolStarted)
+    {
+        printf("drvAsynVISAConnectPool: pool already started, must be called before drvAsynVISAPortConfigure\n");
+        return -1;
+    }
+    if (nThreads > 0)
+    {
+        connectPoolThreads = nThreads;
+    }
+    if (maxBackoff > 0.0)
+    {
+        connectPoolMaxBackoff = maxBackoff;
+    }
+    connectPoolDefault = (allPorts != 0);
+    return 0;
+}
+
+/// Write a query and read its reply in one call to the driver, the equivalent of asynOctetSyncIO writeRead()
+/// for a VISA port. pasynUser must be connected to the port, e.g. by pasynOctetSyncIO->connect().
+/// @param[in] pasynUser asyn user connected to a drvAsynVISAPortConfigure() port
+/// @param[in] query data to write, the port output terminator is appended
+/// @param[in] nquery number of bytes in query
+/// @param[out] reply buffer for the reply
+/// @param[in] maxchars size of reply
+/// @param[in] timeout timeout (s) for the write and read
+/// @param[out] nbytesIn number of bytes read
+/// @param[out] eomReason ASYN_EOM_ flags for the reply, may be NULL
+epicsShareFunc asynStatus
+drvAsynVISAQuery(asynUser *pasynUser, const char *query, size_t nquery, char *reply, size_t maxchars,
+                 double timeout, size_t *nbytesIn, int *eomReason)
+{
+    asynInterface *pasynInterface = pasynManager->findInterface(pasynUser, asynVISAQueryType, 1);
+    if (pasynInterface == NULL)
+    {
+        epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize, "port is not a VISA port");
+        return asynError;
+    }
+    asynVISAQuery *pasynVISAQuery = (asynVISAQuery*)pasynInterface->pinterface;
+    asynStatus status = pasynManager->lockPort(pasynUser);
+    if (status != asynSuccess)
+    {
+        return status;
+    }
+    pasynUser->timeout = timeout;
+    status = pasynVISAQuery->query(pasynInterface->drvPvt, pasynUser, query, nquery, reply, maxchars, nbytesIn, eomReason);
+    if (status == asynSuccess)
+    {
+        asynPrintIO(pasynUser, ASYN_TRACEIO_DEVICE, reply, *nbytesIn, "drvAsynVISAQuery\n");
+    }
+    pasynManager->unlockPort(pasynUser);
+    return status;
+}
+
+/// Print the recent transactions held by the flight recorder of a port, oldest first.
+/// @param[in] portName @copydoc drvAsynVISAFlightDumpArg0
+/// @param[in] count @copydoc drvAsynVISAFlightDumpArg1
+epicsShareFunc int
+drvAsynVISAFlightDump(const char *portName, int count)
+{
+    asynInterface *pasynInterface;
+    int status = -1;
+    if (portName == NULL || *portName == '\0')
+    {
+        printf("drvAsynVISAFlightDump: no port name\n");
+        return -1;
+    }
+    asynUser *pasynUser = pasynManager->createAsynUser(0, 0);
+    if (pasynManager->connectDevice(pasynUser, portName, -1) != asynSuccess)
+    {
+        printf("drvAsynVISAFlightDump: unknown port \"%s\"\n", portName);
+    }
+    else if ( (pasynInterface = pasynManager->findInterface(pasynUser, asynCommonType, 1)) == NULL ||
+              pasynInterface->pinterface != &asynCommonMethods )
+    {
+        printf("drvAsynVISAFlightDump: \"%s\" is not a VISA port\n", portName);
+    }
+    else
+    {
+        // no port lock needed, the recorder is read without one
+        visaDriver_t *driver = (visaDriver_t*)pasynInterface->drvPvt;
+        if (driver->devices == NULL)
+        {
+            flightDump(driver, stdout, count);
+        }
+        else
+        {
+            epicsMutexMustLock(driver->devicesLock);
+            for(visaDeviceMap_t::iterator it = driver->devices->begin(); it != driver->devices->end(); ++it)
+            {
+                flightDump(it->second, stdout, count);
+            }
+            epicsMutexUnlock(driver->devicesLock);
+        }
+        status = 0;
+    }
+    pasynManager->freeAsynUser(pasynUser);
+    return status;
+}
+
+/// Empty the response cache of a port, e.g. after changing the instrument's settings from its front panel.
+/// @param[in] portName @copydoc drvAsynVISACacheClearArg0
+epicsShareFunc int
+drvAsynVISACacheClear(const char *portName)
+{
+    asynInterface *pasynInterface;
+    int status = -1;
+    if (portName == NULL || *portName == '\0')
+    {
+        printf("drvAsynVISACacheClear: no port name\n");
+        return -1;
+    }
+    asynUser *pasynUser = pasynManager->createAsynUser(0, 0);
+    if (pasynManager->connectDevice(pasynUser, portName, -1) != asynSuccess)
+    {
+        printf("drvAsynVISACacheClear: unknown port \"%s\"\n", portName);
+    }
+    else if ( (pasynInterface = pasynManager->findInterface(pasynUser, asynCommonType, 1)) == NULL ||
+              pasynInterface->pinterface != &asynCommonMethods )
+    {
+        printf("drvAsynVISACacheClear: \"%s\" is not a VISA port\n", portName);
+    }
+    else if (pasynManager->lockPort(pasynUser) != asynSuccess)
+    {
+        printf("drvAsynVISACacheClear: cannot lock port \"%s\"\n", portName);
+    }
+    else
+    {
+        // the cache is only used with the port lock held
+        visaDriver_t *driver = (visaDriver_t*)pasynInterface->drvPvt;
+        if (driver->devices == NULL)
+        {
+            cacheClear(driver);
+        }
+        else
+        {
+            epicsMutexMustLock(driver->devicesLock);
+            for(visaDeviceMap_t::iterator it = driver->devices->begin(); it != driver->devices->end(); ++it)
+            {
+                cacheClear(it->second);
+            }
+            epicsMutexUnlock(driver->devicesLock);
+        }
+        pasynManager->unlockPort(pasynUser);
+        status = 0;
+    }
+    pasynManager->freeAsynUser(pasynUser);
+    return status;
+}
+
+/// shared by the threads of drvAsynVISAFindResources()
+typedef struct visaProbe {
+    ViSession                rm;
+    ViUInt32                 timeout;   ///< ms
+    std::vector<std::string> resources; ///< found by viFindRsrc
+    std::vector<std::string> skipped;   ///< serial resources found by viFindRsrc but not probed
+    std::vector<std::string> replies;   ///< *IDN? reply of each resource, empty if none
+    size_t                   next;      ///< next resource to probe
+    int                      nRunning;
+    epicsMutexId             lock;
+    epicsEventId             doneEvent; ///< signalled as each thread finishes
+} visaProbe_t;
+
+/// ask a resource for its identity, returns an empty string if it does not answer
+static std::string probeIdentity(visaProbe_t *probe, const char *rsrc)
+{
+    ViSession vi = VI_NULL;
+    ViUInt32 actual = 0;
+    char reply[256];
+    if (viOpen(probe->rm, rsrc, VI_NULL, probe->timeout, &vi) != VI_SUCCESS)
+    {
+        return "";
+    }
+    viSetAttribute(vi, VI_ATTR_TMO_VALUE, probe->timeout);
+    viSetAttribute(vi, VI_ATTR_TERMCHAR, '\n');
+    viSetAttribute(vi, VI_ATTR_TERMCHAR_EN, VI_TRUE);
+    viSetAttribute(vi, VI_ATTR_ASRL_END_IN, VI_ASRL_END_TERMCHAR); // fails harmlessly when not serial
+    std::string idn;
+    if (viWrite(vi, (ViBuf)"*IDN?\n", 6, &actual) >= 0 &&
+        viRead(vi, reinterpret_cast<ViBuf>(reply), sizeof(reply) - 1, &actual) >= 0)
+    {
+        idn = trimSpace(std::string(reply, actual));
+    }
+    viClose(vi);
+    return idn;
+}
+
+static void probeThread(void *arg)
+{
+    visaProbe_t *probe = (visaProbe_t*)arg;
+    epicsMutexMustLock(probe->lock);
+    while(probe->next < probe->resources.size())
+    {
+        size_t i = probe->next++;
+        std::string rsrc = probe->resources[i];
+        epicsMutexUnlock(probe->lock);
+        std::string idn = probeIdentity(probe, rsrc.c_str());
+        epicsMutexMustLock(probe->lock);
+        probe->replies[i] = idn;
+    }
+    --(probe->nRunning);
+    epicsEventSignal(probe->doneEvent); // before unlocking, as probe goes once nRunning is seen to be 0
+    epicsMutexUnlock(probe->lock);
+}
+
+/// Find VISA resources, ask each for its identity with *IDN? and write a resource map file of where each
+/// instrument is, which then becomes the current map for IDN: resource names in drvAsynVISAPortConfigure().
+/// Resources are probed concurrently, so a scan takes about timeout for each nThreads silent resources.
+/// Serial ports are only probed if asked, as a device on one may not speak SCPI and most ports are silent.
+/// @param[in] expr @copydoc drvAsynVISAFindResourcesArg0
+/// @param[in] fileName @copydoc drvAsynVISAFindResourcesArg1
+/// @param[in] timeout @copydoc drvAsynVISAFindResourcesArg2
+/// @param[in] nThreads @copydoc drvAsynVISAFindResourcesArg3
+/// @param[in] probeSerial @copydoc drvAsynVISAFindResourcesArg4
+epicsShareFunc int
+drvAsynVISAFindResources(const char *expr, const char *fileName, double timeout, int nThreads, int probeSerial)
+{
+    ViFindList findList;
+    ViUInt32 count = 0;
+    ViChar desc[VI_FIND_BUFLEN];
+    ViStatus err;
+    if (fileName == NULL || *fileName == '\0')
+    {
+        printf("drvAsynVISAFindResources: no file name\n");
+        return -1;
+    }
+    if (expr == NULL || *expr == '\0')
+    {
+        expr = "?*INSTR";
+    }
+    if (timeout <= 0.0)
+    {
+        timeout = 2.0;
+    }
+    if (nThreads <= 0)
+    {
+        nThreads = 8;
+    }
+    driverInit();
+    visaProbe_t probe;
+    if (acquireDefaultRM(&(probe.rm)) != VI_SUCCESS)
+    {
+        printf("drvAsynVISAFindResources: viOpenDefaultRM failed\n");
+        return -1;
+    }
+    epicsTimeStamp epicsTS1, epicsTS2;
+    epicsTimeGetCurrent(&epicsTS1);
+    if ( (err = viFindRsrc(probe.rm, expr, &findList, &count, desc)) == VI_SUCCESS )
+    {
+        for(ViUInt32 i = 0; i < count; ++i)
+        {
+            if (i > 0 && viFindNext(findList, desc) != VI_SUCCESS)
+            {
+                break;
+            }
+            if (probeSerial == 0 && epicsStrnCaseCmp(desc, "ASRL", 4) == 0)
+            {
+                probe.skipped.push_back(desc);
+            }
+            else
+            {
+                probe.resources.push_back(desc);
+            }
+        }
+        viClose(findList);
+    }
+    else if (err != VI_ERROR_RSRC_NFOUND)
+    {
+        viStatusDesc(probe.rm, err, desc);
+        printf("drvAsynVISAFindResources: viFindRsrc \"%s\" %s\n", expr, desc);
+        releaseDefaultRM(&(probe.rm));
+        return -1;
+    }
+    probe.timeout = static_cast<ViUInt32>(timeout * 1000.0);
+    probe.replies.resize(probe.resources.size());
+    probe.next = 0;
+    probe.nRunning = 0;
+    probe.lock = epicsMutexMustCreate();
+    probe.doneEvent = epicsEventMustCreate(epicsEventEmpty);
+    for(int i = 0; i < nThreads && i < (int)probe.resources.size(); ++i)
+    {
+        char name[32];
+        epicsSnprintf(name, sizeof(name), "VISAFind%d", i);
+        epicsMutexMustLock(probe.lock);
+        ++probe.nRunning;
+        epicsMutexUnlock(probe.lock);
+        epicsThreadMustCreate(name, epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackSmall),
+                              probeThread, &probe);
+    }
+    while(true)
+    {
+        epicsMutexMustLock(probe.lock);
+        int running = probe.nRunning;
+        epicsMutexUnlock(probe.lock);
+        if (running == 0)
+        {
+            break;
+        }
+        epicsEventWait(probe.doneEvent);
+    }
+    epicsEventDestroy(probe.doneEvent);
+    epicsMutexDestroy(probe.lock);
+    releaseDefaultRM(&(probe.rm));
+    epicsTimeGetCurrent(&epicsTS2);
+
+    // write to a new file and rename it, so an IOC booting meanwhile never sees half a map
+    std::string tmpName = std::string(fileName) + ".tmp";
+    FILE *fp = fopen(tmpName.c_str(), "w");
+    if (fp == NULL)
+    {
+        printf("drvAsynVISAFindResources: cannot write \"%s\"\n", tmpName.c_str());
+        return -1;
+    }
+    char tbuf[64];
+    epicsTimeToStrftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S", &epicsTS2);
+    fprintf(fp, "# VISA resource map written by drvAsynVISAFindResources(\"%s\") at %s\n", expr, tbuf);
+    fprintf(fp, "# identity (manufacturer,model,serial)\tresource\t*IDN? reply\n");
+    for(size_t i = 0; i < probe.skipped.size(); ++i)
+    {
+        fprintf(fp, "# not probed\t%s\t\n", probe.skipped[i].c_str());
+        printf("%40s  (serial, not probed)\n", probe.skipped[i].c_str());
+    }
+    std::map<std::string, std::string> rmap;
+    int nFound = 0;
+    for(size_t i = 0; i < probe.resources.size(); ++i)
+    {
+        std::string key = identityKey(probe.replies[i]);
+        if (key.size() == 0)
+        {
+            fprintf(fp, "# no identity\t%s\t%s\n", probe.resources[i].c_str(), probe.replies[i].c_str());
+            printf("%40s  (no identity)\n", probe.resources[i].c_str());
+            continue;
+        }
+        // the same instrument may be visible on more than one interface, the first found is used
+        bool duplicate = (rmap.find(key) != rmap.end());
+        fprintf(fp, "%s%s\t%s\t%s\n", (duplicate ? "# " : ""), key.c_str(), probe.resources[i].c_str(), probe.replies[i].c_str());
+        printf("%40s  %s%s\n", probe.resources[i].c_str(), key.c_str(), (duplicate ? " (duplicate)" : ""));
+        if (!duplicate)
+        {
+            rmap[key] = probe.resources[i];
+            ++nFound;
+        }
+    }
+    if (fclose(fp) != 0 || rename(tmpName.c_str(), fileName) != 0)
+    {
+        printf("drvAsynVISAFindResources: cannot write \"%s\"\n", fileName);
+        remove(tmpName.c_str());
+        return -1;
+    }
+    resourceMap.swap(rmap);
+    resourceMapFile = fileName;
+    printf("drvAsynVISAFindResources: %d of %d resources identified (%d serial not probed) in %.1f seconds, map written to \"%s\"\n",
+           nFound, (int)probe.resources.size(), (int)probe.skipped.size(), epicsTimeDiffInSeconds(&epicsTS2, &epicsTS1), fileName);
+    return 0;
+}
+
+/// Load a resource map file written by drvAsynVISAFindResources(), so IDN: resource names given to
+/// drvAsynVISAPortConfigure() are looked up in it rather than by scanning at every boot.
+/// @param[in] fileName @copydoc drvAsynVISAResourceMapArg0
+epicsShareFunc int
+drvAsynVISAResourceMap(const char *fileName)
+{
+    std::map<std::string, std::string> rmap;
+    if (fileName == NULL || *fileName == '\0')
+    {
+        printf("drvAsynVISAResourceMap: no file name\n");
+        return -1;
+    }
+    if (loadResourceMap(fileName, rmap) != 0)
+    {
+        printf("drvAsynVISAResourceMap: cannot read \"%s\"\n", fileName);
+        return -1;
+    }
+    resourceMap.swap(rmap);
+    resourceMapFile = fileName;
+    printf("drvAsynVISAResourceMap: %d instruments in \"%s\"\n", (int)resourceMap.size(), fileName);
     return 0;
 }
 
@@ -1029,7 +6584,8 @@ drvAsynVISAPortConfigure(const char *portName,
 
 /// A name for the asyn driver instance we will create e.g. "L0" 
 static const iocshArg drvAsynVISAPortConfigureArg0 = { "portName",iocshArgString}; 
-/// VISA resource name to connect to e.g. "GPIB0::3::INSTR" or "COM10"
+/// VISA resource name to connect to e.g. "GPIB0::3::INSTR" or "COM10", or an instrument identity from the
+/// resource map e.g. "IDN:KEITHLEY INSTRUMENTS INC.,MODEL 2000,1234567" (see drvAsynVISAResourceMap())
 static const iocshArg drvAsynVISAPortConfigureArg1 = { "resourceName",iocshArgString};
 /// Driver priority 
 static const iocshArg drvAsynVISAPortConfigureArg2 = { "priority",iocshArgInt};
@@ -1049,17 +6605,23 @@ static const iocshArg drvAsynVISAPortConfigureArg5 = { "readIntTmoMs",iocshArgIn
 /// read termination character, this is purely to improve read efficiency and is independent of any characters
 /// specified at the asyn or stream device later. It allows a read to terminate early without waiting for a timeout,
 /// if the calling layer is stream device then it will still decide whether it has all the correct characters or not.
+/// A multi character terminator such as "\r\n" uses its last character as the hint and, with noProcessEos=1, also
+/// becomes the native input terminator.
 static const iocshArg drvAsynVISAPortConfigureArg6 = { "termCharIn",iocshArgString};
 /// Indicates that the device signals an "end of message". If this is true, then the driver can assume that 
 /// a VI_SUCCESS call translate to ASYN_EOM_END and this will stop a further call from Stream device if there are
 /// no termination characters to otherwise know all output has been received. 
 /// GPIB devices usually signal END, RS232 serial devices do not and you need to look for a termination character instead etc.  
 static const iocshArg drvAsynVISAPortConfigureArg7 = { "deviceSendsEOM",iocshArgInt};
+/// How to make the initial connection when auto connecting: 0 = use the drvAsynVISAConnectPool() allPorts setting,
+/// 1 = open in the background connect pool concurrently with other ports, retrying with exponential backoff,
+/// -1 = normal asyn auto connect. Records see the port as disconnected until the background connect succeeds.
+static const iocshArg drvAsynVISAPortConfigureArg8 = { "connectMode",iocshArgInt};
 
 static const iocshArg *drvAsynVISAPortConfigureArgs[] = {
     &drvAsynVISAPortConfigureArg0, &drvAsynVISAPortConfigureArg1, &drvAsynVISAPortConfigureArg2,
     &drvAsynVISAPortConfigureArg3, &drvAsynVISAPortConfigureArg4, &drvAsynVISAPortConfigureArg5,
-    &drvAsynVISAPortConfigureArg6, &drvAsynVISAPortConfigureArg7
+    &drvAsynVISAPortConfigureArg6, &drvAsynVISAPortConfigureArg7, &drvAsynVISAPortConfigureArg8
 
 };
 
@@ -1069,7 +6631,97 @@ static const iocshFuncDef drvAsynVISAPortConfigureFuncDef =
 static void drvAsynVISAPortConfigureCallFunc(const iocshArgBuf *args)
 {
     drvAsynVISAPortConfigure(args[0].sval, args[1].sval, args[2].ival, args[3].ival,
-                             args[4].ival, args[5].ival, args[6].sval, args[7].ival);
+                             args[4].ival, args[5].ival, args[6].sval, args[7].ival, args[8].ival);
+}
+
+/// maximum number of ports to open at the same time (default 4)
+static const iocshArg drvAsynVISAConnectPoolArg0 = { "nThreads",iocshArgInt};
+/// maximum delay (s) between retries of a failed background connect, the delay doubles from 1 second up to this (default 60)
+static const iocshArg drvAsynVISAConnectPoolArg1 = { "maxBackoff",iocshArgDouble};
+/// if non-zero, all subsequently configured auto connect ports use background connection unless their connectMode is -1
+static const iocshArg drvAsynVISAConnectPoolArg2 = { "allPorts",iocshArgInt};
+
+static const iocshArg *drvAsynVISAConnectPoolArgs[] = {
+    &drvAsynVISAConnectPoolArg0, &drvAsynVISAConnectPoolArg1, &drvAsynVISAConnectPoolArg2
+};
+
+static const iocshFuncDef drvAsynVISAConnectPoolFuncDef =
+                      {"drvAsynVISAConnectPool",sizeof(drvAsynVISAConnectPoolArgs)/sizeof(iocshArg*),drvAsynVISAConnectPoolArgs};
+
+static void drvAsynVISAConnectPoolCallFunc(const iocshArgBuf *args)
+{
+    drvAsynVISAConnectPool(args[0].ival, args[1].dval, args[2].ival);
+}
+
+/// asyn port name of a drvAsynVISAPortConfigure() port
+static const iocshArg drvAsynVISAFlightDumpArg0 = { "portName",iocshArgString};
+/// number of most recent transactions to print, 0 for all that are kept
+static const iocshArg drvAsynVISAFlightDumpArg1 = { "count",iocshArgInt};
+
+static const iocshArg *drvAsynVISAFlightDumpArgs[] = {
+    &drvAsynVISAFlightDumpArg0, &drvAsynVISAFlightDumpArg1
+};
+
+static const iocshFuncDef drvAsynVISAFlightDumpFuncDef =
+                      {"drvAsynVISAFlightDump",sizeof(drvAsynVISAFlightDumpArgs)/sizeof(iocshArg*),drvAsynVISAFlightDumpArgs};
+
+static void drvAsynVISAFlightDumpCallFunc(const iocshArgBuf *args)
+{
+    drvAsynVISAFlightDump(args[0].sval, args[1].ival);
+}
+
+/// asyn port name e.g. "L0"
+static const iocshArg drvAsynVISACacheClearArg0 = { "portName",iocshArgString};
+
+static const iocshArg *drvAsynVISACacheClearArgs[] = {
+    &drvAsynVISACacheClearArg0
+};
+
+static const iocshFuncDef drvAsynVISACacheClearFuncDef =
+                      {"drvAsynVISACacheClear",sizeof(drvAsynVISACacheClearArgs)/sizeof(iocshArg*),drvAsynVISACacheClearArgs};
+
+static void drvAsynVISACacheClearCallFunc(const iocshArgBuf *args)
+{
+    drvAsynVISACacheClear(args[0].sval);
+}
+
+/// VISA resource expression to search for (default "?*INSTR")
+static const iocshArg drvAsynVISAFindResourcesArg0 = { "expr",iocshArgString};
+/// resource map file to write e.g. "$(TOP)/iocBoot/$(IOC)/visa_resources.txt"
+static const iocshArg drvAsynVISAFindResourcesArg1 = { "fileName",iocshArgString};
+/// timeout (seconds) for each resource to open and answer *IDN? (default 2.0)
+static const iocshArg drvAsynVISAFindResourcesArg2 = { "timeout",iocshArgDouble};
+/// number of resources to probe at once (default 8)
+static const iocshArg drvAsynVISAFindResourcesArg3 = { "nThreads",iocshArgInt};
+/// 1 to also probe serial (ASRL) resources, which are listed but not probed by default (0)
+static const iocshArg drvAsynVISAFindResourcesArg4 = { "probeSerial",iocshArgInt};
+
+static const iocshArg *drvAsynVISAFindResourcesArgs[] = {
+    &drvAsynVISAFindResourcesArg0, &drvAsynVISAFindResourcesArg1, &drvAsynVISAFindResourcesArg2,
+    &drvAsynVISAFindResourcesArg3, &drvAsynVISAFindResourcesArg4
+};
+
+static const iocshFuncDef drvAsynVISAFindResourcesFuncDef =
+                      {"drvAsynVISAFindResources", sizeof(drvAsynVISAFindResourcesArgs)/sizeof(iocshArg*), drvAsynVISAFindResourcesArgs};
+
+static void drvAsynVISAFindResourcesCallFunc(const iocshArgBuf *args)
+{
+    drvAsynVISAFindResources(args[0].sval, args[1].sval, args[2].dval, args[3].ival, args[4].ival);
+}
+
+/// resource map file written by drvAsynVISAFindResources()
+static const iocshArg drvAsynVISAResourceMapArg0 = { "fileName",iocshArgString};
+
+static const iocshArg *drvAsynVISAResourceMapArgs[] = {
+    &drvAsynVISAResourceMapArg0
+};
+
+static const iocshFuncDef drvAsynVISAResourceMapFuncDef =
+                      {"drvAsynVISAResourceMap", sizeof(drvAsynVISAResourceMapArgs)/sizeof(iocshArg*), drvAsynVISAResourceMapArgs};
+
+static void drvAsynVISAResourceMapCallFunc(const iocshArgBuf *args)
+{
+    drvAsynVISAResourceMap(args[0].sval);
 }
 
 extern "C"
@@ -1081,6 +6733,11 @@ drvAsynVISAPortConfigureRegister(void)
     static int firstTime = 1;
     if (firstTime) {
         iocshRegister(&drvAsynVISAPortConfigureFuncDef,drvAsynVISAPortConfigureCallFunc);
+        iocshRegister(&drvAsynVISAConnectPoolFuncDef,drvAsynVISAConnectPoolCallFunc);
+        iocshRegister(&drvAsynVISAFlightDumpFuncDef,drvAsynVISAFlightDumpCallFunc);
+        iocshRegister(&drvAsynVISACacheClearFuncDef,drvAsynVISACacheClearCallFunc);
+        iocshRegister(&drvAsynVISAFindResourcesFuncDef,drvAsynVISAFindResourcesCallFunc);
+        iocshRegister(&drvAsynVISAResourceMapFuncDef,drvAsynVISAResourceMapCallFunc);
         firstTime = 0;
     }
 }
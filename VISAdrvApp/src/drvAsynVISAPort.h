@@ -5,6 +5,17 @@
 
 #include <shareLib.h>  
 
+#include "asynDriver.h"
+
+/// asyn interface of a drvAsynVISAPortConfigure() port for a combined write then read, see drvAsynVISAQuery()
+#define asynVISAQueryType "asynVISAQuery"
+
+/// write a query and read its reply as one driver operation, called with the port locked
+typedef struct asynVISAQuery {
+    asynStatus (*query)(void *drvPvt, asynUser *pasynUser, const char *query, size_t nquery,
+                        char *reply, size_t maxchars, size_t *nbytesTransfered, int *eomReason);
+} asynVISAQuery;
+
 #ifdef __cplusplus
 extern "C" {
 #endif  /* __cplusplus */
@@ -13,7 +24,25 @@ epicsShareFunc int drvAsynVISAPortConfigure(const char *portName,
                          const char *resourceName, 
                          unsigned int priority,
                          int noAutoConnect,
-                         int noProcessEos);
+                         int noProcessEos,
+                         int readIntTmoMs,
+                         const char* termCharIn,
+                         int deviceSendsEOM,
+                         int connectMode);
+
+epicsShareFunc int drvAsynVISAConnectPool(int nThreads, double maxBackoff, int allPorts);
+
+epicsShareFunc int drvAsynVISAFlightDump(const char *portName, int count);
+
+epicsShareFunc int drvAsynVISACacheClear(const char *portName);
+
+epicsShareFunc int drvAsynVISAFindResources(const char *expr, const char *fileName, double timeout, int nThreads,
+                         int probeSerial);
+
+epicsShareFunc int drvAsynVISAResourceMap(const char *fileName);
+
+epicsShareFunc asynStatus drvAsynVISAQuery(asynUser *pasynUser, const char *query, size_t nquery, char *reply,
+                         size_t maxchars, double timeout, size_t *nbytesIn, int *eomReason);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,757 @@
+/// @file drvAsynVISATermios.cpp native serial port backend of drvAsynVISAPort using POSIX termios
+///
+/// A port whose resource name is a tty device path (e.g. /dev/ttyUSB0) talks to it directly with termios,
+/// poll, read and write rather than through a VISA ASRL session. Reads follow VISA semantics (termination
+/// character, count and timeout) so the rest of the driver does not know which backend it is using.
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <epicsMutex.h>
+#include <epicsThread.h>
+
+#include <visa.h>
+
+#include "drvAsynVISABackend.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+#define TERMIOS_MAX_SESSIONS 64
+#define TERMIOS_DEFAULT_BUF  4096
+
+/// state of an open tty, equivalent to a VISA ASRL INSTR session
+typedef struct termiosSession {
+    bool       inUse;
+    int        fd;
+    char       path[256];
+    ViUInt32   timeout;      ///< VI_ATTR_TMO_VALUE (ms)
+    ViUInt8    termChar;     ///< VI_ATTR_TERMCHAR
+    bool       termCharEn;   ///< VI_ATTR_TERMCHAR_EN
+    ViUInt16   endIn;        ///< VI_ATTR_ASRL_END_IN
+    ViUInt16   endOut;       ///< VI_ATTR_ASRL_END_OUT
+    ViUInt32   baud;
+    ViUInt16   dataBits;
+    ViUInt16   parity;
+    ViUInt16   stopBits;
+    ViUInt16   flowCntrl;
+    char*      buf;          ///< bytes read from the tty but not yet returned, kept after a termination character
+    size_t     bufSize;
+    size_t     head;         ///< first unread byte in buf
+    size_t     tail;         ///< one past the last unread byte in buf
+    int        lastErrno;    ///< errno of the last failed system call, for statusDesc
+} termiosSession_t;
+
+static termiosSession_t termiosSessions[TERMIOS_MAX_SESSIONS];
+static epicsMutexId termiosLock = NULL;
+static epicsThreadOnceId termiosOnce = EPICS_THREAD_ONCE_INIT;
+
+static void termiosInit(void*)
+{
+    termiosLock = epicsMutexMustCreate();
+}
+
+/// session handles are the table index plus one, so VI_NULL is never a valid session
+static termiosSession_t* termiosGet(ViSession vi)
+{
+    if (vi < 1 || vi > TERMIOS_MAX_SESSIONS || !termiosSessions[vi - 1].inUse)
+    {
+        return NULL;
+    }
+    return &(termiosSessions[vi - 1]);
+}
+
+static ViStatus termiosErrno(termiosSession_t* s, int err)
+{
+    s->lastErrno = err;
+    return (err == EIO || err == ENXIO || err == ENODEV) ? VI_ERROR_CONN_LOST : VI_ERROR_SYSTEM_ERROR;
+}
+
+static bool termiosMatch(const char *resourceName)
+{
+    return strncmp(resourceName, "/dev/", 5) == 0;
+}
+
+static speed_t termiosSpeed(ViUInt32 baud)
+{
+    static const struct { ViUInt32 baud; speed_t speed; } speeds[] = {
+        { 50, B50 }, { 75, B75 }, { 110, B110 }, { 134, B134 }, { 150, B150 }, { 200, B200 },
+        { 300, B300 }, { 600, B600 }, { 1200, B1200 }, { 1800, B1800 }, { 2400, B2400 },
+        { 4800, B4800 }, { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 },
+#ifdef B57600
+        { 57600, B57600 },
+#endif
+#ifdef B115200
+        { 115200, B115200 },
+#endif
+#ifdef B230400
+        { 230400, B230400 },
+#endif
+#ifdef B460800
+        { 460800, B460800 },
+#endif
+#ifdef B921600
+        { 921600, B921600 },
+#endif
+    };
+    for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); ++i)
+    {
+        if (speeds[i].baud == baud)
+        {
+            return speeds[i].speed;
+        }
+    }
+    return B0;
+}
+
+/// apply the serial settings of the session to the tty in raw mode, reads never block in the kernel
+static ViStatus termiosApply(termiosSession_t* s)
+{
+    struct termios tio;
+    speed_t speed = termiosSpeed(s->baud);
+    if (speed == B0)
+    {
+        return VI_ERROR_NSUP_ATTR_STATE;
+    }
+    if (tcgetattr(s->fd, &tio) < 0)
+    {
+        return termiosErrno(s, errno);
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CREAD | CLOCAL;
+    tio.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS);
+#ifdef CMSPAR
+    tio.c_cflag &= ~CMSPAR;
+#endif
+    tio.c_iflag &= ~(IXON | IXOFF | IXANY);
+    switch (s->dataBits)
+    {
+        case 5: tio.c_cflag |= CS5; break;
+        case 6: tio.c_cflag |= CS6; break;
+        case 7: tio.c_cflag |= CS7; break;
+        default: tio.c_cflag |= CS8; break;
+    }
+    switch (s->parity)
+    {
+        case VI_ASRL_PAR_ODD: tio.c_cflag |= PARENB | PARODD; break;
+        case VI_ASRL_PAR_EVEN: tio.c_cflag |= PARENB; break;
+#ifdef CMSPAR
+        case VI_ASRL_PAR_MARK: tio.c_cflag |= PARENB | PARODD | CMSPAR; break;
+        case VI_ASRL_PAR_SPACE: tio.c_cflag |= PARENB | CMSPAR; break;
+#endif
+        default: break;
+    }
+    if (s->stopBits == VI_ASRL_STOP_TWO)
+    {
+        tio.c_cflag |= CSTOPB;
+    }
+    if (s->flowCntrl & VI_ASRL_FLOW_RTS_CTS)
+    {
+        tio.c_cflag |= CRTSCTS;
+    }
+    if (s->flowCntrl & VI_ASRL_FLOW_XON_XOFF)
+    {
+        tio.c_iflag |= IXON | IXOFF;
+    }
+    if (s->flowCntrl & VI_ASRL_FLOW_DTR_DSR)
+    {
+        tio.c_cflag &= ~CLOCAL; // honour the modem lines, as asyn's own serial driver does for clocal N
+    }
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(s->fd, TCSANOW, &tio) < 0)
+    {
+        return termiosErrno(s, errno);
+    }
+    // DTR says we can receive, termiosWrite() waits for DSR. A tty with no modem lines, e.g. a pty, refuses the ioctl
+    int dtr = TIOCM_DTR;
+    if (s->flowCntrl & VI_ASRL_FLOW_DTR_DSR)
+    {
+        ioctl(s->fd, TIOCMBIS, &dtr);
+    }
+    return VI_SUCCESS;
+}
+
+static ViStatus termiosOpen(ViSession, char *resourceName, ViSession *vi)
+{
+    epicsThreadOnce(&termiosOnce, termiosInit, NULL);
+    *vi = VI_NULL;
+    int fd = open(resourceName, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0)
+    {
+        return (errno == ENOENT || errno == ENXIO) ? VI_ERROR_RSRC_NFOUND :
+               (errno == EBUSY ? VI_ERROR_RSRC_LOCKED : VI_ERROR_SYSTEM_ERROR);
+    }
+    if (!isatty(fd))
+    {
+        close(fd);
+        return VI_ERROR_RSRC_NFOUND;
+    }
+    epicsMutexMustLock(termiosLock);
+    int i;
+    for (i = 0; i < TERMIOS_MAX_SESSIONS && termiosSessions[i].inUse; ++i)
+        ;
+    if (i == TERMIOS_MAX_SESSIONS)
+    {
+        epicsMutexUnlock(termiosLock);
+        close(fd);
+        return VI_ERROR_ALLOC;
+    }
+    termiosSession_t* s = &(termiosSessions[i]);
+    memset(s, 0, sizeof(termiosSession_t));
+    s->inUse = true;
+    epicsMutexUnlock(termiosLock);
+    s->fd = fd;
+    strncpy(s->path, resourceName, sizeof(s->path) - 1);
+    s->timeout = 2000;
+    s->termChar = '\n';
+    s->termCharEn = false;
+    s->endIn = VI_ASRL_END_TERMCHAR;
+    s->endOut = VI_ASRL_END_NONE;
+    s->baud = 9600;
+    s->dataBits = 8;
+    s->parity = VI_ASRL_PAR_NONE;
+    s->stopBits = VI_ASRL_STOP_ONE;
+    s->flowCntrl = VI_ASRL_FLOW_NONE;
+    s->bufSize = TERMIOS_DEFAULT_BUF;
+    s->buf = static_cast<char*>(malloc(s->bufSize));
+    ViStatus err = (s->buf != NULL ? termiosApply(s) : VI_ERROR_ALLOC);
+    if (err != VI_SUCCESS)
+    {
+        free(s->buf);
+        close(fd);
+        s->inUse = false;
+        return err;
+    }
+#if defined(__linux__) && defined(TIOCGSERIAL)
+    struct serial_struct ser;   // USB serial adapters otherwise hold received bytes for up to 16ms
+    if (ioctl(fd, TIOCGSERIAL, &ser) == 0)
+    {
+        ser.flags |= ASYNC_LOW_LATENCY;
+        ioctl(fd, TIOCSSERIAL, &ser);
+    }
+#endif
+    tcflush(fd, TCIOFLUSH);
+    *vi = static_cast<ViSession>(i + 1);
+    return VI_SUCCESS;
+}
+
+static ViStatus termiosClose(ViSession vi)
+{
+    termiosSession_t* s = termiosGet(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    close(s->fd);
+    free(s->buf);
+    epicsMutexMustLock(termiosLock);
+    s->inUse = false;
+    epicsMutexUnlock(termiosLock);
+    return VI_SUCCESS;
+}
+
+/// milliseconds left before deadline, -1 for no deadline
+static int termiosRemaining(const struct timespec* deadline, ViUInt32 timeout)
+{
+    if (timeout == VI_TMO_INFINITE)
+    {
+        return -1;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long ms = (deadline->tv_sec - now.tv_sec) * 1000 + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+    return ms > 0 ? static_cast<int>(ms) : 0;
+}
+
+static void termiosDeadline(struct timespec* deadline, ViUInt32 timeout)
+{
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    if (timeout != VI_TMO_INFINITE)
+    {
+        deadline->tv_sec += timeout / 1000;
+        deadline->tv_nsec += (timeout % 1000) * 1000000L;
+        if (deadline->tv_nsec >= 1000000000L)
+        {
+            deadline->tv_sec += 1;
+            deadline->tv_nsec -= 1000000000L;
+        }
+    }
+}
+
+/// with DTR/DSR flow control wait for the device to assert DSR, returns VI_ERROR_TMO if the deadline passes first.
+/// The kernel has no DSR handshake, so the line is polled every ms. A tty with no modem lines never holds output back.
+static ViStatus termiosWaitDsr(termiosSession_t* s, const struct timespec* deadline)
+{
+    int bits = 0;
+    while ((s->flowCntrl & VI_ASRL_FLOW_DTR_DSR) && ioctl(s->fd, TIOCMGET, &bits) == 0 && (bits & TIOCM_DSR) == 0)
+    {
+        if (termiosRemaining(deadline, s->timeout) == 0)
+        {
+            return VI_ERROR_TMO;
+        }
+        epicsThreadSleep(0.001);
+    }
+    return VI_SUCCESS;
+}
+
+/// wait for fd to become ready for events, returns VI_ERROR_TMO if the deadline passes first
+static ViStatus termiosWait(termiosSession_t* s, short events, const struct timespec* deadline)
+{
+    struct pollfd pfd;
+    pfd.fd = s->fd;
+    pfd.events = events;
+    while (true)
+    {
+        pfd.revents = 0;
+        int n = poll(&pfd, 1, termiosRemaining(deadline, s->timeout));
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return termiosErrno(s, errno);
+        }
+        if (n == 0)
+        {
+            return VI_ERROR_TMO;
+        }
+        if (pfd.revents & events)
+        {
+            return VI_SUCCESS;
+        }
+        if (pfd.revents & (POLLHUP | POLLERR | POLLNVAL))
+        {
+            return termiosErrno(s, EIO);
+        }
+    }
+}
+
+/// read up to count bytes, stopping at the termination character if enabled (VI_ATTR_TERMCHAR_EN or
+/// VI_ATTR_ASRL_END_IN of VI_ASRL_END_TERMCHAR), when count bytes are read, or when the timeout expires
+static ViStatus termiosRead(ViSession vi, ViBuf buf, ViUInt32 count, ViUInt32 *retCount)
+{
+    termiosSession_t* s = termiosGet(vi);
+    if (retCount != NULL)
+    {
+        *retCount = 0;
+    }
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    bool useTerm = s->termCharEn || s->endIn == VI_ASRL_END_TERMCHAR;
+    struct timespec deadline;
+    termiosDeadline(&deadline, s->timeout);
+    ViUInt32 n = 0;
+    ViStatus err = VI_SUCCESS;
+    while (n < count)
+    {
+        if (s->head == s->tail)
+        {
+            s->head = s->tail = 0;
+            ssize_t r = read(s->fd, s->buf, s->bufSize);
+            if (r > 0)
+            {
+                s->tail = static_cast<size_t>(r);
+            }
+            else if (r == 0 || errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
+                if (s->timeout == VI_TMO_IMMEDIATE)
+                {
+                    err = VI_ERROR_TMO;
+                    break;
+                }
+                if ( (err = termiosWait(s, POLLIN, &deadline)) != VI_SUCCESS )
+                {
+                    break;
+                }
+                continue;
+            }
+            else
+            {
+                err = termiosErrno(s, errno);
+                break;
+            }
+        }
+        size_t avail = s->tail - s->head;
+        size_t want = count - n;
+        size_t len = (avail < want ? avail : want);
+        const char* start = s->buf + s->head;
+        const char* term = (useTerm ? static_cast<const char*>(memchr(start, s->termChar, len)) : NULL);
+        if (term != NULL)
+        {
+            len = static_cast<size_t>(term - start) + 1;
+        }
+        memcpy(buf + n, start, len);
+        s->head += len;
+        n += static_cast<ViUInt32>(len);
+        if (term != NULL)
+        {
+            err = VI_SUCCESS_TERM_CHAR;
+            break;
+        }
+    }
+    if (err == VI_SUCCESS)
+    {
+        err = VI_SUCCESS_MAX_CNT;
+    }
+    if (retCount != NULL)
+    {
+        *retCount = n;
+    }
+    return err;
+}
+
+static ViStatus termiosWrite(ViSession vi, ViBuf buf, ViUInt32 count, ViUInt32 *retCount)
+{
+    termiosSession_t* s = termiosGet(vi);
+    if (retCount != NULL)
+    {
+        *retCount = 0;
+    }
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    struct timespec deadline;
+    termiosDeadline(&deadline, s->timeout);
+    ViUInt32 n = 0;
+    ViStatus err = VI_SUCCESS;
+    while (n < count)
+    {
+        if ( (err = termiosWaitDsr(s, &deadline)) != VI_SUCCESS )
+        {
+            break;
+        }
+        ssize_t w = write(s->fd, buf + n, count - n);
+        if (w > 0)
+        {
+            n += static_cast<ViUInt32>(w);
+        }
+        else if (w == 0 || errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        {
+            if ( (err = termiosWait(s, POLLOUT, &deadline)) != VI_SUCCESS )
+            {
+                break;
+            }
+        }
+        else
+        {
+            err = termiosErrno(s, errno);
+            break;
+        }
+    }
+    if (retCount != NULL)
+    {
+        *retCount = n;
+    }
+    return err;
+}
+
+static ViStatus termiosSetAttribute(ViSession vi, ViAttr attr, ViAttrState value)
+{
+    termiosSession_t* s = termiosGet(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    termiosSession_t old = *s;
+    switch (attr)
+    {
+        case VI_ATTR_TMO_VALUE:
+            s->timeout = static_cast<ViUInt32>(value);
+            return VI_SUCCESS;
+        case VI_ATTR_TERMCHAR:
+            s->termChar = static_cast<ViUInt8>(value);
+            return VI_SUCCESS;
+        case VI_ATTR_TERMCHAR_EN:
+            s->termCharEn = (value != VI_FALSE);
+            return VI_SUCCESS;
+        case VI_ATTR_ASRL_END_IN:
+            if (value != VI_ASRL_END_NONE && value != VI_ASRL_END_TERMCHAR)
+            {
+                return VI_ERROR_NSUP_ATTR_STATE;
+            }
+            s->endIn = static_cast<ViUInt16>(value);
+            return VI_SUCCESS;
+        case VI_ATTR_ASRL_END_OUT:
+            if (value != VI_ASRL_END_NONE)
+            {
+                return VI_ERROR_NSUP_ATTR_STATE;
+            }
+            s->endOut = static_cast<ViUInt16>(value);
+            return VI_SUCCESS;
+        case VI_ATTR_SEND_END_EN:
+        case VI_ATTR_SUPPRESS_END_EN:
+            return VI_SUCCESS;  // there is no END on a tty
+        case VI_ATTR_ASRL_BAUD:
+            s->baud = static_cast<ViUInt32>(value);
+            break;
+        case VI_ATTR_ASRL_DATA_BITS:
+            if (value < 5 || value > 8)
+            {
+                return VI_ERROR_NSUP_ATTR_STATE;
+            }
+            s->dataBits = static_cast<ViUInt16>(value);
+            break;
+        case VI_ATTR_ASRL_PARITY:
+#ifndef CMSPAR
+            if (value == VI_ASRL_PAR_MARK || value == VI_ASRL_PAR_SPACE)
+            {
+                return VI_ERROR_NSUP_ATTR_STATE;
+            }
+#endif
+            if (value > VI_ASRL_PAR_SPACE)
+            {
+                return VI_ERROR_NSUP_ATTR_STATE;
+            }
+            s->parity = static_cast<ViUInt16>(value);
+            break;
+        case VI_ATTR_ASRL_STOP_BITS:
+            if (value != VI_ASRL_STOP_ONE && value != VI_ASRL_STOP_TWO)
+            {
+                return VI_ERROR_NSUP_ATTR_STATE;
+            }
+            s->stopBits = static_cast<ViUInt16>(value);
+            break;
+        case VI_ATTR_ASRL_FLOW_CNTRL:
+            if (value & ~(VI_ASRL_FLOW_XON_XOFF | VI_ASRL_FLOW_RTS_CTS | VI_ASRL_FLOW_DTR_DSR))
+            {
+                return VI_ERROR_NSUP_ATTR_STATE;
+            }
+            s->flowCntrl = static_cast<ViUInt16>(value);
+            break;
+        case VI_ATTR_RSRC_CLASS:
+        case VI_ATTR_INTF_TYPE:
+        case VI_ATTR_INTF_INST_NAME:
+        case VI_ATTR_ASRL_AVAIL_NUM:
+            return VI_ERROR_ATTR_READONLY;
+        default:
+            return VI_ERROR_NSUP_ATTR;
+    }
+    ViStatus err = termiosApply(s);
+    if (err != VI_SUCCESS)
+    {
+        *s = old;
+    }
+    return err;
+}
+
+static ViStatus termiosGetAttribute(ViSession vi, ViAttr attr, void *value)
+{
+    termiosSession_t* s = termiosGet(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    switch (attr)
+    {
+        case VI_ATTR_TMO_VALUE:
+            *static_cast<ViUInt32*>(value) = s->timeout;
+            return VI_SUCCESS;
+        case VI_ATTR_TERMCHAR:
+            *static_cast<ViUInt8*>(value) = s->termChar;
+            return VI_SUCCESS;
+        case VI_ATTR_TERMCHAR_EN:
+            *static_cast<ViBoolean*>(value) = (s->termCharEn ? VI_TRUE : VI_FALSE);
+            return VI_SUCCESS;
+        case VI_ATTR_ASRL_END_IN:
+            *static_cast<ViUInt16*>(value) = s->endIn;
+            return VI_SUCCESS;
+        case VI_ATTR_ASRL_END_OUT:
+            *static_cast<ViUInt16*>(value) = s->endOut;
+            return VI_SUCCESS;
+        case VI_ATTR_SEND_END_EN:
+        case VI_ATTR_SUPPRESS_END_EN:
+            *static_cast<ViBoolean*>(value) = VI_FALSE;
+            return VI_SUCCESS;
+        case VI_ATTR_ASRL_BAUD:
+            *static_cast<ViUInt32*>(value) = s->baud;
+            return VI_SUCCESS;
+        case VI_ATTR_ASRL_DATA_BITS:
+            *static_cast<ViUInt16*>(value) = s->dataBits;
+            return VI_SUCCESS;
+        case VI_ATTR_ASRL_PARITY:
+            *static_cast<ViUInt16*>(value) = s->parity;
+            return VI_SUCCESS;
+        case VI_ATTR_ASRL_STOP_BITS:
+            *static_cast<ViUInt16*>(value) = s->stopBits;
+            return VI_SUCCESS;
+        case VI_ATTR_ASRL_FLOW_CNTRL:
+            *static_cast<ViUInt16*>(value) = s->flowCntrl;
+            return VI_SUCCESS;
+        case VI_ATTR_INTF_TYPE:
+            *static_cast<ViUInt16*>(value) = VI_INTF_ASRL;
+            return VI_SUCCESS;
+        case VI_ATTR_INTF_INST_NAME:
+            strcpy(static_cast<char*>(value), s->path);
+            return VI_SUCCESS;
+        case VI_ATTR_RSRC_CLASS:
+            strcpy(static_cast<char*>(value), "INSTR");
+            return VI_SUCCESS;
+        case VI_ATTR_ASRL_AVAIL_NUM:
+        {
+            int pending = 0;
+            if (ioctl(s->fd, FIONREAD, &pending) < 0)
+            {
+                return termiosErrno(s, errno);
+            }
+            *static_cast<ViUInt32*>(value) = static_cast<ViUInt32>(s->tail - s->head) + static_cast<ViUInt32>(pending);
+            return VI_SUCCESS;
+        }
+        default:
+            return VI_ERROR_NSUP_ATTR;
+    }
+}
+
+static ViStatus termiosClear(ViSession vi)
+{
+    termiosSession_t* s = termiosGet(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    s->head = s->tail = 0;
+    if (tcflush(s->fd, TCIOFLUSH) < 0)
+    {
+        return termiosErrno(s, errno);
+    }
+    return VI_SUCCESS;
+}
+
+static ViStatus termiosFlush(ViSession vi, ViUInt16 mask)
+{
+    termiosSession_t* s = termiosGet(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    if (mask & (VI_READ_BUF | VI_READ_BUF_DISCARD | VI_IO_IN_BUF | VI_IO_IN_BUF_DISCARD))
+    {
+        s->head = s->tail = 0;
+        if ( (mask & (VI_IO_IN_BUF | VI_IO_IN_BUF_DISCARD)) && tcflush(s->fd, TCIFLUSH) < 0 )
+        {
+            return termiosErrno(s, errno);
+        }
+    }
+    if ( (mask & (VI_WRITE_BUF | VI_IO_OUT_BUF)) && tcdrain(s->fd) < 0 )
+    {
+        return termiosErrno(s, errno);
+    }
+    if ( (mask & (VI_WRITE_BUF_DISCARD | VI_IO_OUT_BUF_DISCARD)) && tcflush(s->fd, TCOFLUSH) < 0 )
+    {
+        return termiosErrno(s, errno);
+    }
+    return VI_SUCCESS;
+}
+
+/// only the input buffer is ours, output goes straight to the tty driver
+static ViStatus termiosSetBuf(ViSession vi, ViUInt16 mask, ViUInt32 size)
+{
+    termiosSession_t* s = termiosGet(vi);
+    if (s == NULL)
+    {
+        return VI_ERROR_INV_OBJECT;
+    }
+    if ( (mask & (VI_READ_BUF | VI_IO_IN_BUF)) && size > 0 && size > s->tail - s->head )
+    {
+        char* buf = static_cast<char*>(malloc(size));
+        if (buf == NULL)
+        {
+            return VI_ERROR_ALLOC;
+        }
+        memcpy(buf, s->buf + s->head, s->tail - s->head);
+        s->tail -= s->head;
+        s->head = 0;
+        free(s->buf);
+        s->buf = buf;
+        s->bufSize = size;
+    }
+    return VI_SUCCESS;
+}
+
+static ViStatus termiosReadSTB(ViSession, ViUInt16 *)
+{
+    return VI_ERROR_NSUP_OPER;
+}
+
+static ViStatus termiosStatusDesc(ViSession vi, ViStatus status, ViChar *desc)
+{
+    static const struct { ViStatus status; const char* text; } descs[] = {
+        { VI_SUCCESS, "Operation completed successfully" },
+        { VI_SUCCESS_TERM_CHAR, "The specified termination character was read" },
+        { VI_SUCCESS_MAX_CNT, "The number of bytes read is equal to the input count" },
+        { VI_ERROR_TMO, "Timeout expired before operation completed" },
+        { VI_ERROR_CONN_LOST, "The serial device has gone away" },
+        { VI_ERROR_INV_OBJECT, "The given session reference is invalid" },
+        { VI_ERROR_RSRC_NFOUND, "No serial device of this name" },
+        { VI_ERROR_RSRC_LOCKED, "The serial device is in use" },
+        { VI_ERROR_ALLOC, "Insufficient system resources" },
+        { VI_ERROR_NSUP_ATTR, "The attribute is not supported by the native serial backend" },
+        { VI_ERROR_NSUP_ATTR_STATE, "The attribute value is not supported by the native serial backend" },
+        { VI_ERROR_ATTR_READONLY, "The attribute is read-only" },
+        { VI_ERROR_NSUP_OPER, "The operation is not supported by the native serial backend" },
+    };
+    termiosSession_t* s = termiosGet(vi);
+    if (status == VI_ERROR_SYSTEM_ERROR || (status == VI_ERROR_CONN_LOST && s != NULL && s->lastErrno != 0))
+    {
+        snprintf(desc, 256, "Serial device error: %s", strerror(s != NULL && s->lastErrno != 0 ? s->lastErrno : errno));
+        return VI_SUCCESS;
+    }
+    for (size_t i = 0; i < sizeof(descs) / sizeof(descs[0]); ++i)
+    {
+        if (descs[i].status == status)
+        {
+            snprintf(desc, 256, "%s", descs[i].text);
+            return VI_SUCCESS;
+        }
+    }
+    snprintf(desc, 256, "Unknown status 0x%08X", static_cast<unsigned>(status));
+    return VI_WARN_UNKNOWN_STATUS;
+}
+
+static const visaBackend_t termiosBackend = {
+    "native termios",
+    termiosMatch,
+    termiosOpen,
+    termiosClose,
+    termiosRead,
+    termiosWrite,
+    termiosSetAttribute,
+    termiosGetAttribute,
+    termiosClear,
+    termiosFlush,
+    termiosSetBuf,
+    termiosReadSTB,
+    termiosStatusDesc,
+    NULL,               // no events, a read already polls the tty
+    NULL,
+    NULL,
+    NULL,
+    NULL,               // or asynchronous I/O
+    NULL,
+    NULL
+};
+
+const visaBackend_t *visaTermiosBackend = &termiosBackend;
+
+#else
+
+const visaBackend_t *visaTermiosBackend = NULL;
+
+#endif /* _WIN32 */
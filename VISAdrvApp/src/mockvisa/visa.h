@@ -0,0 +1,185 @@
+/// @file visa.h the part of the VISA API used by drvAsynVISAPort, for building with VISA_MOCK=YES where no
+/// VISA library is installed. Names and values are those of the IVI VISA specification, the functions are in
+/// drvAsynVISAMockLib.cpp and only reach simulated instruments.
+
+#ifndef DRVASYNVISA_MOCK_VISA_H
+#define DRVASYNVISA_MOCK_VISA_H
+
+#define VISA_MOCK_LIBRARY 1
+
+#if defined(_WIN32)
+#define _VI_FUNC __stdcall
+#else
+#define _VI_FUNC
+#endif
+
+typedef unsigned int   ViUInt32;
+typedef int            ViInt32;
+typedef unsigned short ViUInt16;
+typedef short          ViInt16;
+typedef unsigned char  ViUInt8;
+typedef char           ViChar;
+typedef ViUInt16       ViBoolean;
+typedef ViInt32        ViStatus;
+typedef ViUInt32       ViObject;
+typedef ViObject       ViSession;
+typedef ViUInt32       ViAttr;
+#if defined(_WIN64) || defined(__LP64__) || defined(_LP64)
+typedef unsigned long long ViAttrState;
+#else
+typedef ViUInt32       ViAttrState;
+#endif
+typedef ViUInt32       ViEventType;
+typedef ViObject       ViEvent;
+typedef ViUInt32       ViJobId;
+typedef ViObject       ViFindList;
+typedef ViUInt32       ViAccessMode;
+typedef ViUInt8*       ViBuf;
+typedef const ViUInt8* ViConstBuf;
+typedef ViChar*        ViRsrc;
+typedef const ViChar*  ViConstRsrc;
+typedef const ViChar*  ViConstString;
+
+#define VI_NULL                     0
+#define VI_TRUE                     1
+#define VI_FALSE                    0
+
+#define VI_SUCCESS                  0
+#define VI_SUCCESS_EVENT_EN         0x3FFF0002L
+#define VI_SUCCESS_EVENT_DIS        0x3FFF0003L
+#define VI_SUCCESS_TERM_CHAR        0x3FFF0005L
+#define VI_SUCCESS_MAX_CNT          0x3FFF0006L
+#define VI_WARN_UNKNOWN_STATUS      0x3FFF0085L
+
+#define VI_ERROR_SYSTEM_ERROR       ((ViStatus)0xBFFF0000UL)
+#define VI_ERROR_INV_OBJECT         ((ViStatus)0xBFFF000EUL)
+#define VI_ERROR_RSRC_LOCKED        ((ViStatus)0xBFFF000FUL)
+#define VI_ERROR_RSRC_NFOUND        ((ViStatus)0xBFFF0011UL)
+#define VI_ERROR_TMO                ((ViStatus)0xBFFF0015UL)
+#define VI_ERROR_NSUP_ATTR          ((ViStatus)0xBFFF001DUL)
+#define VI_ERROR_NSUP_ATTR_STATE    ((ViStatus)0xBFFF001EUL)
+#define VI_ERROR_ATTR_READONLY      ((ViStatus)0xBFFF001FUL)
+#define VI_ERROR_INV_EVENT          ((ViStatus)0xBFFF0026UL)
+#define VI_ERROR_NENABLED           ((ViStatus)0xBFFF002FUL)
+#define VI_ERROR_ABORT              ((ViStatus)0xBFFF0030UL)
+#define VI_ERROR_INP_PROT_VIOL      ((ViStatus)0xBFFF0036UL)
+#define VI_ERROR_ALLOC              ((ViStatus)0xBFFF003CUL)
+#define VI_ERROR_IO                 ((ViStatus)0xBFFF003EUL)
+#define VI_ERROR_NSUP_OPER          ((ViStatus)0xBFFF0067UL)
+#define VI_ERROR_INV_JOB_ID         ((ViStatus)0xBFFF0078UL)
+#define VI_ERROR_CONN_LOST          ((ViStatus)0xBFFF00A6UL)
+
+#define VI_TMO_IMMEDIATE            0L
+#define VI_TMO_INFINITE             0xFFFFFFFFUL
+#define VI_FIND_BUFLEN              256
+#define VI_NO_SEC_ADDR              0xFFFF
+#define VI_TRIG_PROT_DEFAULT        0
+
+#define VI_INTF_GPIB                1
+#define VI_INTF_ASRL                4
+#define VI_INTF_TCPIP               6
+#define VI_INTF_USB                 7
+
+#define VI_ATTR_RSRC_CLASS          0xBFFF0001UL
+#define VI_ATTR_RSRC_NAME           0xBFFF0002UL
+#define VI_ATTR_SEND_END_EN         0x3FFF0016UL
+#define VI_ATTR_TERMCHAR            0x3FFF0018UL
+#define VI_ATTR_TMO_VALUE           0x3FFF001AUL
+#define VI_ATTR_ASRL_BAUD           0x3FFF0021UL
+#define VI_ATTR_ASRL_DATA_BITS      0x3FFF0022UL
+#define VI_ATTR_ASRL_PARITY         0x3FFF0023UL
+#define VI_ATTR_ASRL_STOP_BITS      0x3FFF0024UL
+#define VI_ATTR_ASRL_FLOW_CNTRL     0x3FFF0025UL
+#define VI_ATTR_RD_BUF_SIZE         0x3FFF002BUL
+#define VI_ATTR_WR_BUF_SIZE         0x3FFF002EUL
+#define VI_ATTR_SUPPRESS_END_EN     0x3FFF0036UL
+#define VI_ATTR_TERMCHAR_EN         0x3FFF0038UL
+#define VI_ATTR_ASRL_AVAIL_NUM      0x3FFF00ACUL
+#define VI_ATTR_ASRL_END_IN         0x3FFF00B3UL
+#define VI_ATTR_ASRL_END_OUT        0x3FFF00B4UL
+#define VI_ATTR_INTF_INST_NAME      0xBFFF00E9UL
+#define VI_ATTR_INTF_TYPE           0x3FFF0171UL
+#define VI_ATTR_GPIB_PRIMARY_ADDR   0x3FFF0172UL
+#define VI_ATTR_GPIB_SECONDARY_ADDR 0x3FFF0173UL
+#define VI_ATTR_INTF_NUM            0x3FFF0176UL
+#define VI_ATTR_GPIB_UNADDR_EN      0x3FFF0184UL
+#define VI_ATTR_TCPIP_NODELAY       0x3FFF019AUL
+#define VI_ATTR_TCPIP_KEEPALIVE     0x3FFF019BUL
+#define VI_ATTR_GPIB_READDR_EN      0x3FFF019BUL
+#define VI_ATTR_USB_MAX_INTR_SIZE   0x3FFF01AFUL
+#define VI_ATTR_TCPIP_IS_HISLIP     0x3FFF0300UL
+
+#define VI_ATTR_JOB_ID              0x3FFF4006UL
+#define VI_ATTR_EVENT_TYPE          0x3FFF4010UL
+#define VI_ATTR_STATUS              0x3FFF4025UL
+#define VI_ATTR_RET_COUNT_32        0x3FFF4026UL
+#define VI_ATTR_RET_COUNT           VI_ATTR_RET_COUNT_32
+
+#define VI_EVENT_IO_COMPLETION      0x3FFF2009UL
+#define VI_EVENT_SERVICE_REQ        0x3FFF200BUL
+#define VI_EVENT_ASRL_CHAR          0x3FFF2035UL
+#define VI_QUEUE                    1
+
+#define VI_ASRL_PAR_NONE            0
+#define VI_ASRL_PAR_ODD             1
+#define VI_ASRL_PAR_EVEN            2
+#define VI_ASRL_PAR_MARK            3
+#define VI_ASRL_PAR_SPACE           4
+#define VI_ASRL_STOP_ONE            10
+#define VI_ASRL_STOP_ONE5           15
+#define VI_ASRL_STOP_TWO            20
+#define VI_ASRL_FLOW_NONE           0
+#define VI_ASRL_FLOW_XON_XOFF       1
+#define VI_ASRL_FLOW_RTS_CTS        2
+#define VI_ASRL_FLOW_DTR_DSR        4
+#define VI_ASRL_END_NONE            0
+#define VI_ASRL_END_TERMCHAR        2
+
+#define VI_READ_BUF                 1
+#define VI_WRITE_BUF                2
+#define VI_READ_BUF_DISCARD         4
+#define VI_WRITE_BUF_DISCARD        8
+#define VI_IO_IN_BUF                16
+#define VI_IO_OUT_BUF               32
+#define VI_IO_IN_BUF_DISCARD        64
+#define VI_IO_OUT_BUF_DISCARD       128
+
+#define VI_GPIB_REN_DEASSERT        0
+#define VI_GPIB_REN_ASSERT_ADDRESS  3
+#define VI_GPIB_REN_ADDRESS_GTL     6
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+ViStatus _VI_FUNC viOpenDefaultRM(ViSession *vi);
+ViStatus _VI_FUNC viOpen(ViSession sesn, ViConstRsrc name, ViAccessMode mode, ViUInt32 timeout, ViSession *vi);
+ViStatus _VI_FUNC viClose(ViObject vi);
+ViStatus _VI_FUNC viFindRsrc(ViSession sesn, ViConstString expr, ViFindList *findList, ViUInt32 *retCount, ViChar *desc);
+ViStatus _VI_FUNC viFindNext(ViFindList findList, ViChar *desc);
+ViStatus _VI_FUNC viSetAttribute(ViObject vi, ViAttr attrName, ViAttrState attrValue);
+ViStatus _VI_FUNC viGetAttribute(ViObject vi, ViAttr attrName, void *attrValue);
+ViStatus _VI_FUNC viStatusDesc(ViObject vi, ViStatus status, ViChar *desc);
+ViStatus _VI_FUNC viTerminate(ViObject vi, ViUInt16 degree, ViJobId jobId);
+ViStatus _VI_FUNC viEnableEvent(ViSession vi, ViEventType eventType, ViUInt16 mechanism, ViUInt32 context);
+ViStatus _VI_FUNC viDisableEvent(ViSession vi, ViEventType eventType, ViUInt16 mechanism);
+ViStatus _VI_FUNC viDiscardEvents(ViSession vi, ViEventType eventType, ViUInt16 mechanism);
+ViStatus _VI_FUNC viWaitOnEvent(ViSession vi, ViEventType inEventType, ViUInt32 timeout, ViEventType *outEventType, ViEvent *outContext);
+ViStatus _VI_FUNC viRead(ViSession vi, ViBuf buf, ViUInt32 count, ViUInt32 *retCount);
+ViStatus _VI_FUNC viReadAsync(ViSession vi, ViBuf buf, ViUInt32 count, ViJobId *jobId);
+ViStatus _VI_FUNC viWrite(ViSession vi, ViConstBuf buf, ViUInt32 count, ViUInt32 *retCount);
+ViStatus _VI_FUNC viWriteAsync(ViSession vi, ViConstBuf buf, ViUInt32 count, ViJobId *jobId);
+ViStatus _VI_FUNC viSetBuf(ViSession vi, ViUInt16 mask, ViUInt32 size);
+ViStatus _VI_FUNC viFlush(ViSession vi, ViUInt16 mask);
+ViStatus _VI_FUNC viClear(ViSession vi);
+ViStatus _VI_FUNC viReadSTB(ViSession vi, ViUInt16 *status);
+ViStatus _VI_FUNC viAssertTrigger(ViSession vi, ViUInt16 protocol);
+ViStatus _VI_FUNC viGpibControlREN(ViSession vi, ViUInt16 mode);
+ViStatus _VI_FUNC viGpibCommand(ViSession vi, ViConstBuf cmd, ViUInt32 cnt, ViUInt32 *retCnt);
+ViStatus _VI_FUNC viGpibSendIFC(ViSession vi);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* DRVASYNVISA_MOCK_VISA_H */
@@ -0,0 +1,547 @@
+/// @file drvAsynVISAMockTest.cpp drvAsynVISAPort transactions with simulated instruments
+
+#include <string.h>
+#include <stdio.h>
+
+#include <epicsUnitTest.h>
+#include <testMain.h>
+#include <dbUnitTest.h>
+#include <iocsh.h>
+#include <epicsTime.h>
+#include <epicsThread.h>
+
+#include "asynDriver.h"
+#include "asynOctetSyncIO.h"
+#include "asynInt64SyncIO.h"
+#include "asynFloat64ArraySyncIO.h"
+
+#include "drvAsynVISAPort.h"
+
+extern "C" int drvAsynVISAMockTest_registerRecordDeviceDriver(struct dbBase *pdbbase);
+
+/// connect to a port and set its terminators, which are the same both ways
+static asynUser* connectPort(const char *portName, const char *eos)
+{
+    asynUser *pasynUser = NULL;
+    if (pasynOctetSyncIO->connect(portName, 0, &pasynUser, NULL) != asynSuccess)
+    {
+        testAbort("cannot connect to port %s", portName);
+    }
+    pasynOctetSyncIO->setOutputEos(pasynUser, eos, static_cast<int>(strlen(eos)));
+    pasynOctetSyncIO->setInputEos(pasynUser, eos, static_cast<int>(strlen(eos)));
+    return pasynUser;
+}
+
+/// write a query and read its reply, returning the asyn status
+static asynStatus query(asynUser *pasynUser, const char *command, char *reply, size_t maxchars, double timeout,
+                        int *eomReason, double *elapsed)
+{
+    size_t nout = 0, nin = 0;
+    epicsTimeStamp start, end;
+    *reply = '\0';
+    *eomReason = 0;
+    epicsTimeGetCurrent(&start);
+    asynStatus status = pasynOctetSyncIO->writeRead(pasynUser, command, strlen(command), reply, maxchars,
+                                                    timeout, &nout, &nin, eomReason);
+    epicsTimeGetCurrent(&end);
+    *elapsed = epicsTimeDiffInSeconds(&end, &start);
+    reply[nin < maxchars ? nin : maxchars - 1] = '\0';
+    return status;
+}
+
+/// read a statistics counter of a port
+static epicsInt64 counter(const char *portName, const char *name)
+{
+    asynUser *pasynUser = NULL;
+    epicsInt64 value = -1;
+    if (pasynInt64SyncIO->connect(portName, 0, &pasynUser, name) == asynSuccess)
+    {
+        pasynInt64SyncIO->read(pasynUser, &value, 1.0);
+        pasynInt64SyncIO->disconnect(pasynUser);
+    }
+    return value;
+}
+
+/// read the binary block returned by a query through the BLOCK parameter of a port
+static asynStatus readBlock(const char *portName, const char *query, epicsFloat64 *values, size_t nelements,
+                            size_t *nIn, char *errorMessage, size_t errorSize)
+{
+    asynUser *pasynUser = NULL;
+    char drvInfo[64];
+    *nIn = 0;
+    epicsSnprintf(drvInfo, sizeof(drvInfo), "BLOCK %s", query);
+    if (pasynFloat64ArraySyncIO->connect(portName, 0, &pasynUser, drvInfo) != asynSuccess)
+    {
+        testAbort("cannot connect to %s of port %s", drvInfo, portName);
+    }
+    asynStatus status = pasynFloat64ArraySyncIO->read(pasynUser, values, nelements, nIn, 1.0);
+    epicsSnprintf(errorMessage, errorSize, "%s", pasynUser->errorMessage);
+    pasynFloat64ArraySyncIO->disconnect(pasynUser);
+    return status;
+}
+
+/// a GPIB instrument ends its reply with END and no terminator
+static void testGpibEnd()
+{
+    char reply[256];
+    int eomReason;
+    double elapsed;
+    testDiag("GPIB reply ended by END");
+    iocshCmd("drvAsynVISAMockInstrument(\"GPIB0::5::INSTR\", \"GPIB\", \"latency=2 write=0.5\")");
+    iocshCmd("drvAsynVISAMockReply(\"GPIB0::5::INSTR\", \"*IDN?\", \"MOCK,DMM,0,1.0\")");
+    drvAsynVISAPortConfigure("gpib5", "GPIB0::5::INSTR", 0, 0, 0, 0, NULL, 1, 0);
+    asynUser *pasynUser = connectPort("gpib5", "");
+    testOk(query(pasynUser, "*IDN?", reply, sizeof(reply), 1.0, &eomReason, &elapsed) == asynSuccess,
+           "query succeeds");
+    testOk(strcmp(reply, "MOCK,DMM,0,1.0") == 0, "reply is \"%s\"", reply);
+    testOk((eomReason & ASYN_EOM_END) != 0, "END ends the reply (eomReason 0x%x)", eomReason);
+    testOk(elapsed >= 0.002, "reply takes at least the write time and latency (%.4f s)", elapsed);
+    pasynOctetSyncIO->disconnect(pasynUser);
+}
+
+/// a port is multi-device only for a whole GPIB board, not a device on it
+static void testGpibMultiDevice()
+{
+    int multiDevice = -1;
+    testDiag("multi-device GPIB port");
+    asynUser *pasynUser = pasynManager->createAsynUser(0, 0);
+    iocshCmd("drvAsynVISAMockInstrument(\"GPIB0::3::INSTR\", \"GPIB\", \"\")");
+    drvAsynVISAPortConfigure("gpib3", "GPIB0::3::INSTR", 0, 1, 0, 0, NULL, 0, 0);
+    testOk(pasynManager->isMultiDevice(pasynUser, "gpib3", &multiDevice) == asynSuccess && multiDevice == 0,
+           "GPIB0::3::INSTR is a single device port");
+    drvAsynVISAPortConfigure("gpib0", "GPIB0::INTFC", 0, 1, 0, 0, NULL, 0, 0);
+    testOk(pasynManager->isMultiDevice(pasynUser, "gpib0", &multiDevice) == asynSuccess && multiDevice == 1,
+           "GPIB0::INTFC is a multi-device port");
+    pasynManager->freeAsynUser(pasynUser);
+}
+
+/// a serial instrument ends its reply with the input terminator, which the driver removes
+static void testSerialTermChar()
+{
+    char reply[256];
+    int eomReason;
+    double elapsed;
+    testDiag("serial reply ended by a termination character");
+    iocshCmd("drvAsynVISAMockInstrument(\"ASRL1::INSTR\", \"ASRL\", \"byte=0.087\")");
+    iocshCmd("drvAsynVISAMockReply(\"ASRL1::INSTR\", \"MEAS?\", \"+1.234E-03\")");
+    drvAsynVISAPortConfigure("serial1", "ASRL1::INSTR", 0, 0, 0, 0, NULL, 0, 0);
+    asynUser *pasynUser = connectPort("serial1", "\n");
+    testOk(query(pasynUser, "MEAS?", reply, sizeof(reply), 1.0, &eomReason, &elapsed) == asynSuccess,
+           "query succeeds");
+    testOk(strcmp(reply, "+1.234E-03") == 0, "reply is \"%s\"", reply);
+    testOk((eomReason & ASYN_EOM_EOS) != 0, "terminator ends the reply (eomReason 0x%x)", eomReason);
+    pasynOctetSyncIO->disconnect(pasynUser);
+}
+
+/// a long reply trickling in a byte at a time is read whole in one call with either read strategy, and takes
+/// as long as its bytes. One longer than the caller's buffer ends on the count.
+static void testTrickle()
+{
+    asynStatus status;
+    char reply[1024];
+    int eomReason;
+    double elapsed;
+    testDiag("reply arriving a byte at a time");
+    iocshCmd("drvAsynVISAMockInstrument(\"SLOW\", \"ASRL\", \"byte=0.25\")");
+    iocshCmd("drvAsynVISAMockReply(\"SLOW\", \"DATA?\", \"{values:40}\")");
+    drvAsynVISAPortConfigure("slow", "MOCK::SLOW", 0, 0, 0, 0, NULL, 0, 0);
+    asynUser *pasynUser = connectPort("slow", "\n");
+    testOk(query(pasynUser, "DATA?", reply, sizeof(reply), 1.0, &eomReason, &elapsed) == asynSuccess,
+           "query succeeds");
+    testOk(strlen(reply) == 40 * 12 + 39 && eomReason == ASYN_EOM_EOS,
+           "whole reply read in one call (%u characters, eomReason 0x%x)", (unsigned)strlen(reply), eomReason);
+    testOk(elapsed >= 0.1, "reply takes a byte time per byte (%.3f s)", elapsed);
+    iocshCmd("asynSetOption(\"slow\", 0, \"readstrategy\", \"avail\")");
+    status = query(pasynUser, "DATA?", reply, sizeof(reply), 1.0, &eomReason, &elapsed);
+    testOk(status == asynSuccess && strlen(reply) == 40 * 12 + 39 && eomReason == ASYN_EOM_EOS,
+           "and with readstrategy avail (%u characters, eomReason 0x%x)", (unsigned)strlen(reply), eomReason);
+    status = query(pasynUser, "DATA?", reply, 100, 1.0, &eomReason, &elapsed);
+    testOk(status == asynSuccess && eomReason == ASYN_EOM_CNT, "reply longer than the buffer ends on the count "
+           "(eomReason 0x%x)", eomReason);
+    pasynOctetSyncIO->disconnect(pasynUser);
+}
+
+/// no reply within the timeout, then an I/O error that outlasts the retries, are reported to the caller
+static void testErrors()
+{
+    char reply[256];
+    int eomReason;
+    double elapsed;
+    testDiag("timeout and I/O error");
+    iocshCmd("drvAsynVISAMockInstrument(\"LATE\", \"TCPIP\", \"latency=500\")");
+    iocshCmd("drvAsynVISAMockReply(\"LATE\", \"*IDN?\", \"MOCK,LATE,0,1.0\")");
+    drvAsynVISAPortConfigure("late", "MOCK::LATE", 0, 0, 0, 0, NULL, 0, 0);
+    asynUser *pasynUser = connectPort("late", "");
+    testOk(query(pasynUser, "*IDN?", reply, sizeof(reply), 0.1, &eomReason, &elapsed) == asynTimeout,
+           "late reply times out");
+    testOk(elapsed < 0.4, "timeout is kept (%.3f s)", elapsed);
+    testOk(pasynOctetSyncIO->flush(pasynUser) == asynSuccess, "flush after a timeout succeeds");
+    iocshCmd("drvAsynVISAMockInstrument(\"LATE\", \"\", \"latency=0 errors=3\")");
+    testOk(query(pasynUser, "*IDN?", reply, sizeof(reply), 1.0, &eomReason, &elapsed) == asynError,
+           "I/O error is reported");
+    pasynOctetSyncIO->disconnect(pasynUser);
+}
+
+/// the rest of a reply read only in part is discarded by a flush, and by the zero timeout read of a port with a
+/// negative readIntTmoMs, so the next query gets its own reply
+static void testStaleInput()
+{
+    asynStatus status;
+    char reply[256];
+    size_t nin = 0;
+    int eomReason;
+    double elapsed;
+    testDiag("stale partial reply discarded");
+    iocshCmd("drvAsynVISAMockInstrument(\"STALE\", \"TCPIP\", \"\")");
+    iocshCmd("drvAsynVISAMockReply(\"STALE\", \"*IDN?\", \"MOCK,STALE,0,1.0\")");
+    drvAsynVISAPortConfigure("stale", "MOCK::STALE", 0, 0, 0, 0, NULL, 0, 0);
+    drvAsynVISAPortConfigure("stalezero", "MOCK::STALE", 0, 0, 0, -1, NULL, 0, 0);
+    asynUser *pasynUser = connectPort("stale", "");
+    status = query(pasynUser, "*IDN?", reply, 5, 1.0, &eomReason, &elapsed);
+    testOk(status == asynSuccess && eomReason == ASYN_EOM_CNT, "partial read leaves the rest (\"%s\")", reply);
+    testOk(pasynOctetSyncIO->flush(pasynUser) == asynSuccess, "flush succeeds");
+    status = query(pasynUser, "*IDN?", reply, sizeof(reply), 1.0, &eomReason, &elapsed);
+    testOk(status == asynSuccess && strcmp(reply, "MOCK,STALE,0,1.0") == 0, "next reply after a flush is \"%s\"",
+           reply);
+    testOk(counter("stale", "DISCARD_BYTES") == 11, "flush discarded the rest (%lld bytes)",
+           (long long)counter("stale", "DISCARD_BYTES"));
+    pasynOctetSyncIO->disconnect(pasynUser);
+    pasynUser = connectPort("stalezero", "");
+    status = query(pasynUser, "*IDN?", reply, 5, 1.0, &eomReason, &elapsed);
+    testOk(status == asynSuccess && eomReason == ASYN_EOM_CNT, "partial read leaves the rest (\"%s\")", reply);
+    status = pasynOctetSyncIO->read(pasynUser, reply, sizeof(reply), 0.0, &nin, &eomReason);
+    testOk(status == asynTimeout && nin == 0, "zero timeout read returns nothing (%lu bytes)", (unsigned long)nin);
+    status = query(pasynUser, "*IDN?", reply, sizeof(reply), 1.0, &eomReason, &elapsed);
+    testOk(status == asynSuccess && strcmp(reply, "MOCK,STALE,0,1.0") == 0,
+           "next reply after a zero timeout read is \"%s\"", reply);
+    testOk(counter("stalezero", "DISCARD_BYTES") == 11, "zero timeout read discarded the rest (%lld bytes)",
+           (long long)counter("stalezero", "DISCARD_BYTES"));
+    pasynOctetSyncIO->disconnect(pasynUser);
+}
+
+/// query a cacheable command after changing the instrument's reply to it, returning the reply the port gives
+static const char* cachedQuery(asynUser *pasynUser, const char *newReply, char *reply, size_t maxchars)
+{
+    char cmd[128];
+    int eomReason;
+    double elapsed;
+    epicsSnprintf(cmd, sizeof(cmd), "drvAsynVISAMockReply(\"CACHE\", \"*IDN?\", \"%s\")", newReply);
+    iocshCmd(cmd);
+    if (query(pasynUser, "*IDN?", reply, maxchars, 1.0, &eomReason, &elapsed) != asynSuccess)
+    {
+        epicsSnprintf(reply, maxchars, "(query failed)");
+    }
+    return reply;
+}
+
+/// a cached reply is returned within its time to live, and the device asked again after it, after a write
+/// that does not match a cache prefix and after drvAsynVISACacheClear
+static void testCache()
+{
+    char reply[256];
+    size_t nout = 0;
+    testDiag("response cache");
+    iocshCmd("drvAsynVISAMockInstrument(\"CACHE\", \"TCPIP\", \"\")");
+    drvAsynVISAPortConfigure("cache", "MOCK::CACHE", 0, 0, 0, 0, NULL, 1, 0);
+    iocshCmd("asynSetOption(\"cache\", 0, \"cacheprefix\", \"*IDN?|*OPT?\")");
+    iocshCmd("asynSetOption(\"cache\", 0, \"cachettl\", \"300\")");
+    asynUser *pasynUser = connectPort("cache", "");
+    testOk(strcmp(cachedQuery(pasynUser, "MOCK,A", reply, sizeof(reply)), "MOCK,A") == 0,
+           "first query asks the device (\"%s\")", reply);
+    testOk(strcmp(cachedQuery(pasynUser, "MOCK,B", reply, sizeof(reply)), "MOCK,A") == 0,
+           "query within the time to live is cached (\"%s\")", reply);
+    epicsThreadSleep(0.4);
+    testOk(strcmp(cachedQuery(pasynUser, "MOCK,B", reply, sizeof(reply)), "MOCK,B") == 0,
+           "query after the time to live asks the device (\"%s\")", reply);
+    testOk(strcmp(cachedQuery(pasynUser, "MOCK,C", reply, sizeof(reply)), "MOCK,B") == 0,
+           "new reply is cached (\"%s\")", reply);
+    pasynOctetSyncIO->write(pasynUser, "*RST", 4, 1.0, &nout);
+    testOk(strcmp(cachedQuery(pasynUser, "MOCK,C", reply, sizeof(reply)), "MOCK,C") == 0,
+           "query after another write asks the device (\"%s\")", reply);
+    drvAsynVISACacheClear("cache");
+    testOk(strcmp(cachedQuery(pasynUser, "MOCK,D", reply, sizeof(reply)), "MOCK,D") == 0,
+           "query after drvAsynVISACacheClear asks the device (\"%s\")", reply);
+    testOk(counter("cache", "CACHE_HITS") == 2 && counter("cache", "CACHE_MISSES") == 4,
+           "hits and misses counted (%lld and %lld)", (long long)counter("cache", "CACHE_HITS"),
+           (long long)counter("cache", "CACHE_MISSES"));
+    pasynOctetSyncIO->disconnect(pasynUser);
+}
+
+/// ask the driver to open the session of a port again, as asynManager does when it autoconnects
+static asynStatus reconnect(asynUser *pasynUser, char *errorMessage, size_t errorSize)
+{
+    asynInterface *pcommon = pasynManager->findInterface(pasynUser, asynCommonType, 1);
+    asynCommon *common = static_cast<asynCommon*>(pcommon->pinterface);
+    pasynManager->lockPort(pasynUser);
+    asynStatus status = common->connect(pcommon->drvPvt, pasynUser);
+    epicsSnprintf(errorMessage, errorSize, "%s", pasynUser->errorMessage);
+    pasynManager->unlockPort(pasynUser);
+    return status;
+}
+
+/// an I/O error is first retried, then cleared with viClear, and only then is the session closed and reopened,
+/// waiting longer after each failed open
+static void testRecover()
+{
+    asynStatus status;
+    char reply[256], errorMessage[256];
+    int eomReason;
+    double elapsed;
+    testDiag("error recovery");
+    iocshCmd("drvAsynVISAMockInstrument(\"FLAKY\", \"TCPIP\", \"\")");
+    iocshCmd("drvAsynVISAMockReply(\"FLAKY\", \"*IDN?\", \"MOCK,FLAKY,0,1.0\")");
+    drvAsynVISAPortConfigure("flaky", "MOCK::FLAKY", 0, 0, 0, 0, NULL, 1, 0);
+    asynUser *pasynUser = connectPort("flaky", "");
+    iocshCmd("drvAsynVISAMockInstrument(\"FLAKY\", \"\", \"errors=1\")");
+    status = query(pasynUser, "*IDN?", reply, sizeof(reply), 1.0, &eomReason, &elapsed);
+    testOk(status == asynSuccess && strcmp(reply, "MOCK,FLAKY,0,1.0") == 0, "one error is fixed by a retry");
+    testOk(counter("flaky", "RECOVER_RETRIES") == 1 && counter("flaky", "RECOVER_CLEARS") == 0,
+           "retry counted (%lld retries, %lld clears)", (long long)counter("flaky", "RECOVER_RETRIES"),
+           (long long)counter("flaky", "RECOVER_CLEARS"));
+    iocshCmd("drvAsynVISAMockInstrument(\"FLAKY\", \"\", \"errors=2\")");
+    status = query(pasynUser, "*IDN?", reply, sizeof(reply), 1.0, &eomReason, &elapsed);
+    testOk(status == asynError, "error that the retry does not fix is reported");
+    status = query(pasynUser, "*IDN?", reply, sizeof(reply), 1.0, &eomReason, &elapsed);
+    testOk(status == asynSuccess && strcmp(reply, "MOCK,FLAKY,0,1.0") == 0, "session kept after viClear");
+    testOk(counter("flaky", "RECOVER_RETRIES") == 2 && counter("flaky", "RECOVER_CLEARS") == 1 &&
+           counter("flaky", "RECOVER_REOPENS") == 0, "retry and clear counted (%lld retries, %lld clears)",
+           (long long)counter("flaky", "RECOVER_RETRIES"), (long long)counter("flaky", "RECOVER_CLEARS"));
+    // with no viClear the session is closed, and the instrument is off when it is reopened. Only this test
+    // reopens it, so asynManager autoconnecting does not use up the attempts
+    pasynManager->autoConnect(pasynUser, 0);
+    iocshCmd("asynSetOption(\"flaky\", 0, \"recoverclear\", \"N\")");
+    iocshCmd("drvAsynVISAMockInstrument(\"FLAKY\", \"\", \"errors=2 offline=Y\")");
+    status = query(pasynUser, "*IDN?", reply, sizeof(reply), 1.0, &eomReason, &elapsed);
+    testOk(status == asynError, "error with recoverclear N is reported");
+    status = reconnect(pasynUser, errorMessage, sizeof(errorMessage));
+    testOk(status == asynError, "reopen of an offline instrument fails (%s)", errorMessage);
+    iocshCmd("drvAsynVISAMockInstrument(\"FLAKY\", \"\", \"offline=N\")");
+    status = reconnect(pasynUser, errorMessage, sizeof(errorMessage));
+    testOk(status == asynError && strstr(errorMessage, "deferred") != NULL, "next reopen waits (%s)",
+           errorMessage);
+    epicsThreadSleep(0.6);
+    status = reconnect(pasynUser, errorMessage, sizeof(errorMessage));
+    testOk(status == asynSuccess, "reopen succeeds after the backoff");
+    status = query(pasynUser, "*IDN?", reply, sizeof(reply), 1.0, &eomReason, &elapsed);
+    testOk(status == asynSuccess && strcmp(reply, "MOCK,FLAKY,0,1.0") == 0, "reopened session answers");
+    testOk(counter("flaky", "RECOVER_RETRIES") == 3 && counter("flaky", "RECOVER_CLEARS") == 1 &&
+           counter("flaky", "RECOVER_REOPENS") == 1, "reopen counted (%lld retries, %lld clears, %lld reopens)",
+           (long long)counter("flaky", "RECOVER_RETRIES"), (long long)counter("flaky", "RECOVER_CLEARS"),
+           (long long)counter("flaky", "RECOVER_REOPENS"));
+    pasynOctetSyncIO->disconnect(pasynUser);
+}
+
+/// an instrument that hangs until the call is terminated is aborted by the watchdog at the port deadline
+static void testDeadline()
+{
+    char reply[256];
+    int eomReason;
+    double elapsed;
+    testDiag("hung instrument aborted at the deadline");
+    iocshCmd("drvAsynVISAMockInstrument(\"HUNG\", \"TCPIP\", \"hang=1\")");
+    iocshCmd("drvAsynVISAMockReply(\"HUNG\", \"*IDN?\", \"\")");
+    drvAsynVISAPortConfigure("hung", "MOCK::HUNG", 0, 0, 0, 0, NULL, 0, 0);
+    iocshCmd("asynSetOption(\"hung\", 0, \"deadline\", \"200\")");
+    asynUser *pasynUser = connectPort("hung", "");
+    testOk(query(pasynUser, "*IDN?", reply, sizeof(reply), 0.1, &eomReason, &elapsed) == asynError,
+           "hung read is aborted with an error");
+    testOk(elapsed >= 0.2 && elapsed < 1.5, "abort comes after the timeouts and deadline (%.3f s)", elapsed);
+    testOk(counter("hung", "DEADLINE_OVERRUNS") == 1, "overrun counted (%lld)",
+           (long long)counter("hung", "DEADLINE_OVERRUNS"));
+    pasynOctetSyncIO->disconnect(pasynUser);
+}
+
+/// the block header is found after any text before it, and a reply that is not a whole block is an error
+static void testBlockHeader()
+{
+    asynStatus status;
+    epicsFloat64 values[16];
+    size_t nIn;
+    char message[256];
+    testDiag("binary block header");
+    iocshCmd("drvAsynVISAMockInstrument(\"BLK\", \"GPIB\", \"\")");
+    iocshCmd("drvAsynVISAMockReply(\"BLK\", \"CURV?\", \":CURVE #15ABCDE\")");
+    iocshCmd("drvAsynVISAMockReply(\"BLK\", \"ERR?\", \"ERROR\")");
+    iocshCmd("drvAsynVISAMockReply(\"BLK\", \"SHORT?\", \"#15ABC\")");
+    drvAsynVISAPortConfigure("blk", "MOCK::BLK", 0, 0, 0, 0, NULL, 1, 0);
+    iocshCmd("asynSetOption(\"blk\", 0, \"blocktype\", \"int8\")");
+    status = readBlock("blk", "CURV?", values, 16, &nIn, message, sizeof(message));
+    testOk(status == asynSuccess && nIn == 5 && values[0] == 'A' && values[4] == 'E',
+           "text before the header is skipped (%u values)", (unsigned)nIn);
+    status = readBlock("blk", "ERR?", values, 16, &nIn, message, sizeof(message));
+    testOk(status == asynError, "reply with no header is an error: %s", message);
+    status = readBlock("blk", "SHORT?", values, 16, &nIn, message, sizeof(message));
+    testOk(status == asynError, "block ended early by END is an error: %s", message);
+}
+
+/// block elements are converted from the "blocktype" and "blockendian" of the port
+static void testBlockConvert()
+{
+    asynStatus status;
+    epicsFloat64 values[16];
+    size_t nIn;
+    char message[256];
+    testDiag("binary block element type and byte order");
+    iocshCmd("drvAsynVISAMockInstrument(\"BLK2\", \"GPIB\", \"\")");
+    iocshCmd("drvAsynVISAMockReply(\"BLK2\", \"CURVB?\", \"{block:4}\")");
+    drvAsynVISAPortConfigure("blk2", "MOCK::BLK2", 0, 0, 0, 0, NULL, 1, 0);
+    iocshCmd("asynSetOption(\"blk2\", 0, \"blocktype\", \"int16\")");
+    iocshCmd("asynSetOption(\"blk2\", 0, \"blockendian\", \"little\")");
+    status = readBlock("blk2", "CURVB?", values, 16, &nIn, message, sizeof(message));
+    testOk(status == asynSuccess && nIn == 2 && values[0] == 0x0100 && values[1] == 0x0302,
+           "little endian int16 (%u values %g %g)", (unsigned)nIn, values[0], values[1]);
+    iocshCmd("asynSetOption(\"blk2\", 0, \"blockendian\", \"big\")");
+    status = readBlock("blk2", "CURVB?", values, 16, &nIn, message, sizeof(message));
+    testOk(status == asynSuccess && nIn == 2 && values[0] == 0x0001 && values[1] == 0x0203,
+           "big endian int16 (%u values %g %g)", (unsigned)nIn, values[0], values[1]);
+}
+
+/// a block longer than the array is cut to fit with the rest discarded, and one split over reads is read whole
+static void testBlockLength()
+{
+    asynStatus status;
+    epicsFloat64 values[256];
+    size_t nIn;
+    char message[256], reply[256];
+    int eomReason;
+    double elapsed;
+    testDiag("binary block longer than the array, and split over reads");
+    iocshCmd("drvAsynVISAMockInstrument(\"BLK3\", \"GPIB\", \"\")");
+    iocshCmd("drvAsynVISAMockReply(\"BLK3\", \"CURVB?\", \"{block:16}\")");
+    iocshCmd("drvAsynVISAMockReply(\"BLK3\", \"*IDN?\", \"MOCK,BLK,0,1.0\")");
+    drvAsynVISAPortConfigure("blk3", "MOCK::BLK3", 0, 0, 0, 0, NULL, 1, 0);
+    iocshCmd("asynSetOption(\"blk3\", 0, \"blocktype\", \"int8\")");
+    status = readBlock("blk3", "CURVB?", values, 8, &nIn, message, sizeof(message));
+    testOk(status == asynSuccess && nIn == 8 && values[7] == 7, "block cut to the array (%u values)", (unsigned)nIn);
+    asynUser *pasynUser = connectPort("blk3", "");
+    status = query(pasynUser, "*IDN?", reply, sizeof(reply), 1.0, &eomReason, &elapsed);
+    testOk(status == asynSuccess && strcmp(reply, "MOCK,BLK,0,1.0") == 0,
+           "rest of the block discarded, next reply is \"%s\"", reply);
+    pasynOctetSyncIO->disconnect(pasynUser);
+    // a raw socket read with no termination character ends when the data received so far runs out
+    iocshCmd("drvAsynVISAMockInstrument(\"TCPIP0::blk::5025::SOCKET\", \"SOCKET\", \"byte=0.002\")");
+    iocshCmd("drvAsynVISAMockReply(\"TCPIP0::blk::5025::SOCKET\", \"CURVB?\", \"{block:200}\")");
+    drvAsynVISAPortConfigure("blk4", "TCPIP0::blk::5025::SOCKET", 0, 0, 0, 0, NULL, 0, 0);
+    iocshCmd("asynSetOption(\"blk4\", 0, \"blocktype\", \"int8\")");
+    status = readBlock("blk4", "CURVB?", values, 256, &nIn, message, sizeof(message));
+    testOk(status == asynSuccess && nIn == 200 && values[199] == static_cast<epicsInt8>(199),
+           "socket block read whole (%u values)", (unsigned)nIn);
+}
+
+/// small writes are sent as one transfer at the next read, or coalesceage ms after the first, and a timed
+/// send that fails is reported to the next caller, including a block read
+static void testCoalesce()
+{
+    asynStatus status;
+    char reply[256], message[256];
+    size_t nout, nIn;
+    int eomReason;
+    epicsFloat64 values[16];
+    testDiag("write coalescing");
+    iocshCmd("drvAsynVISAMockInstrument(\"COAL\", \"GPIB\", \"write=0.3\")");
+    iocshCmd("drvAsynVISAMockReply(\"COAL\", \"*IDN?\", \"MOCK,COAL,0,1.0\")");
+    iocshCmd("drvAsynVISAMockReply(\"COAL\", \"CURVB?\", \"{block:4}\")");
+    drvAsynVISAPortConfigure("coal", "MOCK::COAL", 0, 0, 0, 0, NULL, 1, 0);
+    iocshCmd("asynSetOption(\"coal\", 0, \"coalesce\", \"Y\")");
+    iocshCmd("asynSetOption(\"coal\", 0, \"coalesceage\", \"50\")");
+    asynUser *pasynUser = connectPort("coal", "\n");
+    epicsInt64 calls = counter("coal", "WRITE_CALLS");
+    pasynOctetSyncIO->write(pasynUser, "VOLT 1", 6, 1.0, &nout);
+    pasynOctetSyncIO->write(pasynUser, "CURR 2", 6, 1.0, &nout);
+    pasynOctetSyncIO->write(pasynUser, "*IDN?", 5, 1.0, &nout);
+    status = pasynOctetSyncIO->read(pasynUser, reply, sizeof(reply) - 1, 1.0, &nIn, &eomReason);
+    reply[status == asynSuccess ? nIn : 0] = '\0';
+    testOk(status == asynSuccess && strcmp(reply, "MOCK,COAL,0,1.0") == 0, "read after coalesced writes gets \"%s\"",
+           reply);
+    testOk(counter("coal", "WRITE_CALLS") == calls + 1 && counter("coal", "WRITES_SAVED") == 2,
+           "three writes sent in one transfer");
+    calls = counter("coal", "WRITE_CALLS");
+    pasynOctetSyncIO->write(pasynUser, "VOLT 2", 6, 1.0, &nout);
+    testOk(counter("coal", "WRITE_CALLS") == calls, "write held back");
+    epicsThreadSleep(0.2);
+    testOk(counter("coal", "WRITE_CALLS") == calls + 1, "write sent coalesceage after it was made");
+    // the write and its retry fail
+    iocshCmd("drvAsynVISAMockInstrument(\"COAL\", \"\", \"errors=2\")");
+    pasynOctetSyncIO->write(pasynUser, "VOLT 3", 6, 1.0, &nout);
+    epicsThreadSleep(0.2);
+    status = readBlock("coal", "CURVB?", values, 16, &nIn, message, sizeof(message));
+    testOk(status == asynError, "failed timed send reported to the block read: %s", message);
+    status = readBlock("coal", "CURVB?", values, 16, &nIn, message, sizeof(message));
+    testOk(status == asynSuccess && nIn == 4, "and only once (%u values)", (unsigned)nIn);
+    pasynOctetSyncIO->disconnect(pasynUser);
+}
+
+/// read a reply with no write before it
+static asynStatus readReply(asynUser *pasynUser, char *reply, size_t maxchars, int *eomReason)
+{
+    size_t nin = 0;
+    *reply = '\0';
+    asynStatus status = pasynOctetSyncIO->read(pasynUser, reply, maxchars, 1.0, &nin, eomReason);
+    reply[nin < maxchars ? nin : maxchars - 1] = '\0';
+    return status;
+}
+
+/// with noProcessEos=1 the driver finds a two character terminator itself, on a raw socket whose reads end
+/// wherever the data received so far does. Bytes after a terminator are the next read's, unless flushed or closed.
+static void testNativeEos()
+{
+    asynStatus status;
+    char reply[256];
+    int eomReason;
+    double elapsed;
+    testDiag("native input terminator");
+    iocshCmd("drvAsynVISAMockInstrument(\"TCPIP0::eos::5025::SOCKET\", \"SOCKET\", \"byte=2 eos=\\r\\n\")");
+    iocshCmd("drvAsynVISAMockReply(\"TCPIP0::eos::5025::SOCKET\", \"*IDN?\", \"MOCK,EOS,0,1.0\")");
+    iocshCmd("drvAsynVISAMockReply(\"TCPIP0::eos::5025::SOCKET\", \"LINES?\", \"ONE\\r\\nTWO\")");
+    drvAsynVISAPortConfigure("eos", "TCPIP0::eos::5025::SOCKET", 0, 0, 1, 0, NULL, 0, 0);
+    iocshCmd("asynSetOption(\"eos\", 0, \"tcptermchar\", \"N\")");
+    asynUser *pasynUser = connectPort("eos", "\r\n");
+    status = query(pasynUser, "*IDN?", reply, sizeof(reply), 1.0, &eomReason, &elapsed);
+    testOk(status == asynSuccess && strcmp(reply, "MOCK,EOS,0,1.0") == 0 && eomReason == ASYN_EOM_EOS,
+           "terminator arriving a byte per read is found (\"%s\", eomReason 0x%x)", reply, eomReason);
+    // byte=0 so both lines arrive together in one VISA read
+    iocshCmd("drvAsynVISAMockInstrument(\"TCPIP0::eos::5025::SOCKET\", \"\", \"byte=0\")");
+    status = query(pasynUser, "LINES?", reply, sizeof(reply), 1.0, &eomReason, &elapsed);
+    testOk(status == asynSuccess && strcmp(reply, "ONE") == 0, "first line \"%s\"", reply);
+    status = readReply(pasynUser, reply, sizeof(reply), &eomReason);
+    testOk(status == asynSuccess && strcmp(reply, "TWO") == 0 && eomReason == ASYN_EOM_EOS,
+           "second line kept for the next read \"%s\"", reply);
+    status = query(pasynUser, "LINES?", reply, sizeof(reply), 1.0, &eomReason, &elapsed);
+    pasynOctetSyncIO->flush(pasynUser);
+    status = readReply(pasynUser, reply, sizeof(reply), &eomReason);
+    testOk(status == asynTimeout && reply[0] == '\0', "second line discarded by flush");
+    status = query(pasynUser, "LINES?", reply, sizeof(reply), 1.0, &eomReason, &elapsed);
+    asynInterface *pcommon = pasynManager->findInterface(pasynUser, asynCommonType, 1);
+    asynCommon *common = static_cast<asynCommon*>(pcommon->pinterface);
+    pasynManager->lockPort(pasynUser);
+    common->disconnect(pcommon->drvPvt, pasynUser);
+    common->connect(pcommon->drvPvt, pasynUser);
+    pasynManager->unlockPort(pasynUser);
+    status = readReply(pasynUser, reply, sizeof(reply), &eomReason);
+    testOk(status == asynTimeout && reply[0] == '\0', "second line discarded when the session is closed");
+    pasynOctetSyncIO->disconnect(pasynUser);
+}
+
+MAIN(drvAsynVISAMockTest)
+{
+    testPlan(66);
+    testdbPrepare();
+    testdbReadDatabase("drvAsynVISAMockTest.dbd", NULL, NULL);
+    drvAsynVISAMockTest_registerRecordDeviceDriver(pdbbase);
+    testGpibEnd();
+    testGpibMultiDevice();
+    testSerialTermChar();
+    testTrickle();
+    testErrors();
+    testStaleInput();
+    testCache();
+    testRecover();
+    testDeadline();
+    testBlockHeader();
+    testBlockConvert();
+    testBlockLength();
+    testCoalesce();
+    testNativeEos();
+    testdbCleanup();
+    return testDone();
+}
@@ -16,6 +16,9 @@ cd "${TOP}"
 dbLoadDatabase "dbd/VISAdrvTest.dbd"
 VISAdrvTest_registerRecordDeviceDriver pdbbase
 
+## uncomment to open ports concurrently in the background rather than during iocInit
+#drvAsynVISAConnectPool(4, 60.0, 1)
+
 ## after device is mapped in NI MAX under devices and interfaces, and right click "scan for instruments"
 drvAsynVISAPortConfigure("visa", "GPIB0::3::INSTR")
 ## instead if device is on another machine and you add the computer as a remote system in NI MAX
@@ -34,11 +37,20 @@ epicsEnvSet ("STREAM_PROTOCOL_PATH", "$(TOP)/data")
 
 ## Load our record instances
 dbLoadRecords("db/VISAdrvTest.db","P=$(MYPVPREFIX)Q=VISA:,PORT=visa")
+dbLoadRecords("db/VISAdrvStats.db","P=$(MYPVPREFIX),Q=VISA:,PORT=visa")
+## uncomment to handle GPIB service requests rather than polling the status byte
+#asynSetOption("visa", 0, "srq", "Y")
+#dbLoadRecords("db/VISAdrvSRQ.db","P=$(MYPVPREFIX),Q=VISA:,PORT=visa")
+## print recent transactions if the session is closed after an error, see also drvAsynVISAFlightDump("visa", 0)
+#asynSetOption("visa", 0, "flightdump", "Y")
 dbLoadRecords("$(ASYN)/db/asynRecord.db","P=$(MYPVPREFIX),R=VISA:ASYNREC,PORT=visa,ADDR=0,OMAX=80,IMAX=80")
 
 cd "${TOP}/iocBoot/${IOC}"
 iocInit
 
+## measure transaction rate and latency through the port
+#drvAsynVISABenchmark("visa", "*IDN?", 100, 1.0, 256, 1)
+
 ## Start any sequence programs
 #seq sncxxx,"user=faa59Host"
 
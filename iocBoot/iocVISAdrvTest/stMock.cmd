@@ -0,0 +1,99 @@
+## @file stMock.cmd Benchmarks of VISAdrv against simulated instruments, no VISA hardware needed
+
+#!../../bin/windows-x64/VISAdrvTest
+
+## build with VISA_MOCK=YES in configure/CONFIG_SITE where no VISA library is installed,
+## instrument timings are those of the real links: ms of latency and ms per byte
+
+< envPaths
+
+cd "${TOP}"
+
+## Register all support components
+dbLoadDatabase "dbd/VISAdrvTest.dbd"
+VISAdrvTest_registerRecordDeviceDriver pdbbase
+
+## GPIB instrument: addressing costs a write time, replies end with END
+drvAsynVISAMockInstrument("GPIB0::3::INSTR", "GPIB", "latency=1 byte=0.001 write=0.3")
+drvAsynVISAMockReply("GPIB0::3::INSTR", "*IDN?", "MOCK,DMM,0,1.0")
+drvAsynVISAMockReply("GPIB0::3::INSTR", "CURV?", "{values:1000}")
+drvAsynVISAMockReply("GPIB0::3::INSTR", "CURVB?", "{block:8000}")
+drvAsynVISAPortConfigure("gpib", "GPIB0::3::INSTR", 0, 0, 0, 0, NULL, 1)
+
+## 115200 baud serial instrument ending replies with a line feed
+drvAsynVISAMockInstrument("ASRL1::INSTR", "ASRL", "latency=2 byte=0.087")
+drvAsynVISAMockReply("ASRL1::INSTR", "MEAS?", "+1.234E-03")
+drvAsynVISAMockReply("ASRL1::INSTR", "CURV?", "{values:40}")
+drvAsynVISAPortConfigure("serial", "ASRL1::INSTR", 0, 0, 0, 0, "\n")
+
+## serial instrument ending replies with CR LF, by asynInterposeEos (noProcessEos=0) and by the driver (noProcessEos=1)
+drvAsynVISAMockInstrument("ASRL2::INSTR", "ASRL", "latency=2 byte=0.087 eos=\r\n")
+drvAsynVISAMockReply("ASRL2::INSTR", "MEAS?", "+1.234E-03")
+drvAsynVISAPortConfigure("crlf", "ASRL2::INSTR", 0, 0, 0, 0, "\r\n")
+drvAsynVISAPortConfigure("crlfnative", "ASRL2::INSTR", 0, 0, 1, 0, "\r\n")
+
+## raw socket and USBTMC instruments
+drvAsynVISAMockInstrument("TCPIP0::scope::5025::SOCKET", "SOCKET", "latency=0.2 byte=0.0001")
+drvAsynVISAMockReply("TCPIP0::scope::5025::SOCKET", "*IDN?", "MOCK,SCOPE,0,1.0")
+drvAsynVISAPortConfigure("socket", "TCPIP0::scope::5025::SOCKET", 0, 0, 0, 0, "\n")
+drvAsynVISAMockInstrument("USB0::0x0957::0x1796::MY0001::INSTR", "USB", "latency=0.5 byte=0.0002 write=0.125")
+drvAsynVISAMockReply("USB0::0x0957::0x1796::MY0001::INSTR", "*IDN?", "MOCK,AWG,0,1.0")
+drvAsynVISAMockReply("USB0::0x0957::0x1796::MY0001::INSTR", "CURVB?", "{block:100000}")
+drvAsynVISAPortConfigure("usb", "USB0::0x0957::0x1796::MY0001::INSTR")
+
+## pseudo terminal echo for the native termios backend
+drvAsynVISAPtyEcho("PTY")
+drvAsynVISAPortConfigure("tty", "$(PTY)", 0, 0, 0, 0, "\n")
+
+asynOctetSetOutputEos("gpib",0,"\n")
+asynOctetSetOutputEos("serial",0,"\n")
+asynOctetSetInputEos("serial",0,"\n")
+asynOctetSetOutputEos("crlf",0,"\r\n")
+asynOctetSetInputEos("crlf",0,"\r\n")
+asynOctetSetOutputEos("crlfnative",0,"\r\n")
+asynOctetSetInputEos("crlfnative",0,"\r\n")
+asynOctetSetOutputEos("socket",0,"\n")
+asynOctetSetInputEos("socket",0,"\n")
+asynOctetSetOutputEos("usb",0,"\n")
+asynOctetSetOutputEos("tty",0,"\n")
+asynOctetSetInputEos("tty",0,"\n")
+
+dbLoadRecords("db/VISAdrvStats.db","P=$(MYPVPREFIX),Q=VISA:,PORT=gpib")
+
+cd "${TOP}/iocBoot/${IOC}"
+iocInit
+
+## plain transaction rate and latency of each link
+drvAsynVISABenchmark("gpib", "*IDN?", 200, 1.0, 256, 1)
+drvAsynVISABenchmark("serial", "MEAS?", 200, 1.0, 256, 1)
+drvAsynVISABenchmark("crlf", "MEAS?", 200, 1.0, 256, 1)
+drvAsynVISABenchmark("crlfnative", "MEAS?", 200, 1.0, 256, 1)
+drvAsynVISABenchmark("socket", "*IDN?", 200, 1.0, 256, 1)
+drvAsynVISABenchmark("usb", "*IDN?", 200, 1.0, 256, 1)
+drvAsynVISABenchmark("tty", "PING", 200, 1.0, 256, 1)
+
+## overlapped write and read, write coalescing, read ahead, the adaptive read timeout and the serial read strategy
+drvAsynVISAOptionBenchmark("socket", "*IDN?", 200, 1.0, "asyncio", "N", "Y", 256)
+drvAsynVISAOptionBenchmark("usb", "*IDN?", 200, 1.0, "asyncio", "N", "Y", 256)
+drvAsynVISAOptionBenchmark("serial", "MEAS?", 200, 1.0, "readahead", "N", "Y", 256)
+drvAsynVISAOptionBenchmark("serial", "MEAS?", 200, 1.0, "adaptivetmo", "N", "Y", 256)
+drvAsynVISAOptionBenchmark("serial", "CURV?", 100, 1.0, "readstrategy", "twostage", "avail", 1024)
+
+## text trace against binary block
+drvAsynVISABlockBenchmark("gpib", "CURV?", "CURVB?", 50, 2.0, 14000)
+drvAsynVISABlockBenchmark("usb", "", "CURVB?", 50, 2.0, 100100)
+
+## combined query against separate write and read
+drvAsynVISAQueryBenchmark("gpib", "*IDN?", 200, 1.0, 256)
+drvAsynVISAQueryBenchmark("socket", "*IDN?", 200, 1.0, 256)
+
+## socket options, USBTMC END and the per-port deadline. The simulated socket has no Nagle algorithm or delayed
+## ACK, so tcpnodelay only makes a difference against a real LAN instrument
+drvAsynVISAOptionBenchmark("socket", "*IDN?", 200, 1.0, "tcpnodelay", "N", "Y", 256)
+drvAsynVISAOptionBenchmark("usb", "*IDN?", 200, 1.0, "usbend", "N", "Y", 256)
+drvAsynVISAOptionBenchmark("gpib", "*IDN?", 200, 1.0, "deadline", "0", "5", 256)
+
+## ways of discarding stale input
+drvAsynVISAFlushBenchmark("serial", "MEAS?", 100, 1.0, 0, 256)
+
+drvAsynVISAMockReport("")
@@ -1,5 +1,8 @@
 ## link visa to an IOC
 ## assumes $(APPNAME) already defined
+## nothing to link when VISA_MOCK=YES, the mock VISA functions are in the VISAdrv library
+
+ifneq ($(VISA_MOCK),YES)
 
 ifneq ($(findstring windows,$(EPICS_HOST_ARCH)),)
 $(APPNAME)_LIBS += visa64
@@ -12,3 +15,4 @@ ifneq ($(findstring linux,$(EPICS_HOST_ARCH)),)
 $(APPNAME)_LDFLAGS += -L/usr/lib/x86_64-linux-gnu
 $(APPNAME)_SYS_LIBS_Linux += visa
 endif
+endif